@@ -25,13 +25,40 @@
  *
  * The ADC is being used for a variety of sensory inputs.
  *
+ * All sensors are sampled once every PWM period without CPU involvement.
+ * The TIM1 channel 4 reference (rising at pwm_offset counts into the
+ * period) is put out as TIM1 TRGO. The STM32F1 can not start the regular
+ * group from TIM1 channel 4 directly, TIM4 relays it: the TRGO starts TIM4
+ * in one pulse mode and the TIM4 channel 4 compare event one timer tick
+ * later starts the regular sequence. The sequence is moved by DMA1 channel
+ * 1 into a circular buffer of two sample blocks. The half and full
+ * transfer interrupts mark a completed block while the DMA goes on filling
+ * the other one, so the interrupt is the only CPU work per PWM period.
+ *
+ * ADC1 converts the current at every rank of the regular sequence to
+ * oversample it within the period. The interrupt decimates every block by
+ * averaging it (a boxcar filter) into the per period value used by the
+ * current control and integrates the blocks until the sensor process
+ * trigger, which then gets the average of its whole interval.
+ *
+ * Battery voltage and temperature are taken from resistor networks whose
+ * source impedance does not settle within the 1.5 cycle sample time of the
+ * current. ADC2 converts them in its injected sequence with the
+ * longest sample time, started directly by the TIM1 channel 4 compare
+ * along with the current sequence. The sequence takes several PWM periods,
+ * the triggers arriving while it runs are ignored. The interrupt picks up
+ * every completed sequence once and integrates it the same way.
+ *
  * @todo This code should be divided more into hardware specific and
  * application specific code.
  */
 
+#include <stdint.h>
+
 #include <stm32/rcc.h>
 #include <stm32/misc.h>
 #include <stm32/adc.h>
+#include <stm32/dma.h>
 #include <stm32/gpio.h>
 #include <stm32/tim.h>
 
@@ -50,13 +77,66 @@
 #include "gprot.h"
 #include "driver/sys_tick.h"
 
-void adc_conv_trigger(int id);
+/**
+ * Sample time of the current, the sequence has to finish within one PWM
+ * period: 4 * (1.5 + 12.5) cycles at 12MHz are 4.7us.
+ */
+#define ADC_SAMPLE_TIME ADC_SampleTime_1Cycles5
+
+/**
+ * Sample time of battery voltage and temperature: 2 * (239.5 + 12.5)
+ * cycles at 12MHz are 42us per injected sequence.
+ */
+#define ADC_SLOW_SAMPLE_TIME ADC_SampleTime_239Cycles5
+
+/**
+ * Number of sample blocks in the DMA buffer.
+ */
+#define ADC_BLOCKS 2
+
+/**
+ * Interval of the sensor process trigger in sys_tick ticks (10ms).
+ */
+#define ADC_SENSOR_INTERVAL 1000
+
+static void adc_sensor_tick(int id);
 
 /**
  * ADC data instance
  */
 struct adc_data adc_data;
 
+/**
+ * DMA target, two sample blocks of ADC1 current conversions.
+ */
+static volatile u16 adc_samples[ADC_BLOCKS][ADC_SAMPLES];
+
+/**
+ * Block sums integrated over the sensor process interval.
+ */
+struct adc_sum {
+	u32 battery_voltage;	/**< Battery voltage samples sum */
+	u32 current;		/**< Current samples sum */
+	u32 temp;		/**< Temperature samples sum */
+	u32 blocks;		/**< Number of blocks summed up */
+	u32 slow;		/**< Number of injected sequences summed up */
+};
+
+/**
+ * Sensor interval sums instance
+ */
+static struct adc_sum adc_sum;
+
+/**
+ * Function run after every completed sample block
+ */
+static void (*volatile adc_callback)(void);
+
+/**
+ * Sensor data is due for the sensor process
+ */
+static volatile bool adc_sensor_due;
+
 /**
  * Initialize the ADC peripherals and internal state of the driver
  */
@@ -65,13 +145,20 @@ void adc_init(void)
 	NVIC_InitTypeDef nvic;
 	GPIO_InitTypeDef gpio;
 	ADC_InitTypeDef adc;
+	DMA_InitTypeDef dma;
+	TIM_TimeBaseInitTypeDef tim_base;
+	TIM_OCInitTypeDef tim_oc;
+	int i;
 
-	/* enable ADC1 clock */
+	/* enable ADC1, ADC2, DMA1 and TIM4 clock */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA |
-			       RCC_APB2Periph_ADC1, ENABLE);
+			       RCC_APB2Periph_ADC1 |
+			       RCC_APB2Periph_ADC2, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
 
-	/* Configure and enable ADC interrupt */
-	nvic.NVIC_IRQChannel = ADC1_2_IRQn;
+	/* Configure and enable DMA1 channel 1 interrupt */
+	nvic.NVIC_IRQChannel = DMA1_Channel1_IRQn;
 	nvic.NVIC_IRQChannelPreemptionPriority = 0;
 	nvic.NVIC_IRQChannelSubPriority = 0;
 	nvic.NVIC_IRQChannelCmd = ENABLE;
@@ -93,33 +180,66 @@ void adc_init(void)
 	adc_data.battery_voltage = 0;
 	adc_data.current = 0;
 	adc_data.temp = 0;
+	adc_data.battery_voltage_avg = 0;
+	adc_data.current_avg = 0;
+	adc_data.temp_avg = 0;
+
+	adc_sum.battery_voltage = 0;
+	adc_sum.current = 0;
+	adc_sum.temp = 0;
+	adc_sum.blocks = 0;
+	adc_sum.slow = 0;
+
+	/* DMA1 channel 1: ADC1 data register into both sample blocks */
+	DMA_DeInit(DMA1_Channel1);
+	dma.DMA_PeripheralBaseAddr = (uintptr_t)&ADC1->DR;
+	dma.DMA_MemoryBaseAddr = (uintptr_t)&adc_samples[0][0];
+	dma.DMA_DIR = DMA_DIR_PeripheralSRC;
+	dma.DMA_BufferSize = ADC_BLOCKS * ADC_SAMPLES;
+	dma.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dma.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dma.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	dma.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	dma.DMA_Mode = DMA_Mode_Circular;
+	dma.DMA_Priority = DMA_Priority_High;
+	dma.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel1, &dma);
+
+	/* One interrupt per completed sample block */
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(DMA1_Channel1, ENABLE);
 
-	/* Configure ADC1 */
+	/* Configure ADC1, converting the current */
 	adc.ADC_Mode = ADC_Mode_Independent;
 	adc.ADC_ScanConvMode = ENABLE;
-	adc.ADC_ContinuousConvMode = ENABLE;
-	adc.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
+	adc.ADC_ContinuousConvMode = DISABLE;
+	adc.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T4_CC4;
 	adc.ADC_DataAlign = ADC_DataAlign_Right;
-	adc.ADC_NbrOfChannel = 0;
+	adc.ADC_NbrOfChannel = ADC_SAMPLES;
 	ADC_Init(ADC1, &adc);
 
-	ADC_InjectedSequencerLengthConfig(ADC1, 3);
+	for (i = 0; i < ADC_SAMPLES; i++)
+		ADC_RegularChannelConfig(ADC1, ADC_CHANNEL_CURRENT,
+					 i + 1, ADC_SAMPLE_TIME);
 
-	ADC_InjectedChannelConfig(ADC1, ADC_CHANNEL_BATTERY_VOLTAGE, 1,
-				  ADC_SampleTime_239Cycles5);
-	ADC_InjectedChannelConfig(ADC1, ADC_CHANNEL_CURRENT, 2,
-				  ADC_SampleTime_239Cycles5);
-	ADC_InjectedChannelConfig(ADC1, ADC_CHANNEL_TEMP, 3,
-				  ADC_SampleTime_239Cycles5);
+	/* Configure ADC2, converting battery voltage and temperature */
+	adc.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
+	adc.ADC_NbrOfChannel = 1;
+	ADC_Init(ADC2, &adc);
 
-        /* ADC1 injected external trigger configuration */
-        ADC_ExternalTrigInjectedConvConfig(ADC1, ADC_ExternalTrigInjecConv_None);
+	ADC_InjectedSequencerLengthConfig(ADC2, 2);
+	ADC_InjectedChannelConfig(ADC2, ADC_CHANNEL_BATTERY_VOLTAGE, 1,
+				  ADC_SLOW_SAMPLE_TIME);
+	ADC_InjectedChannelConfig(ADC2, ADC_CHANNEL_TEMP, 2,
+				  ADC_SLOW_SAMPLE_TIME);
+	ADC_ExternalTrigInjectedConvConfig(ADC2,
+					   ADC_ExternalTrigInjecConv_T1_CC4);
 
-	/* Enable ADC1 JEOC interrupt */
-	ADC_ITConfig(ADC1, ADC_IT_JEOC, ENABLE);
+	ADC_DMACmd(ADC1, ENABLE);
 
-	/* Enable ADC1 */
+	/* Enable ADC1 and ADC2 */
 	ADC_Cmd(ADC1, ENABLE);
+	ADC_Cmd(ADC2, ENABLE);
 
 	/* Enable ADC1 reset calibaration register */
 	ADC_ResetCalibration(ADC1);
@@ -133,35 +253,151 @@ void adc_init(void)
 	/* Check the end of ADC1 calibration */
 	while (ADC_GetCalibrationStatus(ADC1) == SET) ;
 
-	/* Start ADC1 Software Conversion */
-	ADC_SoftwareStartInjectedConvCmd(ADC1, ENABLE);
+	/* Same for ADC2 */
+	ADC_ResetCalibration(ADC2);
+	while (ADC_GetResetCalibrationStatus(ADC2) == SET) ;
+	ADC_StartCalibration(ADC2);
+	while (ADC_GetCalibrationStatus(ADC2) == SET) ;
+
+	/* ADC1 regular and ADC2 injected external trigger enable */
+	ADC_ExternalTrigConvCmd(ADC1, ENABLE);
+	ADC_ExternalTrigInjectedConvCmd(ADC2, ENABLE);
+
+	/* TIM4 relays the TIM1 trigger output, one pulse of two ticks */
+	tim_base.TIM_Period = 1;
+	tim_base.TIM_Prescaler = 0;
+	tim_base.TIM_ClockDivision = 0;
+	tim_base.TIM_CounterMode = TIM_CounterMode_Up;
+	tim_base.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM4, &tim_base);
+
+	/* TIM4 channel 4 compare starts the ADC, no output pin */
+	tim_oc.TIM_OCMode = TIM_OCMode_PWM2;
+	tim_oc.TIM_OutputState = TIM_OutputState_Disable;
+	tim_oc.TIM_OutputNState = TIM_OutputNState_Disable;
+	tim_oc.TIM_Pulse = 1;
+	tim_oc.TIM_OCPolarity = TIM_OCPolarity_High;
+	tim_oc.TIM_OCNPolarity = TIM_OCNPolarity_High;
+	tim_oc.TIM_OCIdleState = TIM_OCIdleState_Reset;
+	tim_oc.TIM_OCNIdleState = TIM_OCNIdleState_Reset;
+	TIM_OC4Init(TIM4, &tim_oc);
 
-	/* Register adc as a timed callback */
-	sys_tick_timer_register(adc_conv_trigger, 1000);
+	TIM_SelectOnePulseMode(TIM4, TIM_OPMode_Single);
+	TIM_SelectInputTrigger(TIM4, TIM_TS_ITR0);
+	TIM_SelectSlaveMode(TIM4, TIM_SlaveMode_Trigger);
+
+	/* TIM1 channel 4 reference as trigger output to TIM4 */
+	TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_OC4Ref);
+
+	/* Pace the sensor process */
+	sys_tick_timer_register(adc_sensor_tick, ADC_SENSOR_INTERVAL);
 }
 
 /**
- * ADC1 interrupt hander
+ * Average of a power of two number of samples.
+ *
+ * Rounds half to even, rounding the frequent ties of a short average up
+ * would bias it by up to a quarter count.
+ *
+ * @param sum Sum of the samples
+ * @param n Number of samples
  */
-void adc1_2_irq_handler(void)
+static inline u16 adc_average(u32 sum, u32 n)
 {
-	ADC_ClearITPendingBit(ADC1, ADC_IT_JEOC);
+	return (u16)((sum + (n / 2) - 1 + ((sum / n) & 1)) / n);
+}
+
+/**
+ * DMA1 channel 1 interrupt handler
+ *
+ * Called once per completed sample block, the half transfer flag marks the
+ * first block, the transfer complete flag the second one.
+ */
+void dma1_channel1_irq_handler(void)
+{
+	const volatile u16 *samples;
+	u32 current = 0;
+	u32 blocks;
+	int i;
+
+	if (DMA_GetITStatus(DMA1_IT_TC1) != RESET)
+		samples = adc_samples[1];
+	else
+		samples = adc_samples[0];
+
+	DMA_ClearITPendingBit(DMA1_IT_GL1);
 
-	adc_data.battery_voltage =
-		ADC_GetInjectedConversionValue(ADC1, ADC_BATTERY_VOLTAGE);
-	adc_data.current =
-		ADC_GetInjectedConversionValue(ADC1, ADC_CURRENT);
-	adc_data.temp =
-		ADC_GetInjectedConversionValue(ADC1, ADC_TEMP);
+	for (i = 0; i < ADC_SAMPLES; i++)
+		current += samples[i];
 
-	adc_data.trigger = true;
+	adc_data.current = adc_average(current, ADC_SAMPLES);
+	adc_sum.current += current;
+	adc_sum.blocks++;
+
+	/*
+	 * Picked up within a period of the sequence end, long before the next
+	 * sequence overwrites its first rank.
+	 */
+	if (ADC_GetFlagStatus(ADC2, ADC_FLAG_JEOC) != RESET) {
+		ADC_ClearFlag(ADC2, ADC_FLAG_JEOC);
+		adc_data.battery_voltage = ADC_GetInjectedConversionValue(ADC2,
+			ADC_InjectedChannel_1);
+		adc_data.temp = ADC_GetInjectedConversionValue(ADC2,
+			ADC_InjectedChannel_2);
+
+		adc_sum.battery_voltage += adc_data.battery_voltage;
+		adc_sum.temp += adc_data.temp;
+		adc_sum.slow++;
+	}
+
+	/* Keep the sensor process at the sys_tick rate */
+	if (adc_sensor_due) {
+		adc_sensor_due = false;
+
+		blocks = adc_sum.slow;
+		if (blocks != 0) {
+			adc_data.battery_voltage_avg = (u16)
+				((adc_sum.battery_voltage + (blocks / 2)) /
+				 blocks);
+			adc_data.temp_avg = (u16)
+				((adc_sum.temp + (blocks / 2)) / blocks);
+		}
+		blocks = adc_sum.blocks * ADC_SAMPLES;
+		adc_data.current_avg = (u16)
+			((adc_sum.current + (blocks / 2)) / blocks);
+
+		adc_sum.battery_voltage = 0;
+		adc_sum.current = 0;
+		adc_sum.temp = 0;
+		adc_sum.blocks = 0;
+		adc_sum.slow = 0;
+
+		adc_data.trigger = true;
+	}
+
+	if (adc_callback != NULL)
+		adc_callback();
 }
 
 /**
- * Trigger timer callback
+ * Register a function to be run after every completed sample block.
+ *
+ * The callback is run once every PWM period from the DMA interrupt right
+ * after adc_data was updated.
+ *
+ * @param callback Function to run, NULL for none
+ */
+void adc_set_callback(void (*callback)(void))
+{
+	adc_callback = callback;
+}
+
+/**
+ * Sensor process pacing timer callback
  */
-void adc_conv_trigger(int id) {
+void adc_sensor_tick(int id)
+{
+	id = id;
 
-	/* Start ADC1 Software Conversion */
-	ADC_SoftwareStartInjectedConvCmd(ADC1, ENABLE);
+	adc_sensor_due = true;
 }
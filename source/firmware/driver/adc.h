@@ -26,20 +26,29 @@
 #define ADC_CHANNEL_BATTERY_VOLTAGE ADC_Channel_3
 #define ADC_CHANNEL_CURRENT ADC_Channel_4
 #define ADC_CHANNEL_TEMP ADC_Channel_5
-
-#define ADC_BATTERY_VOLTAGE ADC_InjectedChannel_1
-#define ADC_CURRENT ADC_InjectedChannel_2
-#define ADC_TEMP ADC_InjectedChannel_3
 /** @} */
 
+/**
+ * Number of current conversions in one sample block.
+ */
+#define ADC_SAMPLES 4
+
 /**
  * ADC output data
+ *
+ * The plain values are updated every PWM period, the current is the
+ * average of one sample block, battery voltage and temperature are the
+ * last completed slow conversion. The _avg values are averaged over the
+ * last sensor process interval and updated along with the trigger.
  */
 struct adc_data {
 	bool trigger; /**< New data arrived trigger */
 	u16 battery_voltage; /**< Raw half battery voltage value */
 	u16 current; /**< Raw global current value */
 	u16 temp; /**< RAW temperature measurement */
+	u16 battery_voltage_avg; /**< Battery voltage sensor interval average */
+	u16 current_avg; /**< Current sensor interval average */
+	u16 temp_avg; /**< Temperature sensor interval average */
 };
 
 extern struct adc_data adc_data;
@@ -47,5 +56,6 @@ extern volatile bool adc_new_data_trigger;
 
 void adc_init(void);
 void adc_set(u8 channel);
+void adc_set_callback(void (*callback)(void));
 
 #endif /* __ADC_H */
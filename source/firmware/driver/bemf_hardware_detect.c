@@ -25,12 +25,27 @@
  *
  * This implementation uses a comparator output as source of zero crossing
  * detection.
+ *
+ * With BEMF_HD__QUALIFY the comparator interrupts are only enabled inside
+ * the window a crossing is expected in: once a crossing is taken in closed
+ * loop they stay masked until the blanking time after the following
+ * commutation is over, comm_tim.c reopens them. An edge opening a new
+ * crossing masks the interrupt of its comparator and is only taken after
+ * BEMF_HD__VOTE_N of the next BEMF_HD__VOTE_M comparator samples confirm
+ * its level (see bemf_vote.c). The samples are taken once per PWM period from the TIM1
+ * compare interrupt at the end of the on time, at full duty cycle from the
+ * ADC trigger compare. The capture keeps the time of the edge. Close to
+ * the top speed there is no time for the vote and edges are taken right
+ * away.
  */
 
 #include "config.h"
 
 #include "types.h"
 
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
 #include "bemf_hardware_detect.h"
 
 #include <stm32/misc.h>
@@ -38,9 +53,67 @@
 #include <stm32/rcc.h>
 #include <stm32/gpio.h>
 
+#include <stm32/tim.h>
+
 #include "driver/led.h"
 #include "driver/debug_pins.h"
 #include "comm_tim.h"
+#include "pwm/pwm.h"
+#include "bemf_vote.h"
+#include "trace.h"
+
+/**
+ * EXTI lines of the three BEMF comparators.
+ */
+#define BEMF_HD_LINES (EXTI_Line10 | EXTI_Line11 | EXTI_Line12)
+
+/**
+ * Shortest commutation time an edge is voted on, leaves one PWM period more
+ * than the longest vote [commutation timer ticks].
+ */
+#define BEMF_HD_VOTE_MIN_FREQ ((BEMF_HD__VOTE_M + 1) * BEMF_HD_PWM_TICKS)
+
+/**
+ * Comparator of one phase.
+ */
+struct bemf_hd_phase {
+	u16 pin;			/**< GPIOB pin, same bit as its EXTI line */
+	enum bemf_hd_source rising;	/**< Source of a rising edge */
+	enum bemf_hd_source falling;	/**< Source of a falling edge */
+};
+
+/**
+ * Comparators of phase U, V and W, in the order of the PWM phases A, B
+ * and C.
+ */
+static const struct bemf_hd_phase bemf_hd_phases[BEMF_HD_PHASES] = {
+	{ GPIO_Pin_10, bemf_hd_phase_u_rising, bemf_hd_phase_u_falling },
+	{ GPIO_Pin_11, bemf_hd_phase_v_rising, bemf_hd_phase_v_falling },
+	{ GPIO_Pin_12, bemf_hd_phase_w_rising, bemf_hd_phase_w_falling },
+};
+
+#ifdef BEMF_HD__QUALIFY
+/**
+ * Comparator edge being voted on.
+ */
+struct bemf_hd_candidate {
+	enum bemf_hd_source source;	/**< Phase and direction of the edge */
+	u32 time;			/**< Time of the edge */
+	struct bemf_vote vote;		/**< Vote on the edge */
+};
+
+/**
+ * Internal state of the BEMF edge qualification.
+ */
+struct bemf_hd_state {
+	struct bemf_hd_candidate candidate[BEMF_HD_PHASES]; /**< Per comparator */
+	u32 voting;			/**< EXTI lines with an edge being voted on */
+	u16 levels;			/**< Comparator levels last seen, GPIOB pins */
+	bool open;			/**< Crossing window open */
+};
+
+static struct bemf_hd_state bemf_hd_state; /**< Internal state instance */
+#endif
 
 struct bemf_hd_data bemf_hd_data;
 u16 bemf_line_state;
@@ -121,145 +194,335 @@ void bemf_hd_init(void)
 
 void bemf_hd_reset(void)
 {
+	int i;
+
 	bemf_hd_data.source = bemf_hd_phase_none;
 	bemf_hd_data.trigger = false;
+	bemf_hd_data.glitches = 0;
+	for (i = 0; i < BEMF_HD_PHASES; i++)
+		bemf_hd_data.edges[i] = 0;
+	bemf_hd_data.driven = 0;
+
+#ifdef BEMF_HD__QUALIFY
+	TIM_ITConfig(TIM1, TIM_IT_CC1 | TIM_IT_CC4, DISABLE);
+	for (i = 0; i < BEMF_HD_PHASES; i++) {
+		bemf_hd_state.candidate[i].source = bemf_hd_phase_none;
+		bemf_vote_init(&bemf_hd_state.candidate[i].vote,
+			       BEMF_HD__VOTE_N, BEMF_HD__VOTE_M);
+	}
+	bemf_hd_state.voting = 0;
+	bemf_hd_window_open();
+#endif
 }
 
-void bemf_hd_phase_u(void)
+/**
+ * Mask the comparator interrupts.
+ */
+void bemf_hd_window_close(void)
 {
-	bemf_line_state = GPIOB->IDR;
-	OFF(DP_EXT_SDA);
-	//DEBUG("UPhase Detect\n");
+#ifdef BEMF_HD__QUALIFY
+	bemf_hd_state.open = false;
+#endif
+	EXTI->IMR &= ~BEMF_HD_LINES;
+}
 
-	/*
-	 * Take care of oscillating interrupt triggers and filter them out
-	 * also detect the source of the interrupt.
-	 */
-	if ((bemf_hd_data.source != bemf_hd_phase_u_rising) &&
-		(bemf_hd_data.source != bemf_hd_phase_u_falling)) {
+/**
+ * Enable the comparator interrupts, edges while they were masked are
+ * dropped.
+ *
+ * Comparators with an edge being voted on stay masked until the vote ends.
+ */
+void bemf_hd_window_open(void)
+{
+	u32 lines = BEMF_HD_LINES;
+
+#ifdef BEMF_HD__QUALIFY
+	bemf_hd_state.open = true;
+	lines &= ~bemf_hd_state.voting;
+	/* EXTI line n and GPIO pin n share the bit */
+	bemf_hd_state.levels = (u16)((bemf_hd_state.levels & ~lines) |
+				     (GPIOB->IDR & lines));
+#endif
+
+	EXTI_ClearITPendingBit(lines);
+	EXTI->IMR |= lines;
+}
+
+#ifdef BEMF_HD__QUALIFY
+/**
+ * Check if a comparator edge is being voted on.
+ *
+ * @return true until the vote on the last edge ended
+ */
+bool bemf_hd_voting(void)
+{
+	return bemf_hd_state.voting != 0;
+}
+#endif
+
+/**
+ * Take a BEMF zero crossing.
+ *
+ * @param source Phase and direction of the crossing
+ * @param rising Rising comparator edge
+ * @param time Time of the comparator edge
+ */
+static void bemf_hd_latch(enum bemf_hd_source source, bool rising, u32 time)
+{
 #ifndef BEMF__DEBUG
-		comm_tim_update_capture_and_time();
+	comm_tim_update_capture_and_time_at(time);
 #else
-		DEBUG("Comm time update capture and time\n");
+	(void)time;
+	DEBUG("Comm time update capture and time\n");
+#endif
+	bemf_hd_data.source = source;
+	bemf_hd_data.trigger = true;
+	if (rising)
+		BEMF_HD_LED_RISING();
+	else
+		BEMF_HD_LED_FALLING();
+	trace_log(trace_ev_bemf, (u8)source, 0);
+
+#ifdef BEMF_HD__QUALIFY
+	/* No crossing until the next commutation, comm_tim reopens */
+	if (comm_tim_trigger_comm) {
+		bemf_hd_state.voting = 0;
+		bemf_hd_window_close();
+	}
+#endif
+}
+
+#ifdef BEMF_HD__QUALIFY
+/**
+ * Track the level of a comparator from its interrupts.
+ *
+ * A glitch shorter than the interrupt latency is over by the time the
+ * handler reads the level, which then looks like an edge back to the level
+ * the comparator had. Such edges are no crossing.
+ *
+ * @param phase Comparator index, 0 for phase U
+ * @return true if the level differs from the one seen last
+ */
+static bool bemf_hd_changed(int phase)
+{
+	u16 pin = bemf_hd_phases[phase].pin;
+	bool changed = ((bemf_line_state ^ bemf_hd_state.levels) & pin) != 0;
+
+	bemf_hd_state.levels = (u16)((bemf_hd_state.levels & ~pin) |
+				     (bemf_line_state & pin));
+
+	return changed;
+}
 #endif
-		if ((bemf_line_state & (1 << 10)) != 0) {
-			bemf_hd_data.source = bemf_hd_phase_u_rising;
-			bemf_hd_data.trigger = true;
-			BEMF_HD_LED_RISING();
-		}else{
-			bemf_hd_data.source = bemf_hd_phase_u_falling;
-			bemf_hd_data.trigger = true;
-			BEMF_HD_LED_FALLING();
+
+/**
+ * Comparator edge opening a new BEMF crossing.
+ *
+ * Each comparator is voted on separately, so that a glitch on one phase
+ * does not hide the crossing of another.
+ *
+ * @param phase Comparator index, 0 for phase U
+ * @param time Time of the edge
+ */
+static void bemf_hd_edge(int phase, u32 time)
+{
+	u16 pin = bemf_hd_phases[phase].pin;
+	bool rising = (bemf_line_state & pin) != 0;
+	enum bemf_hd_source source = rising ? bemf_hd_phases[phase].rising :
+		bemf_hd_phases[phase].falling;
+#ifdef BEMF_HD__QUALIFY
+	struct bemf_hd_candidate *candidate = &bemf_hd_state.candidate[phase];
+	u32 line = pin;
+
+	if (!bemf_hd_changed(phase)) {
+		bemf_hd_data.glitches++;
+		return;
+	}
+
+	if (comm_tim_data.freq > BEMF_HD_VOTE_MIN_FREQ) {
+		candidate->source = source;
+		candidate->time = time;
+		bemf_vote_start(&candidate->vote, rising);
+
+		/* The comparator stays quiet until the vote ends */
+		bemf_hd_state.voting |= line;
+		EXTI->IMR &= ~line;
+		if ((bemf_hd_state.voting & ~line) == 0) {
+			TIM_ClearITPendingBit(TIM1, TIM_IT_CC1 | TIM_IT_CC4);
+			TIM_ITConfig(TIM1, TIM_IT_CC1 | TIM_IT_CC4, ENABLE);
 		}
-	} else {
+		return;
+	}
+#endif
+
+	bemf_hd_latch(source, rising, time);
+}
+
+/**
+ * Comparator edge on the phase of the last crossing.
+ *
+ * Without qualification these are bounces of the crossing, the last one
+ * becomes the start of the next period measurement. With qualification
+ * bounces are voted out, a late edge is noise and must not move it.
+ *
+ * @param phase Comparator index, 0 for phase U
+ * @param time Time of the edge
+ */
+static void bemf_hd_repeat(int phase, u32 time)
+{
+#ifdef BEMF_HD__QUALIFY
+	(void)bemf_hd_changed(phase);
+	(void)time;
+#else
+	(void)phase;
 #ifndef BEMF__DEBUG
-		comm_tim_update_next_prev();
+	comm_tim_update_next_prev_at(time);
 #else
-		DEBUG("Comm time update next prev\n");
+	(void)time;
+	DEBUG("Comm time update next prev\n");
 #endif
+#endif
+}
+
+#ifdef BEMF_HD__QUALIFY
+/**
+ * Sample the comparators with an edge being voted on.
+ *
+ * Called from the TIM1 compare interrupt.
+ *
+ * @param off_time true at the end of the PWM on time, false at the ADC
+ * trigger, only used at full duty cycle
+ */
+void bemf_hd_sample(bool off_time)
+{
+	struct bemf_hd_state *state = &bemf_hd_state;
+	struct bemf_hd_candidate *candidate;
+	enum bemf_hd_source source;
+	enum bemf_vote_result result;
+	u32 line;
+	int i;
+
+	if (!off_time && (pwm_duty() < BEMF_HD_PWM_PERIOD))
+		return;
+
+	for (i = 0; (i < BEMF_HD_PHASES) && (state->voting != 0); i++) {
+		line = bemf_hd_phases[i].pin;
+		if ((state->voting & line) == 0)
+			continue;
+
+		candidate = &state->candidate[i];
+		result = bemf_vote_sample(&candidate->vote,
+					  (GPIOB->IDR & line) != 0);
+		if (result == bv_pending)
+			continue;
+
+		state->voting &= ~line;
+		source = candidate->source;
+		candidate->source = bemf_hd_phase_none;
+
+		if (result == bv_confirmed)
+			bemf_hd_latch(source, candidate->vote.level,
+				      candidate->time);
+		else
+			bemf_hd_data.glitches++;
+
+		if (state->open) {
+			state->levels = (u16)((state->levels & ~line) |
+					      (GPIOB->IDR & line));
+			EXTI_ClearITPendingBit(line);
+			EXTI->IMR |= line;
+		}
 	}
 
-	EXTI_ClearITPendingBit(EXTI_Line10);
-	ON(DP_EXT_SDA);
+	if (state->voting == 0)
+		TIM_ITConfig(TIM1, TIM_IT_CC1 | TIM_IT_CC4, DISABLE);
 }
+#endif
 
-void bemf_hd_phase_v(void)
+/**
+ * Comparator edge of one phase.
+ *
+ * Takes care of oscillating interrupt triggers: an edge on the phase of the
+ * last crossing does not open a new one.
+ *
+ * @param phase Comparator index, 0 for phase U
+ * @param time Time of the edge
+ */
+static void bemf_hd_phase(int phase, u32 time)
 {
-	bemf_line_state = GPIOB->IDR;
-		OFF(DP_EXT_SDA);
-
-		/*
-		 * Take care of oscillating interrupt triggers and filter them out
-		 * also detect the source of the interrupt.
-		 */
-		if ((bemf_hd_data.source != bemf_hd_phase_v_rising) &&
-			(bemf_hd_data.source != bemf_hd_phase_v_falling)) {
-	#ifndef BEMF__DEBUG
-			comm_tim_update_capture_and_time();
-	#else
-			DEBUG("Comm time update capture and time\n");
-	#endif
-			if ((bemf_line_state & (1 << 11)) != 0) {
-				bemf_hd_data.source = bemf_hd_phase_v_rising;
-				bemf_hd_data.trigger = true;
-				//DEBUG("VPhase Rise\n");
-				BEMF_HD_LED_RISING();
-			}else{
-				bemf_hd_data.source = bemf_hd_phase_v_falling;
-				bemf_hd_data.trigger = true;
-				//DEBUG("VPhase Fall\n");
-				BEMF_HD_LED_FALLING();
-			}
-		} else {
-	#ifndef BEMF__DEBUG
-			comm_tim_update_next_prev();
-	#else
-			DEBUG("Comm time update next prev\n");
-	#endif
-		}
+	const struct bemf_hd_phase *p = &bemf_hd_phases[phase];
 
-		EXTI_ClearITPendingBit(EXTI_Line11);
-		ON(DP_EXT_SDA);
+	bemf_hd_data.edges[phase]++;
 
+	if ((bemf_hd_data.source != p->rising) &&
+	    (bemf_hd_data.source != p->falling))
+		bemf_hd_edge(phase, time);
+	else
+		bemf_hd_repeat(phase, time);
 }
+
 /**
- * handler (phase W)
+ * EXTI lines of the comparators of the floating phases.
+ *
+ * Edges of driven phases follow the PWM and carry no BEMF information. With
+ * no phase floating, as with all outputs on for the field oriented control,
+ * all comparators are watched.
  */
-void bemf_hd_phase_w(void)
+static u32 bemf_hd_floating_lines(void)
 {
-	bemf_line_state = GPIOB->IDR;
-		OFF(DP_EXT_SDA);
-
-		/*
-		 * Take care of oscillating interrupt triggers and filter them out
-		 * also detect the source of the interrupt.
-		 */
-		if ((bemf_hd_data.source != bemf_hd_phase_w_rising) &&
-			(bemf_hd_data.source != bemf_hd_phase_w_falling)) {
-	#ifndef BEMF__DEBUG
-			comm_tim_update_capture_and_time();
-	#else
-			DEBUG("Comm time update capture and time\n");
-	#endif
-			if ((bemf_line_state & (1 << 12)) != 0) {
-				bemf_hd_data.source = bemf_hd_phase_w_rising;
-				bemf_hd_data.trigger = true;
-				//DEBUG("WPhase Rise\n");
-				BEMF_HD_LED_RISING();
-			}else{
-				bemf_hd_data.source = bemf_hd_phase_w_falling;
-				bemf_hd_data.trigger = true;
-				BEMF_HD_LED_FALLING();
-				//DEBUG("WPhase Falling\n");
-			}
-		} else {
-	#ifndef BEMF__DEBUG
-			comm_tim_update_next_prev();
-	#else
-			DEBUG("Comm time update next prev\n");
-	#endif
-		}
+	u8 floating = pwm_floating;
+	u32 lines = 0;
+	int i;
 
-		EXTI_ClearITPendingBit(EXTI_Line12);
-		ON(DP_EXT_SDA);
+	if (floating == 0)
+		return BEMF_HD_LINES;
+
+	for (i = 0; i < BEMF_HD_PHASES; i++)
+		if ((floating & (1 << i)) != 0)
+			lines |= bemf_hd_phases[i].pin;
 
+	return lines;
 }
 
 /**
  * External interrupt bank 10:15 handler
+ *
+ * Handles all pending comparator lines in one pass with a single read of
+ * the comparator levels and the time.
  */
 void exti15_10_irq_handler(void)
 {
-	if(EXTI_GetITStatus(EXTI_Line10) != RESET)
-	{
-		bemf_hd_phase_u();
-	}else if(EXTI_GetITStatus(EXTI_Line11) != RESET)
-	{
-		bemf_hd_phase_v();
-	}else if(EXTI_GetITStatus(EXTI_Line12) != RESET)
-	{
-		bemf_hd_phase_w();
-	}else{
+	u32 pending = EXTI->PR & EXTI->IMR & BEMF_HD_LINES;
+	u32 floating;
+	u32 time;
+	int i;
+
+	if (pending == 0) {
 		DEBUG("Stray interrupt on EXTI15_10 Bank\n")
+		return;
 	}
+
+	OFF(DP_EXT_SDA);
+	EXTI_ClearITPendingBit(pending);
+	bemf_line_state = GPIOB->IDR;
+	time = comm_tim_now();
+
+#ifndef BEMF_HD__QUALIFY
+	/* Edges from the demagnetization after a commutation are no crossing */
+	if (comm_tim_blanking(time)) {
+		ON(DP_EXT_SDA);
+		return;
+	}
+#endif
+
+	floating = bemf_hd_floating_lines();
+	if ((pending & ~floating) != 0)
+		bemf_hd_data.driven++;
+	pending &= floating;
+
+	for (i = 0; i < BEMF_HD_PHASES; i++)
+		if ((pending & bemf_hd_phases[i].pin) != 0)
+			bemf_hd_phase(i, time);
+
+	ON(DP_EXT_SDA);
 }
@@ -19,6 +19,23 @@
 #ifndef __BEMF_HARDWARE_DETECT_H
 #define __BEMF_HARDWARE_DETECT_H
 
+/**
+ * Number of BEMF comparators, on GPIOB pin and EXTI line 10 and up.
+ */
+#define BEMF_HD_PHASES 3
+
+/**
+ * PWM period in timer counts.
+ */
+#define BEMF_HD_PWM_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * PWM period in commutation timer ticks, TIM1 counts BEMF_HD_PWM_PERIOD + 1
+ * cycles of the 72MHz clock without prescaler.
+ */
+#define BEMF_HD_PWM_TICKS \
+	((BEMF_HD_PWM_PERIOD + 1) / (72000000 / COMM_TIM_CLOCK))
+
 enum bemf_hd_source {
 	bemf_hd_phase_none,
 	bemf_hd_phase_u_rising,
@@ -32,11 +49,18 @@ enum bemf_hd_source {
 struct bemf_hd_data {
 	enum bemf_hd_source source;
 	bool trigger;
+	u32 glitches;		/**< Comparator edges rejected by the vote */
+	u32 edges[BEMF_HD_PHASES]; /**< Comparator edges per floating phase */
+	u32 driven;		/**< Interrupts with edges of driven phases */
 };
 
 extern struct bemf_hd_data bemf_hd_data;
 
 void bemf_hd_init(void);
 void bemf_hd_reset(void);
+void bemf_hd_window_close(void);
+void bemf_hd_window_open(void);
+void bemf_hd_sample(bool off_time);
+bool bemf_hd_voting(void);
 
 #endif /* __BEMF_HARDWARE_DETECT_H */
@@ -23,6 +23,22 @@
  *
  * @brief  CAN driver implementation
  *
+ * Governor protocol transport over CAN, so that one bus can serve all the
+ * controllers of a vehicle.
+ *
+ * The controller listens to the request identifier of its node id and to
+ * the broadcast request identifier and answers on the answer identifier of
+ * its node id, see GP_CAN_REQUEST_ID() and GP_CAN_ANSWER_ID() in lg/gpdef.h.
+ * The node id is CAN__DEFAULT_ADDR or CAN_ADDR given on the make command
+ * line. One filter bank in identifier list mode passes the two request
+ * identifiers, all other traffic on the bus never reaches the receive FIFO.
+ *
+ * The receive interrupt copies the payload of the received frames into a
+ * buffer and raises @ref can_rx_trigger, the bytes are parsed by
+ * can_process_rx() from the main loop. The governor output is sent in
+ * frames of up to GP_CAN_PAYLOAD bytes from all three transmit mailboxes,
+ * the transmit mailbox empty interrupt refills them. Transmit FIFO priority
+ * keeps the frames in order as they all have the same identifier.
  */
 
 #include "config.h"
@@ -30,32 +46,76 @@
 #include <stdint.h>
 #include <string.h>
 
-#include "driver/can.h"
-
 #include <stm32/rcc.h>
 #include <stm32/gpio.h>
-#include <stm32/flash.h>
 #include <stm32/misc.h>
 #include <stm32/can.h>
 
-#include "led.h"
+#include "types.h"
 
-#define RCC_APB2Periph_GPIO_CAN RCC_APB2Periph_GPIOA
-#define GPIO_CAN GPIOA
-#define GPIO_Pin_CAN_RX GPIO_Pin_11
-#define GPIO_Pin_CAN_TX GPIO_Pin_12
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
 
-CanTxMsg can_tx_msg;
-CanRxMsg can_rx_msg;
+#include "driver/can.h"
 
-//void _can_run_rx_callback(uint32_t id, uint8_t *buf, uint8_t len);
+/**
+ * Node id of this controller.
+ */
+#ifdef CAN_ADDR
+#define CAN_NODE_ID CAN_ADDR
+#else
+#define CAN_NODE_ID CAN__DEFAULT_ADDR
+#endif
+
+/**
+ * Size of the receive buffer, a power of two.
+ */
+#define CAN_RX_BUF_SIZE 128
 
+/**
+ * Receive buffer, written by the receive interrupt.
+ */
+static volatile u8 can_rx_buf[CAN_RX_BUF_SIZE];
+
+/**
+ * Write position of the receive interrupt in the receive buffer.
+ */
+static volatile u16 can_rx_head;
+
+/**
+ * Position in the receive buffer up to which bytes were handled.
+ */
+static u16 can_rx_tail;
+
+/**
+ * Number of received bytes dropped because the receive buffer was full.
+ */
+volatile u32 can_rx_overruns;
+
+/**
+ * Value of @ref can_rx_overruns when the receive buffer was last handled.
+ */
+static u32 can_rx_overruns_seen;
+
+/**
+ * Received data waiting for can_process_rx() flag.
+ */
+volatile bool can_rx_trigger;
+
+static CanTxMsg can_tx_msg;
+static CanRxMsg can_rx_msg;
+
+static void can_filter_init(u8 bank, u32 id_a, u32 id_b);
+static void can_tx_fill(void);
+
+/**
+ * CAN driver initialization.
+ */
 void can_init(void)
 {
 	GPIO_InitTypeDef gpio;
 	NVIC_InitTypeDef nvic;
 	CAN_InitTypeDef can;
-	CAN_FilterInitTypeDef can_filter;
 
 	/* Enable peripheral clocks */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO |
@@ -73,45 +133,43 @@ void can_init(void)
 	gpio.GPIO_Speed = GPIO_Speed_50MHz;
 	GPIO_Init(GPIOA, &gpio);
 
-	/* NVIC configuration */
-	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_0);
-
+	/* Enable the receive FIFO 0 and transmit interrupts */
 	nvic.NVIC_IRQChannel = USB_LP_CAN1_RX0_IRQn;
-	nvic.NVIC_IRQChannelPreemptionPriority = 0x00;
-	nvic.NVIC_IRQChannelSubPriority = 0x00;
+	nvic.NVIC_IRQChannelPreemptionPriority = 0;
+	nvic.NVIC_IRQChannelSubPriority = 1;
 	nvic.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&nvic);
 
+	nvic.NVIC_IRQChannel = USB_HP_CAN1_TX_IRQn;
+	NVIC_Init(&nvic);
+
 	/* CAN register init */
 	CAN_DeInit(CAN1);
 	CAN_StructInit(&can);
 
-	/* CAN cell init */
+	/* CAN cell init, transmit in request order */
 	can.CAN_TTCM = DISABLE;
 	can.CAN_ABOM = CAN__ERR_RESUME;
 	can.CAN_AWUM = DISABLE;
 	can.CAN_NART = DISABLE;
 	can.CAN_RFLM = DISABLE;
-	can.CAN_TXFP = DISABLE;
+	can.CAN_TXFP = ENABLE;
 	can.CAN_Mode = CAN_Mode_Normal;
 	can.CAN_SJW = CAN__SJW_TQ;
 	can.CAN_BS1 = CAN__BS1_TQ;
 	can.CAN_BS2 = CAN__BS2_TQ;
 	can.CAN_Prescaler = CAN__PRESCALER;
-	can.CAN_ABOM = ENABLE;
-	CAN_Init(CAN1, &can);
+	(void)CAN_Init(CAN1, &can);
 
-	/* CAN filter init */
-	can_filter.CAN_FilterNumber = 0;
-	can_filter.CAN_FilterMode = CAN_FilterMode_IdMask;
-	can_filter.CAN_FilterScale = CAN_FilterScale_32bit;
-	can_filter.CAN_FilterIdHigh = 0x0000;
-	can_filter.CAN_FilterIdLow = 0x0000;
-	can_filter.CAN_FilterMaskIdHigh = 0x0000;
-	can_filter.CAN_FilterMaskIdLow = 0x0000;
-	can_filter.CAN_FilterFIFOAssignment = 0;
-	can_filter.CAN_FilterActivation = ENABLE;
-	CAN_FilterInit(&can_filter);
+	/* Only our own and broadcast requests pass */
+	can_filter_init(0, GP_CAN_REQUEST_ID(CAN_NODE_ID),
+			GP_CAN_REQUEST_ID(GP_CAN_NODE_BROADCAST));
+
+	can_rx_head = 0;
+	can_rx_tail = 0;
+	can_rx_overruns = 0;
+	can_rx_overruns_seen = 0;
+	can_rx_trigger = false;
 
 	/* transmit struct init */
 	can_tx_msg.StdId = 0x0;
@@ -122,11 +180,53 @@ void can_init(void)
 #else
 	can_tx_msg.IDE = CAN_ID_STD;
 #endif
-	can_tx_msg.DLC = 1;
+	can_tx_msg.DLC = 0;
 
-	CAN_ITConfig(CAN1, CAN_IT_FMP0, ENABLE);
+	CAN_ITConfig(CAN1, CAN_IT_FMP0 | CAN_IT_TME, ENABLE);
 }
 
+/**
+ * Set up a filter bank passing exactly two identifiers into FIFO 0.
+ *
+ * @param bank Filter bank number
+ * @param id_a First identifier
+ * @param id_b Second identifier
+ */
+void can_filter_init(u8 bank, u32 id_a, u32 id_b)
+{
+	CAN_FilterInitTypeDef can_filter;
+
+	can_filter.CAN_FilterNumber = bank;
+	can_filter.CAN_FilterMode = CAN_FilterMode_IdList;
+#ifdef CAN__USE_EXT_ID
+	/* One identifier per 32bit register */
+	can_filter.CAN_FilterScale = CAN_FilterScale_32bit;
+	can_filter.CAN_FilterIdHigh = (u16)((id_a << 3) >> 16);
+	can_filter.CAN_FilterIdLow = (u16)((id_a << 3) | CAN_ID_EXT);
+	can_filter.CAN_FilterMaskIdHigh = (u16)((id_b << 3) >> 16);
+	can_filter.CAN_FilterMaskIdLow = (u16)((id_b << 3) | CAN_ID_EXT);
+#else
+	/* Four 16bit identifiers, each of ours twice */
+	can_filter.CAN_FilterScale = CAN_FilterScale_16bit;
+	can_filter.CAN_FilterIdHigh = (u16)(id_a << 5);
+	can_filter.CAN_FilterIdLow = (u16)(id_b << 5);
+	can_filter.CAN_FilterMaskIdHigh = (u16)(id_a << 5);
+	can_filter.CAN_FilterMaskIdLow = (u16)(id_b << 5);
+#endif
+	can_filter.CAN_FilterFIFOAssignment = CAN_FIFO0;
+	can_filter.CAN_FilterActivation = ENABLE;
+	CAN_FilterInit(&can_filter);
+}
+
+/**
+ * Queue a frame for transmission.
+ *
+ * @param id Frame identifier
+ * @param buf Payload
+ * @param len Payload length, at most 8
+ *
+ * @return 0 on success, -1 if len is too long or no mailbox is free
+ */
 int can_transmit(uint32_t id, const uint8_t *buf, uint8_t len)
 {
 	if(len > 8){
@@ -142,33 +242,109 @@ int can_transmit(uint32_t id, const uint8_t *buf, uint8_t len)
 
 	memcpy(can_tx_msg.Data, buf, len);
 
-	CAN_Transmit(CAN1, &can_tx_msg);
+	if (CAN_Transmit(CAN1, &can_tx_msg) == CAN_NO_MB)
+		return -1;
 
-	//TOGGLE(LED_ORANGE);
+	return 0;
+}
 
+/**
+ * Start sending the governor output buffer.
+ *
+ * Called whenever the governor has queued output, fills the free transmit
+ * mailboxes, the transmit interrupt picks up the rest.
+ */
+void can_enable_send(void)
+{
+	u32 primask;
 
-	return 0;
+	/* The transmit interrupt fills the mailboxes too */
+	primask = __get_PRIMASK();
+	__disable_irq();
+	can_tx_fill();
+	__set_PRIMASK(primask);
 }
 
-void usb_lp_can_rx0_irq_handler(void)
+/**
+ * Move governor output into free transmit mailboxes.
+ */
+void can_tx_fill(void)
 {
-	static int delay = 100;
+	u8 *data;
+	s32 len;
 
-	//ADC_ClearITPendingBit(CAN1, CAN_IT_FMP0);
+	while ((len = gpc_pickup_block(&data)) > 0) {
+		if (len > GP_CAN_PAYLOAD)
+			len = GP_CAN_PAYLOAD;
 
-	CAN_Receive(CAN1, CAN_FIFO0, &can_rx_msg);
+		if (can_transmit(GP_CAN_ANSWER_ID(CAN_NODE_ID), data,
+				 (u8)len) != 0)
+			return;
 
-	if(delay == 0) {
-		delay = 100;
-		TOGGLE(LED_RED);
-	}else{
-		delay--;
+		(void)gpc_pickup_done(len);
 	}
-		TOGGLE(LED_BLUE);
-#ifdef CAN__USE_EXT_ID
-	//_can_run_rx_callback(can_rx_msg.ExtId, can_rx_msg.Data, can_rx_msg.DLC);
-#else
-	//_can_run_rx_callback(can_rx_msg.StdId, can_rx_msg.Data, can_rx_msg.DLC);
-#endif
 }
 
+/**
+ * Hand all bytes received so far to the governor.
+ *
+ * Run from the main loop when @ref can_rx_trigger is set. If the receive
+ * interrupt dropped bytes on a full buffer the buffer is dropped and the
+ * governor parser resynchronized instead.
+ */
+void can_process_rx(void)
+{
+	u32 overruns = can_rx_overruns;
+
+	if (overruns != can_rx_overruns_seen) {
+		can_rx_overruns_seen = overruns;
+		can_rx_tail = can_rx_head;
+		gpc_resync();
+		return;
+	}
+
+	while (can_rx_tail != can_rx_head) {
+		(void)gpc_handle_byte(can_rx_buf[can_rx_tail]);
+		can_rx_tail = (can_rx_tail + 1) & (CAN_RX_BUF_SIZE - 1);
+	}
+}
+
+/**
+ * CAN receive FIFO 0 interrupt handler.
+ */
+void usb_lp_can_rx0_irq_handler(void)
+{
+	u16 head = can_rx_head;
+	u16 next;
+	u8 len;
+	u8 i;
+
+	while (CAN_MessagePending(CAN1, CAN_FIFO0) != 0) {
+		CAN_Receive(CAN1, CAN_FIFO0, &can_rx_msg);
+
+		/* DLC values above 8 still carry 8 data bytes */
+		len = (can_rx_msg.DLC > 8) ? 8 : can_rx_msg.DLC;
+		for (i = 0; i < len; i++) {
+			next = (head + 1) & (CAN_RX_BUF_SIZE - 1);
+			if (next == can_rx_tail) {
+				can_rx_overruns++;
+				continue;
+			}
+			can_rx_buf[head] = can_rx_msg.Data[i];
+			head = next;
+		}
+	}
+
+	can_rx_head = head;
+	can_rx_trigger = true;
+}
+
+/**
+ * CAN transmit interrupt handler, a mailbox became empty.
+ */
+void usb_hp_can_tx_irq_handler(void)
+{
+	CAN_ClearITPendingBit(CAN1, CAN_IT_TME);
+
+	can_tx_fill();
+}
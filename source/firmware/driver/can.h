@@ -19,8 +19,15 @@
 #ifndef CAN_H
 #define CAN_H
 
+extern volatile bool can_rx_trigger;
+extern volatile u32 can_rx_overruns;
+
 void can_init(void);
-void usb_lp_can1_rx0_irq_handler(void);
 int can_transmit(uint32_t id, const uint8_t *buf, uint8_t len);
+void can_enable_send(void);
+void can_process_rx(void);
+
+void usb_lp_can_rx0_irq_handler(void);
+void usb_hp_can_tx_irq_handler(void);
 
-#endif /* CAN_HW_H */
+#endif /* CAN_H */
@@ -32,6 +32,13 @@
 
 #include "debug_pins.h"
 
+#ifndef DP__USE_EXT_I2C
+/**
+ * Stand in port register block for unused debug pins.
+ */
+GPIO_TypeDef debug_pins_none;
+#endif
+
 void debug_pins_init(void)
 {
 	GPIO_InitTypeDef gpio;
@@ -21,10 +21,16 @@
 
 #include "config.h"
 
+#include <stm32/gpio.h>
+
 #include "macro_utils.h"
 
 #ifdef DP__USE_ENCODER
 
+#ifdef COMMP_HALL
+#error "The encoder pins can not be debug pins and Hall sensor inputs at once"
+#endif
+
 #define DP_ENC_A_PORT GPIOA
 #define DP_ENC_A_PIN 6
 
@@ -35,12 +41,27 @@
 
 #ifdef DP__USE_EXT_I2C
 
+#ifdef I2C__ENABLE
+#error "The external I2C pins can not be debug pins and I2C slave at once"
+#endif
+
 #define DP_EXT_SCL_PORT GPIOB
 #define DP_EXT_SCL_PIN 8
 
 #define DP_EXT_SDA_PORT GPIOB
 #define DP_EXT_SDA_PIN 9
 
+#else
+
+/* Debug output to the external I2C pins goes nowhere */
+extern GPIO_TypeDef debug_pins_none;
+
+#define DP_EXT_SCL_PORT (&debug_pins_none)
+#define DP_EXT_SCL_PIN 8
+
+#define DP_EXT_SDA_PORT (&debug_pins_none)
+#define DP_EXT_SDA_PIN 9
+
 #endif
 
 void debug_pins_init(void);
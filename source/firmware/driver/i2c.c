@@ -0,0 +1,339 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   driver/i2c.c
+ *
+ * @brief  I2C slave driver implementation
+ *
+ * Register interface for flight controllers on the external I2C port
+ * (I2C1 remapped to PB8 SCL and PB9 SDA) at the slave address I2C__ADDR.
+ * It replaces the external I2C debug pins, see debug_pins.h.
+ *
+ * The first byte of a write sets the register pointer, every following
+ * pair of bytes is written LSB first to the register under the pointer
+ * which then advances. A read returns the registers from the pointer on,
+ * also LSB first, without moving the pointer, so repeated reads return the
+ * same registers. Registers are the governor registers, accessed through
+ * gpc_get_reg() and gpc_set_reg() so both interfaces see the same register
+ * map and run the same register changed hook. Addresses from
+ * I2C_TELEMETRY_ADDR on hold a read only copy of the speed, current,
+ * voltage and temperature registers.
+ *
+ * In the style of the Mikrokopter motor controllers a flight controller
+ * only needs two short transfers per cycle: a three byte write of a
+ * setpoint register, after which the pointer goes back to the telemetry
+ * block, and an eight byte read of the telemetry.
+ *
+ * Bytes are handled one by one in the event interrupt. The peripheral
+ * stretches the clock while the interrupt is pending, so no byte gets lost.
+ * A register write is queued as soon as its MSB is received and only raises
+ * @ref i2c_rx_trigger. The register changed hook can start and stop the
+ * motor or switch the PWM scheme, so the queue is handed to the governor by
+ * i2c_process_rx() from the main loop, like the bytes of the USART. A write
+ * that finds the queue full is dropped and counted in @ref i2c_errors.
+ */
+
+#include "config.h"
+
+#include <stm32/rcc.h>
+#include <stm32/gpio.h>
+#include <stm32/misc.h>
+#include <stm32/i2c.h>
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+
+#include "driver/i2c.h"
+
+/** @{ */
+/**
+ * Status bits in the word returned by I2C_GetLastEvent(), SR2 in the upper
+ * half.
+ */
+#define I2C_EV_ADDR 0x00000002
+#define I2C_EV_STOPF 0x00000010
+#define I2C_EV_RXNE 0x00000040
+#define I2C_EV_TXE 0x00000080
+#define I2C_EV_TRA 0x00040000
+/** @} */
+
+/**
+ * Number of register writes the queue holds, a power of two.
+ */
+#define I2C_RX_QUEUE_SIZE 16
+
+/**
+ * Governor registers mirrored in the telemetry block.
+ */
+static const u8 i2c_telemetry_map[I2C_TELEMETRY_REGS] = {
+	GPROT_SPEED_RPM_REG_ADDR,
+	GPROT_ADC_CURRENT_REG_ADDR,
+	GPROT_ADC_BATTERY_VOLTAGE_REG_ADDR,
+	GPROT_ADC_TEMPERATURE_REG_ADDR
+};
+
+/**
+ * Transfer state of the I2C slave.
+ */
+struct i2c_state {
+	u8 ptr;			/**< Register pointer */
+	u8 tx_addr;		/**< Register being read */
+	u8 count;		/**< Bytes received in the current write */
+	bool hi;		/**< Next byte is the MSB */
+	u16 data;		/**< Register value being transferred */
+};
+
+static struct i2c_state i2c_state;
+
+/**
+ * Register write received but not yet handed to the governor.
+ */
+struct i2c_write {
+	u8 addr;		/**< Register address */
+	u16 val;		/**< Register value */
+};
+
+/**
+ * Register writes from the event interrupt to the main loop. The interrupt
+ * only moves the head, i2c_process_rx() only the tail.
+ */
+static struct i2c_write i2c_rx_queue[I2C_RX_QUEUE_SIZE];
+static volatile u8 i2c_rx_head;
+static volatile u8 i2c_rx_tail;
+
+/**
+ * Set when register writes are waiting for i2c_process_rx().
+ */
+volatile bool i2c_rx_trigger;
+
+/**
+ * Number of writes to registers that do not exist or are read only.
+ */
+volatile u32 i2c_rejected;
+
+/**
+ * Number of bus errors, overruns and register writes dropped with the
+ * queue full.
+ */
+volatile u32 i2c_errors;
+
+/**
+ * I2C slave driver initialization.
+ */
+void i2c_init(void)
+{
+	GPIO_InitTypeDef gpio;
+	NVIC_InitTypeDef nvic;
+	I2C_InitTypeDef i2c;
+
+	/* Enable peripheral clocks */
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO |
+			       RCC_APB2Periph_GPIOB, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_I2C1, ENABLE);
+
+	/* Configure I2C pins: SCL and SDA */
+	gpio.GPIO_Pin = GPIO_Pin_8 | GPIO_Pin_9;
+	gpio.GPIO_Mode = GPIO_Mode_AF_OD;
+	gpio.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_Init(GPIOB, &gpio);
+
+	GPIO_PinRemapConfig(GPIO_Remap_I2C1, ENABLE);
+
+	/* Enable the event and error interrupts */
+	nvic.NVIC_IRQChannel = I2C1_EV_IRQn;
+	nvic.NVIC_IRQChannelPreemptionPriority = 0;
+	nvic.NVIC_IRQChannelSubPriority = 1;
+	nvic.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic);
+
+	nvic.NVIC_IRQChannel = I2C1_ER_IRQn;
+	NVIC_Init(&nvic);
+
+	i2c_state.ptr = I2C_TELEMETRY_ADDR;
+	i2c_state.tx_addr = I2C_TELEMETRY_ADDR;
+	i2c_state.count = 0;
+	i2c_state.hi = false;
+	i2c_state.data = 0;
+	i2c_rx_head = 0;
+	i2c_rx_tail = 0;
+	i2c_rx_trigger = false;
+	i2c_rejected = 0;
+	i2c_errors = 0;
+
+	/* I2C cell init */
+	I2C_DeInit(I2C1);
+	i2c.I2C_Mode = I2C_Mode_I2C;
+	i2c.I2C_DutyCycle = I2C_DutyCycle_2;
+	i2c.I2C_OwnAddress1 = I2C__ADDR << 1;
+	i2c.I2C_Ack = I2C_Ack_Enable;
+	i2c.I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
+	i2c.I2C_ClockSpeed = I2C__CLOCK;
+	I2C_Init(I2C1, &i2c);
+
+	I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, ENABLE);
+	I2C_Cmd(I2C1, ENABLE);
+}
+
+/**
+ * Value of a register as seen from the I2C side.
+ */
+static u16 i2c_reg(u8 addr)
+{
+	u16 val = 0;
+
+	if ((addr >= I2C_TELEMETRY_ADDR) &&
+	    (addr < (I2C_TELEMETRY_ADDR + I2C_TELEMETRY_REGS)))
+		addr = i2c_telemetry_map[addr - I2C_TELEMETRY_ADDR];
+
+	(void)gpc_get_reg(addr, &val);
+
+	return val;
+}
+
+/**
+ * Queue a register write for the main loop.
+ */
+static void i2c_queue(u8 addr, u16 val)
+{
+	u8 head = i2c_rx_head;
+	u8 next = (head + 1) & (I2C_RX_QUEUE_SIZE - 1);
+
+	if (next == i2c_rx_tail) {
+		i2c_errors++;
+		return;
+	}
+
+	i2c_rx_queue[head].addr = addr;
+	i2c_rx_queue[head].val = val;
+	i2c_rx_head = next;
+	i2c_rx_trigger = true;
+}
+
+/**
+ * Write the queued registers and run their register changed hook.
+ *
+ * Run from the main loop when @ref i2c_rx_trigger is set.
+ */
+void i2c_process_rx(void)
+{
+	u8 tail = i2c_rx_tail;
+
+	while (tail != i2c_rx_head) {
+		if (gpc_set_reg(i2c_rx_queue[tail].addr,
+				i2c_rx_queue[tail].val) != 0)
+			i2c_rejected++;
+		tail = (tail + 1) & (I2C_RX_QUEUE_SIZE - 1);
+		i2c_rx_tail = tail;
+	}
+}
+
+/**
+ * Handle a received byte.
+ */
+static void i2c_rx(u8 byte)
+{
+	i2c_state.count++;
+
+	if (i2c_state.count == 1) {
+		i2c_state.ptr = byte;
+		return;
+	}
+
+	if ((i2c_state.count & 1) == 0) {
+		i2c_state.data = byte;
+		return;
+	}
+
+	i2c_state.data |= (u16)byte << 8;
+	i2c_queue(i2c_state.ptr, i2c_state.data);
+	i2c_state.ptr++;
+}
+
+/**
+ * Get the next byte to transmit.
+ */
+static u8 i2c_tx(void)
+{
+	/* Take the whole register at once so it can not tear */
+	if (!i2c_state.hi) {
+		i2c_state.data = i2c_reg(i2c_state.tx_addr);
+		i2c_state.hi = true;
+		return (u8)(i2c_state.data & 0xFF);
+	}
+
+	i2c_state.hi = false;
+	i2c_state.tx_addr++;
+
+	return (u8)(i2c_state.data >> 8);
+}
+
+/**
+ * I2C1 event interrupt handler.
+ */
+void i2c1_ev_irq_handler(void)
+{
+	/* Reading SR1 and SR2 clears ADDR */
+	u32 event = I2C_GetLastEvent(I2C1);
+
+	if ((event & I2C_EV_ADDR) != 0) {
+		i2c_state.count = 0;
+		i2c_state.tx_addr = i2c_state.ptr;
+		i2c_state.hi = false;
+	}
+
+	if ((event & I2C_EV_RXNE) != 0)
+		i2c_rx(I2C_ReceiveData(I2C1));
+
+	if ((event & (I2C_EV_TRA | I2C_EV_TXE)) == (I2C_EV_TRA | I2C_EV_TXE))
+		I2C_SendData(I2C1, i2c_tx());
+
+	if ((event & I2C_EV_STOPF) != 0) {
+		/* Writing CR1 after reading SR1 clears STOPF */
+		I2C_Cmd(I2C1, ENABLE);
+
+		/* Register writes go back to the telemetry for the next read */
+		if (i2c_state.count > 1)
+			i2c_state.ptr = I2C_TELEMETRY_ADDR;
+		i2c_state.count = 0;
+	}
+}
+
+/**
+ * I2C1 error interrupt handler.
+ */
+void i2c1_er_irq_handler(void)
+{
+	/* The master ends every read with a NACK */
+	if (I2C_GetITStatus(I2C1, I2C_IT_AF) != RESET)
+		I2C_ClearITPendingBit(I2C1, I2C_IT_AF);
+
+	if (I2C_GetITStatus(I2C1, I2C_IT_BERR) != RESET) {
+		I2C_ClearITPendingBit(I2C1, I2C_IT_BERR);
+		i2c_errors++;
+	}
+
+	if (I2C_GetITStatus(I2C1, I2C_IT_OVR) != RESET) {
+		I2C_ClearITPendingBit(I2C1, I2C_IT_OVR);
+		i2c_errors++;
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef I2C_H
+#define I2C_H
+
+/**
+ * First register of the read only telemetry block.
+ */
+#define I2C_TELEMETRY_ADDR 32
+
+/**
+ * Number of registers in the telemetry block: speed [rpm], current,
+ * battery voltage and temperature.
+ */
+#define I2C_TELEMETRY_REGS 4
+
+extern volatile bool i2c_rx_trigger;
+extern volatile u32 i2c_rejected;
+extern volatile u32 i2c_errors;
+
+void i2c_init(void);
+void i2c_process_rx(void);
+
+void i2c1_ev_irq_handler(void);
+void i2c1_er_irq_handler(void);
+
+#endif /* I2C_H */
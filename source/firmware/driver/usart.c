@@ -23,13 +23,33 @@
  *
  * @brief  USART driver implementation
  *
+ * Both directions are moved by DMA so that the interrupt rate scales with
+ * the bursts of governor traffic and not with the bytes.
+ *
+ * DMA1 channel 5 receives into a circular buffer. The USART idle line
+ * interrupt marks the end of a burst, the half and full transfer
+ * interrupts make sure a long burst is picked up before the DMA laps the
+ * buffer. The interrupts only raise @ref usart_rx_trigger, the bytes are
+ * parsed by usart_process_rx() from the main loop.
+ *
+ * The half and full transfer interrupts also count the bytes the DMA wrote.
+ * When the main loop falls a whole buffer behind, the unhandled bytes were
+ * overwritten. The buffer is then dropped, the governor parser restarts on
+ * the next byte and the overrun is counted in @ref usart_rx_overruns.
+ *
+ * DMA1 channel 4 transmits straight out of the governor output buffer, one
+ * contiguous block at a time. The transfer complete interrupt releases the
+ * block and starts the next one.
  */
 
 #include "config.h"
 
+#include <stdint.h>
+
 #include <stm32/rcc.h>
 #include <stm32/misc.h>
 #include <stm32/usart.h>
+#include <stm32/dma.h>
 #include <stm32/gpio.h>
 #include <stm32/tim.h>
 
@@ -43,9 +63,46 @@
 #include "led.h"
 
 /**
- * Data buffer used for incoming and outgoing data.
+ * Size of the receive DMA buffer, a power of two.
  */
-static volatile s16 data_buf;
+#define USART_RX_BUF_SIZE 64
+
+/**
+ * Receive DMA buffer.
+ */
+static volatile u8 usart_rx_buf[USART_RX_BUF_SIZE];
+
+/**
+ * Position in the receive buffer up to which bytes were handled.
+ */
+static u16 usart_rx_pos;
+
+/**
+ * Number of bytes handled.
+ */
+static u32 usart_rx_count;
+
+/**
+ * Number of bytes the DMA wrote up to the last half or full transfer.
+ */
+static volatile u32 usart_rx_written;
+
+/**
+ * Number of times the receive DMA overwrote unhandled bytes.
+ */
+volatile u32 usart_rx_overruns;
+
+/**
+ * Length of the block being transmitted, 0 if idle.
+ */
+static volatile s32 usart_tx_len;
+
+/**
+ * Received data waiting for usart_process_rx() flag.
+ */
+volatile bool usart_rx_trigger;
+
+static void usart_tx_next(void);
 
 /**
  * USART driver initialization.
@@ -55,19 +112,27 @@ void usart_init(void)
 	NVIC_InitTypeDef nvic;
 	GPIO_InitTypeDef gpio;
 	USART_InitTypeDef usart;
+	DMA_InitTypeDef dma;
 
 	/* enable clock for USART1 peripherial */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1 |
 			       RCC_APB2Periph_GPIOB |
 			       RCC_APB2Periph_AFIO, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 
-	/* Enable the USART1 interrupts */
+	/* Enable the USART1 and DMA1 channel 4 and 5 interrupts */
 	nvic.NVIC_IRQChannel = USART1_IRQn;
 	nvic.NVIC_IRQChannelPreemptionPriority = 0;
 	nvic.NVIC_IRQChannelSubPriority = 1;
 	nvic.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&nvic);
 
+	nvic.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+	NVIC_Init(&nvic);
+
+	nvic.NVIC_IRQChannel = DMA1_Channel5_IRQn;
+	NVIC_Init(&nvic);
+
 	/* enable USART1 pin software remapping */
 	GPIO_PinRemapConfig(GPIO_Remap_USART1, ENABLE);
 
@@ -83,6 +148,44 @@ void usart_init(void)
 	gpio.GPIO_Mode = GPIO_Mode_IN_FLOATING;
 	GPIO_Init(GPIOB, &gpio);
 
+	/* DMA1 channel 5: USART1 data register into the receive buffer */
+	usart_rx_pos = 0;
+	usart_rx_count = 0;
+	usart_rx_written = 0;
+	usart_rx_overruns = 0;
+	usart_rx_trigger = false;
+
+	DMA_DeInit(DMA1_Channel5);
+	dma.DMA_PeripheralBaseAddr = (uintptr_t)&USART1->DR;
+	dma.DMA_MemoryBaseAddr = (uintptr_t)&usart_rx_buf[0];
+	dma.DMA_DIR = DMA_DIR_PeripheralSRC;
+	dma.DMA_BufferSize = USART_RX_BUF_SIZE;
+	dma.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dma.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dma.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	dma.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	dma.DMA_Mode = DMA_Mode_Circular;
+	dma.DMA_Priority = DMA_Priority_Medium;
+	dma.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel5, &dma);
+
+	DMA_ITConfig(DMA1_Channel5, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(DMA1_Channel5, ENABLE);
+
+	/* DMA1 channel 4: governor output buffer into the data register,
+	 * address and length are set per block */
+	usart_tx_len = 0;
+
+	DMA_DeInit(DMA1_Channel4);
+	dma.DMA_MemoryBaseAddr = 0;
+	dma.DMA_DIR = DMA_DIR_PeripheralDST;
+	dma.DMA_BufferSize = 0;
+	dma.DMA_Mode = DMA_Mode_Normal;
+	dma.DMA_Priority = DMA_Priority_Low;
+	DMA_Init(DMA1_Channel4, &dma);
+
+	DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
+
 	/* Initialize the usart subsystem */
 	usart.USART_BaudRate = 153600;//USART__BAUD;
 	usart.USART_WordLength = USART_WordLength_8b;
@@ -94,55 +197,118 @@ void usart_init(void)
 	/* Configure USART1 */
 	USART_Init(USART1, &usart);
 
-	/* Enable USART1 Receive and Transmit interrupts */
-	USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);
-	//USART_ITConfig(USART1, USART_IT_TXE, ENABLE);
+	/* Hand both directions to the DMA, interrupt on idle line only */
+	USART_DMACmd(USART1, USART_DMAReq_Rx | USART_DMAReq_Tx, ENABLE);
+	USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);
 
 	/* Enable the USART1 */
 	USART_Cmd(USART1, ENABLE);
 }
 
 /**
- * Enable USART send interrupt.
+ * Start sending the governor output buffer.
+ *
+ * Called whenever the governor has queued output, does nothing while a
+ * block is in flight as the transfer complete interrupt picks up the rest.
  */
 void usart_enable_send(void)
 {
-	USART_ITConfig(USART1, USART_IT_TXE, ENABLE);
+	if (usart_tx_len == 0)
+		usart_tx_next();
 }
 
 /**
- * Disable USART send interrupt.
+ * Stop sending, the unsent rest stays in the governor output buffer.
  */
 void usart_disable_send(void)
 {
-	USART_ITConfig(USART1, USART_IT_TXE, DISABLE);
+	DMA_Cmd(DMA1_Channel4, DISABLE);
+	if (usart_tx_len != 0) {
+		(void)gpc_pickup_done(usart_tx_len - (s32)
+				      DMA_GetCurrDataCounter(DMA1_Channel4));
+		usart_tx_len = 0;
+	}
 }
 
 /**
- * USART interrupt handler.
+ * Start the DMA on the next contiguous block of governor output if any.
  */
-void usart1_irq_handler(void)
+void usart_tx_next(void)
+{
+	u8 *data;
+	s32 len = gpc_pickup_block(&data);
+
+	usart_tx_len = len;
+	if (len == 0)
+		return;
+
+	DMA_Cmd(DMA1_Channel4, DISABLE);
+	DMA1_Channel4->CMAR = (uintptr_t)data;
+	DMA1_Channel4->CNDTR = (u32)len;
+	DMA_Cmd(DMA1_Channel4, ENABLE);
+}
+
+/**
+ * Hand all bytes received so far to the governor.
+ *
+ * Run from the main loop when @ref usart_rx_trigger is set. If the DMA
+ * lapped the handled position the buffer is dropped and the governor parser
+ * resynchronized instead.
+ */
+void usart_process_rx(void)
 {
+	u32 written = usart_rx_written;
+	u16 end = (u16)(USART_RX_BUF_SIZE -
+			DMA_GetCurrDataCounter(DMA1_Channel5));
+	/* written lags the DMA by less than a buffer as it is read first */
+	u32 received = written + ((end - written) & (USART_RX_BUF_SIZE - 1));
 
-	//LED_GREEN_TOGGLE();
-	/* input (RX) handler */
-	if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) {
-		data_buf = (s16)USART_ReceiveData(USART1);
+	if ((received - usart_rx_count) >= USART_RX_BUF_SIZE) {
+		usart_rx_overruns++;
+		usart_rx_count = received;
+		usart_rx_pos = end;
+		gpc_resync();
+		return;
+	}
 
-		if (gpc_handle_byte((u8)data_buf) != 0) {
-			//LED_GREEN_TOGGLE();
-		} else {
-			//LED_RED_ON();
-		}
+	while (usart_rx_pos != end) {
+		(void)gpc_handle_byte(usart_rx_buf[usart_rx_pos]);
+		usart_rx_pos = (usart_rx_pos + 1) & (USART_RX_BUF_SIZE - 1);
+		usart_rx_count++;
 	}
+}
 
-	/* output (TX) handler */
-	if (USART_GetITStatus(USART1, USART_IT_TXE) != RESET) {
-		if ((data_buf = gpc_pickup_byte()) >= 0) {
-			USART_SendData(USART1,(uint16_t)data_buf);
-			//LED_GREEN_TOGGLE();
-		} else {
-			usart_disable_send();
-		}
+/**
+ * USART interrupt handler, end of a receive burst.
+ */
+void usart1_irq_handler(void)
+{
+	if (USART_GetITStatus(USART1, USART_IT_IDLE) != RESET) {
+		/* Reading the status then the data register clears the flag */
+		(void)USART_ReceiveData(USART1);
+		usart_rx_trigger = true;
 	}
 }
+
+/**
+ * DMA1 channel 4 interrupt handler, transmit block complete.
+ */
+void dma1_channel4_irq_handler(void)
+{
+	DMA_ClearITPendingBit(DMA1_IT_GL4);
+
+	(void)gpc_pickup_done(usart_tx_len);
+	usart_tx_next();
+}
+
+/**
+ * DMA1 channel 5 interrupt handler, receive buffer half or completely
+ * filled.
+ */
+void dma1_channel5_irq_handler(void)
+{
+	DMA_ClearITPendingBit(DMA1_IT_GL5);
+
+	usart_rx_written += USART_RX_BUF_SIZE / 2;
+	usart_rx_trigger = true;
+}
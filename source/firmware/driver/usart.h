@@ -19,9 +19,13 @@
 #ifndef __USART_H
 #define __USART_H
 
+extern volatile bool usart_rx_trigger;
+extern volatile uint32_t usart_rx_overruns;
+
 void usart_init(void);
 /*@unused@*/ void usart_enable_send(void);
 /*@unused@*/ void usart_disable_send(void);
+void usart_process_rx(void);
 
 void usart3_irq_handler(void);
 void clear_buffer(void); //used to send error message
@@ -0,0 +1,409 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   adc.c
+ *
+ * @brief  Host model of the ADC1 and ADC2 regular and injected conversion
+ *         groups.
+ *
+ * A regular sequence is started by the selected external trigger of ADC1
+ * once it is enabled. Each channel takes its sample time plus 12.5 ADC
+ * clock cycles, at the end the channel value provided by the simulation is
+ * latched into the data register and, with DMA enabled, moved by DMA1
+ * channel 1. The next rank follows right away in scan mode.
+ *
+ * In regular simultaneous mode ADC2 converts its own sequence in lockstep
+ * with ADC1 and its result is found in the upper half of the ADC1 data
+ * register. Every conversion can be given gaussian noise.
+ *
+ * The injected sequence of each converter is started by its own external
+ * trigger and runs alongside the regular sequence of the other converter,
+ * its results are latched into the injected data registers. An injected
+ * sequence interrupting a regular one on the same converter is not modelled.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <cmsis/stm32.h>
+#include <stm32/adc.h>
+
+#include "hal.h"
+
+ADC_TypeDef host_adc1;
+ADC_TypeDef host_adc2;
+
+/**
+ * ADC clock [Hz].
+ */
+#define HAL_ADC_CLOCK 12e6
+
+/**
+ * Conversion cycles on top of the sample time.
+ */
+#define HAL_ADC_CONV_CYCLES 12.5
+
+/**
+ * DMA channel serving ADC1.
+ */
+#define HAL_ADC_DMA_CHANNEL 1
+
+#define HAL_ADC_CHANNELS 18
+#define HAL_ADC_RANKS 16
+#define HAL_ADC_INJECTED_RANKS 4
+
+#define ADC_SR_EOC 0x0002
+#define ADC_SR_JEOC 0x0004
+
+/**
+ * State of one converter that is not visible in the register block.
+ */
+struct hal_adc_conv {
+	bool on;				/**< ADON state */
+	bool scan;				/**< Scan mode */
+	bool dma;				/**< DMA requests enabled */
+	bool ext;				/**< External trigger enabled */
+	uint32_t mode;				/**< Dual mode */
+	uint32_t trigger;			/**< External trigger source */
+	uint8_t length;				/**< Regular sequence length */
+	uint8_t rank_channel[HAL_ADC_RANKS];	/**< Channel of each rank */
+	double rank_time[HAL_ADC_RANKS];	/**< Conversion time of each rank [s] */
+	bool jext;				/**< Injected external trigger enabled */
+	uint32_t jtrigger;			/**< Injected external trigger source */
+	uint8_t jlength;			/**< Injected sequence length */
+	uint8_t jrank_channel[HAL_ADC_INJECTED_RANKS]; /**< Channel of each injected rank */
+	double jrank_time[HAL_ADC_INJECTED_RANKS]; /**< Conversion time of each injected rank [s] */
+	uint8_t jrank;				/**< Injected rank being converted */
+	double jremaining;			/**< Remaining injected conversion time, <0 if idle */
+};
+
+/**
+ * ADC model state that is not visible in the register block.
+ */
+struct hal_adc {
+	struct hal_adc_conv conv[2];		/**< ADC1 and ADC2 */
+	uint16_t channel_value[HAL_ADC_CHANNELS]; /**< Analog input values */
+	double channel_noise[HAL_ADC_CHANNELS];	/**< Noise rms [counts] */
+	uint32_t rand;				/**< Noise generator state */
+	bool dual;				/**< ADC2 runs along with ADC1 */
+	uint8_t rank;				/**< Rank being converted */
+	double remaining;			/**< Remaining conversion time, <0 if idle */
+};
+
+static struct hal_adc hal_adc;
+
+/**
+ * Sample time in ADC clock cycles, indexed by ADC_SampleTime_*.
+ */
+static const double hal_adc_sample_cycles[8] = {
+	1.5, 7.5, 13.5, 28.5, 41.5, 55.5, 71.5, 239.5
+};
+
+static struct hal_adc_conv *hal_adc_conv(ADC_TypeDef *adc)
+{
+	return &hal_adc.conv[(adc == ADC2) ? 1 : 0];
+}
+
+/**
+ * Reset the ADC model.
+ */
+void hal_adc_reset(void)
+{
+	int c;
+	int i;
+
+	memset(&host_adc1, 0, sizeof(host_adc1));
+	memset(&host_adc2, 0, sizeof(host_adc2));
+	memset(&hal_adc, 0, sizeof(hal_adc));
+	hal_adc.remaining = -1;
+	hal_adc.rand = 1;
+	for (c = 0; c < 2; c++) {
+		hal_adc.conv[c].length = 1;
+		hal_adc.conv[c].trigger = ADC_ExternalTrigConv_None;
+		for (i = 0; i < HAL_ADC_RANKS; i++)
+			hal_adc.conv[c].rank_time[i] =
+				(hal_adc_sample_cycles[0] +
+				 HAL_ADC_CONV_CYCLES) / HAL_ADC_CLOCK;
+		hal_adc.conv[c].jlength = 1;
+		hal_adc.conv[c].jtrigger = ADC_ExternalTrigInjecConv_None;
+		for (i = 0; i < HAL_ADC_INJECTED_RANKS; i++)
+			hal_adc.conv[c].jrank_time[i] =
+				(hal_adc_sample_cycles[0] +
+				 HAL_ADC_CONV_CYCLES) / HAL_ADC_CLOCK;
+		hal_adc.conv[c].jremaining = -1;
+	}
+}
+
+/**
+ * Set the analog value of one ADC input channel.
+ */
+void hal_adc_set_channel(int channel, uint16_t value)
+{
+	if ((channel >= 0) && (channel < HAL_ADC_CHANNELS))
+		hal_adc.channel_value[channel] = value & 0x0FFF;
+}
+
+/**
+ * Set the rms noise added to every conversion of one ADC input channel.
+ *
+ * @param channel ADC input channel
+ * @param rms Noise rms in ADC counts, 0 for none
+ */
+void hal_adc_set_noise(int channel, double rms)
+{
+	if ((channel >= 0) && (channel < HAL_ADC_CHANNELS))
+		hal_adc.channel_noise[channel] = rms;
+}
+
+/**
+ * Uniform random number in (0, 1).
+ */
+static double hal_adc_rand(void)
+{
+	hal_adc.rand = (hal_adc.rand * 1103515245U) + 12345U;
+	return ((hal_adc.rand >> 8) + 0.5) / 16777216.0;
+}
+
+/**
+ * Convert one channel.
+ */
+static uint16_t hal_adc_convert(uint8_t channel)
+{
+	double value = hal_adc.channel_value[channel];
+
+	if (hal_adc.channel_noise[channel] > 0)
+		value += hal_adc.channel_noise[channel] *
+			sqrt(-2 * log(hal_adc_rand())) *
+			cos(2 * M_PI * hal_adc_rand());
+
+	value = floor(value + 0.5);
+	if (value < 0)
+		return 0;
+	if (value > 0x0FFF)
+		return 0x0FFF;
+	return (uint16_t)value;
+}
+
+/**
+ * Start the regular sequence if the external trigger is set to source and
+ * no conversion is running.
+ */
+void hal_adc_trigger(uint32_t source)
+{
+	struct hal_adc_conv *conv = &hal_adc.conv[0];
+
+	if (!conv->on || !conv->ext || (conv->trigger != source) ||
+	    (hal_adc.remaining >= 0))
+		return;
+
+	hal_adc.dual = (conv->mode == ADC_Mode_RegSimult) &&
+		(hal_adc.conv[1].mode == ADC_Mode_RegSimult) &&
+		hal_adc.conv[1].on;
+	hal_adc.rank = 0;
+	hal_adc.remaining = conv->rank_time[0];
+}
+
+/**
+ * Start the injected sequences whose external trigger is set to source and
+ * that are not running.
+ */
+void hal_adc_trigger_injected(uint32_t source)
+{
+	struct hal_adc_conv *conv;
+	int c;
+
+	for (c = 0; c < 2; c++) {
+		conv = &hal_adc.conv[c];
+		if (!conv->on || !conv->jext || (conv->jtrigger != source) ||
+		    (conv->jremaining >= 0))
+			continue;
+
+		conv->jrank = 0;
+		conv->jremaining = conv->jrank_time[0];
+	}
+}
+
+/**
+ * Advance a running injected sequence.
+ */
+static void hal_adc_advance_injected(ADC_TypeDef *adc,
+				     struct hal_adc_conv *conv, double dt)
+{
+	if (conv->jremaining < 0)
+		return;
+
+	conv->jremaining -= dt;
+	while (conv->jremaining <= 0) {
+		adc->JDR[conv->jrank] =
+			hal_adc_convert(conv->jrank_channel[conv->jrank]);
+
+		conv->jrank++;
+		if (conv->jrank >= conv->jlength) {
+			adc->SR |= ADC_SR_JEOC;
+			conv->jremaining = -1;
+			return;
+		}
+		conv->jremaining += conv->jrank_time[conv->jrank];
+	}
+}
+
+/**
+ * Advance the running conversions.
+ */
+void hal_adc_advance(double dt)
+{
+	struct hal_adc_conv *conv = &hal_adc.conv[0];
+	uint16_t value;
+
+	hal_adc_advance_injected(&host_adc1, &hal_adc.conv[0], dt);
+	hal_adc_advance_injected(&host_adc2, &hal_adc.conv[1], dt);
+
+	if (hal_adc.remaining < 0)
+		return;
+
+	hal_adc.remaining -= dt;
+	while (hal_adc.remaining <= 0) {
+		host_adc1.DR = hal_adc_convert(conv->rank_channel[hal_adc.rank]);
+		host_adc1.SR |= ADC_SR_EOC;
+		if (hal_adc.dual) {
+			value = hal_adc_convert(
+				hal_adc.conv[1].rank_channel[hal_adc.rank]);
+			host_adc2.DR = value;
+			host_adc2.SR |= ADC_SR_EOC;
+			host_adc1.DR |= (uint32_t)value << 16;
+		}
+		if (conv->dma)
+			hal_dma_request(HAL_ADC_DMA_CHANNEL);
+
+		hal_adc.rank++;
+		if (!conv->scan || (hal_adc.rank >= conv->length)) {
+			hal_adc.remaining = -1;
+			return;
+		}
+		hal_adc.remaining += conv->rank_time[hal_adc.rank];
+	}
+}
+
+void ADC_Init(ADC_TypeDef *adc, ADC_InitTypeDef *init)
+{
+	struct hal_adc_conv *conv = hal_adc_conv(adc);
+
+	conv->mode = init->ADC_Mode;
+	conv->scan = (init->ADC_ScanConvMode == ENABLE);
+	conv->trigger = init->ADC_ExternalTrigConv;
+	if ((init->ADC_NbrOfChannel >= 1) &&
+	    (init->ADC_NbrOfChannel <= HAL_ADC_RANKS))
+		conv->length = init->ADC_NbrOfChannel;
+}
+
+void ADC_RegularChannelConfig(ADC_TypeDef *adc, uint8_t channel, uint8_t rank,
+			      uint8_t sample_time)
+{
+	struct hal_adc_conv *conv = hal_adc_conv(adc);
+
+	if ((rank >= 1) && (rank <= HAL_ADC_RANKS) &&
+	    (channel < HAL_ADC_CHANNELS)) {
+		conv->rank_channel[rank - 1] = channel;
+		conv->rank_time[rank - 1] =
+			(hal_adc_sample_cycles[sample_time & 7] +
+			 HAL_ADC_CONV_CYCLES) / HAL_ADC_CLOCK;
+	}
+}
+
+void ADC_ExternalTrigConvCmd(ADC_TypeDef *adc, FunctionalState state)
+{
+	hal_adc_conv(adc)->ext = (state == ENABLE);
+}
+
+void ADC_InjectedSequencerLengthConfig(ADC_TypeDef *adc, uint8_t length)
+{
+	if ((length >= 1) && (length <= HAL_ADC_INJECTED_RANKS))
+		hal_adc_conv(adc)->jlength = length;
+}
+
+void ADC_InjectedChannelConfig(ADC_TypeDef *adc, uint8_t channel,
+			       uint8_t rank, uint8_t sample_time)
+{
+	struct hal_adc_conv *conv = hal_adc_conv(adc);
+
+	if ((rank >= 1) && (rank <= HAL_ADC_INJECTED_RANKS) &&
+	    (channel < HAL_ADC_CHANNELS)) {
+		conv->jrank_channel[rank - 1] = channel;
+		conv->jrank_time[rank - 1] =
+			(hal_adc_sample_cycles[sample_time & 7] +
+			 HAL_ADC_CONV_CYCLES) / HAL_ADC_CLOCK;
+	}
+}
+
+void ADC_ExternalTrigInjectedConvConfig(ADC_TypeDef *adc, uint32_t trigger)
+{
+	hal_adc_conv(adc)->jtrigger = trigger;
+}
+
+void ADC_ExternalTrigInjectedConvCmd(ADC_TypeDef *adc, FunctionalState state)
+{
+	hal_adc_conv(adc)->jext = (state == ENABLE);
+}
+
+uint16_t ADC_GetInjectedConversionValue(ADC_TypeDef *adc, uint8_t channel)
+{
+	return (uint16_t)adc->JDR[((channel - ADC_InjectedChannel_1) / 4) & 3];
+}
+
+FlagStatus ADC_GetFlagStatus(ADC_TypeDef *adc, uint8_t flag)
+{
+	return ((adc->SR & flag) != 0) ? SET : RESET;
+}
+
+void ADC_ClearFlag(ADC_TypeDef *adc, uint8_t flag)
+{
+	adc->SR &= ~(uint32_t)flag;
+}
+
+void ADC_DMACmd(ADC_TypeDef *adc, FunctionalState state)
+{
+	hal_adc_conv(adc)->dma = (state == ENABLE);
+}
+
+void ADC_Cmd(ADC_TypeDef *adc, FunctionalState state)
+{
+	hal_adc_conv(adc)->on = (state == ENABLE);
+}
+
+void ADC_ResetCalibration(ADC_TypeDef *adc)
+{
+	(void)adc;
+}
+
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef *adc)
+{
+	(void)adc;
+	return RESET;
+}
+
+void ADC_StartCalibration(ADC_TypeDef *adc)
+{
+	(void)adc;
+}
+
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef *adc)
+{
+	(void)adc;
+	return RESET;
+}
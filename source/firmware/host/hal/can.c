@@ -0,0 +1,551 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   can.c
+ *
+ * @brief  Host model of the bxCAN CAN1 cell and the bus it is attached to.
+ *
+ * Frames of other nodes handed to @ref hal_can_rx() and frames the firmware
+ * queues in the transmit mailboxes share one bus at the configured bit
+ * rate. Whenever the bus is idle the pending frame with the lowest
+ * identifier wins the arbitration, the mailboxes are served in request
+ * order with transmit FIFO priority and by identifier otherwise.
+ *
+ * Received frames pass the active filter banks assigned to FIFO 0 into the
+ * three message deep receive FIFO 0, FIFO 1 is not modelled. Transmitted
+ * frames are collected in a buffer the simulation can read.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/can.h>
+
+#include "hal.h"
+
+CAN_TypeDef host_can1;
+
+struct hal_can_stats hal_can_stats;
+
+#define CAN_MCR_INRQ 0x00000001
+#define CAN_MCR_TXFP 0x00000004
+#define CAN_TSR_RQCP0 0x00000001
+#define CAN_TSR_TXOK0 0x00000002
+#define CAN_TSR_TME0 0x04000000
+#define CAN_RF0R_FMP0 0x00000003
+#define CAN_RF0R_FULL0 0x00000008
+#define CAN_RF0R_FOVR0 0x00000010
+#define CAN_IER_TMEIE 0x00000001
+#define CAN_IER_FMPIE0 0x00000002
+#define CAN_TIR_TXRQ 0x00000001
+#define CAN_TIR_RTR 0x00000002
+#define CAN_TIR_IDE 0x00000004
+
+/**
+ * Bits in the mailbox status of mailbox N.
+ */
+#define CAN_TSR_RQCP(N) (CAN_TSR_RQCP0 << ((N) * 8))
+#define CAN_TSR_TXOK(N) (CAN_TSR_TXOK0 << ((N) * 8))
+#define CAN_TSR_TME(N) (CAN_TSR_TME0 << (N))
+
+#define HAL_CAN_MAILBOXES 3
+#define HAL_CAN_FIFO_DEPTH 3
+#define HAL_CAN_FILTER_BANKS 14
+#define HAL_CAN_QUEUE_SIZE 1024
+
+/**
+ * Frame queue.
+ */
+struct hal_can_queue {
+	struct hal_can_frame frame[HAL_CAN_QUEUE_SIZE];	/**< Queue storage */
+	uint32_t head;					/**< Write index */
+	uint32_t tail;					/**< Read index */
+};
+
+/**
+ * CAN model state that is not visible in the register block.
+ */
+struct hal_can {
+	double bit_time;		/**< Time needed for one bit */
+	double busy;			/**< Remaining time of the frame on the bus */
+	int tx_mailbox;			/**< Mailbox on the bus, -1 other node */
+	struct hal_can_frame bus_frame;	/**< Frame on the bus */
+	uint32_t seq;			/**< Transmit request counter */
+	uint32_t tx_seq[HAL_CAN_MAILBOXES]; /**< Request order of the mailboxes */
+	struct hal_can_frame fifo[HAL_CAN_FIFO_DEPTH]; /**< Receive FIFO 0 */
+	int fifo_count;			/**< Messages in receive FIFO 0 */
+	struct hal_can_queue tx;	/**< Transmitted frames */
+	struct hal_can_queue rx;	/**< Frames of other nodes */
+};
+
+static struct hal_can hal_can;
+
+static bool hal_can_queue_put(struct hal_can_queue *q,
+			      const struct hal_can_frame *frame)
+{
+	uint32_t next = (q->head + 1) % HAL_CAN_QUEUE_SIZE;
+
+	if (next == q->tail)
+		return false;
+
+	q->frame[q->head] = *frame;
+	q->head = next;
+
+	return true;
+}
+
+static bool hal_can_queue_get(struct hal_can_queue *q,
+			      struct hal_can_frame *frame)
+{
+	if (q->head == q->tail)
+		return false;
+
+	if (frame != NULL)
+		*frame = q->frame[q->tail];
+	q->tail = (q->tail + 1) % HAL_CAN_QUEUE_SIZE;
+
+	return true;
+}
+
+/**
+ * Identifier in the bit layout of the mailbox identifier registers.
+ */
+static uint32_t hal_can_ir(const struct hal_can_frame *frame)
+{
+	if (frame->ext)
+		return (frame->id << 3) | CAN_TIR_IDE;
+
+	return frame->id << 21;
+}
+
+/**
+ * Identifier in the bit layout of a 16bit filter.
+ */
+static uint16_t hal_can_filter16(const struct hal_can_frame *frame)
+{
+	if (frame->ext)
+		return (uint16_t)(((frame->id >> 18) << 5) | 0x0008 |
+				  ((frame->id >> 15) & 0x0007));
+
+	return (uint16_t)(frame->id << 5);
+}
+
+/**
+ * Check if any active FIFO 0 filter bank passes a frame.
+ */
+static bool hal_can_filter(const struct hal_can_frame *frame)
+{
+	uint32_t id32 = hal_can_ir(frame);
+	uint16_t id16 = hal_can_filter16(frame);
+	uint32_t fr1, fr2, bit;
+	int bank;
+
+	for (bank = 0; bank < HAL_CAN_FILTER_BANKS; bank++) {
+		bit = 1u << bank;
+		if (((host_can1.FA1R & bit) == 0) ||
+		    ((host_can1.FFA1R & bit) != 0))
+			continue;
+
+		fr1 = host_can1.sFilterRegister[bank].FR1;
+		fr2 = host_can1.sFilterRegister[bank].FR2;
+
+		if ((host_can1.FS1R & bit) != 0) {
+			if ((host_can1.FM1R & bit) != 0) {
+				if ((id32 == fr1) || (id32 == fr2))
+					return true;
+			} else if (((id32 ^ fr1) & fr2) == 0) {
+				return true;
+			}
+		} else if ((host_can1.FM1R & bit) != 0) {
+			if ((id16 == (fr1 & 0xFFFF)) || (id16 == (fr1 >> 16)) ||
+			    (id16 == (fr2 & 0xFFFF)) || (id16 == (fr2 >> 16)))
+				return true;
+		} else if ((((id16 ^ fr1) & (fr1 >> 16) & 0xFFFF) == 0) ||
+			   (((id16 ^ fr2) & (fr2 >> 16) & 0xFFFF) == 0)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Show the oldest message of receive FIFO 0 in the output mailbox.
+ */
+static void hal_can_fifo_update(void)
+{
+	CAN_FIFOMailBox_TypeDef *mb = &host_can1.sFIFOMailBox[0];
+	const struct hal_can_frame *frame = &hal_can.fifo[0];
+
+	host_can1.RF0R = (host_can1.RF0R & ~(CAN_RF0R_FMP0 | CAN_RF0R_FULL0)) |
+		(uint32_t)hal_can.fifo_count;
+	if (hal_can.fifo_count == HAL_CAN_FIFO_DEPTH)
+		host_can1.RF0R |= CAN_RF0R_FULL0;
+
+	if (hal_can.fifo_count == 0)
+		return;
+
+	mb->RIR = hal_can_ir(frame);
+	mb->RDTR = frame->len;
+	mb->RDLR = (uint32_t)frame->data[0] | ((uint32_t)frame->data[1] << 8) |
+		((uint32_t)frame->data[2] << 16) |
+		((uint32_t)frame->data[3] << 24);
+	mb->RDHR = (uint32_t)frame->data[4] | ((uint32_t)frame->data[5] << 8) |
+		((uint32_t)frame->data[6] << 16) |
+		((uint32_t)frame->data[7] << 24);
+}
+
+/**
+ * Frame in a transmit mailbox.
+ */
+static void hal_can_mailbox_frame(int n, struct hal_can_frame *frame)
+{
+	CAN_TxMailBox_TypeDef *mb = &host_can1.sTxMailBox[n];
+	int i;
+
+	frame->ext = (mb->TIR & CAN_TIR_IDE) != 0;
+	frame->id = frame->ext ? (mb->TIR >> 3) : (mb->TIR >> 21);
+	frame->len = (uint8_t)(mb->TDTR & 0x0F);
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = (uint8_t)(mb->TDLR >> (i * 8));
+		frame->data[i + 4] = (uint8_t)(mb->TDHR >> (i * 8));
+	}
+}
+
+/**
+ * Pending transmit mailbox that wins the internal priority, -1 if none.
+ */
+static int hal_can_next_mailbox(void)
+{
+	struct hal_can_frame a, b;
+	int best = -1;
+	int n;
+
+	for (n = 0; n < HAL_CAN_MAILBOXES; n++) {
+		if ((host_can1.sTxMailBox[n].TIR & CAN_TIR_TXRQ) == 0)
+			continue;
+
+		if (best < 0) {
+			best = n;
+		} else if ((host_can1.MCR & CAN_MCR_TXFP) != 0) {
+			if (hal_can.tx_seq[n] < hal_can.tx_seq[best])
+				best = n;
+		} else {
+			hal_can_mailbox_frame(n, &a);
+			hal_can_mailbox_frame(best, &b);
+			if (hal_can_ir(&a) < hal_can_ir(&b))
+				best = n;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Duration of a frame on the bus including the interframe space, without
+ * stuff bits.
+ */
+static double hal_can_frame_time(const struct hal_can_frame *frame)
+{
+	return ((frame->ext ? 67 : 47) + (8 * frame->len)) * hal_can.bit_time;
+}
+
+/**
+ * Finish the frame on the bus.
+ */
+static void hal_can_complete(void)
+{
+	CAN_TxMailBox_TypeDef *mb;
+	int n = hal_can.tx_mailbox;
+
+	if (n >= 0) {
+		mb = &host_can1.sTxMailBox[n];
+		mb->TIR &= ~CAN_TIR_TXRQ;
+		host_can1.TSR |= CAN_TSR_RQCP(n) | CAN_TSR_TXOK(n) |
+			CAN_TSR_TME(n);
+		(void)hal_can_queue_put(&hal_can.tx, &hal_can.bus_frame);
+		hal_can_stats.tx_frames++;
+		return;
+	}
+
+	if (!hal_can_filter(&hal_can.bus_frame)) {
+		hal_can_stats.rx_rejected++;
+		return;
+	}
+
+	if (hal_can.fifo_count == HAL_CAN_FIFO_DEPTH) {
+		host_can1.RF0R |= CAN_RF0R_FOVR0;
+		hal_can_stats.rx_overruns++;
+		return;
+	}
+
+	hal_can.fifo[hal_can.fifo_count++] = hal_can.bus_frame;
+	hal_can_stats.rx_frames++;
+	hal_can_fifo_update();
+}
+
+/**
+ * Reset the CAN model.
+ */
+void hal_can_reset(void)
+{
+	memset(&hal_can, 0, sizeof(hal_can));
+	memset(&hal_can_stats, 0, sizeof(hal_can_stats));
+	CAN_DeInit(&host_can1);
+}
+
+/**
+ * Advance the bus.
+ */
+void hal_can_advance(double dt)
+{
+	struct hal_can_frame own;
+	struct hal_can_frame *other;
+	int n;
+
+	if (hal_can.busy > 0) {
+		hal_can.busy -= dt;
+		if (hal_can.busy > 0)
+			return;
+		hal_can_complete();
+	}
+
+	if ((host_can1.MCR & CAN_MCR_INRQ) != 0)
+		return;
+
+	/* Arbitration between our best mailbox and the other nodes */
+	n = hal_can_next_mailbox();
+	other = (hal_can.rx.head != hal_can.rx.tail) ?
+		&hal_can.rx.frame[hal_can.rx.tail] : NULL;
+
+	if (n >= 0) {
+		hal_can_mailbox_frame(n, &own);
+		if ((other == NULL) || (hal_can_ir(&own) < hal_can_ir(other))) {
+			hal_can.tx_mailbox = n;
+			hal_can.bus_frame = own;
+			hal_can.busy = hal_can_frame_time(&own);
+			return;
+		}
+	}
+
+	if (other != NULL) {
+		hal_can.tx_mailbox = -1;
+		(void)hal_can_queue_get(&hal_can.rx, &hal_can.bus_frame);
+		hal_can.busy = hal_can_frame_time(&hal_can.bus_frame);
+	}
+}
+
+/**
+ * Check if a CAN interrupt is pending.
+ */
+bool hal_can_pending(enum hal_irq irq)
+{
+	switch (irq) {
+	case hal_irq_usb_hp_can_tx:
+		return ((host_can1.IER & CAN_IER_TMEIE) != 0) &&
+			((host_can1.TSR & (CAN_TSR_RQCP(0) | CAN_TSR_RQCP(1) |
+					   CAN_TSR_RQCP(2))) != 0);
+	case hal_irq_usb_lp_can_rx0:
+		return ((host_can1.IER & CAN_IER_FMPIE0) != 0) &&
+			((host_can1.RF0R & CAN_RF0R_FMP0) != 0);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Queue a frame sent by another node on the bus.
+ *
+ * @return 0 on success, -1 if the queue is full
+ */
+int hal_can_rx(const struct hal_can_frame *frame)
+{
+	return hal_can_queue_put(&hal_can.rx, frame) ? 0 : -1;
+}
+
+/**
+ * Get the next frame transmitted by the firmware.
+ *
+ * @return 0 on success, -1 if none available
+ */
+int hal_can_tx_pop(struct hal_can_frame *frame)
+{
+	return hal_can_queue_get(&hal_can.tx, frame) ? 0 : -1;
+}
+
+void CAN_DeInit(CAN_TypeDef *can)
+{
+	memset(can, 0, sizeof(*can));
+	can->MCR = CAN_MCR_INRQ;
+	can->TSR = CAN_TSR_TME(0) | CAN_TSR_TME(1) | CAN_TSR_TME(2);
+	hal_can.fifo_count = 0;
+	hal_can.bit_time = 1e-6;
+}
+
+uint8_t CAN_Init(CAN_TypeDef *can, CAN_InitTypeDef *init)
+{
+	uint32_t tq = 1 + (init->CAN_BS1 + 1) + (init->CAN_BS2 + 1);
+
+	can->MCR = 0;
+	if (init->CAN_TXFP == ENABLE)
+		can->MCR |= CAN_MCR_TXFP;
+	can->BTR = ((uint32_t)init->CAN_SJW << 24) |
+		((uint32_t)init->CAN_BS2 << 20) |
+		((uint32_t)init->CAN_BS1 << 16) |
+		(uint32_t)(init->CAN_Prescaler - 1);
+
+	/* CAN1 runs from the APB1 clock, half the core clock */
+	hal_can.bit_time = (init->CAN_Prescaler * tq) / (HAL_CORE_CLOCK / 2);
+
+	return 1;
+}
+
+void CAN_StructInit(CAN_InitTypeDef *init)
+{
+	memset(init, 0, sizeof(*init));
+	init->CAN_Mode = CAN_Mode_Normal;
+	init->CAN_SJW = CAN_SJW_1tq;
+	init->CAN_BS1 = CAN_BS1_4tq;
+	init->CAN_BS2 = CAN_BS2_3tq;
+	init->CAN_Prescaler = 1;
+}
+
+void CAN_FilterInit(CAN_FilterInitTypeDef *init)
+{
+	CAN_FilterRegister_TypeDef *fr =
+		&host_can1.sFilterRegister[init->CAN_FilterNumber];
+	uint32_t bit = 1u << init->CAN_FilterNumber;
+
+	host_can1.FA1R &= ~bit;
+
+	if (init->CAN_FilterScale == CAN_FilterScale_16bit) {
+		host_can1.FS1R &= ~bit;
+		fr->FR1 = ((uint32_t)init->CAN_FilterMaskIdLow << 16) |
+			init->CAN_FilterIdLow;
+		fr->FR2 = ((uint32_t)init->CAN_FilterMaskIdHigh << 16) |
+			init->CAN_FilterIdHigh;
+	} else {
+		host_can1.FS1R |= bit;
+		fr->FR1 = ((uint32_t)init->CAN_FilterIdHigh << 16) |
+			init->CAN_FilterIdLow;
+		fr->FR2 = ((uint32_t)init->CAN_FilterMaskIdHigh << 16) |
+			init->CAN_FilterMaskIdLow;
+	}
+
+	if (init->CAN_FilterMode == CAN_FilterMode_IdList)
+		host_can1.FM1R |= bit;
+	else
+		host_can1.FM1R &= ~bit;
+
+	if (init->CAN_FilterFIFOAssignment == CAN_FIFO1)
+		host_can1.FFA1R |= bit;
+	else
+		host_can1.FFA1R &= ~bit;
+
+	if (init->CAN_FilterActivation == ENABLE)
+		host_can1.FA1R |= bit;
+}
+
+void CAN_ITConfig(CAN_TypeDef *can, uint32_t it, FunctionalState state)
+{
+	uint32_t bits = 0;
+
+	if ((it & CAN_IT_TME) != 0)
+		bits |= CAN_IER_TMEIE;
+	if ((it & CAN_IT_FMP0) != 0)
+		bits |= CAN_IER_FMPIE0;
+
+	if (state == ENABLE)
+		can->IER |= bits;
+	else
+		can->IER &= ~bits;
+
+	hal_irq_service();
+}
+
+uint8_t CAN_Transmit(CAN_TypeDef *can, CanTxMsg *msg)
+{
+	CAN_TxMailBox_TypeDef *mb;
+	uint8_t n;
+
+	for (n = 0; n < HAL_CAN_MAILBOXES; n++)
+		if ((can->TSR & CAN_TSR_TME(n)) != 0)
+			break;
+
+	if (n == HAL_CAN_MAILBOXES)
+		return CAN_NO_MB;
+
+	mb = &can->sTxMailBox[n];
+	if (msg->IDE == CAN_ID_EXT)
+		mb->TIR = (msg->ExtId << 3) | CAN_TIR_IDE;
+	else
+		mb->TIR = msg->StdId << 21;
+	mb->TIR |= msg->RTR;
+	mb->TDTR = msg->DLC & 0x0F;
+	mb->TDLR = (uint32_t)msg->Data[0] | ((uint32_t)msg->Data[1] << 8) |
+		((uint32_t)msg->Data[2] << 16) | ((uint32_t)msg->Data[3] << 24);
+	mb->TDHR = (uint32_t)msg->Data[4] | ((uint32_t)msg->Data[5] << 8) |
+		((uint32_t)msg->Data[6] << 16) | ((uint32_t)msg->Data[7] << 24);
+
+	can->TSR &= ~CAN_TSR_TME(n);
+	hal_can.tx_seq[n] = hal_can.seq++;
+	mb->TIR |= CAN_TIR_TXRQ;
+
+	return n;
+}
+
+uint8_t CAN_MessagePending(CAN_TypeDef *can, uint8_t fifo)
+{
+	if (fifo != CAN_FIFO0)
+		return 0;
+
+	return (uint8_t)(can->RF0R & CAN_RF0R_FMP0);
+}
+
+void CAN_Receive(CAN_TypeDef *can, uint8_t fifo, CanRxMsg *msg)
+{
+	CAN_FIFOMailBox_TypeDef *mb = &can->sFIFOMailBox[fifo];
+	int i;
+
+	msg->IDE = (uint8_t)(mb->RIR & CAN_TIR_IDE);
+	if (msg->IDE == CAN_ID_EXT)
+		msg->ExtId = mb->RIR >> 3;
+	else
+		msg->StdId = mb->RIR >> 21;
+	msg->RTR = (uint8_t)(mb->RIR & CAN_TIR_RTR);
+	msg->DLC = (uint8_t)(mb->RDTR & 0x0F);
+	msg->FMI = (uint8_t)(mb->RDTR >> 8);
+	for (i = 0; i < 4; i++) {
+		msg->Data[i] = (uint8_t)(mb->RDLR >> (i * 8));
+		msg->Data[i + 4] = (uint8_t)(mb->RDHR >> (i * 8));
+	}
+
+	/* Release the output mailbox */
+	if ((fifo == CAN_FIFO0) && (hal_can.fifo_count > 0)) {
+		hal_can.fifo_count--;
+		memmove(&hal_can.fifo[0], &hal_can.fifo[1],
+			hal_can.fifo_count * sizeof(hal_can.fifo[0]));
+		hal_can_fifo_update();
+	}
+}
+
+void CAN_ClearITPendingBit(CAN_TypeDef *can, uint32_t it)
+{
+	if (it == CAN_IT_TME)
+		can->TSR &= ~(CAN_TSR_RQCP(0) | CAN_TSR_RQCP(1) |
+			      CAN_TSR_RQCP(2));
+}
@@ -0,0 +1,349 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   core.c
+ *
+ * @brief  Host model of the Cortex-M3 core peripherals.
+ *
+ * Interrupt handlers are called synchronously from @ref hal_irq_service()
+ * which is run by the simulation after every time step and after every
+ * software generated event outside of interrupt context. Handlers do not
+ * nest, pending sources are served in the order of enum hal_irq and their
+ * host execution time is recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <cmsis/stm32.h>
+#include <stm32/rcc.h>
+#include <stm32/misc.h>
+
+#include "hal.h"
+
+/* Firmware interrupt handlers */
+void tim1_trg_com_irq_handler(void);
+void tim1_up_irq_handler(void);
+void tim1_cc_irq_handler(void);
+void tim2_irq_handler(void);
+void exti15_10_irq_handler(void);
+void dma1_channel1_irq_handler(void);
+void dma1_channel4_irq_handler(void);
+void dma1_channel5_irq_handler(void);
+void i2c1_ev_irq_handler(void);
+void i2c1_er_irq_handler(void);
+void usart1_irq_handler(void);
+void usb_hp_can_tx_irq_handler(void);
+void usb_lp_can_rx0_irq_handler(void);
+void sys_tick_handler(void);
+
+/**
+ * Upper bound of handler invocations in one service run, protects against
+ * handlers that do not clear their interrupt source.
+ */
+#define HAL_IRQ_SERVICE_LIMIT 1000
+
+struct hal_irq_stats hal_irq_stats[hal_irq_num];
+
+const char *hal_irq_names[hal_irq_num] = {
+	"tim1_trg_com",
+	"tim1_up",
+	"tim2",
+	"exti15_10",
+	"tim1_cc",
+	"dma1_channel1",
+	"dma1_channel4",
+	"dma1_channel5",
+	"i2c1_ev",
+	"i2c1_er",
+	"usart1",
+	"usb_hp_can_tx",
+	"usb_lp_can_rx0",
+	"sys_tick"
+};
+
+/**
+ * Internal state of the core model.
+ */
+struct hal_core {
+	bool enabled[hal_irq_num];	/**< NVIC enable state */
+	bool in_isr;			/**< Currently running a handler */
+	uint32_t primask;		/**< Interrupt mask */
+	double sys_tick_period;		/**< SysTick period in seconds, 0 if off */
+	double sys_tick_time;		/**< Time since the last SysTick */
+	uint32_t sys_tick_pending;	/**< Pending SysTick exceptions */
+};
+
+static struct hal_core hal_core;
+
+static void (*const hal_irq_handlers[hal_irq_num])(void) = {
+	tim1_trg_com_irq_handler,
+	tim1_up_irq_handler,
+	tim2_irq_handler,
+	exti15_10_irq_handler,
+	tim1_cc_irq_handler,
+	dma1_channel1_irq_handler,
+	dma1_channel4_irq_handler,
+	dma1_channel5_irq_handler,
+	i2c1_ev_irq_handler,
+	i2c1_er_irq_handler,
+	usart1_irq_handler,
+	usb_hp_can_tx_irq_handler,
+	usb_lp_can_rx0_irq_handler,
+	sys_tick_handler
+};
+
+/**
+ * Reset all peripheral models.
+ */
+void hal_reset(void)
+{
+	memset(&hal_core, 0, sizeof(hal_core));
+	memset(hal_irq_stats, 0, sizeof(hal_irq_stats));
+
+	hal_tim_reset();
+	hal_gpio_reset();
+	hal_adc_reset();
+	hal_dma_reset();
+	hal_usart_reset();
+	hal_can_reset();
+	hal_i2c_reset();
+}
+
+/**
+ * Enable or disable an interrupt channel by its STM32 IRQ number.
+ */
+void hal_irq_enable(int irqn, bool enable)
+{
+	switch (irqn) {
+	case TIM1_TRG_COM_IRQn:
+		hal_core.enabled[hal_irq_tim1_trg_com] = enable;
+		break;
+	case TIM1_UP_IRQn:
+		hal_core.enabled[hal_irq_tim1_up] = enable;
+		break;
+	case TIM1_CC_IRQn:
+		hal_core.enabled[hal_irq_tim1_cc] = enable;
+		break;
+	case TIM2_IRQn:
+		hal_core.enabled[hal_irq_tim2] = enable;
+		break;
+	case EXTI15_10_IRQn:
+		hal_core.enabled[hal_irq_exti15_10] = enable;
+		break;
+	case DMA1_Channel1_IRQn:
+		hal_core.enabled[hal_irq_dma1_channel1] = enable;
+		break;
+	case DMA1_Channel4_IRQn:
+		hal_core.enabled[hal_irq_dma1_channel4] = enable;
+		break;
+	case DMA1_Channel5_IRQn:
+		hal_core.enabled[hal_irq_dma1_channel5] = enable;
+		break;
+	case I2C1_EV_IRQn:
+		hal_core.enabled[hal_irq_i2c1_ev] = enable;
+		break;
+	case I2C1_ER_IRQn:
+		hal_core.enabled[hal_irq_i2c1_er] = enable;
+		break;
+	case USART1_IRQn:
+		hal_core.enabled[hal_irq_usart1] = enable;
+		break;
+	case USB_HP_CAN1_TX_IRQn:
+		hal_core.enabled[hal_irq_usb_hp_can_tx] = enable;
+		break;
+	case USB_LP_CAN1_RX0_IRQn:
+		hal_core.enabled[hal_irq_usb_lp_can_rx0] = enable;
+		break;
+	default:
+		break;
+	}
+}
+
+static bool hal_irq_pending(enum hal_irq irq)
+{
+	switch (irq) {
+	case hal_irq_tim1_trg_com:
+	case hal_irq_tim1_up:
+	case hal_irq_tim1_cc:
+	case hal_irq_tim2:
+		return hal_tim_pending(irq);
+	case hal_irq_exti15_10:
+		return hal_exti_pending();
+	case hal_irq_dma1_channel1:
+		return hal_dma_pending(1);
+	case hal_irq_dma1_channel4:
+		return hal_dma_pending(4);
+	case hal_irq_dma1_channel5:
+		return hal_dma_pending(5);
+	case hal_irq_i2c1_ev:
+	case hal_irq_i2c1_er:
+		return hal_i2c_pending(irq);
+	case hal_irq_usart1:
+		return hal_usart_pending();
+	case hal_irq_usb_hp_can_tx:
+	case hal_irq_usb_lp_can_rx0:
+		return hal_can_pending(irq);
+	case hal_irq_sys_tick:
+		return hal_core.sys_tick_pending != 0;
+	default:
+		return false;
+	}
+}
+
+static uint64_t hal_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void hal_irq_call(enum hal_irq irq)
+{
+	uint64_t start;
+	uint64_t ns;
+
+	if (irq == hal_irq_sys_tick)
+		hal_core.sys_tick_pending--;
+
+	hal_core.in_isr = true;
+	start = hal_ns();
+	hal_irq_handlers[irq]();
+	ns = hal_ns() - start;
+	hal_core.in_isr = false;
+
+	hal_irq_stats[irq].count++;
+	hal_irq_stats[irq].ns_total += ns;
+	if (ns > hal_irq_stats[irq].ns_max)
+		hal_irq_stats[irq].ns_max = ns;
+}
+
+/**
+ * Check if the code runs from an interrupt handler.
+ *
+ * @return true while a handler called by hal_irq_service() runs
+ */
+bool hal_in_isr(void)
+{
+	return hal_core.in_isr;
+}
+
+/**
+ * Run all pending and enabled interrupt handlers.
+ */
+void hal_irq_service(void)
+{
+	int calls = 0;
+	int irq;
+
+	if (hal_core.in_isr || (hal_core.primask != 0))
+		return;
+
+	irq = 0;
+	while (irq < hal_irq_num) {
+		if ((hal_core.enabled[irq] || (irq == hal_irq_sys_tick)) &&
+		    hal_irq_pending((enum hal_irq)irq)) {
+			if (++calls > HAL_IRQ_SERVICE_LIMIT) {
+				fprintf(stderr, "hal: interrupt %s is not "
+					"cleared by its handler\n",
+					hal_irq_names[irq]);
+				exit(2);
+			}
+			hal_irq_call((enum hal_irq)irq);
+			irq = 0;
+		} else {
+			irq++;
+		}
+	}
+}
+
+/**
+ * Advance the SysTick timer.
+ */
+void hal_sys_tick_advance(double dt)
+{
+	if (hal_core.sys_tick_period <= 0)
+		return;
+
+	hal_core.sys_tick_time += dt;
+	while (hal_core.sys_tick_time >= hal_core.sys_tick_period) {
+		hal_core.sys_tick_time -= hal_core.sys_tick_period;
+		hal_core.sys_tick_pending++;
+	}
+}
+
+uint32_t SysTick_Config(uint32_t ticks)
+{
+	hal_core.sys_tick_period = ticks / HAL_CORE_CLOCK;
+	hal_core.sys_tick_time = 0;
+
+	return 0;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return hal_core.primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+	hal_core.primask = primask;
+}
+
+void __disable_irq(void)
+{
+	hal_core.primask = 1;
+}
+
+void __enable_irq(void)
+{
+	hal_core.primask = 0;
+}
+
+void NVIC_PriorityGroupConfig(uint32_t group)
+{
+	(void)group;
+}
+
+void NVIC_Init(NVIC_InitTypeDef *nvic)
+{
+	hal_irq_enable(nvic->NVIC_IRQChannel,
+		       nvic->NVIC_IRQChannelCmd == ENABLE);
+}
+
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state)
+{
+	(void)periph;
+	(void)state;
+}
+
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state)
+{
+	(void)periph;
+	(void)state;
+}
+
+void RCC_AHBPeriphClockCmd(uint32_t periph, FunctionalState state)
+{
+	(void)periph;
+	(void)state;
+}
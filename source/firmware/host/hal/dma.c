@@ -0,0 +1,267 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   dma.c
+ *
+ * @brief  Host model of the DMA1 controller.
+ *
+ * Peripheral models request one transfer of a channel with
+ * @ref hal_dma_request(), it is done right away. The channel keeps its own
+ * address and count registers like the hardware, the programmed values are
+ * loaded when the channel is enabled and restored on every wrap in circular
+ * mode. Half transfer and transfer complete flags are set when the
+ * remaining count reaches half of and zero.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/dma.h>
+
+#include "hal.h"
+
+DMA_TypeDef host_dma1;
+DMA_Channel_TypeDef host_dma1_channel[HAL_DMA_CHANNELS];
+
+#define DMA_CCR_EN 0x0001
+#define DMA_CCR_IE_MASK 0x000E
+#define DMA_CCR_DIR 0x0010
+#define DMA_CCR_CIRC 0x0020
+#define DMA_CCR_PINC 0x0040
+#define DMA_CCR_MINC 0x0080
+
+#define DMA_ISR_GIF 0x1
+#define DMA_ISR_TCIF 0x2
+#define DMA_ISR_HTIF 0x4
+
+/**
+ * DMA channel model state that is not visible in the register block.
+ */
+struct hal_dma_channel {
+	uintptr_t par;		/**< Current peripheral address */
+	uintptr_t mar;		/**< Current memory address */
+	uint32_t count;		/**< Remaining transfers */
+	uint32_t size;		/**< Programmed number of transfers */
+};
+
+static struct hal_dma_channel hal_dma[HAL_DMA_CHANNELS];
+
+static DMA_Channel_TypeDef *hal_dma_regs(int channel)
+{
+	return &host_dma1_channel[channel - 1];
+}
+
+static int hal_dma_index(DMA_Channel_TypeDef *regs)
+{
+	return (int)(regs - host_dma1_channel) + 1;
+}
+
+static void hal_dma_load(int channel)
+{
+	DMA_Channel_TypeDef *regs = hal_dma_regs(channel);
+	struct hal_dma_channel *ch = &hal_dma[channel - 1];
+
+	ch->size = regs->CNDTR;
+	ch->count = ch->size;
+	ch->par = regs->CPAR;
+	ch->mar = regs->CMAR;
+}
+
+static void hal_dma_reload(int channel)
+{
+	DMA_Channel_TypeDef *regs = hal_dma_regs(channel);
+	struct hal_dma_channel *ch = &hal_dma[channel - 1];
+
+	ch->count = ch->size;
+	ch->par = regs->CPAR;
+	ch->mar = regs->CMAR;
+	regs->CNDTR = ch->count;
+}
+
+static uint32_t hal_dma_read(uintptr_t addr, uint32_t size)
+{
+	switch (size) {
+	case 0:
+		return *(volatile uint8_t *)addr;
+	case 1:
+		return *(volatile uint16_t *)addr;
+	default:
+		return *(volatile uint32_t *)addr;
+	}
+}
+
+static void hal_dma_write(uintptr_t addr, uint32_t size, uint32_t val)
+{
+	switch (size) {
+	case 0:
+		*(volatile uint8_t *)addr = (uint8_t)val;
+		break;
+	case 1:
+		*(volatile uint16_t *)addr = (uint16_t)val;
+		break;
+	default:
+		*(volatile uint32_t *)addr = val;
+		break;
+	}
+}
+
+/**
+ * Reset the DMA model.
+ */
+void hal_dma_reset(void)
+{
+	memset(&host_dma1, 0, sizeof(host_dma1));
+	memset(host_dma1_channel, 0, sizeof(host_dma1_channel));
+	memset(hal_dma, 0, sizeof(hal_dma));
+}
+
+/**
+ * Check if a DMA channel is enabled and has transfers left.
+ *
+ * @param channel Channel number 1..7
+ */
+static bool hal_dma_ready(int channel)
+{
+	return ((hal_dma_regs(channel)->CCR & DMA_CCR_EN) != 0) &&
+		(hal_dma[channel - 1].count != 0);
+}
+
+/**
+ * Do one transfer of a DMA channel.
+ *
+ * @param channel Channel number 1..7
+ */
+bool hal_dma_request(int channel)
+{
+	DMA_Channel_TypeDef *regs = hal_dma_regs(channel);
+	struct hal_dma_channel *ch = &hal_dma[channel - 1];
+	uint32_t psize = (regs->CCR >> 8) & 3;
+	uint32_t msize = (regs->CCR >> 10) & 3;
+	int shift = 4 * (channel - 1);
+
+	if (!hal_dma_ready(channel))
+		return false;
+
+	if ((regs->CCR & DMA_CCR_DIR) != 0)
+		hal_dma_write(ch->par, psize, hal_dma_read(ch->mar, msize));
+	else
+		hal_dma_write(ch->mar, msize, hal_dma_read(ch->par, psize));
+
+	if ((regs->CCR & DMA_CCR_PINC) != 0)
+		ch->par += 1U << psize;
+	if ((regs->CCR & DMA_CCR_MINC) != 0)
+		ch->mar += 1U << msize;
+
+	ch->count--;
+	regs->CNDTR = ch->count;
+
+	if (ch->count == ch->size / 2)
+		host_dma1.ISR |= (DMA_ISR_GIF | DMA_ISR_HTIF) << shift;
+
+	if (ch->count == 0) {
+		host_dma1.ISR |= (DMA_ISR_GIF | DMA_ISR_TCIF) << shift;
+		if ((regs->CCR & DMA_CCR_CIRC) != 0)
+			hal_dma_reload(channel);
+	}
+
+	return true;
+}
+
+/**
+ * Check if a DMA channel interrupt is pending.
+ *
+ * @param channel Channel number 1..7
+ */
+bool hal_dma_pending(int channel)
+{
+	uint32_t flags = (host_dma1.ISR >> (4 * (channel - 1))) &
+		DMA_CCR_IE_MASK;
+
+	return (flags & hal_dma_regs(channel)->CCR) != 0;
+}
+
+void DMA_DeInit(DMA_Channel_TypeDef *channel)
+{
+	int shift = 4 * (hal_dma_index(channel) - 1);
+
+	memset(channel, 0, sizeof(*channel));
+	host_dma1.ISR &= ~(0xFU << shift);
+}
+
+void DMA_Init(DMA_Channel_TypeDef *channel, DMA_InitTypeDef *init)
+{
+	channel->CCR = (channel->CCR & DMA_CCR_EN) | init->DMA_DIR |
+		init->DMA_Mode | init->DMA_PeripheralInc |
+		init->DMA_MemoryInc | init->DMA_PeripheralDataSize |
+		init->DMA_MemoryDataSize | init->DMA_Priority |
+		init->DMA_M2M;
+	channel->CNDTR = init->DMA_BufferSize;
+	channel->CPAR = init->DMA_PeripheralBaseAddr;
+	channel->CMAR = init->DMA_MemoryBaseAddr;
+}
+
+void DMA_Cmd(DMA_Channel_TypeDef *channel, FunctionalState state)
+{
+	if (state == ENABLE) {
+		channel->CCR |= DMA_CCR_EN;
+		hal_dma_load(hal_dma_index(channel));
+	} else {
+		channel->CCR &= ~DMA_CCR_EN;
+	}
+}
+
+void DMA_ITConfig(DMA_Channel_TypeDef *channel, uint32_t it,
+		  FunctionalState state)
+{
+	if (state == ENABLE)
+		channel->CCR |= it;
+	else
+		channel->CCR &= ~it;
+}
+
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *channel)
+{
+	return (uint16_t)channel->CNDTR;
+}
+
+FlagStatus DMA_GetFlagStatus(uint32_t flag)
+{
+	return ((host_dma1.ISR & flag) != 0) ? SET : RESET;
+}
+
+void DMA_ClearFlag(uint32_t flag)
+{
+	host_dma1.ISR &= ~flag;
+}
+
+ITStatus DMA_GetITStatus(uint32_t it)
+{
+	return ((host_dma1.ISR & it) != 0) ? SET : RESET;
+}
+
+void DMA_ClearITPendingBit(uint32_t it)
+{
+	int i;
+
+	/* Clearing the global flag clears all flags of the channel */
+	for (i = 0; i < HAL_DMA_CHANNELS; i++) {
+		if ((it & (DMA_ISR_GIF << (4 * i))) != 0)
+			it |= 0xFU << (4 * i);
+	}
+
+	host_dma1.ISR &= ~it;
+}
@@ -0,0 +1,146 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gpio.c
+ *
+ * @brief  Host model of the GPIO ports and the external interrupt controller.
+ *
+ * The BEMF comparator outputs are connected to GPIOB pins 10, 11 and 12 and
+ * raise EXTI line 10, 11 and 12 on the configured edges.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/gpio.h>
+#include <stm32/exti.h>
+
+#include "hal.h"
+
+GPIO_TypeDef host_gpioa;
+GPIO_TypeDef host_gpiob;
+GPIO_TypeDef host_gpioc;
+EXTI_TypeDef host_exti;
+
+/**
+ * First GPIOB pin (and EXTI line) of the BEMF comparator inputs.
+ */
+#define HAL_BEMF_FIRST_PIN 10
+
+/**
+ * EXTI lines served by the EXTI15_10 interrupt.
+ */
+#define HAL_EXTI15_10_MASK 0xFC00
+
+/**
+ * Reset the GPIO and EXTI models.
+ */
+void hal_gpio_reset(void)
+{
+	memset(&host_gpioa, 0, sizeof(host_gpioa));
+	memset(&host_gpiob, 0, sizeof(host_gpiob));
+	memset(&host_gpioc, 0, sizeof(host_gpioc));
+	memset(&host_exti, 0, sizeof(host_exti));
+}
+
+/**
+ * Set the output level of one BEMF comparator.
+ *
+ * @param phase Phase index 0..2
+ * @param level Comparator output level
+ */
+void hal_bemf_set(int phase, bool level)
+{
+	uint32_t bit = 1 << (HAL_BEMF_FIRST_PIN + phase);
+	bool old = (host_gpiob.IDR & bit) != 0;
+
+	if (old == level)
+		return;
+
+	if (level) {
+		host_gpiob.IDR |= bit;
+		if ((host_exti.RTSR & bit) != 0)
+			host_exti.PR |= bit & host_exti.IMR;
+	} else {
+		host_gpiob.IDR &= ~bit;
+		if ((host_exti.FTSR & bit) != 0)
+			host_exti.PR |= bit & host_exti.IMR;
+	}
+}
+
+/**
+ * Check if an EXTI15_10 interrupt is pending.
+ */
+bool hal_exti_pending(void)
+{
+	return (host_exti.PR & host_exti.IMR & HAL_EXTI15_10_MASK) != 0;
+}
+
+void GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init)
+{
+	(void)port;
+	(void)init;
+}
+
+void GPIO_WriteBit(GPIO_TypeDef *port, uint16_t pin, BitAction value)
+{
+	if (value == Bit_SET)
+		port->ODR |= pin;
+	else
+		port->ODR &= ~pin;
+}
+
+void GPIO_PinRemapConfig(uint32_t remap, FunctionalState state)
+{
+	(void)remap;
+	(void)state;
+}
+
+void GPIO_EXTILineConfig(uint8_t port_source, uint8_t pin_source)
+{
+	(void)port_source;
+	(void)pin_source;
+}
+
+void EXTI_Init(EXTI_InitTypeDef *init)
+{
+	if (init->EXTI_LineCmd != ENABLE) {
+		host_exti.IMR &= ~init->EXTI_Line;
+		return;
+	}
+
+	host_exti.IMR |= init->EXTI_Line;
+	host_exti.RTSR &= ~init->EXTI_Line;
+	host_exti.FTSR &= ~init->EXTI_Line;
+
+	if ((init->EXTI_Trigger == EXTI_Trigger_Rising) ||
+	    (init->EXTI_Trigger == EXTI_Trigger_Rising_Falling))
+		host_exti.RTSR |= init->EXTI_Line;
+	if ((init->EXTI_Trigger == EXTI_Trigger_Falling) ||
+	    (init->EXTI_Trigger == EXTI_Trigger_Rising_Falling))
+		host_exti.FTSR |= init->EXTI_Line;
+}
+
+ITStatus EXTI_GetITStatus(uint32_t line)
+{
+	return ((host_exti.PR & host_exti.IMR & line) != 0) ? SET : RESET;
+}
+
+void EXTI_ClearITPendingBit(uint32_t line)
+{
+	host_exti.PR &= ~line;
+}
@@ -0,0 +1,170 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   hal.h
+ *
+ * @brief  Host peripheral model interface.
+ *
+ * The host peripheral model implements the subset of the STM32 StdPeriph API
+ * used by the motor controller firmware on top of RAM register blocks. This
+ * header is the interface between the peripheral model and the simulation
+ * that drives it, it is not used by firmware code.
+ */
+
+#ifndef __HOST_HAL_H
+#define __HOST_HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Core clock frequency of the simulated STM32.
+ */
+#define HAL_CORE_CLOCK 72000000.0
+
+/**
+ * Number of DMA1 channels.
+ */
+#define HAL_DMA_CHANNELS 7
+
+/**
+ * Simulated interrupt sources in order of service priority.
+ */
+enum hal_irq {
+	hal_irq_tim1_trg_com = 0,
+	hal_irq_tim1_up,
+	hal_irq_tim2,
+	hal_irq_exti15_10,
+	hal_irq_tim1_cc,
+	hal_irq_dma1_channel1,
+	hal_irq_dma1_channel4,
+	hal_irq_dma1_channel5,
+	hal_irq_i2c1_ev,
+	hal_irq_i2c1_er,
+	hal_irq_usart1,
+	hal_irq_usb_hp_can_tx,
+	hal_irq_usb_lp_can_rx0,
+	hal_irq_sys_tick,
+	hal_irq_num
+};
+
+/**
+ * Interrupt service statistics.
+ */
+struct hal_irq_stats {
+	uint32_t count;		/**< Number of handler invocations */
+	uint64_t ns_total;	/**< Accumulated host time spent in the handler */
+	uint64_t ns_max;	/**< Longest host time spent in one invocation */
+};
+
+extern struct hal_irq_stats hal_irq_stats[hal_irq_num];
+extern const char *hal_irq_names[hal_irq_num];
+
+/**
+ * CAN frame on the simulated bus.
+ */
+struct hal_can_frame {
+	uint32_t id;		/**< Standard or extended identifier */
+	bool ext;		/**< Extended identifier flag */
+	uint8_t len;		/**< Payload length */
+	uint8_t data[8];	/**< Payload */
+};
+
+/**
+ * CAN bus statistics.
+ */
+struct hal_can_stats {
+	uint32_t tx_frames;	/**< Frames sent by the firmware */
+	uint32_t rx_frames;	/**< Frames passed into receive FIFO 0 */
+	uint32_t rx_rejected;	/**< Frames dropped by the filter banks */
+	uint32_t rx_overruns;	/**< Frames lost to a full receive FIFO 0 */
+};
+
+extern struct hal_can_stats hal_can_stats;
+
+/**
+ * I2C bus statistics.
+ */
+struct hal_i2c_stats {
+	uint32_t xfers;		/**< Transfers completed by the bus master */
+	uint32_t nacks;		/**< Transfers with the address not acknowledged */
+	uint32_t rx_bytes;	/**< Data bytes received by the firmware */
+	uint32_t tx_bytes;	/**< Data bytes sent by the firmware */
+	double stretch;		/**< Time the slave held the clock low [s] */
+	double time;		/**< Bus time [s] */
+	double rx_time;		/**< Bus time of the last received byte [s] */
+};
+
+extern struct hal_i2c_stats hal_i2c_stats;
+
+/* core.c */
+void hal_reset(void);
+void hal_irq_enable(int irqn, bool enable);
+void hal_irq_service(void);
+bool hal_in_isr(void);
+void hal_sys_tick_advance(double dt);
+
+/* tim.c */
+void hal_tim_reset(void);
+void hal_tim_advance(double dt);
+bool hal_tim_pending(enum hal_irq irq);
+void hal_tim1_phase_drive(int phase, double *high, double *low);
+
+/* gpio.c */
+void hal_gpio_reset(void);
+void hal_bemf_set(int phase, bool level);
+bool hal_exti_pending(void);
+
+/* adc.c */
+void hal_adc_reset(void);
+void hal_adc_advance(double dt);
+void hal_adc_set_channel(int channel, uint16_t value);
+void hal_adc_set_noise(int channel, double rms);
+void hal_adc_trigger(uint32_t source);
+void hal_adc_trigger_injected(uint32_t source);
+
+/* dma.c */
+void hal_dma_reset(void);
+bool hal_dma_request(int channel);
+bool hal_dma_pending(int channel);
+
+/* usart.c */
+void hal_usart_reset(void);
+void hal_usart_advance(double dt);
+bool hal_usart_pending(void);
+int hal_usart_rx(uint8_t byte);
+int hal_usart_tx_pop(void);
+
+/* can.c */
+void hal_can_reset(void);
+void hal_can_advance(double dt);
+bool hal_can_pending(enum hal_irq irq);
+int hal_can_rx(const struct hal_can_frame *frame);
+int hal_can_tx_pop(struct hal_can_frame *frame);
+
+/* i2c.c */
+void hal_i2c_reset(void);
+void hal_i2c_advance(double dt);
+bool hal_i2c_pending(enum hal_irq irq);
+int hal_i2c_write(uint8_t addr, const uint8_t *data, int len);
+int hal_i2c_read(uint8_t addr, int len);
+int hal_i2c_read_pop(void);
+bool hal_i2c_busy(void);
+
+#endif /* __HOST_HAL_H */
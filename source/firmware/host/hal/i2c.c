@@ -0,0 +1,425 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   i2c.c
+ *
+ * @brief  Host model of the I2C1 cell in slave mode and its bus master.
+ *
+ * Transfers queued with @ref hal_i2c_write() and @ref hal_i2c_read() are
+ * run by an emulated bus master at the clock speed the firmware configured.
+ * The master addresses the slave, sends or receives the data bytes and
+ * ends reads with a NACK, every transfer with a stop condition. Addresses
+ * other than the own address 1 are not acknowledged.
+ *
+ * The slave stretches the clock while ADDR is set, while a received byte
+ * is still in the data register and while the data register is empty in
+ * transmit mode, so the bus waits for the firmware the same way it does on
+ * the STM32. Bytes read by the master are collected in a buffer the
+ * simulation can read.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/i2c.h>
+
+#include "hal.h"
+
+I2C_TypeDef host_i2c1;
+
+struct hal_i2c_stats hal_i2c_stats;
+
+#define I2C_CR1_PE 0x0001
+#define I2C_CR1_ACK 0x0400
+#define I2C_CR2_ITERREN 0x0100
+#define I2C_CR2_ITEVTEN 0x0200
+#define I2C_CR2_ITBUFEN 0x0400
+#define I2C_SR1_ADDR 0x0002
+#define I2C_SR1_BTF 0x0004
+#define I2C_SR1_STOPF 0x0010
+#define I2C_SR1_RXNE 0x0040
+#define I2C_SR1_TXE 0x0080
+#define I2C_SR1_BERR 0x0100
+#define I2C_SR1_AF 0x0400
+#define I2C_SR1_OVR 0x0800
+#define I2C_SR2_BUSY 0x0002
+#define I2C_SR2_TRA 0x0004
+
+#define HAL_I2C_XFER_MAX 64
+#define HAL_I2C_QUEUE_SIZE 64
+#define HAL_I2C_BUF_SIZE 4096
+
+/**
+ * Bus phase of the transfer in progress.
+ */
+enum hal_i2c_phase {
+	hal_i2c_idle,		/**< No transfer on the bus */
+	hal_i2c_address,	/**< Start condition and address byte */
+	hal_i2c_addr_wait,	/**< Stretching until ADDR is cleared */
+	hal_i2c_rx,		/**< Data byte from the master */
+	hal_i2c_rx_wait,	/**< Stretching until the last byte is read */
+	hal_i2c_tx_wait,	/**< Stretching until the data register is loaded */
+	hal_i2c_tx,		/**< Data byte to the master */
+	hal_i2c_stop		/**< Stop condition */
+};
+
+/**
+ * Transfer of the bus master.
+ */
+struct hal_i2c_xfer {
+	uint8_t addr;			/**< 7 bit slave address */
+	bool read;			/**< Read from the slave */
+	int len;			/**< Number of data bytes */
+	uint8_t data[HAL_I2C_XFER_MAX];	/**< Data bytes of a write */
+};
+
+/**
+ * I2C model state that is not visible in the register block.
+ */
+struct hal_i2c {
+	double bit_time;		/**< Time needed for one bit */
+	double remaining;		/**< Remaining time of the current phase */
+	enum hal_i2c_phase phase;	/**< Bus phase */
+	struct hal_i2c_xfer xfer;	/**< Transfer on the bus */
+	int pos;			/**< Data bytes done in the transfer */
+	bool acked;			/**< Address acknowledged by the slave */
+	uint8_t shift;			/**< Byte in the shift register */
+	bool sr1_read;			/**< SR1 read, first step of clearing STOPF */
+	struct hal_i2c_xfer queue[HAL_I2C_QUEUE_SIZE]; /**< Queued transfers */
+	uint32_t head;			/**< Transfer queue write index */
+	uint32_t tail;			/**< Transfer queue read index */
+	uint8_t rd[HAL_I2C_BUF_SIZE];	/**< Bytes read by the master */
+	uint32_t rd_head;		/**< Read buffer write index */
+	uint32_t rd_tail;		/**< Read buffer read index */
+};
+
+static struct hal_i2c hal_i2c;
+
+/**
+ * Reset the I2C model.
+ */
+void hal_i2c_reset(void)
+{
+	memset(&host_i2c1, 0, sizeof(host_i2c1));
+	memset(&hal_i2c, 0, sizeof(hal_i2c));
+	memset(&hal_i2c_stats, 0, sizeof(hal_i2c_stats));
+	hal_i2c.bit_time = 1.0 / 100000;
+}
+
+static void hal_i2c_queue(uint8_t addr, bool read, const uint8_t *data,
+			  int len)
+{
+	uint32_t next = (hal_i2c.head + 1) % HAL_I2C_QUEUE_SIZE;
+	struct hal_i2c_xfer *xfer = &hal_i2c.queue[hal_i2c.head];
+
+	xfer->addr = addr;
+	xfer->read = read;
+	xfer->len = len;
+	if (data != NULL)
+		memcpy(xfer->data, data, (size_t)len);
+
+	hal_i2c.head = next;
+}
+
+static bool hal_i2c_queue_full(int len)
+{
+	return (len > HAL_I2C_XFER_MAX) ||
+		(((hal_i2c.head + 1) % HAL_I2C_QUEUE_SIZE) == hal_i2c.tail);
+}
+
+/**
+ * Queue a write transfer of the bus master.
+ *
+ * @return 0 on success, -1 if the queue is full or len too long
+ */
+int hal_i2c_write(uint8_t addr, const uint8_t *data, int len)
+{
+	if (hal_i2c_queue_full(len))
+		return -1;
+
+	hal_i2c_queue(addr, false, data, len);
+
+	return 0;
+}
+
+/**
+ * Queue a read transfer of the bus master.
+ *
+ * @return 0 on success, -1 if the queue is full or len too long
+ */
+int hal_i2c_read(uint8_t addr, int len)
+{
+	if (hal_i2c_queue_full(len))
+		return -1;
+
+	hal_i2c_queue(addr, true, NULL, len);
+
+	return 0;
+}
+
+/**
+ * Get the next byte the bus master read from the firmware.
+ *
+ * @return byte value or -1 if none available
+ */
+int hal_i2c_read_pop(void)
+{
+	uint8_t byte;
+
+	if (hal_i2c.rd_head == hal_i2c.rd_tail)
+		return -1;
+
+	byte = hal_i2c.rd[hal_i2c.rd_tail];
+	hal_i2c.rd_tail = (hal_i2c.rd_tail + 1) % HAL_I2C_BUF_SIZE;
+
+	return byte;
+}
+
+/**
+ * Check if the bus master has transfers queued or in progress.
+ */
+bool hal_i2c_busy(void)
+{
+	return (hal_i2c.phase != hal_i2c_idle) ||
+		(hal_i2c.head != hal_i2c.tail);
+}
+
+static void hal_i2c_start_stop(void)
+{
+	hal_i2c.phase = hal_i2c_stop;
+	hal_i2c.remaining = hal_i2c.bit_time;
+}
+
+static void hal_i2c_stretch(double dt, uint16_t flags)
+{
+	host_i2c1.SR1 |= flags;
+	hal_i2c_stats.stretch += dt;
+}
+
+/**
+ * Advance the bus.
+ */
+void hal_i2c_advance(double dt)
+{
+	uint32_t next;
+
+	hal_i2c_stats.time += dt;
+
+	switch (hal_i2c.phase) {
+	case hal_i2c_idle:
+		if (hal_i2c.head == hal_i2c.tail)
+			break;
+		hal_i2c.xfer = hal_i2c.queue[hal_i2c.tail];
+		hal_i2c.tail = (hal_i2c.tail + 1) % HAL_I2C_QUEUE_SIZE;
+		hal_i2c.pos = 0;
+		hal_i2c.acked = false;
+		hal_i2c.phase = hal_i2c_address;
+		/* Start condition, address byte and acknowledge */
+		hal_i2c.remaining = 10 * hal_i2c.bit_time;
+		break;
+	case hal_i2c_address:
+		hal_i2c.remaining -= dt;
+		if (hal_i2c.remaining > 0)
+			break;
+		if (((host_i2c1.CR1 & (I2C_CR1_PE | I2C_CR1_ACK)) !=
+		     (I2C_CR1_PE | I2C_CR1_ACK)) ||
+		    (((host_i2c1.OAR1 >> 1) & 0x7F) != hal_i2c.xfer.addr)) {
+			hal_i2c_stats.nacks++;
+			hal_i2c_start_stop();
+			break;
+		}
+		hal_i2c.acked = true;
+		host_i2c1.SR1 |= I2C_SR1_ADDR;
+		host_i2c1.SR2 |= I2C_SR2_BUSY;
+		if (hal_i2c.xfer.read) {
+			host_i2c1.SR1 |= I2C_SR1_TXE;
+			host_i2c1.SR2 |= I2C_SR2_TRA;
+		}
+		hal_i2c.phase = hal_i2c_addr_wait;
+		break;
+	case hal_i2c_addr_wait:
+		if ((host_i2c1.SR1 & I2C_SR1_ADDR) != 0) {
+			hal_i2c_stretch(dt, 0);
+			break;
+		}
+		if (hal_i2c.xfer.len == 0) {
+			hal_i2c_start_stop();
+		} else if (hal_i2c.xfer.read) {
+			hal_i2c.phase = hal_i2c_tx_wait;
+		} else {
+			hal_i2c.phase = hal_i2c_rx;
+			hal_i2c.remaining = 9 * hal_i2c.bit_time;
+		}
+		break;
+	case hal_i2c_rx:
+		hal_i2c.remaining -= dt;
+		if (hal_i2c.remaining > 0)
+			break;
+		hal_i2c.phase = hal_i2c_rx_wait;
+		/* Fall through */
+	case hal_i2c_rx_wait:
+		if ((host_i2c1.SR1 & I2C_SR1_RXNE) != 0) {
+			hal_i2c_stretch(dt, I2C_SR1_BTF);
+			break;
+		}
+		host_i2c1.DR = hal_i2c.xfer.data[hal_i2c.pos++];
+		host_i2c1.SR1 |= I2C_SR1_RXNE;
+		hal_i2c_stats.rx_bytes++;
+		hal_i2c_stats.rx_time = hal_i2c_stats.time;
+		if (hal_i2c.pos < hal_i2c.xfer.len) {
+			hal_i2c.phase = hal_i2c_rx;
+			hal_i2c.remaining = 9 * hal_i2c.bit_time;
+		} else {
+			hal_i2c_start_stop();
+		}
+		break;
+	case hal_i2c_tx_wait:
+		if ((host_i2c1.SR1 & I2C_SR1_TXE) != 0) {
+			hal_i2c_stretch(dt, 0);
+			break;
+		}
+		hal_i2c.shift = (uint8_t)host_i2c1.DR;
+		host_i2c1.SR1 |= I2C_SR1_TXE;
+		hal_i2c.phase = hal_i2c_tx;
+		hal_i2c.remaining = 9 * hal_i2c.bit_time;
+		break;
+	case hal_i2c_tx:
+		hal_i2c.remaining -= dt;
+		if (hal_i2c.remaining > 0)
+			break;
+		next = (hal_i2c.rd_head + 1) % HAL_I2C_BUF_SIZE;
+		if (next != hal_i2c.rd_tail) {
+			hal_i2c.rd[hal_i2c.rd_head] = hal_i2c.shift;
+			hal_i2c.rd_head = next;
+		}
+		hal_i2c_stats.tx_bytes++;
+		if (++hal_i2c.pos < hal_i2c.xfer.len) {
+			hal_i2c.phase = hal_i2c_tx_wait;
+			break;
+		}
+		/* The master does not acknowledge the last byte */
+		host_i2c1.SR1 = (host_i2c1.SR1 & ~I2C_SR1_TXE) | I2C_SR1_AF;
+		hal_i2c_start_stop();
+		break;
+	case hal_i2c_stop:
+		hal_i2c.remaining -= dt;
+		if (hal_i2c.remaining > 0)
+			break;
+		/* Only a slave receiver detects the stop condition */
+		if (hal_i2c.acked && !hal_i2c.xfer.read)
+			host_i2c1.SR1 |= I2C_SR1_STOPF;
+		host_i2c1.SR2 &= ~(I2C_SR2_BUSY | I2C_SR2_TRA);
+		hal_i2c_stats.xfers++;
+		hal_i2c.phase = hal_i2c_idle;
+		break;
+	}
+}
+
+/**
+ * Check if an I2C1 interrupt is pending.
+ */
+bool hal_i2c_pending(enum hal_irq irq)
+{
+	uint16_t sr1 = host_i2c1.SR1;
+	uint16_t cr2 = host_i2c1.CR2;
+
+	if (irq == hal_irq_i2c1_er)
+		return ((cr2 & I2C_CR2_ITERREN) != 0) &&
+			((sr1 & (I2C_SR1_BERR | I2C_SR1_AF | I2C_SR1_OVR)) != 0);
+
+	if ((cr2 & I2C_CR2_ITEVTEN) == 0)
+		return false;
+
+	return ((sr1 & (I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_STOPF)) != 0) ||
+		(((cr2 & I2C_CR2_ITBUFEN) != 0) &&
+		 ((sr1 & (I2C_SR1_RXNE | I2C_SR1_TXE)) != 0));
+}
+
+void I2C_DeInit(I2C_TypeDef *i2c)
+{
+	memset(i2c, 0, sizeof(*i2c));
+}
+
+void I2C_Init(I2C_TypeDef *i2c, I2C_InitTypeDef *init)
+{
+	i2c->OAR1 = init->I2C_AcknowledgedAddress | init->I2C_OwnAddress1;
+	i2c->CR1 = (i2c->CR1 & ~I2C_CR1_ACK) | I2C_CR1_PE | init->I2C_Ack;
+	if (init->I2C_ClockSpeed != 0)
+		hal_i2c.bit_time = 1.0 / init->I2C_ClockSpeed;
+}
+
+/*
+ * Writing CR1 after reading SR1 clears STOPF.
+ */
+void I2C_Cmd(I2C_TypeDef *i2c, FunctionalState state)
+{
+	if (state == ENABLE)
+		i2c->CR1 |= I2C_CR1_PE;
+	else
+		i2c->CR1 &= ~I2C_CR1_PE;
+
+	if (hal_i2c.sr1_read)
+		i2c->SR1 &= ~I2C_SR1_STOPF;
+	hal_i2c.sr1_read = false;
+}
+
+void I2C_ITConfig(I2C_TypeDef *i2c, uint16_t it, FunctionalState state)
+{
+	if (state == ENABLE)
+		i2c->CR2 |= it;
+	else
+		i2c->CR2 &= ~it;
+
+	hal_irq_service();
+}
+
+/*
+ * Reads SR1 and then SR2, that clears ADDR.
+ */
+uint32_t I2C_GetLastEvent(I2C_TypeDef *i2c)
+{
+	uint32_t event = ((uint32_t)i2c->SR2 << 16) | i2c->SR1;
+
+	hal_i2c.sr1_read = true;
+	i2c->SR1 &= ~I2C_SR1_ADDR;
+
+	return event & 0x00FFFFFF;
+}
+
+uint8_t I2C_ReceiveData(I2C_TypeDef *i2c)
+{
+	i2c->SR1 &= ~(I2C_SR1_RXNE | I2C_SR1_BTF);
+
+	return (uint8_t)i2c->DR;
+}
+
+void I2C_SendData(I2C_TypeDef *i2c, uint8_t data)
+{
+	i2c->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+	i2c->DR = data;
+}
+
+ITStatus I2C_GetITStatus(I2C_TypeDef *i2c, uint32_t it)
+{
+	return ((i2c->SR1 & it & 0xFFFF) != 0) &&
+		((i2c->CR2 & I2C_CR2_ITERREN) != 0) ? SET : RESET;
+}
+
+void I2C_ClearITPendingBit(I2C_TypeDef *i2c, uint32_t it)
+{
+	i2c->SR1 &= ~(it & 0xFFFF);
+}
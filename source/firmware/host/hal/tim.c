@@ -0,0 +1,556 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   tim.c
+ *
+ * @brief  Host model of the TIM1, TIM2 and TIM4 timer peripherals.
+ *
+ * All timers count up with a clock of @ref HAL_CORE_CLOCK divided by the
+ * prescaler and set their compare and update flags when the counter passes
+ * the respective values. TIM1 additionally models the capture compare
+ * control preload: while CCPC is set the CCER and CCMR values written by the
+ * firmware only take effect at the next COM event, exactly like the six step
+ * commutation code expects.
+ *
+ * Channels configured for input capture do not set their compare flags,
+ * the firmware side of the capture registers and flags is modelled but no
+ * input edges are generated.
+ *
+ * TIM1 puts out its channel 4 compare as trigger output if selected. TIM4
+ * can be started by it in trigger slave mode (ITR0), stops at its update
+ * event in one pulse mode and starts the ADC regular sequence with its
+ * channel 4 compare event.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/tim.h>
+#include <stm32/adc.h>
+
+#include "hal.h"
+
+TIM_TypeDef host_tim1;
+TIM_TypeDef host_tim2;
+TIM_TypeDef host_tim4;
+
+#define TIM_CR1_CEN 0x0001
+#define TIM_CR1_OPM 0x0008
+#define TIM_CR2_CCPC 0x0001
+#define TIM_CR2_MMS 0x0070
+#define TIM_SMCR_SMS 0x0007
+#define TIM_SMCR_TS 0x0070
+#define TIM_BDTR_MOE 0x8000
+
+/**
+ * Timer model state that is not visible in the register block.
+ */
+struct hal_tim {
+	TIM_TypeDef *regs;	/**< Register block */
+	double frac;		/**< Fractional timer ticks not counted yet */
+	uint16_t ccer;		/**< Active CCER value (TIM1 COM preload) */
+	uint16_t ccmr1;		/**< Active CCMR1 value (TIM1 COM preload) */
+	uint16_t ccmr2;		/**< Active CCMR2 value (TIM1 COM preload) */
+};
+
+static struct hal_tim hal_tim1 = { &host_tim1, 0, 0, 0, 0 };
+static struct hal_tim hal_tim2 = { &host_tim2, 0, 0, 0, 0 };
+static struct hal_tim hal_tim4 = { &host_tim4, 0, 0, 0, 0 };
+
+static struct hal_tim *hal_tim_get(TIM_TypeDef *tim)
+{
+	if (tim == TIM1)
+		return &hal_tim1;
+	if (tim == TIM4)
+		return &hal_tim4;
+	return &hal_tim2;
+}
+
+/**
+ * Reset both timer models.
+ */
+void hal_tim_reset(void)
+{
+	memset(&host_tim1, 0, sizeof(host_tim1));
+	memset(&host_tim2, 0, sizeof(host_tim2));
+	memset(&host_tim4, 0, sizeof(host_tim4));
+	host_tim1.ARR = 0xFFFF;
+	host_tim2.ARR = 0xFFFF;
+	host_tim4.ARR = 0xFFFF;
+
+	hal_tim1.frac = 0;
+	hal_tim1.ccer = 0;
+	hal_tim1.ccmr1 = 0;
+	hal_tim1.ccmr2 = 0;
+	hal_tim2.frac = 0;
+	hal_tim4.frac = 0;
+}
+
+/**
+ * Check if the compare value is passed when counting n ticks from cnt.
+ */
+static bool hal_tim_passes(uint32_t cnt, uint32_t n, uint32_t ccr,
+			   uint32_t period)
+{
+	uint32_t dist;
+
+	if (ccr >= period)
+		return false;
+
+	if (n >= period)
+		return true;
+
+	dist = (ccr + period - cnt) % period;
+
+	return (dist != 0) && (dist <= n);
+}
+
+/**
+ * Check if a channel is configured as input capture (CCxS not zero).
+ */
+static bool hal_tim_is_input(TIM_TypeDef *tim, int channel)
+{
+	uint16_t ccmr = (channel < 2) ? tim->CCMR1 : tim->CCMR2;
+
+	return ((ccmr >> ((channel & 1) ? 8 : 0)) & 0x0003) != 0;
+}
+
+/**
+ * Start TIM4 if it is slaved to the TIM1 trigger output.
+ */
+static void hal_tim1_trgo(void)
+{
+	if (((host_tim4.SMCR & TIM_SMCR_SMS) == TIM_SlaveMode_Trigger) &&
+	    ((host_tim4.SMCR & TIM_SMCR_TS) == TIM_TS_ITR0))
+		host_tim4.CR1 |= TIM_CR1_CEN;
+}
+
+static void hal_tim_count(struct hal_tim *t, double dt)
+{
+	TIM_TypeDef *tim = t->regs;
+	uint32_t period = (uint32_t)tim->ARR + 1;
+	uint32_t cnt = tim->CNT;
+	uint32_t n;
+
+	if ((tim->CR1 & TIM_CR1_CEN) == 0)
+		return;
+
+	t->frac += dt * HAL_CORE_CLOCK / ((double)tim->PSC + 1);
+	n = (uint32_t)t->frac;
+	t->frac -= n;
+
+	if (n == 0)
+		return;
+
+	if (hal_tim_passes(cnt, n, tim->CCR1, period))
+		tim->SR |= TIM_IT_CC1;
+	if (hal_tim_passes(cnt, n, tim->CCR2, period))
+		tim->SR |= TIM_IT_CC2;
+	if (!hal_tim_is_input(tim, 2) &&
+	    hal_tim_passes(cnt, n, tim->CCR3, period))
+		tim->SR |= TIM_IT_CC3;
+	if (!hal_tim_is_input(tim, 3) &&
+	    hal_tim_passes(cnt, n, tim->CCR4, period)) {
+		tim->SR |= TIM_IT_CC4;
+		if (t == &hal_tim1)
+			hal_adc_trigger_injected(ADC_ExternalTrigInjecConv_T1_CC4);
+		if ((t == &hal_tim1) &&
+		    ((tim->CR2 & TIM_CR2_MMS) == TIM_TRGOSource_OC4Ref))
+			hal_tim1_trgo();
+		if (t == &hal_tim4)
+			hal_adc_trigger(ADC_ExternalTrigConv_T4_CC4);
+	}
+	if ((cnt + n) >= period) {
+		tim->SR |= TIM_IT_Update;
+		if ((tim->CR1 & TIM_CR1_OPM) != 0) {
+			tim->CR1 &= ~TIM_CR1_CEN;
+			tim->CNT = 0;
+			t->frac = 0;
+			return;
+		}
+	}
+
+	tim->CNT = (uint16_t)((cnt + n) % period);
+}
+
+/**
+ * Advance all timers.
+ */
+void hal_tim_advance(double dt)
+{
+	hal_tim_count(&hal_tim1, dt);
+	hal_tim_count(&hal_tim2, dt);
+	hal_tim_count(&hal_tim4, dt);
+}
+
+/**
+ * Check if a timer interrupt source is pending.
+ */
+bool hal_tim_pending(enum hal_irq irq)
+{
+	switch (irq) {
+	case hal_irq_tim1_trg_com:
+		return (host_tim1.SR & host_tim1.DIER & TIM_IT_COM) != 0;
+	case hal_irq_tim1_up:
+		return (host_tim1.SR & host_tim1.DIER & TIM_IT_Update) != 0;
+	case hal_irq_tim1_cc:
+		return (host_tim1.SR & host_tim1.DIER &
+			(TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4)) != 0;
+	case hal_irq_tim2:
+		return (host_tim2.SR & host_tim2.DIER & 0x00FF) != 0;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Get the averaged switch state of one TIM1 driven half bridge.
+ *
+ * @param phase Phase (channel) index 0..2
+ * @param high Output: fraction of time the high side switch is on
+ * @param low Output: fraction of time the low side switch is on
+ */
+void hal_tim1_phase_drive(int phase, double *high, double *low)
+{
+	uint16_t ccer;
+	uint16_t ccmr1;
+	uint16_t ccmr2;
+	uint16_t ccr;
+	uint16_t mode;
+	bool e;
+	bool ne;
+	double duty;
+	double ref;
+
+	*high = 0;
+	*low = 0;
+
+	if ((host_tim1.BDTR & TIM_BDTR_MOE) == 0)
+		return;
+
+	if ((host_tim1.CR2 & TIM_CR2_CCPC) != 0) {
+		ccer = hal_tim1.ccer;
+		ccmr1 = hal_tim1.ccmr1;
+		ccmr2 = hal_tim1.ccmr2;
+	} else {
+		ccer = host_tim1.CCER;
+		ccmr1 = host_tim1.CCMR1;
+		ccmr2 = host_tim1.CCMR2;
+	}
+
+	switch (phase) {
+	case 0:
+		mode = ccmr1 & 0x0070;
+		ccr = host_tim1.CCR1;
+		break;
+	case 1:
+		mode = (ccmr1 >> 8) & 0x0070;
+		ccr = host_tim1.CCR2;
+		break;
+	default:
+		mode = ccmr2 & 0x0070;
+		ccr = host_tim1.CCR3;
+		break;
+	}
+
+	e = ((ccer >> (4 * phase)) & TIM_CCx_Enable) != 0;
+	ne = ((ccer >> (4 * phase)) & TIM_CCxN_Enable) != 0;
+
+	duty = (double)ccr / ((double)host_tim1.ARR + 1);
+	if (duty > 1)
+		duty = 1;
+
+	switch (mode) {
+	case TIM_ForcedAction_Active:
+		ref = 1;
+		break;
+	case TIM_OCMode_PWM1:
+		ref = duty;
+		break;
+	case TIM_OCMode_PWM2:
+		ref = 1 - duty;
+		break;
+	default:
+		ref = 0;
+		break;
+	}
+
+	/* See the output control bit table of the advanced control timers:
+	 * with both outputs enabled OCxN is the complement of OCxREF, with
+	 * only OCxN enabled it follows OCxREF.
+	 */
+	if (e && ne) {
+		*high = ref;
+		*low = 1 - ref;
+	} else if (e) {
+		*high = ref;
+	} else if (ne) {
+		*low = ref;
+	}
+}
+
+void TIM_TimeBaseInit(TIM_TypeDef *tim, TIM_TimeBaseInitTypeDef *init)
+{
+	tim->ARR = init->TIM_Period;
+	tim->PSC = init->TIM_Prescaler;
+	tim->RCR = init->TIM_RepetitionCounter;
+}
+
+void TIM_PrescalerConfig(TIM_TypeDef *tim, uint16_t prescaler, uint16_t mode)
+{
+	(void)mode;
+	tim->PSC = prescaler;
+}
+
+static void hal_tim_oc_init(TIM_TypeDef *tim, int channel,
+			    TIM_OCInitTypeDef *init)
+{
+	volatile uint16_t *ccmr = (channel < 2) ? &tim->CCMR1 : &tim->CCMR2;
+	int ccmr_shift = (channel & 1) ? 8 : 0;
+	int ccer_shift = channel * 4;
+	uint16_t ccer_bits = init->TIM_OutputState | init->TIM_OCPolarity;
+
+	if ((tim == TIM1) && (channel < 3))
+		ccer_bits |= init->TIM_OutputNState | init->TIM_OCNPolarity;
+
+	*ccmr = (*ccmr & ~(0x0073 << ccmr_shift)) |
+		(init->TIM_OCMode << ccmr_shift);
+	tim->CCER = (tim->CCER & ~(0x000F << ccer_shift)) |
+		(ccer_bits << ccer_shift);
+
+	switch (channel) {
+	case 0:
+		tim->CCR1 = init->TIM_Pulse;
+		break;
+	case 1:
+		tim->CCR2 = init->TIM_Pulse;
+		break;
+	case 2:
+		tim->CCR3 = init->TIM_Pulse;
+		break;
+	default:
+		tim->CCR4 = init->TIM_Pulse;
+		break;
+	}
+}
+
+void TIM_OC1Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init)
+{
+	hal_tim_oc_init(tim, 0, init);
+}
+
+void TIM_OC2Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init)
+{
+	hal_tim_oc_init(tim, 1, init);
+}
+
+void TIM_OC3Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init)
+{
+	hal_tim_oc_init(tim, 2, init);
+}
+
+void TIM_OC4Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init)
+{
+	hal_tim_oc_init(tim, 3, init);
+}
+
+void TIM_ICInit(TIM_TypeDef *tim, TIM_ICInitTypeDef *init)
+{
+	int channel = init->TIM_Channel / 4;
+	volatile uint16_t *ccmr = (channel < 2) ? &tim->CCMR1 : &tim->CCMR2;
+	int ccmr_shift = (channel & 1) ? 8 : 0;
+	int ccer_shift = channel * 4;
+
+	*ccmr = (*ccmr & ~(0x00FF << ccmr_shift)) |
+		((init->TIM_ICSelection | init->TIM_ICPrescaler |
+		  (init->TIM_ICFilter << 4)) << ccmr_shift);
+	tim->CCER = (tim->CCER & ~(0x000F << ccer_shift)) |
+		((TIM_CCx_Enable | init->TIM_ICPolarity) << ccer_shift);
+}
+
+void TIM_OC1PreloadConfig(TIM_TypeDef *tim, uint16_t preload)
+{
+	tim->CCMR1 = (tim->CCMR1 & ~0x0008) | preload;
+}
+
+void TIM_OC2PreloadConfig(TIM_TypeDef *tim, uint16_t preload)
+{
+	tim->CCMR1 = (tim->CCMR1 & ~0x0800) | (preload << 8);
+}
+
+void TIM_OC3PreloadConfig(TIM_TypeDef *tim, uint16_t preload)
+{
+	tim->CCMR2 = (tim->CCMR2 & ~0x0008) | preload;
+}
+
+void TIM_OC4PreloadConfig(TIM_TypeDef *tim, uint16_t preload)
+{
+	tim->CCMR2 = (tim->CCMR2 & ~0x0800) | (preload << 8);
+}
+
+void TIM_BDTRConfig(TIM_TypeDef *tim, TIM_BDTRInitTypeDef *init)
+{
+	tim->BDTR = init->TIM_OSSRState | init->TIM_OSSIState |
+		init->TIM_LOCKLevel | init->TIM_DeadTime | init->TIM_Break |
+		init->TIM_BreakPolarity | init->TIM_AutomaticOutput;
+}
+
+void TIM_CCPreloadControl(TIM_TypeDef *tim, FunctionalState state)
+{
+	if (state == ENABLE)
+		tim->CR2 |= TIM_CR2_CCPC;
+	else
+		tim->CR2 &= ~TIM_CR2_CCPC;
+}
+
+void TIM_CtrlPWMOutputs(TIM_TypeDef *tim, FunctionalState state)
+{
+	if (state == ENABLE)
+		tim->BDTR |= TIM_BDTR_MOE;
+	else
+		tim->BDTR &= ~TIM_BDTR_MOE;
+}
+
+void TIM_ITConfig(TIM_TypeDef *tim, uint16_t it, FunctionalState state)
+{
+	if (state == ENABLE)
+		tim->DIER |= it;
+	else
+		tim->DIER &= ~it;
+}
+
+void TIM_Cmd(TIM_TypeDef *tim, FunctionalState state)
+{
+	if (state == ENABLE)
+		tim->CR1 |= TIM_CR1_CEN;
+	else
+		tim->CR1 &= ~TIM_CR1_CEN;
+}
+
+void TIM_GenerateEvent(TIM_TypeDef *tim, uint16_t source)
+{
+	struct hal_tim *t = hal_tim_get(tim);
+
+	if ((source & TIM_EventSource_COM) != 0) {
+		t->ccer = tim->CCER;
+		t->ccmr1 = tim->CCMR1;
+		t->ccmr2 = tim->CCMR2;
+		tim->SR |= TIM_IT_COM;
+	}
+
+	if ((source & TIM_EventSource_Update) != 0) {
+		tim->CNT = 0;
+		t->frac = 0;
+		tim->SR |= TIM_IT_Update;
+	}
+
+	if ((source & TIM_EventSource_CC1) != 0)
+		tim->SR |= TIM_IT_CC1;
+
+	hal_irq_service();
+}
+
+ITStatus TIM_GetITStatus(TIM_TypeDef *tim, uint16_t it)
+{
+	return ((tim->SR & it) != 0) && ((tim->DIER & it) != 0) ? SET : RESET;
+}
+
+void TIM_ClearITPendingBit(TIM_TypeDef *tim, uint16_t it)
+{
+	tim->SR &= ~it;
+}
+
+uint16_t TIM_GetCounter(TIM_TypeDef *tim)
+{
+	return tim->CNT;
+}
+
+void TIM_SetCounter(TIM_TypeDef *tim, uint16_t counter)
+{
+	tim->CNT = counter;
+}
+
+void TIM_SetCompare1(TIM_TypeDef *tim, uint16_t compare)
+{
+	tim->CCR1 = compare;
+}
+
+void TIM_SetCompare2(TIM_TypeDef *tim, uint16_t compare)
+{
+	tim->CCR2 = compare;
+}
+
+void TIM_SetCompare3(TIM_TypeDef *tim, uint16_t compare)
+{
+	tim->CCR3 = compare;
+}
+
+void TIM_SetCompare4(TIM_TypeDef *tim, uint16_t compare)
+{
+	tim->CCR4 = compare;
+}
+
+uint16_t TIM_GetCapture1(TIM_TypeDef *tim)
+{
+	return tim->CCR1;
+}
+
+uint16_t TIM_GetCapture3(TIM_TypeDef *tim)
+{
+	/* Reading a capture clears its flag */
+	if (hal_tim_is_input(tim, 2))
+		tim->SR &= ~TIM_FLAG_CC3;
+	return tim->CCR3;
+}
+
+uint16_t TIM_GetCapture4(TIM_TypeDef *tim)
+{
+	/* Reading a capture clears its flag */
+	if (hal_tim_is_input(tim, 3))
+		tim->SR &= ~TIM_FLAG_CC4;
+	return tim->CCR4;
+}
+
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef *tim, uint16_t flag)
+{
+	return (tim->SR & flag) != 0 ? SET : RESET;
+}
+
+void TIM_ClearFlag(TIM_TypeDef *tim, uint16_t flag)
+{
+	tim->SR &= ~flag;
+}
+
+void TIM_SelectOutputTrigger(TIM_TypeDef *tim, uint16_t source)
+{
+	tim->CR2 = (tim->CR2 & ~TIM_CR2_MMS) | source;
+}
+
+void TIM_SelectInputTrigger(TIM_TypeDef *tim, uint16_t source)
+{
+	tim->SMCR = (tim->SMCR & ~TIM_SMCR_TS) | source;
+}
+
+void TIM_SelectSlaveMode(TIM_TypeDef *tim, uint16_t mode)
+{
+	tim->SMCR = (tim->SMCR & ~TIM_SMCR_SMS) | mode;
+}
+
+void TIM_SelectOnePulseMode(TIM_TypeDef *tim, uint16_t mode)
+{
+	tim->CR1 = (tim->CR1 & ~TIM_CR1_OPM) | mode;
+}
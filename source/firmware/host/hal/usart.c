@@ -0,0 +1,269 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usart.c
+ *
+ * @brief  Host model of USART1.
+ *
+ * Transmitted bytes are collected in a buffer the simulation can read, bytes
+ * handed to @ref hal_usart_rx() are received at the configured baud rate.
+ *
+ * With DMA requests enabled received bytes are moved by DMA1 channel 5 and
+ * bytes to transmit fetched by DMA1 channel 4. The idle line flag is set one
+ * byte time after the last received byte when no further byte follows.
+ */
+
+#include <cmsis/stm32.h>
+#include <stm32/usart.h>
+
+#include "hal.h"
+
+USART_TypeDef host_usart1;
+
+#define USART_SR_IDLE 0x0010
+#define USART_SR_RXNE 0x0020
+#define USART_SR_TXE 0x0080
+#define USART_CR1_IDLEIE 0x0010
+#define USART_CR1_RXNEIE 0x0020
+#define USART_CR1_TXEIE 0x0080
+#define USART_CR3_DMAR 0x0040
+#define USART_CR3_DMAT 0x0080
+
+/**
+ * DMA channels serving USART1 transmission and reception.
+ */
+#define HAL_USART_DMA_TX 4
+#define HAL_USART_DMA_RX 5
+
+#define HAL_USART_BUF_SIZE 4096
+
+/**
+ * Simple byte queue.
+ */
+struct hal_usart_queue {
+	uint8_t data[HAL_USART_BUF_SIZE];	/**< Queue storage */
+	uint32_t head;				/**< Write index */
+	uint32_t tail;				/**< Read index */
+};
+
+/**
+ * USART model state that is not visible in the register block.
+ */
+struct hal_usart {
+	double byte_time;		/**< Time needed for one byte */
+	double tx_remaining;		/**< Remaining time of the current tx byte */
+	double rx_remaining;		/**< Remaining time of the current rx byte */
+	bool idle_armed;		/**< Idle line detection pending */
+	struct hal_usart_queue tx;	/**< Transmitted bytes */
+	struct hal_usart_queue rx;	/**< Bytes to be received */
+};
+
+static struct hal_usart hal_usart;
+
+static bool hal_usart_queue_put(struct hal_usart_queue *q, uint8_t byte)
+{
+	uint32_t next = (q->head + 1) % HAL_USART_BUF_SIZE;
+
+	if (next == q->tail)
+		return false;
+
+	q->data[q->head] = byte;
+	q->head = next;
+
+	return true;
+}
+
+static int hal_usart_queue_get(struct hal_usart_queue *q)
+{
+	uint8_t byte;
+
+	if (q->head == q->tail)
+		return -1;
+
+	byte = q->data[q->tail];
+	q->tail = (q->tail + 1) % HAL_USART_BUF_SIZE;
+
+	return byte;
+}
+
+/**
+ * Reset the USART model.
+ */
+void hal_usart_reset(void)
+{
+	memset(&host_usart1, 0, sizeof(host_usart1));
+	memset(&hal_usart, 0, sizeof(hal_usart));
+	host_usart1.SR = USART_SR_TXE;
+	hal_usart.byte_time = 10.0 / 115200;
+}
+
+/**
+ * Advance transmission and reception.
+ */
+void hal_usart_advance(double dt)
+{
+	int byte;
+
+	if (hal_usart.tx_remaining > 0) {
+		hal_usart.tx_remaining -= dt;
+		if (hal_usart.tx_remaining <= 0)
+			host_usart1.SR |= USART_SR_TXE;
+	}
+
+	if (((host_usart1.SR & USART_SR_TXE) != 0) &&
+	    ((host_usart1.CR3 & USART_CR3_DMAT) != 0) &&
+	    hal_dma_request(HAL_USART_DMA_TX))
+		USART_SendData(&host_usart1, host_usart1.DR);
+
+	hal_usart.rx_remaining -= dt;
+	if ((hal_usart.rx_remaining <= 0) &&
+	    ((host_usart1.SR & USART_SR_RXNE) == 0)) {
+		byte = hal_usart_queue_get(&hal_usart.rx);
+		if (byte >= 0) {
+			host_usart1.DR = (uint16_t)byte;
+			host_usart1.SR |= USART_SR_RXNE;
+			hal_usart.rx_remaining = hal_usart.byte_time;
+			hal_usart.idle_armed = true;
+
+			/* The DMA read of the data register clears RXNE */
+			if (((host_usart1.CR3 & USART_CR3_DMAR) != 0) &&
+			    hal_dma_request(HAL_USART_DMA_RX))
+				host_usart1.SR &= ~USART_SR_RXNE;
+		} else if (hal_usart.idle_armed) {
+			hal_usart.idle_armed = false;
+			host_usart1.SR |= USART_SR_IDLE;
+		}
+	}
+}
+
+/**
+ * Check if an USART interrupt is pending.
+ */
+bool hal_usart_pending(void)
+{
+	return (host_usart1.SR & host_usart1.CR1 &
+		(USART_SR_IDLE | USART_SR_RXNE | USART_SR_TXE)) != 0;
+}
+
+/**
+ * Queue one byte for reception by the firmware.
+ *
+ * @return 0 on success, -1 if the queue is full
+ */
+int hal_usart_rx(uint8_t byte)
+{
+	return hal_usart_queue_put(&hal_usart.rx, byte) ? 0 : -1;
+}
+
+/**
+ * Get the next byte transmitted by the firmware.
+ *
+ * @return byte value or -1 if none available
+ */
+int hal_usart_tx_pop(void)
+{
+	return hal_usart_queue_get(&hal_usart.tx);
+}
+
+void USART_Init(USART_TypeDef *usart, USART_InitTypeDef *init)
+{
+	(void)usart;
+	if (init->USART_BaudRate != 0)
+		hal_usart.byte_time = 10.0 / init->USART_BaudRate;
+}
+
+void USART_ITConfig(USART_TypeDef *usart, uint16_t it, FunctionalState state)
+{
+	uint16_t bit;
+
+	switch (it) {
+	case USART_IT_RXNE:
+		bit = USART_CR1_RXNEIE;
+		break;
+	case USART_IT_TXE:
+		bit = USART_CR1_TXEIE;
+		break;
+	case USART_IT_IDLE:
+		bit = USART_CR1_IDLEIE;
+		break;
+	default:
+		bit = 0;
+		break;
+	}
+
+	if (state == ENABLE)
+		usart->CR1 |= bit;
+	else
+		usart->CR1 &= ~bit;
+
+	hal_irq_service();
+}
+
+void USART_Cmd(USART_TypeDef *usart, FunctionalState state)
+{
+	(void)usart;
+	(void)state;
+}
+
+ITStatus USART_GetITStatus(USART_TypeDef *usart, uint16_t it)
+{
+	uint16_t bit;
+
+	switch (it) {
+	case USART_IT_RXNE:
+		bit = USART_SR_RXNE;
+		break;
+	case USART_IT_TXE:
+		bit = USART_SR_TXE;
+		break;
+	case USART_IT_IDLE:
+		bit = USART_SR_IDLE;
+		break;
+	default:
+		return RESET;
+	}
+
+	return ((usart->SR & bit) != 0) && ((usart->CR1 & bit) != 0) ?
+		SET : RESET;
+}
+
+/*
+ * Reading the data register after the status register also clears IDLE.
+ */
+uint16_t USART_ReceiveData(USART_TypeDef *usart)
+{
+	usart->SR &= ~(USART_SR_RXNE | USART_SR_IDLE);
+
+	return usart->DR;
+}
+
+void USART_SendData(USART_TypeDef *usart, uint16_t data)
+{
+	usart->SR &= ~USART_SR_TXE;
+	(void)hal_usart_queue_put(&hal_usart.tx, (uint8_t)data);
+	hal_usart.tx_remaining = hal_usart.byte_time;
+}
+
+void USART_DMACmd(USART_TypeDef *usart, uint16_t req, FunctionalState state)
+{
+	if (state == ENABLE)
+		usart->CR3 |= req;
+	else
+		usart->CR3 &= ~req;
+}
@@ -0,0 +1,224 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replacement of the CMSIS/StdPeriph core header.
+ *
+ * Peripheral register blocks are plain structs in RAM that are driven by the
+ * host peripheral model in host/hal.
+ */
+
+#ifndef __HOST_CMSIS_STM32_H
+#define __HOST_CMSIS_STM32_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+typedef enum IRQn {
+	ADC1_2_IRQn = 18,
+	EXTI1_IRQn = 7,
+	EXTI2_IRQn = 8,
+	DMA1_Channel1_IRQn = 11,
+	DMA1_Channel2_IRQn = 12,
+	DMA1_Channel3_IRQn = 13,
+	DMA1_Channel4_IRQn = 14,
+	DMA1_Channel5_IRQn = 15,
+	DMA1_Channel6_IRQn = 16,
+	DMA1_Channel7_IRQn = 17,
+	USB_HP_CAN1_TX_IRQn = 19,
+	USB_LP_CAN1_RX0_IRQn = 20,
+	TIM1_UP_IRQn = 25,
+	TIM1_TRG_COM_IRQn = 26,
+	TIM1_CC_IRQn = 27,
+	TIM2_IRQn = 28,
+	I2C1_EV_IRQn = 31,
+	I2C1_ER_IRQn = 32,
+	USART1_IRQn = 37,
+	EXTI15_10_IRQn = 40
+} IRQn_Type;
+
+typedef struct {
+	volatile uint16_t CR1;
+	volatile uint16_t CR2;
+	volatile uint16_t SMCR;
+	volatile uint16_t DIER;
+	volatile uint16_t SR;
+	volatile uint16_t EGR;
+	volatile uint16_t CCMR1;
+	volatile uint16_t CCMR2;
+	volatile uint16_t CCER;
+	volatile uint16_t CNT;
+	volatile uint16_t PSC;
+	volatile uint16_t ARR;
+	volatile uint16_t RCR;
+	volatile uint16_t CCR1;
+	volatile uint16_t CCR2;
+	volatile uint16_t CCR3;
+	volatile uint16_t CCR4;
+	volatile uint16_t BDTR;
+} TIM_TypeDef;
+
+typedef struct {
+	volatile uint32_t CRL;
+	volatile uint32_t CRH;
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+	volatile uint32_t BSRR;
+	volatile uint32_t BRR;
+	volatile uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+	volatile uint32_t IMR;
+	volatile uint32_t EMR;
+	volatile uint32_t RTSR;
+	volatile uint32_t FTSR;
+	volatile uint32_t SWIER;
+	volatile uint32_t PR;
+} EXTI_TypeDef;
+
+typedef struct {
+	volatile uint32_t SR;
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t JDR[4];
+	volatile uint32_t DR;
+} ADC_TypeDef;
+
+/*
+ * The DMA address registers hold host pointers.
+ */
+typedef struct {
+	volatile uint32_t CCR;
+	volatile uint32_t CNDTR;
+	volatile uintptr_t CPAR;
+	volatile uintptr_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	volatile uint32_t ISR;
+	volatile uint32_t IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+	volatile uint16_t SR;
+	volatile uint16_t DR;
+	volatile uint16_t BRR;
+	volatile uint16_t CR1;
+	volatile uint16_t CR2;
+	volatile uint16_t CR3;
+} USART_TypeDef;
+
+typedef struct {
+	volatile uint16_t CR1;
+	volatile uint16_t CR2;
+	volatile uint16_t OAR1;
+	volatile uint16_t OAR2;
+	volatile uint16_t DR;
+	volatile uint16_t SR1;
+	volatile uint16_t SR2;
+	volatile uint16_t CCR;
+	volatile uint16_t TRISE;
+} I2C_TypeDef;
+
+typedef struct {
+	volatile uint32_t TIR;
+	volatile uint32_t TDTR;
+	volatile uint32_t TDLR;
+	volatile uint32_t TDHR;
+} CAN_TxMailBox_TypeDef;
+
+typedef struct {
+	volatile uint32_t RIR;
+	volatile uint32_t RDTR;
+	volatile uint32_t RDLR;
+	volatile uint32_t RDHR;
+} CAN_FIFOMailBox_TypeDef;
+
+typedef struct {
+	volatile uint32_t FR1;
+	volatile uint32_t FR2;
+} CAN_FilterRegister_TypeDef;
+
+typedef struct {
+	volatile uint32_t MCR;
+	volatile uint32_t MSR;
+	volatile uint32_t TSR;
+	volatile uint32_t RF0R;
+	volatile uint32_t RF1R;
+	volatile uint32_t IER;
+	volatile uint32_t ESR;
+	volatile uint32_t BTR;
+	CAN_TxMailBox_TypeDef sTxMailBox[3];
+	CAN_FIFOMailBox_TypeDef sFIFOMailBox[2];
+	volatile uint32_t FMR;
+	volatile uint32_t FM1R;
+	volatile uint32_t FS1R;
+	volatile uint32_t FFA1R;
+	volatile uint32_t FA1R;
+	CAN_FilterRegister_TypeDef sFilterRegister[14];
+} CAN_TypeDef;
+
+extern TIM_TypeDef host_tim1;
+extern TIM_TypeDef host_tim2;
+extern TIM_TypeDef host_tim4;
+extern GPIO_TypeDef host_gpioa;
+extern GPIO_TypeDef host_gpiob;
+extern GPIO_TypeDef host_gpioc;
+extern EXTI_TypeDef host_exti;
+extern ADC_TypeDef host_adc1;
+extern ADC_TypeDef host_adc2;
+extern DMA_TypeDef host_dma1;
+extern DMA_Channel_TypeDef host_dma1_channel[7];
+extern USART_TypeDef host_usart1;
+extern CAN_TypeDef host_can1;
+extern I2C_TypeDef host_i2c1;
+
+#define TIM1 (&host_tim1)
+#define TIM2 (&host_tim2)
+#define TIM4 (&host_tim4)
+#define GPIOA (&host_gpioa)
+#define GPIOB (&host_gpiob)
+#define GPIOC (&host_gpioc)
+#define EXTI (&host_exti)
+#define ADC1 (&host_adc1)
+#define ADC2 (&host_adc2)
+#define DMA1 (&host_dma1)
+#define DMA1_Channel1 (&host_dma1_channel[0])
+#define DMA1_Channel2 (&host_dma1_channel[1])
+#define DMA1_Channel3 (&host_dma1_channel[2])
+#define DMA1_Channel4 (&host_dma1_channel[3])
+#define DMA1_Channel5 (&host_dma1_channel[4])
+#define DMA1_Channel6 (&host_dma1_channel[5])
+#define DMA1_Channel7 (&host_dma1_channel[6])
+#define USART1 (&host_usart1)
+#define CAN1 (&host_can1)
+#define I2C1 (&host_i2c1)
+
+uint32_t SysTick_Config(uint32_t ticks);
+
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+
+#endif /* __HOST_CMSIS_STM32_H */
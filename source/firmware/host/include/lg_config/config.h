@@ -0,0 +1,11 @@
+/*
+ * libgovernor build configuration for the firmware host build.
+ *
+ * Replaces the autoconf generated config.h of libgovernor.
+ */
+
+#define PACKAGE_STRING "libgovernor 0.2"
+#define VERSION_SUFFIX "-host"
+#define BUILDDATE __DATE__
+#define COPYRIGHT "Copyright (C) 2010-2011 Piotr Esden-Tempski <piotr@esden.net>"
+#define LICENSE "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>"
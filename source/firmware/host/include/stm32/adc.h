@@ -0,0 +1,82 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_ADC_H
+#define __HOST_STM32_ADC_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint32_t ADC_Mode;
+	FunctionalState ADC_ScanConvMode;
+	FunctionalState ADC_ContinuousConvMode;
+	uint32_t ADC_ExternalTrigConv;
+	uint32_t ADC_DataAlign;
+	uint8_t ADC_NbrOfChannel;
+} ADC_InitTypeDef;
+
+#define ADC_Mode_Independent ((uint32_t)0x00000000)
+#define ADC_Mode_RegSimult ((uint32_t)0x00060000)
+#define ADC_ExternalTrigConv_T4_CC4 ((uint32_t)0x000A0000)
+#define ADC_ExternalTrigConv_None ((uint32_t)0x000E0000)
+#define ADC_DataAlign_Right ((uint32_t)0x00000000)
+
+#define ADC_ExternalTrigInjecConv_T1_CC4 ((uint32_t)0x00001000)
+#define ADC_ExternalTrigInjecConv_None ((uint32_t)0x00007000)
+
+#define ADC_InjectedChannel_1 ((uint8_t)0x14)
+#define ADC_InjectedChannel_2 ((uint8_t)0x18)
+#define ADC_InjectedChannel_3 ((uint8_t)0x1C)
+#define ADC_InjectedChannel_4 ((uint8_t)0x20)
+
+#define ADC_FLAG_JEOC ((uint8_t)0x04)
+
+#define ADC_Channel_0 ((uint8_t)0x00)
+#define ADC_Channel_1 ((uint8_t)0x01)
+#define ADC_Channel_2 ((uint8_t)0x02)
+#define ADC_Channel_3 ((uint8_t)0x03)
+#define ADC_Channel_4 ((uint8_t)0x04)
+#define ADC_Channel_5 ((uint8_t)0x05)
+#define ADC_Channel_6 ((uint8_t)0x06)
+#define ADC_Channel_7 ((uint8_t)0x07)
+
+#define ADC_SampleTime_1Cycles5 ((uint8_t)0x00)
+#define ADC_SampleTime_7Cycles5 ((uint8_t)0x01)
+#define ADC_SampleTime_28Cycles5 ((uint8_t)0x03)
+#define ADC_SampleTime_239Cycles5 ((uint8_t)0x07)
+
+void ADC_Init(ADC_TypeDef *adc, ADC_InitTypeDef *init);
+void ADC_RegularChannelConfig(ADC_TypeDef *adc, uint8_t channel, uint8_t rank,
+			      uint8_t sample_time);
+void ADC_ExternalTrigConvCmd(ADC_TypeDef *adc, FunctionalState state);
+void ADC_InjectedSequencerLengthConfig(ADC_TypeDef *adc, uint8_t length);
+void ADC_InjectedChannelConfig(ADC_TypeDef *adc, uint8_t channel,
+			       uint8_t rank, uint8_t sample_time);
+void ADC_ExternalTrigInjectedConvConfig(ADC_TypeDef *adc, uint32_t trigger);
+void ADC_ExternalTrigInjectedConvCmd(ADC_TypeDef *adc, FunctionalState state);
+uint16_t ADC_GetInjectedConversionValue(ADC_TypeDef *adc, uint8_t channel);
+FlagStatus ADC_GetFlagStatus(ADC_TypeDef *adc, uint8_t flag);
+void ADC_ClearFlag(ADC_TypeDef *adc, uint8_t flag);
+void ADC_DMACmd(ADC_TypeDef *adc, FunctionalState state);
+void ADC_Cmd(ADC_TypeDef *adc, FunctionalState state);
+void ADC_ResetCalibration(ADC_TypeDef *adc);
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef *adc);
+void ADC_StartCalibration(ADC_TypeDef *adc);
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef *adc);
+
+#endif /* __HOST_STM32_ADC_H */
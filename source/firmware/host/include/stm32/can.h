@@ -0,0 +1,133 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_CAN_H
+#define __HOST_STM32_CAN_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint16_t CAN_Prescaler;
+	uint8_t CAN_Mode;
+	uint8_t CAN_SJW;
+	uint8_t CAN_BS1;
+	uint8_t CAN_BS2;
+	FunctionalState CAN_TTCM;
+	FunctionalState CAN_ABOM;
+	FunctionalState CAN_AWUM;
+	FunctionalState CAN_NART;
+	FunctionalState CAN_RFLM;
+	FunctionalState CAN_TXFP;
+} CAN_InitTypeDef;
+
+typedef struct {
+	uint16_t CAN_FilterIdHigh;
+	uint16_t CAN_FilterIdLow;
+	uint16_t CAN_FilterMaskIdHigh;
+	uint16_t CAN_FilterMaskIdLow;
+	uint16_t CAN_FilterFIFOAssignment;
+	uint8_t CAN_FilterNumber;
+	uint8_t CAN_FilterMode;
+	uint8_t CAN_FilterScale;
+	FunctionalState CAN_FilterActivation;
+} CAN_FilterInitTypeDef;
+
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint8_t IDE;
+	uint8_t RTR;
+	uint8_t DLC;
+	uint8_t Data[8];
+} CanTxMsg;
+
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint8_t IDE;
+	uint8_t RTR;
+	uint8_t DLC;
+	uint8_t Data[8];
+	uint8_t FMI;
+} CanRxMsg;
+
+#define CAN_Mode_Normal ((uint8_t)0x00)
+#define CAN_Mode_LoopBack ((uint8_t)0x01)
+
+#define CAN_SJW_1tq ((uint8_t)0x00)
+#define CAN_SJW_2tq ((uint8_t)0x01)
+#define CAN_SJW_3tq ((uint8_t)0x02)
+#define CAN_SJW_4tq ((uint8_t)0x03)
+
+#define CAN_BS1_1tq ((uint8_t)0x00)
+#define CAN_BS1_2tq ((uint8_t)0x01)
+#define CAN_BS1_3tq ((uint8_t)0x02)
+#define CAN_BS1_4tq ((uint8_t)0x03)
+#define CAN_BS1_5tq ((uint8_t)0x04)
+#define CAN_BS1_6tq ((uint8_t)0x05)
+#define CAN_BS1_7tq ((uint8_t)0x06)
+#define CAN_BS1_8tq ((uint8_t)0x07)
+#define CAN_BS1_9tq ((uint8_t)0x08)
+#define CAN_BS1_10tq ((uint8_t)0x09)
+#define CAN_BS1_11tq ((uint8_t)0x0A)
+#define CAN_BS1_12tq ((uint8_t)0x0B)
+#define CAN_BS1_13tq ((uint8_t)0x0C)
+#define CAN_BS1_14tq ((uint8_t)0x0D)
+#define CAN_BS1_15tq ((uint8_t)0x0E)
+#define CAN_BS1_16tq ((uint8_t)0x0F)
+
+#define CAN_BS2_1tq ((uint8_t)0x00)
+#define CAN_BS2_2tq ((uint8_t)0x01)
+#define CAN_BS2_3tq ((uint8_t)0x02)
+#define CAN_BS2_4tq ((uint8_t)0x03)
+#define CAN_BS2_5tq ((uint8_t)0x04)
+#define CAN_BS2_6tq ((uint8_t)0x05)
+#define CAN_BS2_7tq ((uint8_t)0x06)
+#define CAN_BS2_8tq ((uint8_t)0x07)
+
+#define CAN_FilterMode_IdMask ((uint8_t)0x00)
+#define CAN_FilterMode_IdList ((uint8_t)0x01)
+
+#define CAN_FilterScale_16bit ((uint8_t)0x00)
+#define CAN_FilterScale_32bit ((uint8_t)0x01)
+
+#define CAN_FIFO0 ((uint8_t)0x00)
+#define CAN_FIFO1 ((uint8_t)0x01)
+
+#define CAN_ID_STD ((uint32_t)0x00000000)
+#define CAN_ID_EXT ((uint32_t)0x00000004)
+
+#define CAN_RTR_DATA ((uint32_t)0x00000000)
+#define CAN_RTR_REMOTE ((uint32_t)0x00000002)
+
+#define CAN_NO_MB ((uint8_t)0x04)
+
+#define CAN_IT_TME ((uint32_t)0x00000001)
+#define CAN_IT_FMP0 ((uint32_t)0x00000002)
+
+void CAN_DeInit(CAN_TypeDef *can);
+uint8_t CAN_Init(CAN_TypeDef *can, CAN_InitTypeDef *init);
+void CAN_StructInit(CAN_InitTypeDef *init);
+void CAN_FilterInit(CAN_FilterInitTypeDef *init);
+void CAN_ITConfig(CAN_TypeDef *can, uint32_t it, FunctionalState state);
+uint8_t CAN_Transmit(CAN_TypeDef *can, CanTxMsg *msg);
+uint8_t CAN_MessagePending(CAN_TypeDef *can, uint8_t fifo);
+void CAN_Receive(CAN_TypeDef *can, uint8_t fifo, CanRxMsg *msg);
+void CAN_ClearITPendingBit(CAN_TypeDef *can, uint32_t it);
+
+#endif /* __HOST_STM32_CAN_H */
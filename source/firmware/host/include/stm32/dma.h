@@ -0,0 +1,101 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_DMA_H
+#define __HOST_STM32_DMA_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uintptr_t DMA_PeripheralBaseAddr;
+	uintptr_t DMA_MemoryBaseAddr;
+	uint32_t DMA_DIR;
+	uint32_t DMA_BufferSize;
+	uint32_t DMA_PeripheralInc;
+	uint32_t DMA_MemoryInc;
+	uint32_t DMA_PeripheralDataSize;
+	uint32_t DMA_MemoryDataSize;
+	uint32_t DMA_Mode;
+	uint32_t DMA_Priority;
+	uint32_t DMA_M2M;
+} DMA_InitTypeDef;
+
+#define DMA_DIR_PeripheralDST ((uint32_t)0x00000010)
+#define DMA_DIR_PeripheralSRC ((uint32_t)0x00000000)
+#define DMA_PeripheralInc_Enable ((uint32_t)0x00000040)
+#define DMA_PeripheralInc_Disable ((uint32_t)0x00000000)
+#define DMA_MemoryInc_Enable ((uint32_t)0x00000080)
+#define DMA_MemoryInc_Disable ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_HalfWord ((uint32_t)0x00000100)
+#define DMA_PeripheralDataSize_Word ((uint32_t)0x00000200)
+#define DMA_MemoryDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_MemoryDataSize_HalfWord ((uint32_t)0x00000400)
+#define DMA_MemoryDataSize_Word ((uint32_t)0x00000800)
+#define DMA_Mode_Circular ((uint32_t)0x00000020)
+#define DMA_Mode_Normal ((uint32_t)0x00000000)
+#define DMA_Priority_VeryHigh ((uint32_t)0x00003000)
+#define DMA_Priority_High ((uint32_t)0x00002000)
+#define DMA_Priority_Medium ((uint32_t)0x00001000)
+#define DMA_Priority_Low ((uint32_t)0x00000000)
+#define DMA_M2M_Enable ((uint32_t)0x00004000)
+#define DMA_M2M_Disable ((uint32_t)0x00000000)
+
+#define DMA_IT_TC ((uint32_t)0x00000002)
+#define DMA_IT_HT ((uint32_t)0x00000004)
+#define DMA_IT_TE ((uint32_t)0x00000008)
+
+/* Channel n flags are shifted by 4 * (n - 1) */
+#define DMA1_IT_GL1 ((uint32_t)0x00000001)
+#define DMA1_IT_TC1 ((uint32_t)0x00000002)
+#define DMA1_IT_HT1 ((uint32_t)0x00000004)
+#define DMA1_IT_TE1 ((uint32_t)0x00000008)
+#define DMA1_IT_GL4 ((uint32_t)0x00001000)
+#define DMA1_IT_TC4 ((uint32_t)0x00002000)
+#define DMA1_IT_HT4 ((uint32_t)0x00004000)
+#define DMA1_IT_TE4 ((uint32_t)0x00008000)
+#define DMA1_IT_GL5 ((uint32_t)0x00010000)
+#define DMA1_IT_TC5 ((uint32_t)0x00020000)
+#define DMA1_IT_HT5 ((uint32_t)0x00040000)
+#define DMA1_IT_TE5 ((uint32_t)0x00080000)
+
+#define DMA1_FLAG_GL1 DMA1_IT_GL1
+#define DMA1_FLAG_TC1 DMA1_IT_TC1
+#define DMA1_FLAG_HT1 DMA1_IT_HT1
+#define DMA1_FLAG_TE1 DMA1_IT_TE1
+#define DMA1_FLAG_GL4 DMA1_IT_GL4
+#define DMA1_FLAG_TC4 DMA1_IT_TC4
+#define DMA1_FLAG_HT4 DMA1_IT_HT4
+#define DMA1_FLAG_TE4 DMA1_IT_TE4
+#define DMA1_FLAG_GL5 DMA1_IT_GL5
+#define DMA1_FLAG_TC5 DMA1_IT_TC5
+#define DMA1_FLAG_HT5 DMA1_IT_HT5
+#define DMA1_FLAG_TE5 DMA1_IT_TE5
+
+void DMA_DeInit(DMA_Channel_TypeDef *channel);
+void DMA_Init(DMA_Channel_TypeDef *channel, DMA_InitTypeDef *init);
+void DMA_Cmd(DMA_Channel_TypeDef *channel, FunctionalState state);
+void DMA_ITConfig(DMA_Channel_TypeDef *channel, uint32_t it,
+		  FunctionalState state);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *channel);
+FlagStatus DMA_GetFlagStatus(uint32_t flag);
+void DMA_ClearFlag(uint32_t flag);
+ITStatus DMA_GetITStatus(uint32_t it);
+void DMA_ClearITPendingBit(uint32_t it);
+
+#endif /* __HOST_STM32_DMA_H */
@@ -0,0 +1,53 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_EXTI_H
+#define __HOST_STM32_EXTI_H
+
+#include <cmsis/stm32.h>
+
+typedef enum {
+	EXTI_Mode_Interrupt = 0x00,
+	EXTI_Mode_Event = 0x04
+} EXTIMode_TypeDef;
+
+typedef enum {
+	EXTI_Trigger_Rising = 0x08,
+	EXTI_Trigger_Falling = 0x0C,
+	EXTI_Trigger_Rising_Falling = 0x10
+} EXTITrigger_TypeDef;
+
+typedef struct {
+	uint32_t EXTI_Line;
+	EXTIMode_TypeDef EXTI_Mode;
+	EXTITrigger_TypeDef EXTI_Trigger;
+	FunctionalState EXTI_LineCmd;
+} EXTI_InitTypeDef;
+
+#define EXTI_Line0  ((uint32_t)0x00001)
+#define EXTI_Line1  ((uint32_t)0x00002)
+#define EXTI_Line2  ((uint32_t)0x00004)
+#define EXTI_Line10 ((uint32_t)0x00400)
+#define EXTI_Line11 ((uint32_t)0x00800)
+#define EXTI_Line12 ((uint32_t)0x01000)
+
+void EXTI_Init(EXTI_InitTypeDef *init);
+ITStatus EXTI_GetITStatus(uint32_t line);
+void EXTI_ClearITPendingBit(uint32_t line);
+
+#endif /* __HOST_STM32_EXTI_H */
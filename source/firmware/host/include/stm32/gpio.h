@@ -0,0 +1,88 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_GPIO_H
+#define __HOST_STM32_GPIO_H
+
+#include <cmsis/stm32.h>
+
+typedef enum {
+	GPIO_Speed_10MHz = 1,
+	GPIO_Speed_2MHz,
+	GPIO_Speed_50MHz
+} GPIOSpeed_TypeDef;
+
+typedef enum {
+	GPIO_Mode_AIN = 0x0,
+	GPIO_Mode_IN_FLOATING = 0x04,
+	GPIO_Mode_IPD = 0x28,
+	GPIO_Mode_IPU = 0x48,
+	GPIO_Mode_Out_OD = 0x14,
+	GPIO_Mode_Out_PP = 0x10,
+	GPIO_Mode_AF_OD = 0x1C,
+	GPIO_Mode_AF_PP = 0x18
+} GPIOMode_TypeDef;
+
+typedef struct {
+	uint16_t GPIO_Pin;
+	GPIOSpeed_TypeDef GPIO_Speed;
+	GPIOMode_TypeDef GPIO_Mode;
+} GPIO_InitTypeDef;
+
+typedef enum {
+	Bit_RESET = 0,
+	Bit_SET
+} BitAction;
+
+#define GPIO_Pin_0  ((uint16_t)0x0001)
+#define GPIO_Pin_1  ((uint16_t)0x0002)
+#define GPIO_Pin_2  ((uint16_t)0x0004)
+#define GPIO_Pin_3  ((uint16_t)0x0008)
+#define GPIO_Pin_4  ((uint16_t)0x0010)
+#define GPIO_Pin_5  ((uint16_t)0x0020)
+#define GPIO_Pin_6  ((uint16_t)0x0040)
+#define GPIO_Pin_7  ((uint16_t)0x0080)
+#define GPIO_Pin_8  ((uint16_t)0x0100)
+#define GPIO_Pin_9  ((uint16_t)0x0200)
+#define GPIO_Pin_10 ((uint16_t)0x0400)
+#define GPIO_Pin_11 ((uint16_t)0x0800)
+#define GPIO_Pin_12 ((uint16_t)0x1000)
+#define GPIO_Pin_13 ((uint16_t)0x2000)
+#define GPIO_Pin_14 ((uint16_t)0x4000)
+#define GPIO_Pin_15 ((uint16_t)0x8000)
+
+#define GPIO_PortSourceGPIOA ((uint8_t)0x00)
+#define GPIO_PortSourceGPIOB ((uint8_t)0x01)
+#define GPIO_PortSourceGPIOC ((uint8_t)0x02)
+
+#define GPIO_PinSource0  ((uint8_t)0x00)
+#define GPIO_PinSource1  ((uint8_t)0x01)
+#define GPIO_PinSource2  ((uint8_t)0x02)
+#define GPIO_PinSource10 ((uint8_t)0x0A)
+#define GPIO_PinSource11 ((uint8_t)0x0B)
+#define GPIO_PinSource12 ((uint8_t)0x0C)
+
+#define GPIO_Remap_I2C1 ((uint32_t)0x00000002)
+#define GPIO_Remap_USART1 ((uint32_t)0x00000004)
+
+void GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+void GPIO_WriteBit(GPIO_TypeDef *port, uint16_t pin, BitAction value);
+void GPIO_PinRemapConfig(uint32_t remap, FunctionalState state);
+void GPIO_EXTILineConfig(uint8_t port_source, uint8_t pin_source);
+
+#endif /* __HOST_STM32_GPIO_H */
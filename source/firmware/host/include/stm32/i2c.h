@@ -0,0 +1,59 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_I2C_H
+#define __HOST_STM32_I2C_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint32_t I2C_ClockSpeed;
+	uint16_t I2C_Mode;
+	uint16_t I2C_DutyCycle;
+	uint16_t I2C_OwnAddress1;
+	uint16_t I2C_Ack;
+	uint16_t I2C_AcknowledgedAddress;
+} I2C_InitTypeDef;
+
+#define I2C_Mode_I2C ((uint16_t)0x0000)
+#define I2C_DutyCycle_2 ((uint16_t)0xBFFF)
+#define I2C_Ack_Enable ((uint16_t)0x0400)
+#define I2C_Ack_Disable ((uint16_t)0x0000)
+#define I2C_AcknowledgedAddress_7bit ((uint16_t)0x4000)
+
+/* Interrupt enables (CR2 bits) */
+#define I2C_IT_BUF ((uint16_t)0x0400)
+#define I2C_IT_EVT ((uint16_t)0x0200)
+#define I2C_IT_ERR ((uint16_t)0x0100)
+
+/* Error interrupt sources (SR1 bits) */
+#define I2C_IT_BERR ((uint32_t)0x01000100)
+#define I2C_IT_AF ((uint32_t)0x01000400)
+#define I2C_IT_OVR ((uint32_t)0x01000800)
+
+void I2C_DeInit(I2C_TypeDef *i2c);
+void I2C_Init(I2C_TypeDef *i2c, I2C_InitTypeDef *init);
+void I2C_Cmd(I2C_TypeDef *i2c, FunctionalState state);
+void I2C_ITConfig(I2C_TypeDef *i2c, uint16_t it, FunctionalState state);
+uint32_t I2C_GetLastEvent(I2C_TypeDef *i2c);
+uint8_t I2C_ReceiveData(I2C_TypeDef *i2c);
+void I2C_SendData(I2C_TypeDef *i2c, uint8_t data);
+ITStatus I2C_GetITStatus(I2C_TypeDef *i2c, uint32_t it);
+void I2C_ClearITPendingBit(I2C_TypeDef *i2c, uint32_t it);
+
+#endif /* __HOST_STM32_I2C_H */
@@ -0,0 +1,40 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_MISC_H
+#define __HOST_STM32_MISC_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint8_t NVIC_IRQChannel;
+	uint8_t NVIC_IRQChannelPreemptionPriority;
+	uint8_t NVIC_IRQChannelSubPriority;
+	FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+#define NVIC_PriorityGroup_0 ((uint32_t)0x700)
+#define NVIC_PriorityGroup_1 ((uint32_t)0x600)
+#define NVIC_PriorityGroup_2 ((uint32_t)0x500)
+#define NVIC_PriorityGroup_3 ((uint32_t)0x400)
+#define NVIC_PriorityGroup_4 ((uint32_t)0x300)
+
+void NVIC_PriorityGroupConfig(uint32_t group);
+void NVIC_Init(NVIC_InitTypeDef *nvic);
+
+#endif /* __HOST_STM32_MISC_H */
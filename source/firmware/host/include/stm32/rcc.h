@@ -0,0 +1,44 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_RCC_H
+#define __HOST_STM32_RCC_H
+
+#include <cmsis/stm32.h>
+
+#define RCC_APB2Periph_AFIO   ((uint32_t)0x00000001)
+#define RCC_APB2Periph_GPIOA  ((uint32_t)0x00000004)
+#define RCC_APB2Periph_GPIOB  ((uint32_t)0x00000008)
+#define RCC_APB2Periph_GPIOC  ((uint32_t)0x00000010)
+#define RCC_APB2Periph_ADC1   ((uint32_t)0x00000200)
+#define RCC_APB2Periph_ADC2   ((uint32_t)0x00000400)
+#define RCC_APB2Periph_TIM1   ((uint32_t)0x00000800)
+#define RCC_APB2Periph_USART1 ((uint32_t)0x00004000)
+
+#define RCC_APB1Periph_TIM2   ((uint32_t)0x00000001)
+#define RCC_APB1Periph_TIM4   ((uint32_t)0x00000004)
+#define RCC_APB1Periph_I2C1   ((uint32_t)0x00200000)
+#define RCC_APB1Periph_CAN1   ((uint32_t)0x02000000)
+
+#define RCC_AHBPeriph_DMA1    ((uint32_t)0x00000001)
+
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_AHBPeriphClockCmd(uint32_t periph, FunctionalState state);
+
+#endif /* __HOST_STM32_RCC_H */
@@ -0,0 +1,198 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_TIM_H
+#define __HOST_STM32_TIM_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint16_t TIM_Prescaler;
+	uint16_t TIM_CounterMode;
+	uint16_t TIM_Period;
+	uint16_t TIM_ClockDivision;
+	uint8_t TIM_RepetitionCounter;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_OCMode;
+	uint16_t TIM_OutputState;
+	uint16_t TIM_OutputNState;
+	uint16_t TIM_Pulse;
+	uint16_t TIM_OCPolarity;
+	uint16_t TIM_OCNPolarity;
+	uint16_t TIM_OCIdleState;
+	uint16_t TIM_OCNIdleState;
+} TIM_OCInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_Channel;
+	uint16_t TIM_ICPolarity;
+	uint16_t TIM_ICSelection;
+	uint16_t TIM_ICPrescaler;
+	uint16_t TIM_ICFilter;
+} TIM_ICInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_OSSRState;
+	uint16_t TIM_OSSIState;
+	uint16_t TIM_LOCKLevel;
+	uint16_t TIM_DeadTime;
+	uint16_t TIM_Break;
+	uint16_t TIM_BreakPolarity;
+	uint16_t TIM_AutomaticOutput;
+} TIM_BDTRInitTypeDef;
+
+/* Output compare modes (CCMRx OCxM field) */
+#define TIM_OCMode_Timing ((uint16_t)0x0000)
+#define TIM_OCMode_Active ((uint16_t)0x0010)
+#define TIM_OCMode_Inactive ((uint16_t)0x0020)
+#define TIM_OCMode_Toggle ((uint16_t)0x0030)
+#define TIM_OCMode_PWM1 ((uint16_t)0x0060)
+#define TIM_OCMode_PWM2 ((uint16_t)0x0070)
+
+#define TIM_ForcedAction_Active ((uint16_t)0x0050)
+#define TIM_ForcedAction_InActive ((uint16_t)0x0040)
+
+/* Channels, CCER bit offsets */
+#define TIM_Channel_1 ((uint16_t)0x0000)
+#define TIM_Channel_2 ((uint16_t)0x0004)
+#define TIM_Channel_3 ((uint16_t)0x0008)
+#define TIM_Channel_4 ((uint16_t)0x000C)
+
+#define TIM_CCx_Enable ((uint16_t)0x0001)
+#define TIM_CCx_Disable ((uint16_t)0x0000)
+#define TIM_CCxN_Enable ((uint16_t)0x0004)
+#define TIM_CCxN_Disable ((uint16_t)0x0000)
+
+#define TIM_OutputState_Disable ((uint16_t)0x0000)
+#define TIM_OutputState_Enable ((uint16_t)0x0001)
+#define TIM_OutputNState_Disable ((uint16_t)0x0000)
+#define TIM_OutputNState_Enable ((uint16_t)0x0004)
+
+#define TIM_OCPolarity_High ((uint16_t)0x0000)
+#define TIM_OCPolarity_Low ((uint16_t)0x0002)
+#define TIM_OCNPolarity_High ((uint16_t)0x0000)
+#define TIM_OCNPolarity_Low ((uint16_t)0x0008)
+
+/* Input capture (CCMRx CCxS and ICxPSC fields, CCER CCxP bit) */
+#define TIM_ICPolarity_Rising ((uint16_t)0x0000)
+#define TIM_ICPolarity_Falling ((uint16_t)0x0002)
+#define TIM_ICSelection_DirectTI ((uint16_t)0x0001)
+#define TIM_ICSelection_IndirectTI ((uint16_t)0x0002)
+#define TIM_ICSelection_TRC ((uint16_t)0x0003)
+#define TIM_ICPSC_DIV1 ((uint16_t)0x0000)
+
+#define TIM_OCIdleState_Set ((uint16_t)0x0100)
+#define TIM_OCIdleState_Reset ((uint16_t)0x0000)
+#define TIM_OCNIdleState_Set ((uint16_t)0x0200)
+#define TIM_OCNIdleState_Reset ((uint16_t)0x0000)
+
+#define TIM_OCPreload_Enable ((uint16_t)0x0008)
+#define TIM_OCPreload_Disable ((uint16_t)0x0000)
+
+#define TIM_CounterMode_Up ((uint16_t)0x0000)
+#define TIM_PSCReloadMode_Update ((uint16_t)0x0000)
+#define TIM_PSCReloadMode_Immediate ((uint16_t)0x0001)
+
+#define TIM_OSSRState_Enable ((uint16_t)0x0800)
+#define TIM_OSSRState_Disable ((uint16_t)0x0000)
+#define TIM_OSSIState_Enable ((uint16_t)0x0400)
+#define TIM_OSSIState_Disable ((uint16_t)0x0000)
+#define TIM_LOCKLevel_OFF ((uint16_t)0x0000)
+#define TIM_Break_Enable ((uint16_t)0x1000)
+#define TIM_Break_Disable ((uint16_t)0x0000)
+#define TIM_BreakPolarity_Low ((uint16_t)0x0000)
+#define TIM_BreakPolarity_High ((uint16_t)0x2000)
+#define TIM_AutomaticOutput_Enable ((uint16_t)0x4000)
+#define TIM_AutomaticOutput_Disable ((uint16_t)0x0000)
+
+/* Interrupt sources (DIER/SR bits) */
+#define TIM_IT_Update ((uint16_t)0x0001)
+#define TIM_IT_CC1 ((uint16_t)0x0002)
+#define TIM_IT_CC2 ((uint16_t)0x0004)
+#define TIM_IT_CC3 ((uint16_t)0x0008)
+#define TIM_IT_CC4 ((uint16_t)0x0010)
+#define TIM_IT_COM ((uint16_t)0x0020)
+#define TIM_IT_Trigger ((uint16_t)0x0040)
+#define TIM_IT_Break ((uint16_t)0x0080)
+
+/* Status flags (SR bits) */
+#define TIM_FLAG_Update ((uint16_t)0x0001)
+#define TIM_FLAG_CC1 ((uint16_t)0x0002)
+#define TIM_FLAG_CC2 ((uint16_t)0x0004)
+#define TIM_FLAG_CC3 ((uint16_t)0x0008)
+#define TIM_FLAG_CC4 ((uint16_t)0x0010)
+#define TIM_FLAG_CC1OF ((uint16_t)0x0200)
+#define TIM_FLAG_CC2OF ((uint16_t)0x0400)
+#define TIM_FLAG_CC3OF ((uint16_t)0x0800)
+#define TIM_FLAG_CC4OF ((uint16_t)0x1000)
+
+/* Software event sources (EGR bits) */
+#define TIM_EventSource_Update ((uint16_t)0x0001)
+#define TIM_EventSource_CC1 ((uint16_t)0x0002)
+#define TIM_EventSource_COM ((uint16_t)0x0020)
+
+#define TIM_TRGOSource_Reset ((uint16_t)0x0000)
+#define TIM_TRGOSource_OC4Ref ((uint16_t)0x0070)
+
+#define TIM_TS_ITR0 ((uint16_t)0x0000)
+#define TIM_TS_ITR1 ((uint16_t)0x0010)
+
+#define TIM_SlaveMode_Reset ((uint16_t)0x0004)
+#define TIM_SlaveMode_Trigger ((uint16_t)0x0006)
+
+#define TIM_OPMode_Single ((uint16_t)0x0008)
+#define TIM_OPMode_Repetitive ((uint16_t)0x0000)
+
+void TIM_TimeBaseInit(TIM_TypeDef *tim, TIM_TimeBaseInitTypeDef *init);
+void TIM_PrescalerConfig(TIM_TypeDef *tim, uint16_t prescaler, uint16_t mode);
+void TIM_OC1Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init);
+void TIM_OC2Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init);
+void TIM_OC3Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init);
+void TIM_OC4Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init);
+void TIM_ICInit(TIM_TypeDef *tim, TIM_ICInitTypeDef *init);
+void TIM_OC1PreloadConfig(TIM_TypeDef *tim, uint16_t preload);
+void TIM_OC2PreloadConfig(TIM_TypeDef *tim, uint16_t preload);
+void TIM_OC3PreloadConfig(TIM_TypeDef *tim, uint16_t preload);
+void TIM_OC4PreloadConfig(TIM_TypeDef *tim, uint16_t preload);
+void TIM_BDTRConfig(TIM_TypeDef *tim, TIM_BDTRInitTypeDef *init);
+void TIM_CCPreloadControl(TIM_TypeDef *tim, FunctionalState state);
+void TIM_CtrlPWMOutputs(TIM_TypeDef *tim, FunctionalState state);
+void TIM_ITConfig(TIM_TypeDef *tim, uint16_t it, FunctionalState state);
+void TIM_Cmd(TIM_TypeDef *tim, FunctionalState state);
+void TIM_GenerateEvent(TIM_TypeDef *tim, uint16_t source);
+ITStatus TIM_GetITStatus(TIM_TypeDef *tim, uint16_t it);
+void TIM_ClearITPendingBit(TIM_TypeDef *tim, uint16_t it);
+uint16_t TIM_GetCounter(TIM_TypeDef *tim);
+void TIM_SetCounter(TIM_TypeDef *tim, uint16_t counter);
+void TIM_SetCompare1(TIM_TypeDef *tim, uint16_t compare);
+void TIM_SetCompare2(TIM_TypeDef *tim, uint16_t compare);
+void TIM_SetCompare3(TIM_TypeDef *tim, uint16_t compare);
+void TIM_SetCompare4(TIM_TypeDef *tim, uint16_t compare);
+uint16_t TIM_GetCapture1(TIM_TypeDef *tim);
+uint16_t TIM_GetCapture3(TIM_TypeDef *tim);
+uint16_t TIM_GetCapture4(TIM_TypeDef *tim);
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef *tim, uint16_t flag);
+void TIM_ClearFlag(TIM_TypeDef *tim, uint16_t flag);
+void TIM_SelectOutputTrigger(TIM_TypeDef *tim, uint16_t source);
+void TIM_SelectInputTrigger(TIM_TypeDef *tim, uint16_t source);
+void TIM_SelectSlaveMode(TIM_TypeDef *tim, uint16_t mode);
+void TIM_SelectOnePulseMode(TIM_TypeDef *tim, uint16_t mode);
+
+#endif /* __HOST_STM32_TIM_H */
@@ -0,0 +1,56 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_STM32_USART_H
+#define __HOST_STM32_USART_H
+
+#include <cmsis/stm32.h>
+
+typedef struct {
+	uint32_t USART_BaudRate;
+	uint16_t USART_WordLength;
+	uint16_t USART_StopBits;
+	uint16_t USART_Parity;
+	uint16_t USART_Mode;
+	uint16_t USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+#define USART_WordLength_8b ((uint16_t)0x0000)
+#define USART_StopBits_1 ((uint16_t)0x0000)
+#define USART_Parity_No ((uint16_t)0x0000)
+#define USART_Mode_Rx ((uint16_t)0x0004)
+#define USART_Mode_Tx ((uint16_t)0x0008)
+#define USART_HardwareFlowControl_None ((uint16_t)0x0000)
+
+#define USART_IT_RXNE ((uint16_t)0x0525)
+#define USART_IT_TXE ((uint16_t)0x0727)
+#define USART_IT_TC ((uint16_t)0x0626)
+#define USART_IT_IDLE ((uint16_t)0x0424)
+
+#define USART_DMAReq_Tx ((uint16_t)0x0080)
+#define USART_DMAReq_Rx ((uint16_t)0x0040)
+
+void USART_Init(USART_TypeDef *usart, USART_InitTypeDef *init);
+void USART_ITConfig(USART_TypeDef *usart, uint16_t it, FunctionalState state);
+void USART_Cmd(USART_TypeDef *usart, FunctionalState state);
+ITStatus USART_GetITStatus(USART_TypeDef *usart, uint16_t it);
+uint16_t USART_ReceiveData(USART_TypeDef *usart);
+void USART_SendData(USART_TypeDef *usart, uint16_t data);
+void USART_DMACmd(USART_TypeDef *usart, uint16_t req, FunctionalState state);
+
+#endif /* __HOST_STM32_USART_H */
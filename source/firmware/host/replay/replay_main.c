@@ -0,0 +1,636 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   replay_main.c
+ *
+ * @brief  Commutation trace replay tool.
+ *
+ * Replays a recorded trace of BEMF comparator edges and ADC samples through
+ * the unmodified BEMF detection, commutation process and commutation timer
+ * code running on the host peripheral model. The commutations generated by
+ * the firmware are compared against the ground truth commutation instants
+ * contained in the trace.
+ *
+ * Trace format, one event per line, lines starting with '#' are comments:
+ *
+ * @verbatim
+ * <time> edge <phase> <level>   BEMF comparator output of phase 0..2 changed
+ * <time> adc <channel> <value>  ADC input channel value changed
+ * <time> ref                    ground truth commutation instant
+ * <time> closed_loop [<step> <ticks>]
+ *                               switch the commutation process to closed loop,
+ *                               optionally starting from PWM step <step> and
+ *                               a commutation time of <ticks> timer ticks
+ * @endverbatim
+ *
+ * Times are in seconds and have to be ascending. Without a closed_loop event
+ * the closed loop is switched on with the first event. Without a starting
+ * step and commutation time the firmware has to lock onto the comparator
+ * edges from its reset state, which it may do at a fraction of the
+ * commutation rate. Traces can be recorded on the bench or with the -R
+ * option of mc_sim, which writes the starting step and commutation time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "types.h"
+
+#include "driver/led.h"
+#include "gprot.h"
+#include "driver/usart.h"
+#include "driver/adc.h"
+#include "driver/sys_tick.h"
+#include "driver/bemf_hardware_detect.h"
+#include "driver/debug_pins.h"
+#include "pwm/pwm.h"
+#include "pwm/pwm_steps.h"
+#include "comm_tim.h"
+#include "comm_process.h"
+#include "sensor_process.h"
+#include "trace.h"
+
+#include "hal.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Replay trace event types.
+ */
+enum replay_event_type {
+	replay_ev_edge = 0,
+	replay_ev_adc,
+	replay_ev_ref,
+	replay_ev_closed_loop
+};
+
+/**
+ * One replay trace event.
+ */
+struct replay_event {
+	double time;			/**< Event time [s] */
+	enum replay_event_type type;	/**< Event type */
+	int arg;			/**< Phase, ADC channel or PWM step, < 0 none */
+	int value;			/**< Comparator level, ADC value or commutation time */
+};
+
+/**
+ * Growable array of doubles.
+ */
+struct replay_times {
+	double *t;		/**< Times [s] */
+	size_t n;		/**< Number of used entries */
+	size_t size;		/**< Number of allocated entries */
+};
+
+/**
+ * Replay options.
+ */
+struct replay_options {
+	double loop_time;	/**< Simulated duration of one main loop iteration [s] */
+	double max_step;	/**< Maximum peripheral model time step [s] */
+	double warmup;		/**< Time at the start not evaluated [s] */
+	double max_error;	/**< Fail if the mean absolute error exceeds this [deg], < 0 off */
+	double max_missed;	/**< Fail if more of the evaluated commutations are missed, < 0 off */
+	double max_extra;	/**< Fail if more extra commutations than this share of the evaluated ones, < 0 off */
+	const char *output;	/**< Commutation time output file name */
+	bool quiet;		/**< Only print the summary */
+};
+
+/**
+ * Replay results.
+ */
+struct replay_result {
+	u32 refs;		/**< Evaluated ground truth commutations */
+	u32 matched;		/**< Ground truth commutations with a firmware commutation */
+	u32 extra;		/**< Firmware commutations without ground truth */
+	double err_sum;		/**< Sum of the errors [s] */
+	double err_sq_sum;	/**< Sum of the squared errors [s^2] */
+	double err_max;		/**< Maximum absolute error [s] */
+	double deg_sum;		/**< Sum of the absolute errors [electrical deg] */
+	u32 comm_runs;		/**< run_comm_process invocations */
+	u64 comm_ns;		/**< Host time spent in run_comm_process [ns] */
+	u64 comm_ns_max;	/**< Longest run_comm_process invocation [ns] */
+};
+
+static struct replay_event *replay_events;
+static size_t replay_event_num;
+static struct replay_times replay_refs;
+static struct replay_times replay_comms;
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <trace>\n"
+		"  -l <s>     main loop iteration time (default 2e-6)\n"
+		"  -s <s>     maximum peripheral time step (default 1e-6)\n"
+		"  -w <s>     warmup time not evaluated (default 0.05)\n"
+		"  -m <deg>   fail if the mean absolute error exceeds <deg>\n"
+		"  -M <ratio> fail if more than <ratio> of the ground truth\n"
+		"             commutations are missed\n"
+		"  -X <ratio> fail if the extra commutations exceed <ratio> of the\n"
+		"             ground truth commutations\n"
+		"  -o <file>  write the commutation times to <file>\n"
+		"  -q         quiet, only print the summary\n",
+		name);
+}
+
+static void replay_times_add(struct replay_times *times, double t)
+{
+	if (times->n == times->size) {
+		times->size = times->size ? times->size * 2 : 1024;
+		times->t = realloc(times->t, times->size * sizeof(double));
+		if (!times->t) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	times->t[times->n++] = t;
+}
+
+static u64 replay_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+/**
+ * Load a replay trace.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int replay_load(const char *name)
+{
+	struct replay_event ev;
+	size_t size = 0;
+	char line[256];
+	char type[32];
+	double last = -INFINITY;
+	int lineno = 0;
+	int n;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		perror(name);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if ((line[0] == '#') || (line[0] == '\n'))
+			continue;
+
+		ev.arg = 0;
+		ev.value = 0;
+		n = sscanf(line, "%lf %31s %d %d", &ev.time, type, &ev.arg,
+			   &ev.value);
+
+		if ((n == 4) && (strcmp(type, "edge") == 0)) {
+			ev.type = replay_ev_edge;
+		} else if ((n == 4) && (strcmp(type, "adc") == 0)) {
+			ev.type = replay_ev_adc;
+		} else if ((n >= 2) && (strcmp(type, "ref") == 0)) {
+			ev.type = replay_ev_ref;
+		} else if ((n >= 2) && (strcmp(type, "closed_loop") == 0)) {
+			ev.type = replay_ev_closed_loop;
+			if (n != 4)
+				ev.arg = -1;
+		} else {
+			fprintf(stderr, "%s:%d: invalid event\n", name, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		if (ev.time < last) {
+			fprintf(stderr, "%s:%d: time is not ascending\n", name,
+				lineno);
+			fclose(f);
+			return -1;
+		}
+		last = ev.time;
+
+		if (ev.type == replay_ev_ref) {
+			replay_times_add(&replay_refs, ev.time);
+			continue;
+		}
+
+		if (replay_event_num == size) {
+			size = size ? size * 2 : 1024;
+			replay_events = realloc(replay_events,
+						size * sizeof(*replay_events));
+			if (!replay_events) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		replay_events[replay_event_num++] = ev;
+	}
+
+	fclose(f);
+
+	if (replay_event_num == 0) {
+		fprintf(stderr, "%s: no events\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Advance the peripheral models, the interrupts are served by the caller.
+ */
+static void replay_advance(double dt)
+{
+	if (dt <= 0)
+		return;
+
+	hal_tim_advance(dt);
+	hal_sys_tick_advance(dt);
+	hal_adc_advance(dt);
+	hal_usart_advance(dt);
+}
+
+/**
+ * Firmware initialization, the commutation related subset of mc_main.c
+ */
+static void replay_firmware_init(void)
+{
+	led_init();
+	debug_pins_init();
+	gprot_init();
+	trace_init();
+	usart_init();
+	sys_tick_init();
+	comm_process_init();
+	sensor_process_init();
+	adc_init();
+	pwm_init();
+	comm_tim_init();
+	bemf_hd_init();
+}
+
+/**
+ * Take over the commutation state of the recorded firmware, as the spinup
+ * hands it over to the closed loop.
+ *
+ * @param step PWM step in effect
+ * @param freq Commutation time [commutation timer ticks]
+ */
+static void replay_handover(int step, u32 freq)
+{
+	pwm_steps_load(pwm_scheme, (u8)(step % pwm_scheme->steps));
+	pwm_comm();
+
+	comm_tim_data.freq = freq;
+	comm_tim_update_capture();
+}
+
+/**
+ * Run the trace through the firmware.
+ */
+static void replay_run(const struct replay_options *options,
+		       struct replay_result *result)
+{
+	bool closed_loop_event = false;
+	double now = replay_events[0].time;
+	double next_loop = now;
+	double target;
+	u32 comms;
+	u64 start;
+	u64 ns;
+	size_t i;
+
+	for (i = 0; i < replay_event_num; i++)
+		if (replay_events[i].type == replay_ev_closed_loop)
+			closed_loop_event = true;
+
+	if (!closed_loop_event)
+		comm_process_closed_loop_on();
+
+	comms = hal_irq_stats[hal_irq_tim1_trg_com].count;
+
+	i = 0;
+	while (i < replay_event_num) {
+		target = next_loop;
+		if (replay_events[i].time < target)
+			target = replay_events[i].time;
+		if (target > now + options->max_step)
+			target = now + options->max_step;
+
+		replay_advance(target - now);
+		now = target;
+
+		while ((i < replay_event_num) &&
+		       (replay_events[i].time <= now)) {
+			switch (replay_events[i].type) {
+			case replay_ev_edge:
+				hal_bemf_set(replay_events[i].arg,
+					     replay_events[i].value != 0);
+				break;
+			case replay_ev_adc:
+				hal_adc_set_channel(replay_events[i].arg,
+						    (u16)replay_events[i].value);
+				break;
+			case replay_ev_closed_loop:
+				if (replay_events[i].arg >= 0)
+					replay_handover(replay_events[i].arg,
+							(u32)replay_events[i].value);
+				comm_process_closed_loop_on();
+				break;
+			default:
+				break;
+			}
+			i++;
+		}
+
+		hal_irq_service();
+
+		if (hal_irq_stats[hal_irq_tim1_trg_com].count != comms) {
+			comms = hal_irq_stats[hal_irq_tim1_trg_com].count;
+			replay_times_add(&replay_comms, now);
+		}
+
+		if (now < next_loop)
+			continue;
+		next_loop += options->loop_time;
+
+		/* Commutation part of the firmware main loop, see mc_main.c */
+		if (*comm_process_trigger) {
+			*comm_process_trigger = false;
+			start = replay_ns();
+			run_comm_process();
+			ns = replay_ns() - start;
+			result->comm_runs++;
+			result->comm_ns += ns;
+			if (ns > result->comm_ns_max)
+				result->comm_ns_max = ns;
+		}
+
+		if (*sensor_process_trigger) {
+			*sensor_process_trigger = false;
+			run_sensor_process();
+		}
+
+		run_trace_process();
+
+		/* Drop governor output */
+		while (hal_usart_tx_pop() >= 0)
+			;
+	}
+}
+
+/**
+ * Find the firmware commutation closest to a given time.
+ *
+ * @return index into replay_comms or -1 if there are none
+ */
+static ssize_t replay_closest_comm(double t)
+{
+	size_t lo = 0;
+	size_t hi = replay_comms.n;
+	size_t mid;
+
+	if (replay_comms.n == 0)
+		return -1;
+
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (replay_comms.t[mid] <= t)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if ((lo + 1 < replay_comms.n) &&
+	    (fabs(replay_comms.t[lo + 1] - t) < fabs(replay_comms.t[lo] - t)))
+		return lo + 1;
+
+	return lo;
+}
+
+/**
+ * Compare the firmware commutations against the ground truth.
+ */
+static void replay_evaluate(const struct replay_options *options,
+			    struct replay_result *result)
+{
+	double begin = replay_events[0].time + options->warmup;
+	double first = INFINITY;
+	double last = -INFINITY;
+	double period;
+	double err;
+	ssize_t c;
+	size_t i;
+	u32 comms = 0;
+
+	for (i = 1; i + 1 < replay_refs.n; i++) {
+		if (replay_refs.t[i] < begin)
+			continue;
+
+		period = replay_refs.t[i] - replay_refs.t[i - 1];
+		if (replay_refs.t[i + 1] - replay_refs.t[i] < period)
+			period = replay_refs.t[i + 1] - replay_refs.t[i];
+
+		if (replay_refs.t[i] - period / 2 < first)
+			first = replay_refs.t[i] - period / 2;
+		last = replay_refs.t[i] + period / 2;
+
+		result->refs++;
+
+		c = replay_closest_comm(replay_refs.t[i]);
+		if (c < 0)
+			continue;
+
+		err = replay_comms.t[c] - replay_refs.t[i];
+		if (fabs(err) > period / 2)
+			continue;
+
+		result->matched++;
+		result->err_sum += err;
+		result->err_sq_sum += err * err;
+		result->deg_sum += fabs(err) / period * 60;
+		if (fabs(err) > result->err_max)
+			result->err_max = fabs(err);
+	}
+
+	for (i = 0; i < replay_comms.n; i++)
+		if ((replay_comms.t[i] >= first) && (replay_comms.t[i] < last))
+			comms++;
+
+	result->extra = (comms > result->matched) ? comms - result->matched : 0;
+}
+
+static void replay_print(const struct replay_result *result)
+{
+	const struct hal_irq_stats *exti = &hal_irq_stats[hal_irq_exti15_10];
+	const struct hal_irq_stats *tim2 = &hal_irq_stats[hal_irq_tim2];
+	u32 m = result->matched;
+
+	printf("events:            %lu (%lu ground truth commutations)\n",
+	       (unsigned long)replay_event_num, (unsigned long)replay_refs.n);
+	printf("commutations:      %lu\n", (unsigned long)replay_comms.n);
+	printf("evaluated:         %u, matched %u, missed %u, extra %u\n",
+	       result->refs, m, result->refs - m, result->extra);
+	if (m > 0) {
+		printf("error mean:        %.2f us\n", result->err_sum / m * 1e6);
+		printf("error rms:         %.2f us\n",
+		       sqrt(result->err_sq_sum / m) * 1e6);
+		printf("error max:         %.2f us\n", result->err_max * 1e6);
+		printf("error mean abs:    %.2f deg\n", result->deg_sum / m);
+	}
+	printf("%-18s %10s %10s %10s\n", "cost", "calls", "mean ns", "max ns");
+	printf("%-18s %10u %10.0f %10llu\n", "exti15_10 isr", exti->count,
+	       exti->count ? (double)exti->ns_total / exti->count : 0.0,
+	       (unsigned long long)exti->ns_max);
+	printf("%-18s %10u %10.0f %10llu\n", "tim2 isr", tim2->count,
+	       tim2->count ? (double)tim2->ns_total / tim2->count : 0.0,
+	       (unsigned long long)tim2->ns_max);
+	printf("%-18s %10u %10.0f %10llu\n", "run_comm_process",
+	       result->comm_runs,
+	       result->comm_runs ?
+	       (double)result->comm_ns / result->comm_runs : 0.0,
+	       (unsigned long long)result->comm_ns_max);
+	if (exti->count > 0)
+		printf("cost per edge:     %.0f ns\n",
+		       (double)(exti->ns_total + tim2->ns_total +
+				result->comm_ns) / exti->count);
+}
+
+/**
+ * Main function of the trace replay tool.
+ */
+int main(int argc, char *argv[])
+{
+	struct replay_options options;
+	struct replay_result result;
+	FILE *f;
+	size_t i;
+	int opt;
+
+	options.loop_time = 2e-6;
+	options.max_step = 1e-6;
+	options.warmup = 0.05;
+	options.max_error = -1;
+	options.max_missed = -1;
+	options.max_extra = -1;
+	options.output = NULL;
+	options.quiet = false;
+
+	while ((opt = getopt(argc, argv, "l:s:w:m:M:X:o:qh")) != -1) {
+		switch (opt) {
+		case 'l':
+			options.loop_time = atof(optarg);
+			break;
+		case 's':
+			options.max_step = atof(optarg);
+			break;
+		case 'w':
+			options.warmup = atof(optarg);
+			break;
+		case 'm':
+			options.max_error = atof(optarg);
+			break;
+		case 'M':
+			options.max_missed = atof(optarg);
+			break;
+		case 'X':
+			options.max_extra = atof(optarg);
+			break;
+		case 'o':
+			options.output = optarg;
+			break;
+		case 'q':
+			options.quiet = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((optind != argc - 1) || (options.loop_time <= 0) ||
+	    (options.max_step <= 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (replay_load(argv[optind]) != 0)
+		return 1;
+
+	memset(&result, 0, sizeof(result));
+
+	hal_reset();
+	replay_firmware_init();
+
+	replay_run(&options, &result);
+	replay_evaluate(&options, &result);
+
+	if (options.output) {
+		f = fopen(options.output, "w");
+		if (!f) {
+			perror(options.output);
+			return 1;
+		}
+		for (i = 0; i < replay_comms.n; i++)
+			fprintf(f, "%.9f comm\n", replay_comms.t[i]);
+		fclose(f);
+	}
+
+	if (!options.quiet)
+		printf("trace:             %s\n", argv[optind]);
+	replay_print(&result);
+
+	if ((options.max_error >= 0) &&
+	    ((result.matched == 0) ||
+	     (result.deg_sum / result.matched > options.max_error))) {
+		fprintf(stderr, "FAIL: %s mean commutation error above "
+			"%.1f deg\n", argv[optind], options.max_error);
+		return 1;
+	}
+
+	if ((options.max_missed >= 0) &&
+	    (result.refs - result.matched >
+	     options.max_missed * result.refs)) {
+		fprintf(stderr, "FAIL: %s missed %u of %u commutations\n",
+			argv[optind], result.refs - result.matched,
+			result.refs);
+		return 1;
+	}
+
+	if ((options.max_extra >= 0) &&
+	    (result.extra > options.max_extra * result.refs)) {
+		fprintf(stderr, "FAIL: %s %u extra commutations for %u\n",
+			argv[optind], result.extra, result.refs);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   motor.c
+ *
+ * @brief  Three phase BLDC motor plant model.
+ *
+ * Averaged model of a star connected BLDC motor with trapezoidal BEMF, or a
+ * PMSM with sinusoidal BEMF, driven by a three phase half bridge. The bridge outputs are given as the fraction
+ * of the PWM period the high and low side switch of each phase is on. During
+ * the remaining time the phase current freewheels through the body diodes.
+ * Undriven phases float as long as no current flows through them, otherwise
+ * they are clamped to the supply rails by the diodes until the current
+ * decays.
+ *
+ * The mechanical part consists of the rotor inertia, viscous and static
+ * friction and a fan/propeller load that grows with the square of the speed.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "motor.h"
+
+/**
+ * Currents below this magnitude are treated as zero [A].
+ */
+#define MOTOR_I_EPS 1e-6
+
+/**
+ * Angular velocities below this magnitude are treated as standstill [rad/s].
+ */
+#define MOTOR_OMEGA_EPS 1e-6
+
+/**
+ * Phase drive state during one step.
+ */
+enum motor_phase_mode {
+	motor_phase_floating = 0,
+	motor_phase_driven,
+	motor_phase_clamp_low,
+	motor_phase_clamp_high
+};
+
+/**
+ * Fill in the default parameters, a small 1000KV outrunner without load.
+ */
+void motor_params_default(struct motor_params *p)
+{
+	p->vbus = 12.0;
+	p->r = 0.2;
+	p->l = 50e-6;
+	p->ke = 60.0 / (2 * M_PI * 1000.0) / 2;
+	p->pole_pairs = 7;
+	p->j = 5e-6;
+	p->b = 1e-6;
+	p->t_static = 1e-3;
+	p->k_fan = 0;
+	p->vd = 0.7;
+	p->bemf = motor_bemf_trapezoidal;
+}
+
+/**
+ * Initialize the motor at standstill.
+ */
+void motor_init(struct motor *m, const struct motor_params *p)
+{
+	memset(m, 0, sizeof(*m));
+	m->p = *p;
+	m->v_n = p->vbus / 2;
+}
+
+/**
+ * Normalized BEMF shape, sinusoidal or trapezoidal.
+ *
+ * Zero crossings at 0 and 180 electrical degrees, the trapezoidal shape has
+ * +/-30 degree ramps and 120 degree flat tops.
+ */
+static double motor_bemf_shape(enum motor_bemf bemf, double theta_e)
+{
+	const double ramp = M_PI / 6;
+	double x;
+
+	if (bemf == motor_bemf_sinusoidal)
+		return sin(theta_e);
+
+	x = fmod(theta_e, 2 * M_PI);
+
+	if (x < 0)
+		x += 2 * M_PI;
+
+	if (x < ramp)
+		return x / ramp;
+	if (x < 5 * ramp)
+		return 1;
+	if (x < 7 * ramp)
+		return (M_PI - x) / ramp;
+	if (x < 11 * ramp)
+		return -1;
+	return (x - 2 * M_PI) / ramp;
+}
+
+/**
+ * Calculate the star point voltage from the conducting phases.
+ *
+ * @return number of conducting phases
+ */
+static int motor_star_point(struct motor *m, const enum motor_phase_mode mode[3])
+{
+	double sum = 0;
+	int n = 0;
+	int x;
+
+	for (x = 0; x < 3; x++) {
+		if (mode[x] != motor_phase_floating) {
+			sum += m->v[x] - m->e[x];
+			n++;
+		}
+	}
+
+	if (n > 0) {
+		m->v_n = sum / n;
+	} else {
+		m->v_n = m->p.vbus / 2 - (m->e[0] + m->e[1] + m->e[2]) / 3;
+	}
+
+	return n;
+}
+
+/**
+ * Advance the motor model by one time step.
+ *
+ * @param m Motor
+ * @param high On time fraction of the high side switch of each phase
+ * @param low On time fraction of the low side switch of each phase
+ * @param dt Time step [s]
+ */
+void motor_step(struct motor *m, const double high[3], const double low[3],
+		double dt)
+{
+	const struct motor_params *p = &m->p;
+	enum motor_phase_mode mode[3];
+	double f[3];
+	double i_old[3];
+	double off;
+	double freewheel;
+	double residual;
+	double load;
+	double net;
+	double omega;
+	bool changed;
+	int n;
+	int k;
+	int x;
+	int pass;
+
+	/* BEMF */
+	for (x = 0; x < 3; x++) {
+		f[x] = motor_bemf_shape(p->bemf, p->pole_pairs * m->theta -
+					x * 2 * M_PI / 3);
+		m->e[x] = p->ke * m->omega * f[x];
+		i_old[x] = m->i[x];
+	}
+
+	/* Terminal voltages of driven and diode clamped phases */
+	for (x = 0; x < 3; x++) {
+		off = 1 - high[x] - low[x];
+		if (off < 0)
+			off = 0;
+
+		if ((high[x] + low[x]) > 0) {
+			if (m->i[x] > MOTOR_I_EPS)
+				freewheel = -p->vd;
+			else if (m->i[x] < -MOTOR_I_EPS)
+				freewheel = p->vbus + p->vd;
+			else
+				freewheel = (high[x] > 0) ? 0 : p->vbus;
+
+			mode[x] = motor_phase_driven;
+			m->v[x] = high[x] * p->vbus + off * freewheel;
+		} else if (m->i[x] > MOTOR_I_EPS) {
+			mode[x] = motor_phase_clamp_low;
+			m->v[x] = -p->vd;
+		} else if (m->i[x] < -MOTOR_I_EPS) {
+			mode[x] = motor_phase_clamp_high;
+			m->v[x] = p->vbus + p->vd;
+		} else {
+			mode[x] = motor_phase_floating;
+		}
+	}
+
+	/* Floating phases that would exceed the rails start conducting */
+	n = motor_star_point(m, mode);
+	for (pass = 0; pass < 2; pass++) {
+		changed = false;
+		for (x = 0; x < 3; x++) {
+			if (mode[x] != motor_phase_floating)
+				continue;
+			m->v[x] = m->v_n + m->e[x];
+			if (m->v[x] > p->vbus + p->vd) {
+				mode[x] = motor_phase_clamp_high;
+				m->v[x] = p->vbus + p->vd;
+				changed = true;
+			} else if (m->v[x] < -p->vd) {
+				mode[x] = motor_phase_clamp_low;
+				m->v[x] = -p->vd;
+				changed = true;
+			}
+		}
+		if (!changed)
+			break;
+		n = motor_star_point(m, mode);
+	}
+
+	/* Phase currents */
+	if (n < 2) {
+		m->i[0] = m->i[1] = m->i[2] = 0;
+	} else {
+		for (x = 0; x < 3; x++) {
+			if (mode[x] == motor_phase_floating) {
+				m->i[x] = 0;
+				continue;
+			}
+			m->i[x] += (m->v[x] - m->e[x] - m->v_n -
+				    p->r * m->i[x]) * dt / p->l;
+		}
+
+		/* Diodes block reverse current */
+		for (x = 0; x < 3; x++) {
+			if (((mode[x] == motor_phase_clamp_low) &&
+			     (m->i[x] <= 0)) ||
+			    ((mode[x] == motor_phase_clamp_high) &&
+			     (m->i[x] >= 0))) {
+				m->i[x] = 0;
+				mode[x] = motor_phase_floating;
+			}
+		}
+
+		/* Keep the sum of the currents zero, correct the driven
+		 * phases first.
+		 */
+		residual = m->i[0] + m->i[1] + m->i[2];
+		n = 0;
+		k = 0;
+		for (x = 0; x < 3; x++) {
+			if (mode[x] != motor_phase_floating)
+				n++;
+			if (mode[x] == motor_phase_driven)
+				k++;
+		}
+		for (x = 0; x < 3; x++) {
+			if (n < 2)
+				m->i[x] = 0;
+			else if (k > 0) {
+				if (mode[x] == motor_phase_driven)
+					m->i[x] -= residual / k;
+			} else if (mode[x] != motor_phase_floating) {
+				m->i[x] -= residual / n;
+			}
+		}
+	}
+
+	/* Floating terminals follow the star point */
+	(void)motor_star_point(m, mode);
+	for (x = 0; x < 3; x++) {
+		if (mode[x] != motor_phase_floating)
+			continue;
+		m->v[x] = m->v_n + m->e[x];
+		if (m->v[x] > p->vbus + p->vd)
+			m->v[x] = p->vbus + p->vd;
+		if (m->v[x] < -p->vd)
+			m->v[x] = -p->vd;
+	}
+
+	/* Supply current and electrical torque */
+	m->i_bus = 0;
+	m->torque = 0;
+	for (x = 0; x < 3; x++) {
+		m->torque += p->ke * f[x] * m->i[x];
+		if (mode[x] == motor_phase_driven) {
+			off = 1 - high[x] - low[x];
+			m->i_bus += high[x] * m->i[x];
+			if ((off > 0) && (i_old[x] < 0))
+				m->i_bus += off * m->i[x];
+		} else if (mode[x] == motor_phase_clamp_high) {
+			m->i_bus += m->i[x];
+		}
+	}
+
+	/* Mechanics */
+	omega = m->omega;
+	if (fabs(omega) < MOTOR_OMEGA_EPS) {
+		if (fabs(m->torque) <= p->t_static) {
+			net = 0;
+		} else {
+			net = m->torque - copysign(p->t_static, m->torque);
+		}
+		m->omega = net * dt / p->j;
+	} else {
+		load = p->b * omega + p->k_fan * omega * fabs(omega) +
+			copysign(p->t_static, omega);
+		m->omega = omega + (m->torque - load) * dt / p->j;
+		/* Friction can stop the rotor but not reverse it */
+		if ((m->omega * omega < 0) &&
+		    (fabs(m->torque) <= p->t_static))
+			m->omega = 0;
+	}
+
+	m->distance += fabs(m->omega * dt);
+	m->theta = fmod(m->theta + m->omega * dt, 2 * M_PI);
+	if (m->theta < 0)
+		m->theta += 2 * M_PI;
+}
+
+/**
+ * Mechanical speed in revolutions per minute.
+ */
+double motor_rpm(const struct motor *m)
+{
+	return m->omega * 60 / (2 * M_PI);
+}
@@ -0,0 +1,75 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   motor.h
+ *
+ * @brief  Three phase BLDC and PMSM motor plant model interface.
+ */
+
+#ifndef __SIM_MOTOR_H
+#define __SIM_MOTOR_H
+
+/**
+ * BEMF waveform of the motor.
+ */
+enum motor_bemf {
+	motor_bemf_trapezoidal = 0,	/**< BLDC motor */
+	motor_bemf_sinusoidal		/**< PMSM */
+};
+
+/**
+ * Electrical and mechanical motor parameters.
+ */
+struct motor_params {
+	double vbus;		/**< Supply voltage [V] */
+	double r;		/**< Phase resistance [Ohm] */
+	double l;		/**< Phase inductance [H] */
+	double ke;		/**< Phase BEMF constant [V/(rad/s)], also torque constant [Nm/A] */
+	int pole_pairs;		/**< Number of pole pairs */
+	double j;		/**< Rotor inertia [kg m^2] */
+	double b;		/**< Viscous friction [Nm/(rad/s)] */
+	double t_static;	/**< Static (coulomb) friction torque [Nm] */
+	double k_fan;		/**< Fan/propeller load coefficient [Nm/(rad/s)^2] */
+	double vd;		/**< Freewheeling diode forward voltage [V] */
+	enum motor_bemf bemf;	/**< BEMF waveform */
+};
+
+/**
+ * Motor state.
+ */
+struct motor {
+	struct motor_params p;	/**< Parameters */
+	double i[3];		/**< Phase currents, positive into the motor [A] */
+	double e[3];		/**< Phase BEMF voltages [V] */
+	double v[3];		/**< Averaged terminal voltages [V] */
+	double v_n;		/**< Star point voltage [V] */
+	double omega;		/**< Mechanical angular velocity [rad/s] */
+	double theta;		/**< Mechanical angle [rad] */
+	double distance;	/**< Accumulated absolute mechanical angle [rad] */
+	double torque;		/**< Electrical torque [Nm] */
+	double i_bus;		/**< Averaged supply current [A] */
+};
+
+void motor_params_default(struct motor_params *p);
+void motor_init(struct motor *m, const struct motor_params *p);
+void motor_step(struct motor *m, const double high[3], const double low[3],
+		double dt);
+double motor_rpm(const struct motor *m);
+
+#endif /* __SIM_MOTOR_H */
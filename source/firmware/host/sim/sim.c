@@ -0,0 +1,322 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sim.c
+ *
+ * @brief  Host simulation of the motor controller.
+ *
+ * Couples the peripheral model the firmware is running on with the motor
+ * plant. Every time step the power stage drive is read from the TIM1 model,
+ * the motor is advanced, the BEMF comparator outputs and ADC inputs are
+ * updated and the peripheral timers are advanced. Pending interrupts are
+ * served at the end of the step, so interrupt handlers take no simulated
+ * time.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+#include "sim.h"
+
+/**
+ * ADC input channels and front end scaling.
+ */
+#define SIM_ADC_CHANNEL_BATTERY 3
+#define SIM_ADC_CHANNEL_CURRENT 4
+#define SIM_ADC_CHANNEL_TEMP 5
+#define SIM_ADC_VREF 3.3
+#define SIM_ADC_BATTERY_DIVIDER 11.0
+#define SIM_ADC_CURRENT_OFFSET 2048
+#define SIM_ADC_CURRENT_GAIN 62.0
+#define SIM_ADC_TEMP 1500
+
+/**
+ * Interval of the ADC samples in the replay trace recording [s].
+ */
+#define SIM_RECORD_ADC_INTERVAL 5e-3
+
+/**
+ * Simulation state.
+ */
+struct sim {
+	struct sim_config config;	/**< Configuration */
+	struct motor motor;		/**< Motor plant */
+	double time;			/**< Simulated time [s] */
+	double pending;			/**< Time not yet simulated [s] */
+	double comp_in[3];		/**< Filtered comparator phase inputs [V] */
+	double comp_ref;		/**< Filtered comparator reference [V] */
+	bool comp[3];			/**< Comparator outputs */
+	uint32_t rand;			/**< Noise generator state */
+	bool recorded[3];		/**< Comparator outputs written to the recording */
+	int sector;			/**< Ideal commutation sector of the rotor */
+	double record_adc;		/**< Time of the next recorded ADC sample */
+	double shunt;			/**< Bus shunt current in the PWM on time [A] */
+};
+
+static struct sim sim;
+
+/**
+ * Fill in the default simulation configuration.
+ */
+void sim_config_default(struct sim_config *config)
+{
+	motor_params_default(&config->motor);
+	config->dt = 1e-6;
+	config->comp_tau = 200e-6;
+	config->comp_hyst = 0.02;
+	config->noise = 0;
+	config->glitch = 0;
+	config->rpm = 0;
+	config->seed = 1;
+	config->record = NULL;
+	config->record_start = 0;
+}
+
+/**
+ * Noise sample in the range [-1, 1).
+ */
+static double sim_noise(void)
+{
+	/* xorshift32 */
+	sim.rand ^= sim.rand << 13;
+	sim.rand ^= sim.rand >> 17;
+	sim.rand ^= sim.rand << 5;
+
+	return (double)sim.rand / 2147483648.0 - 1.0;
+}
+
+static uint16_t sim_adc_value(double volts)
+{
+	double counts = volts / SIM_ADC_VREF * 4095;
+
+	if (counts < 0)
+		return 0;
+	if (counts > 4095)
+		return 4095;
+
+	return (uint16_t)counts;
+}
+
+/**
+ * Current sense amplifier output in ADC counts.
+ *
+ * The ADC samples the bus shunt in the on time of the PWM period, where it
+ * carries the current of the phases switched to the high side.
+ */
+static uint16_t sim_adc_current(void)
+{
+	double counts = SIM_ADC_CURRENT_OFFSET +
+		SIM_ADC_CURRENT_GAIN * sim.shunt;
+
+	if (counts < 0)
+		return 0;
+	if (counts > 4095)
+		return 4095;
+
+	return (uint16_t)counts;
+}
+
+/**
+ * Update the BEMF comparators.
+ *
+ * The comparators compare each phase terminal against the virtual star
+ * point formed by the three terminals. All inputs are RC filtered. Glitches
+ * invert an output for one time step at random, the way switching noise
+ * couples into the comparator outputs.
+ */
+static void sim_comparators(double dt)
+{
+	const struct motor *m = &sim.motor;
+	double a = dt / (sim.config.comp_tau + dt);
+	double ref = (m->v[0] + m->v[1] + m->v[2]) / 3;
+	double in;
+	int x;
+
+	sim.comp_ref += a * (ref - sim.comp_ref);
+
+	for (x = 0; x < 3; x++) {
+		in = m->v[x];
+		if (sim.config.noise > 0)
+			in += sim.config.noise * sim_noise();
+		sim.comp_in[x] += a * (in - sim.comp_in[x]);
+
+		if (sim.comp[x]) {
+			if (sim.comp_in[x] < sim.comp_ref - sim.config.comp_hyst / 2)
+				sim.comp[x] = false;
+		} else {
+			if (sim.comp_in[x] > sim.comp_ref + sim.config.comp_hyst / 2)
+				sim.comp[x] = true;
+		}
+
+		if ((sim.config.glitch > 0) &&
+		    ((sim_noise() + 1) / 2 < sim.config.glitch * dt))
+			hal_bemf_set(x, !sim.comp[x]);
+		else
+			hal_bemf_set(x, sim.comp[x]);
+	}
+}
+
+/**
+ * Write the replay trace recording, see replay_main.c for the format.
+ *
+ * Besides the comparator edges and ADC samples the ideal commutation
+ * instants are recorded as ground truth. They are the points where the rotor
+ * passes 30 electrical degrees after a BEMF zero crossing.
+ */
+static void sim_record(void)
+{
+	FILE *f = sim.config.record;
+	double theta_e;
+	int sector;
+	int x;
+
+	theta_e = fmod(sim.motor.theta * sim.motor.p.pole_pairs, 2 * M_PI);
+	sector = ((int)floor((theta_e - M_PI / 6) / (M_PI / 3)) + 6) % 6;
+
+	if (sim.time < sim.config.record_start) {
+		for (x = 0; x < 3; x++)
+			sim.recorded[x] = sim.comp[x];
+		sim.sector = sector;
+		sim.record_adc = sim.time;
+		return;
+	}
+
+	for (x = 0; x < 3; x++) {
+		if (sim.recorded[x] != sim.comp[x]) {
+			fprintf(f, "%.9f edge %d %d\n", sim.time, x,
+				sim.comp[x] ? 1 : 0);
+			sim.recorded[x] = sim.comp[x];
+		}
+	}
+
+	if (sector != sim.sector) {
+		fprintf(f, "%.9f ref\n", sim.time);
+		sim.sector = sector;
+	}
+
+	if (sim.time >= sim.record_adc) {
+		sim.record_adc += SIM_RECORD_ADC_INTERVAL;
+		fprintf(f, "%.9f adc %d %u\n", sim.time,
+			SIM_ADC_CHANNEL_BATTERY,
+			sim_adc_value(sim.motor.p.vbus /
+				      SIM_ADC_BATTERY_DIVIDER));
+		fprintf(f, "%.9f adc %d %u\n", sim.time,
+			SIM_ADC_CHANNEL_CURRENT, sim_adc_current());
+	}
+}
+
+static void sim_step(double dt)
+{
+	double high[3];
+	double low[3];
+	int x;
+
+	for (x = 0; x < 3; x++)
+		hal_tim1_phase_drive(x, &high[x], &low[x]);
+
+	motor_step(&sim.motor, high, low, dt);
+
+	sim.shunt = 0;
+	for (x = 0; x < 3; x++) {
+		if (high[x] > 0)
+			sim.shunt += sim.motor.i[x];
+	}
+
+	sim_comparators(dt);
+
+	hal_adc_set_channel(SIM_ADC_CHANNEL_BATTERY,
+			    sim_adc_value(sim.motor.p.vbus /
+					  SIM_ADC_BATTERY_DIVIDER));
+	hal_adc_set_channel(SIM_ADC_CHANNEL_CURRENT, sim_adc_current());
+	hal_adc_set_channel(SIM_ADC_CHANNEL_TEMP, SIM_ADC_TEMP);
+
+	hal_tim_advance(dt);
+	hal_sys_tick_advance(dt);
+	hal_adc_advance(dt);
+	hal_usart_advance(dt);
+	hal_can_advance(dt);
+	hal_i2c_advance(dt);
+
+	sim.time += dt;
+
+	if (sim.config.record)
+		sim_record();
+
+	hal_irq_service();
+}
+
+/**
+ * Reset the peripheral models and the motor.
+ */
+void sim_init(const struct sim_config *config)
+{
+	memset(&sim, 0, sizeof(sim));
+	sim.config = *config;
+	sim.rand = (config->seed != 0) ? config->seed : 1;
+
+	motor_init(&sim.motor, &config->motor);
+	sim.motor.omega = config->rpm * 2 * M_PI / 60;
+	sim.comp_ref = sim.motor.v_n;
+	sim.comp_in[0] = sim.comp_in[1] = sim.comp_in[2] = sim.motor.v_n;
+
+	hal_reset();
+}
+
+/**
+ * Advance the simulation.
+ *
+ * Time that is not a multiple of the time step is carried over to the next
+ * call.
+ */
+void sim_advance(double time)
+{
+	sim.pending += time;
+
+	while (sim.pending >= sim.config.dt / 2) {
+		sim.pending -= sim.config.dt;
+		sim_step(sim.config.dt);
+	}
+}
+
+/**
+ * Current simulated time [s].
+ */
+double sim_time(void)
+{
+	return sim.time;
+}
+
+/**
+ * Motor plant state.
+ */
+const struct motor *sim_motor(void)
+{
+	return &sim.motor;
+}
+
+/**
+ * Change the static load torque of the motor.
+ *
+ * @param t_static Static (coulomb) friction torque [Nm]
+ */
+void sim_set_load(double t_static)
+{
+	sim.motor.p.t_static = t_static;
+}
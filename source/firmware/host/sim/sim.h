@@ -0,0 +1,56 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sim.h
+ *
+ * @brief  Host simulation of the motor controller interface.
+ */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "motor.h"
+
+/**
+ * Simulation configuration.
+ */
+struct sim_config {
+	struct motor_params motor;	/**< Motor parameters */
+	double dt;			/**< Integration time step [s] */
+	double comp_tau;		/**< BEMF comparator input filter time constant [s] */
+	double comp_hyst;		/**< BEMF comparator hysteresis [V] */
+	double noise;			/**< BEMF comparator input noise amplitude [V] */
+	double glitch;			/**< BEMF comparator output glitches per second and phase */
+	double rpm;			/**< Initial mechanical speed, < 0 turning backwards [rpm] */
+	uint32_t seed;			/**< Noise generator seed */
+	FILE *record;			/**< Replay trace output, NULL if not recording */
+	double record_start;		/**< Recording start time [s] */
+};
+
+void sim_config_default(struct sim_config *config);
+void sim_init(const struct sim_config *config);
+void sim_advance(double time);
+double sim_time(void);
+const struct motor *sim_motor(void);
+void sim_set_load(double t_static);
+
+#endif /* __SIM_H */
@@ -0,0 +1,805 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sim_main.c
+ *
+ * @brief  Host simulation main file.
+ *
+ * Runs the motor controller firmware against the peripheral model and the
+ * motor plant, ignites the motor through the governor interface and reports
+ * spinup time, maximum speed, desynchronizations and interrupt load. With a
+ * speed setpoint it also reports how well the speed is held through a load
+ * step. The rotor can be spinning already at the start, like a windmilling
+ * propeller, to check that the firmware catches it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+
+#include "driver/led.h"
+#include "gprot.h"
+#include "driver/usart.h"
+#include "driver/can.h"
+#include "driver/i2c.h"
+#include "driver/adc.h"
+#include "driver/sys_tick.h"
+#include "driver/bemf_hardware_detect.h"
+#include "driver/debug_pins.h"
+#include "cpu_load_process.h"
+#include "pwm/pwm.h"
+#include "pwm/pwm_steps.h"
+#include "comm_tim.h"
+#include "comm_process.h"
+#include "sensor_process.h"
+#include "control_process.h"
+#include "speed_process.h"
+#include "torque_process.h"
+#include "ppm_process.h"
+#include "trace.h"
+
+#include "hal.h"
+#include "sim.h"
+
+/**
+ * Governor flag register bit that starts and stops the motor, see gprot.c
+ */
+#define SIM_FLAG_COMM_TIM (1 << 1)
+
+/**
+ * Delay before reigniting the motor after it lost sync [s].
+ */
+#define SIM_RESTART_DELAY 0.1
+
+/**
+ * Length of the commutation/rotation comparison window [s].
+ */
+#define SIM_SYNC_WINDOW 0.01
+
+/**
+ * Allowed deviation of the commutation count from the count expected from
+ * the rotor movement in one window before the motor is considered out of
+ * sync.
+ */
+#define SIM_SYNC_TOLERANCE 0.2
+
+/**
+ * Length of the window at the end of the run the final speed is averaged
+ * over [s].
+ */
+#define SIM_SPEED_WINDOW 0.2
+
+/**
+ * Allowed deviation of the speed from the setpoint once settled.
+ */
+#define SIM_SPEED_TOLERANCE 0.02
+
+/**
+ * Running in demo mode flag
+ */
+bool demo;
+
+/**
+ * Simulation scenario.
+ */
+struct sim_scenario {
+	double duration;	/**< Simulated time [s] */
+	double ignite_time;	/**< Time of the first ignition [s] */
+	double loop_time;	/**< Simulated duration of one main loop iteration [s] */
+	s32 power;		/**< Closed loop PWM power, < 0 keeps the spinup power */
+	s32 scheme;		/**< PWM scheme to switch to, < 0 keeps the configured one */
+	double scheme_time;	/**< Time of the PWM scheme switch [s] */
+	s32 speed;		/**< Speed setpoint [rpm], < 0 keeps the configured one */
+	s32 torque;		/**< Torque setpoint [ADC counts], < 0 keeps the configured one */
+	double load;		/**< Static load torque after the load step [Nm], < 0 for no step */
+	double load_time;	/**< Time of the load step [s] */
+	const char *csv;	/**< CSV log file name */
+	double csv_interval;	/**< CSV log interval [s] */
+	bool quiet;		/**< Only print the report */
+	bool strings;		/**< Print governor string packets */
+	bool require;		/**< Fail if the motor does not reach closed loop without desync */
+};
+
+/**
+ * Results of a simulation run.
+ */
+struct sim_report {
+	double spinup_time;	/**< Time from first ignition to closed loop, < 0 if never */
+	double spinning_time;	/**< Total time spent in closed loop [s] */
+	double max_rpm;		/**< Maximum mechanical speed */
+	double max_current;	/**< Largest phase current after the first ignition [A] */
+	u32 ignitions;		/**< Number of ignitions */
+	u32 exits;		/**< Number of closed loop exits */
+	u32 desyncs;		/**< Number of times the commutation lost the rotor */
+	u32 loops;		/**< Main loop iterations */
+	double speed_sum;	/**< Sum of the speed samples in the final window */
+	u32 speed_samples;	/**< Number of speed samples in the final window */
+	double speed_dip;	/**< Largest speed deviation after the load step [rpm] */
+	double speed_settle;	/**< Time from the load step until the speed stayed within tolerance [s] */
+	double wall_time;	/**< Host time used [s] */
+};
+
+/**
+ * Governor output packet decoder state.
+ */
+struct sim_gov_rx {
+	int remaining;		/**< Bytes remaining in the current packet */
+	bool string;		/**< Current packet is a string packet */
+	char buf[GP_STR_PAK_MAX_LEN + 1]; /**< String packet contents */
+	int len;		/**< String packet length */
+};
+
+static struct sim_gov_rx sim_gov_rx;
+
+/**
+ * Synchronization monitor state.
+ *
+ * While the firmware is in closed loop the number of commutations in each
+ * window is compared to the number of 60 degree electrical steps the rotor
+ * actually moved. This catches desynchronizations the firmware does not
+ * notice itself.
+ */
+struct sim_sync {
+	double start;		/**< Window start time, < 0 if not running */
+	u32 comms;		/**< Commutation count at window start */
+	double distance;	/**< Rotor distance at window start */
+	u8 steps;		/**< Commutation steps per electrical turn */
+	bool lost;		/**< Motor out of sync in the last window */
+};
+
+static struct sim_sync sim_sync;
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t <s>     simulated time (default 3)\n"
+		"  -i <s>     ignition time (default 0.05)\n"
+		"  -l <s>     main loop iteration time (default 2e-6)\n"
+		"  -P <power> closed loop PWM power 0..32767\n"
+		"  -S <n>[@<s>] switch to PWM scheme n (at time s, default 0)\n"
+		"  -W <rpm>   speed setpoint, 0 disables the speed control\n"
+		"  -Q <n>     torque setpoint in current ADC counts, 0 only limits\n"
+		"  -D <Nm>@<s> step the static load torque at time s\n"
+		"  -L <Nm>    static friction torque\n"
+		"  -F <k>     fan load coefficient [Nm/(rad/s)^2]\n"
+		"  -V <V>     supply voltage\n"
+		"  -T <s>     comparator input filter time constant\n"
+		"  -n <V>     comparator input noise amplitude\n"
+		"  -g <n>     comparator output glitches per second and phase\n"
+		"  -w <rpm>   initial rotor speed in driving direction, negative\n"
+		"             turns backwards\n"
+		"  -s <seed>  noise seed\n"
+		"  -c <file>  write CSV log\n"
+		"  -C <s>     CSV log interval (default 1e-4)\n"
+		"  -R <file>  record a replay trace\n"
+		"  -A <s>     replay trace recording start time\n"
+		"  -d         print governor string packets\n"
+		"  -q         quiet, only print the report\n"
+		"  -r         fail unless the motor reaches closed loop without desync\n"
+		"             and holds the speed setpoint at the end of the run\n",
+		name);
+}
+
+/**
+ * Send a register write to the firmware through the USART.
+ */
+static void sim_gov_write(u8 addr, u16 value)
+{
+	(void)hal_usart_rx(GP_MODE_WRITE | (addr & GP_ADDR_MASK));
+	(void)hal_usart_rx(value & 0xFF);
+	(void)hal_usart_rx(value >> 8);
+}
+
+/**
+ * Decode the governor output stream of the firmware.
+ */
+static void sim_gov_poll(const struct sim_scenario *scenario)
+{
+	int byte;
+
+	while ((byte = hal_usart_tx_pop()) >= 0) {
+		if (sim_gov_rx.remaining == 0) {
+			if ((byte & GP_MODE_STRING) != 0) {
+				sim_gov_rx.string = true;
+				sim_gov_rx.remaining = byte & GP_STR_LEN_MASK;
+				sim_gov_rx.len = 0;
+			} else {
+				/* register packet: address, lsb, msb */
+				sim_gov_rx.string = false;
+				sim_gov_rx.remaining = 2;
+			}
+		} else {
+			if (sim_gov_rx.string)
+				sim_gov_rx.buf[sim_gov_rx.len++] = (char)byte;
+			sim_gov_rx.remaining--;
+		}
+
+		if (sim_gov_rx.string && (sim_gov_rx.remaining == 0)) {
+			sim_gov_rx.buf[sim_gov_rx.len] = 0;
+			if (scenario->strings)
+				printf("%10.6f gov: %s", sim_time(),
+				       sim_gov_rx.buf);
+			sim_gov_rx.string = false;
+		}
+	}
+}
+
+static const char *sim_state_name(enum control_process_state state)
+{
+	switch (state) {
+	case cps_error:
+		return "error";
+	case cps_idle:
+		return "idle";
+	case cps_aligning:
+		return "aligning";
+	case cps_spinup:
+		return "spinup";
+	case cps_spinning:
+		return "spinning";
+	case cps_catching:
+		return "catching";
+	default:
+		return "unknown";
+	}
+}
+
+/**
+ * Update the synchronization monitor.
+ */
+static void sim_sync_check(bool spinning, struct sim_report *report)
+{
+	const struct motor *m = sim_motor();
+	u32 comms = hal_irq_stats[hal_irq_tim1_trg_com].count;
+	double steps;
+	bool lost;
+
+	if (!spinning) {
+		sim_sync.start = -1;
+		sim_sync.lost = false;
+		return;
+	}
+
+	/* A live scheme switch changes the steps per turn, start over */
+	if (sim_sync.steps != pwm_scheme->steps)
+		sim_sync.start = -1;
+
+	if ((sim_sync.start >= 0) &&
+	    ((sim_time() - sim_sync.start) >= SIM_SYNC_WINDOW)) {
+		steps = (m->distance - sim_sync.distance) *
+			m->p.pole_pairs * pwm_scheme->steps / (2 * M_PI);
+		lost = fabs((comms - sim_sync.comms) - steps) >
+			(SIM_SYNC_TOLERANCE * steps + 1);
+		if (lost && !sim_sync.lost)
+			report->desyncs++;
+		sim_sync.lost = lost;
+		sim_sync.start = -1;
+	}
+
+	if (sim_sync.start < 0) {
+		sim_sync.start = sim_time();
+		sim_sync.comms = comms;
+		sim_sync.distance = m->distance;
+		sim_sync.steps = pwm_scheme->steps;
+	}
+}
+
+/**
+ * Update the speed hold metrics.
+ */
+static void sim_speed_check(const struct sim_scenario *scenario,
+			    double rpm, struct sim_report *report)
+{
+	double error;
+
+	if (scenario->speed <= 0)
+		return;
+
+	error = fabs(rpm - scenario->speed);
+
+	if (sim_time() >= scenario->duration - SIM_SPEED_WINDOW) {
+		report->speed_sum += rpm;
+		report->speed_samples++;
+	}
+
+	if ((scenario->load >= 0) && (sim_time() >= scenario->load_time)) {
+		if (error > report->speed_dip)
+			report->speed_dip = error;
+		if (error > SIM_SPEED_TOLERANCE * scenario->speed)
+			report->speed_settle = sim_time() -
+				scenario->load_time;
+	}
+}
+
+static double sim_wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Firmware initialization, same order as in mc_main.c
+ */
+static void sim_firmware_init(void)
+{
+	led_init();
+	debug_pins_init();
+	gprot_init();
+	trace_init();
+#ifdef CAN__GPROT
+	can_init();
+#else
+	usart_init();
+#endif
+#ifdef I2C__ENABLE
+	i2c_init();
+#endif
+	sys_tick_init();
+	cpu_load_process_init();
+	comm_process_init();
+	sensor_process_init();
+	adc_init();
+	pwm_init();
+	comm_tim_init();
+	control_process_init();
+	speed_process_init();
+	torque_process_init();
+	ppm_process_init();
+	bemf_hd_init();
+}
+
+/**
+ * Write the commutation state the replay starts the firmware from.
+ *
+ * The replay trace holds no power stage drive, so the replayed firmware
+ * takes over the PWM step in effect and the commutation time the way the
+ * closed loop takes them over from the spinup.
+ */
+static void sim_record_handover(FILE *f)
+{
+	u8 steps = pwm_scheme->steps;
+
+	/* pwm_step is the step preloaded for the next commutation */
+	fprintf(f, "%.9f closed_loop %u %u\n", sim_time(),
+		(unsigned)((pwm_step + steps - 1) % steps),
+		(unsigned)comm_tim_data.freq);
+}
+
+/**
+ * Run the firmware main loop together with the simulation.
+ */
+static void sim_run(const struct sim_config *config,
+		    const struct sim_scenario *scenario,
+		    struct sim_report *report)
+{
+	enum control_process_state state;
+	enum control_process_state last_state = cps_idle;
+	const struct motor *m = sim_motor();
+	double ignite_at = scenario->ignite_time;
+	double scheme_at = (scenario->scheme >= 0) ? scenario->scheme_time : -1;
+	double load_at = (scenario->load >= 0) ? scenario->load_time : -1;
+	double record_at = config->record ? config->record_start : -1;
+	double csv_next = 0;
+	double start;
+	double rpm;
+	FILE *csv = NULL;
+	int demo_counter = 500;
+	int demo_dir = 1;
+	int x;
+
+	if (scenario->csv) {
+		csv = fopen(scenario->csv, "w");
+		if (!csv) {
+			perror(scenario->csv);
+			exit(1);
+		}
+		fprintf(csv, "time,state,rpm,theta_e,i_a,i_b,i_c,v_a,v_b,v_c,"
+			"i_bus,pwm_val\n");
+	}
+
+	start = sim_wall_time();
+
+	while (sim_time() < scenario->duration) {
+		/* Scenario events */
+		if ((ignite_at >= 0) && (sim_time() >= ignite_at)) {
+			ignite_at = -1;
+			report->ignitions++;
+			sim_gov_write(GPROT_FLAG_REG_ADDR, 0);
+			if (scenario->speed >= 0)
+				sim_gov_write(GPROT_SPEED_SETPOINT_REG_ADDR,
+					      (u16)scenario->speed);
+			if (scenario->torque >= 0)
+				sim_gov_write(GPROT_TORQUE_SETPOINT_REG_ADDR,
+					      (u16)scenario->torque);
+			sim_gov_write(GPROT_FLAG_REG_ADDR, SIM_FLAG_COMM_TIM);
+			if (!scenario->quiet)
+				printf("%10.6f ignite\n", sim_time());
+		}
+
+		if ((scheme_at >= 0) && (sim_time() >= scheme_at)) {
+			scheme_at = -1;
+			sim_gov_write(GPROT_PWM_SCHEME_REG_ADDR,
+				      (u16)scenario->scheme);
+			if (!scenario->quiet)
+				printf("%10.6f pwm scheme %d\n", sim_time(),
+				       (int)scenario->scheme);
+		}
+
+		if ((record_at >= 0) && (sim_time() >= record_at)) {
+			record_at = -1;
+			sim_record_handover(config->record);
+		}
+
+		if ((load_at >= 0) && (sim_time() >= load_at)) {
+			load_at = -1;
+			sim_set_load(scenario->load);
+			if (!scenario->quiet)
+				printf("%10.6f load %g Nm\n", sim_time(),
+				       scenario->load);
+		}
+
+		/* Firmware main loop body, see mc_main.c */
+		run_cpu_load_process();
+
+#ifdef CAN__GPROT
+		if (can_rx_trigger) {
+			can_rx_trigger = false;
+			can_process_rx();
+		}
+#else
+		if (usart_rx_trigger) {
+			usart_rx_trigger = false;
+			usart_process_rx();
+		}
+#endif
+
+#ifdef I2C__ENABLE
+		if (i2c_rx_trigger) {
+			i2c_rx_trigger = false;
+			i2c_process_rx();
+		}
+#endif
+
+		if (*comm_process_trigger) {
+			*comm_process_trigger = false;
+			run_comm_process();
+		}
+
+		run_control_process();
+
+#ifdef PPM__ENABLE
+		run_ppm_process();
+#endif
+
+		if (*sensor_process_trigger) {
+			*sensor_process_trigger = false;
+			run_sensor_process();
+		}
+
+		run_trace_process();
+
+		if (demo) {
+			if (demo_counter == 0) {
+				demo_counter = 300;
+				pwm_val += demo_dir;
+				if (pwm_val > 300) {
+					demo_dir = -1;
+				}
+
+				if (pwm_val < 100) {
+					demo_dir = 1;
+				}
+			} else {
+				demo_counter--;
+			}
+		}
+
+		report->loops++;
+		sim_advance(scenario->loop_time);
+		sim_gov_poll(scenario);
+
+		/* Metrics */
+		rpm = fabs(motor_rpm(m));
+		if (rpm > report->max_rpm)
+			report->max_rpm = rpm;
+		if (report->ignitions > 0)
+			for (x = 0; x < 3; x++)
+				if (fabs(m->i[x]) > report->max_current)
+					report->max_current = fabs(m->i[x]);
+		sim_speed_check(scenario, rpm, report);
+
+		state = control_process_get_state();
+		if (state == cps_spinning)
+			report->spinning_time += scenario->loop_time;
+		sim_sync_check(state == cps_spinning, report);
+
+		if (state != last_state) {
+			if (!scenario->quiet)
+				printf("%10.6f %s -> %s, %.0f rpm\n", sim_time(),
+				       sim_state_name(last_state),
+				       sim_state_name(state), rpm);
+
+			if (state == cps_spinning) {
+				if (report->spinup_time < 0)
+					report->spinup_time = sim_time() -
+						scenario->ignite_time;
+				if (scenario->power >= 0)
+					sim_gov_write(GPROT_PWM_VAL_REG_ADDR,
+						      (u16)scenario->power);
+			}
+
+			if (last_state == cps_spinning)
+				report->exits++;
+
+			if ((state == cps_idle) && (ignite_at < 0))
+				ignite_at = sim_time() + SIM_RESTART_DELAY;
+
+			last_state = state;
+		}
+
+		if (csv && (sim_time() >= csv_next)) {
+			csv_next += scenario->csv_interval;
+			fprintf(csv, "%.6f,%d,%.1f,%.1f,%.3f,%.3f,%.3f,%.3f,"
+				"%.3f,%.3f,%.3f,%u\n",
+				sim_time(), (int)state, motor_rpm(m),
+				fmod(m->theta * m->p.pole_pairs, 2 * M_PI) *
+				180 / M_PI,
+				m->i[0], m->i[1], m->i[2],
+				m->v[0], m->v[1], m->v[2],
+				m->i_bus, (unsigned)pwm_val);
+		}
+	}
+
+	report->wall_time = sim_wall_time() - start;
+
+	if (csv)
+		fclose(csv);
+}
+
+static void sim_print_report(const struct sim_scenario *scenario,
+			     const struct sim_report *report)
+{
+	double isr_ns = 0;
+	int i;
+
+	printf("simulated time:    %.3f s (%.3f s host)\n",
+	       scenario->duration, report->wall_time);
+	if (report->spinup_time >= 0)
+		printf("spinup time:       %.4f s\n", report->spinup_time);
+	else
+		printf("spinup time:       never\n");
+	printf("max speed:         %.0f rpm\n", report->max_rpm);
+	printf("peak current:      %.1f A\n", report->max_current);
+	printf("ignitions:         %u\n", report->ignitions);
+	printf("closed loop exits: %u\n", report->exits);
+	printf("desyncs:           %u", report->desyncs);
+	if (report->spinning_time > 0)
+		printf(" (%.2f per spinning minute)",
+		       (report->desyncs + report->exits) * 60 /
+		       report->spinning_time);
+	printf("\n");
+	if (scenario->speed > 0) {
+		printf("speed setpoint:    %d rpm\n", (int)scenario->speed);
+		printf("final speed:       %.0f rpm\n",
+		       report->speed_samples ?
+		       report->speed_sum / report->speed_samples : 0.0);
+		if (scenario->load >= 0)
+			printf("load step:         %.0f rpm max deviation, "
+			       "settled after %.3f s\n", report->speed_dip,
+			       report->speed_settle);
+	}
+	printf("main loop:         %u iterations\n", report->loops);
+	printf("%-14s %10s %10s %10s %10s\n",
+	       "interrupt", "calls", "calls/s", "mean ns", "max ns");
+	for (i = 0; i < hal_irq_num; i++) {
+		isr_ns += hal_irq_stats[i].ns_total;
+		printf("%-14s %10u %10.0f %10.0f %10llu\n",
+		       hal_irq_names[i], hal_irq_stats[i].count,
+		       hal_irq_stats[i].count / scenario->duration,
+		       hal_irq_stats[i].count ?
+		       (double)hal_irq_stats[i].ns_total /
+		       hal_irq_stats[i].count : 0.0,
+		       (unsigned long long)hal_irq_stats[i].ns_max);
+	}
+	printf("interrupt share:   %.1f %% of host time\n",
+	       (report->wall_time > 0) ?
+	       isr_ns * 1e-7 / report->wall_time : 0.0);
+}
+
+/**
+ * Main function of the host simulation.
+ */
+int main(int argc, char *argv[])
+{
+	struct sim_config config;
+	struct sim_scenario scenario;
+	struct sim_report report;
+	char *end;
+	int opt;
+
+	sim_config_default(&config);
+
+	scenario.duration = 3;
+	scenario.ignite_time = 0.05;
+	scenario.loop_time = 2e-6;
+	scenario.power = -1;
+	scenario.scheme = -1;
+	scenario.scheme_time = 0;
+	scenario.speed = -1;
+	scenario.torque = -1;
+	scenario.load = -1;
+	scenario.load_time = 0;
+	scenario.csv = NULL;
+	scenario.csv_interval = 1e-4;
+	scenario.quiet = false;
+	scenario.strings = false;
+	scenario.require = false;
+
+	while ((opt = getopt(argc, argv, "t:i:l:P:S:W:Q:D:L:F:V:T:n:g:w:s:c:C:R:A:dqrh")) != -1) {
+		switch (opt) {
+		case 't':
+			scenario.duration = atof(optarg);
+			break;
+		case 'i':
+			scenario.ignite_time = atof(optarg);
+			break;
+		case 'l':
+			scenario.loop_time = atof(optarg);
+			break;
+		case 'P':
+			scenario.power = atoi(optarg);
+			break;
+		case 'S':
+			scenario.scheme = strtol(optarg, &end, 0);
+			if (*end == '@')
+				scenario.scheme_time = atof(end + 1);
+			break;
+		case 'W':
+			scenario.speed = atoi(optarg);
+			break;
+		case 'Q':
+			scenario.torque = atoi(optarg);
+			break;
+		case 'D':
+			scenario.load = strtod(optarg, &end);
+			if (*end == '@')
+				scenario.load_time = atof(end + 1);
+			break;
+		case 'L':
+			config.motor.t_static = atof(optarg);
+			break;
+		case 'F':
+			config.motor.k_fan = atof(optarg);
+			break;
+		case 'V':
+			config.motor.vbus = atof(optarg);
+			break;
+		case 'T':
+			config.comp_tau = atof(optarg);
+			break;
+		case 'n':
+			config.noise = atof(optarg);
+			break;
+		case 'g':
+			config.glitch = atof(optarg);
+			break;
+		case 'w':
+			/* The firmware turns the motor model backwards */
+			config.rpm = -atof(optarg);
+			break;
+		case 's':
+			config.seed = (u32)strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			scenario.csv = optarg;
+			break;
+		case 'C':
+			scenario.csv_interval = atof(optarg);
+			break;
+		case 'R':
+			config.record = fopen(optarg, "w");
+			if (!config.record) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'A':
+			config.record_start = atof(optarg);
+			break;
+		case 'd':
+			scenario.strings = true;
+			break;
+		case 'q':
+			scenario.quiet = true;
+			break;
+		case 'r':
+			scenario.require = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((scenario.loop_time <= 0) || (scenario.duration <= 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	report.spinup_time = -1;
+	report.spinning_time = 0;
+	report.max_rpm = 0;
+	report.max_current = 0;
+	report.ignitions = 0;
+	report.exits = 0;
+	report.desyncs = 0;
+	report.loops = 0;
+	report.speed_sum = 0;
+	report.speed_samples = 0;
+	report.speed_dip = 0;
+	report.speed_settle = 0;
+	report.wall_time = 0;
+
+	if (config.record)
+		fprintf(config.record, "# mc_sim recording, vbus %.1f V, "
+			"static load %g Nm, fan load %g, power %d\n",
+			config.motor.vbus, config.motor.t_static,
+			config.motor.k_fan, (int)scenario.power);
+
+	sim_sync.start = -1;
+	sim_sync.lost = false;
+
+	sim_init(&config);
+	sim_firmware_init();
+
+	sim_run(&config, &scenario, &report);
+
+	sim_print_report(&scenario, &report);
+
+	if (config.record)
+		fclose(config.record);
+
+	if (scenario.require &&
+	    ((report.spinup_time < 0) || (report.exits != 0) ||
+	     (report.desyncs != 0))) {
+		fprintf(stderr, "FAIL: motor did not reach closed loop "
+			"without losing sync\n");
+		return 1;
+	}
+
+	if (scenario.require && (scenario.speed > 0) &&
+	    ((report.speed_samples == 0) ||
+	     (fabs(report.speed_sum / report.speed_samples - scenario.speed) >
+	      SIM_SPEED_TOLERANCE * scenario.speed))) {
+		fprintf(stderr, "FAIL: motor did not hold the speed setpoint\n");
+		return 1;
+	}
+
+	return 0;
+}
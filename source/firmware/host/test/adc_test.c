@@ -0,0 +1,431 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   adc_test.c
+ *
+ * @brief  PWM synchronous ADC sampling tests.
+ *
+ * Runs the ADC driver together with the PWM driver on the peripheral
+ * models: TIM1 CC4 triggers the regular sequence, the DMA moves it into the
+ * double buffer and the block complete interrupt calls the callback.
+ * Checks that there is exactly one callback per PWM period at a fixed point
+ * of the period, that every block holds the current conversions of one
+ * sequence, that the slow battery voltage and temperature conversions of
+ * the ADC2 injected sequence end up in the right fields and are not older
+ * than one sequence, and that the sensor process trigger keeps its 10 ms
+ * rate.
+ *
+ * With noise on the inputs checks that the per period block averages and
+ * the sensor interval averages reduce it by the number of samples taken,
+ * and measures the cost of the block processing against the PWM period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "types.h"
+
+#include "driver/sys_tick.h"
+#include "driver/adc.h"
+#include "pwm/pwm.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+void dma1_channel1_irq_handler(void);
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Timer clock [Hz].
+ */
+#define ADC_TEST_CLOCK 72e6
+
+/**
+ * Real PWM period [s], TIM1 counts from 0 to the auto reload value.
+ */
+#define ADC_TEST_PERIOD ((PWM__BASE_CLOCK / PWM__FREQUENCY + 1) / ADC_TEST_CLOCK)
+
+/**
+ * ADC clock cycles of one conversion.
+ */
+#define ADC_TEST_CONV_CYCLES (1.5 + 12.5)
+
+/**
+ * Duration of the battery voltage and temperature injected sequence [s].
+ */
+#define ADC_TEST_SLOW_TIME (2 * (239.5 + 12.5) / 12e6)
+
+/**
+ * Number of PWM periods a slow conversion can be old before it is replaced:
+ * its own sequence, the next one and the triggers they had to wait for.
+ */
+#define ADC_TEST_SLOW_PERIODS \
+	((u16)(2 * ADC_TEST_SLOW_TIME / ADC_TEST_PERIOD) + 2)
+
+/**
+ * ADC input channels of current, battery voltage and temperature.
+ */
+#define ADC_TEST_CHANNEL_CURRENT 4
+#define ADC_TEST_CHANNEL_BATTERY 3
+#define ADC_TEST_CHANNEL_TEMP 5
+
+/**
+ * Test state shared with the ADC callback.
+ */
+struct adc_test {
+	double time;		/**< Simulated time [s] */
+	u16 generation;		/**< Input values generation */
+	u32 callbacks;		/**< Number of callbacks */
+	u32 mixed;		/**< Blocks not matching the inputs */
+	u32 stale;		/**< Slow conversions too old or on the wrong channel */
+	u32 slow;		/**< Slow conversions seen */
+	u32 triggers;		/**< Sensor process triggers seen */
+	double first;		/**< Time of the first callback [s] */
+	double last;		/**< Time of the last callback [s] */
+	double min_interval;	/**< Shortest callback interval [s] */
+	double max_interval;	/**< Longest callback interval [s] */
+};
+
+static struct adc_test test;
+
+/**
+ * Set all inputs to values encoding the generation and the channel.
+ */
+static void test_set_inputs(u16 generation)
+{
+	u16 base = (u16)((generation & 0x3FF) << 2);
+
+	hal_adc_set_channel(ADC_TEST_CHANNEL_CURRENT, base | 1);
+	hal_adc_set_channel(ADC_TEST_CHANNEL_BATTERY, base | 2);
+	hal_adc_set_channel(ADC_TEST_CHANNEL_TEMP, base | 3);
+}
+
+/**
+ * Check that a slow conversion holds the given channel code of one of the
+ * last generations.
+ */
+static bool test_slow_fresh(u16 value, u16 code)
+{
+	u16 age = (u16)((test.generation - (value >> 2)) & 0x3FF);
+
+	return ((value & 3) == code) && (age <= ADC_TEST_SLOW_PERIODS);
+}
+
+/**
+ * ADC callback, checks the block against the inputs and changes them.
+ */
+static void test_adc_callback(void)
+{
+	u16 base = (u16)((test.generation & 0x3FF) << 2);
+	double interval;
+
+	if (adc_data.current != (base | 1))
+		test.mixed++;
+
+	/* Nothing converted before the first sequence completed */
+	if ((adc_data.battery_voltage != 0) || (adc_data.temp != 0)) {
+		test.slow++;
+		if (!test_slow_fresh(adc_data.battery_voltage, 2) ||
+		    !test_slow_fresh(adc_data.temp, 3))
+			test.stale++;
+	}
+
+	if (adc_data.trigger) {
+		adc_data.trigger = false;
+		test.triggers++;
+	}
+
+	if (test.callbacks == 0) {
+		test.first = test.time;
+	} else {
+		interval = test.time - test.last;
+		test.min_interval = fmin(test.min_interval, interval);
+		test.max_interval = fmax(test.max_interval, interval);
+	}
+	test.last = test.time;
+	test.callbacks++;
+
+	test.generation++;
+	test_set_inputs(test.generation);
+}
+
+/**
+ * Bring up the drivers on reset peripheral models.
+ */
+static void test_init(void)
+{
+	hal_reset();
+	sys_tick_init();
+	adc_init();
+	pwm_init();
+	adc_set_callback(test_adc_callback);
+
+	test.time = 0;
+	test.generation = 0;
+	test.callbacks = 0;
+	test.mixed = 0;
+	test.stale = 0;
+	test.slow = 0;
+	test.triggers = 0;
+	test.min_interval = INFINITY;
+	test.max_interval = 0;
+	test_set_inputs(0);
+}
+
+/**
+ * Run the peripheral models.
+ *
+ * @param duration Time to run [s]
+ * @param dt Time step [s]
+ */
+static void test_run(double duration, double dt)
+{
+	double end = test.time + duration;
+
+	while (test.time < end) {
+		hal_tim_advance(dt);
+		hal_sys_tick_advance(dt);
+		hal_adc_advance(dt);
+		test.time += dt;
+		hal_irq_service();
+	}
+}
+
+static void test_period(void)
+{
+	const double dt = 1e-8;
+	const double duration = 200 * ADC_TEST_PERIOD;
+	double phase;
+	double expect;
+	u32 periods;
+
+	test_init();
+	test_run(duration, dt);
+
+	periods = (u32)((duration - test.first) / ADC_TEST_PERIOD) + 1;
+	phase = fmod(test.first, ADC_TEST_PERIOD);
+	/* CC4 match, relay timer and the conversion sequence */
+	expect = fmod((TIM1->CCR4 + 1) / ADC_TEST_CLOCK +
+		      ADC_SAMPLES * ADC_TEST_CONV_CYCLES / 12e6,
+		      ADC_TEST_PERIOD);
+
+	if (!test_quiet)
+		printf("period:            %u callbacks in %u periods, "
+		       "interval %.3f..%.3f us, phase %.3f us (%.3f us), "
+		       "%u slow conversions stale\n",
+		       test.callbacks, periods, test.min_interval * 1e6,
+		       test.max_interval * 1e6, phase * 1e6, expect * 1e6,
+		       test.stale);
+
+	CHECK(abs((int)test.callbacks - (int)periods) <= 1,
+	      "%u callbacks in %u periods", test.callbacks, periods);
+	CHECK(fabs(test.min_interval - ADC_TEST_PERIOD) < 2 * dt,
+	      "shortest interval %.3f us", test.min_interval * 1e6);
+	CHECK(fabs(test.max_interval - ADC_TEST_PERIOD) < 2 * dt,
+	      "longest interval %.3f us", test.max_interval * 1e6);
+	CHECK(fabs(phase - expect) < 4 * dt,
+	      "sample block complete at %.3f us in the period, "
+	      "expected %.3f us", phase * 1e6, expect * 1e6);
+	CHECK(test.mixed == 0, "%u blocks mixed up", test.mixed);
+	CHECK(test.slow + ADC_TEST_SLOW_PERIODS >= test.callbacks,
+	      "slow conversions only in %u of %u periods", test.slow,
+	      test.callbacks);
+	CHECK(test.stale == 0, "%u slow conversions stale or mixed up",
+	      test.stale);
+}
+
+static void test_sensor_rate(void)
+{
+	const double dt = 1e-7;
+
+	test_init();
+	test_run(0.0305, dt);
+
+	if (!test_quiet)
+		printf("sensor rate:       %u triggers in 30 ms, "
+		       "%u blocks mixed up, %u slow conversions stale\n",
+		       test.triggers, test.mixed, test.stale);
+
+	CHECK(test.triggers == 3, "%u sensor triggers in 30 ms",
+	      test.triggers);
+	CHECK(test.mixed == 0, "%u blocks mixed up", test.mixed);
+	CHECK(test.stale == 0, "%u slow conversions stale or mixed up",
+	      test.stale);
+}
+
+/**
+ * Noise statistics of one value.
+ */
+struct test_stat {
+	double sum;		/**< Sum of the deviations */
+	double sq;		/**< Sum of the squared deviations */
+	double max;		/**< Largest deviation */
+	u32 n;			/**< Number of values */
+};
+
+/**
+ * Noise statistics of the per period and the sensor interval values.
+ */
+static struct test_stat test_fast[3];
+static struct test_stat test_slow[3];
+
+/**
+ * Input values of current, battery voltage and temperature.
+ */
+static const u16 test_input[3] = { 2048, 1500, 1000 };
+
+static void test_stat_add(struct test_stat *s, double value)
+{
+	s->sum += value;
+	s->sq += value * value;
+	s->max = fmax(s->max, fabs(value));
+	s->n++;
+}
+
+static double test_stat_rms(const struct test_stat *s)
+{
+	return (s->n != 0) ? sqrt(s->sq / s->n) : INFINITY;
+}
+
+/**
+ * ADC callback of the noise test, records the deviation from the inputs.
+ */
+static void test_noise_callback(void)
+{
+	test_stat_add(&test_fast[0], adc_data.current - test_input[0]);
+	/* Nothing converted before the first slow sequence completed */
+	if (adc_data.battery_voltage != 0) {
+		test_stat_add(&test_fast[1],
+			      adc_data.battery_voltage - test_input[1]);
+		test_stat_add(&test_fast[2], adc_data.temp - test_input[2]);
+	}
+
+	if (adc_data.trigger) {
+		adc_data.trigger = false;
+		test_stat_add(&test_slow[0], adc_data.current_avg -
+			      test_input[0]);
+		test_stat_add(&test_slow[1], adc_data.battery_voltage_avg -
+			      test_input[1]);
+		test_stat_add(&test_slow[2], adc_data.temp_avg - test_input[2]);
+	}
+}
+
+static void test_noise(void)
+{
+	const double rms = 8;
+	const char *name[3] = { "current", "battery", "temp" };
+	/* Samples per block of each value */
+	const int samples[3] = { ADC_SAMPLES, 1, 1 };
+	/* Blocks sharing one sample of each value */
+	const double blocks[3] = { 1, ADC_TEST_SLOW_TIME / ADC_TEST_PERIOD,
+				   ADC_TEST_SLOW_TIME / ADC_TEST_PERIOD };
+	double mean;
+	double fast;
+	double slow;
+	int i;
+
+	test_init();
+	adc_set_callback(test_noise_callback);
+	hal_adc_set_channel(ADC_TEST_CHANNEL_CURRENT, test_input[0]);
+	hal_adc_set_channel(ADC_TEST_CHANNEL_BATTERY, test_input[1]);
+	hal_adc_set_channel(ADC_TEST_CHANNEL_TEMP, test_input[2]);
+	hal_adc_set_noise(ADC_TEST_CHANNEL_CURRENT, rms);
+	hal_adc_set_noise(ADC_TEST_CHANNEL_BATTERY, rms);
+	hal_adc_set_noise(ADC_TEST_CHANNEL_TEMP, rms);
+	for (i = 0; i < 3; i++) {
+		test_fast[i] = (struct test_stat){ 0, 0, 0, 0 };
+		test_slow[i] = (struct test_stat){ 0, 0, 0, 0 };
+	}
+
+	test_run(0.0505, 1e-7);
+
+	for (i = 0; i < 3; i++) {
+		fast = test_stat_rms(&test_fast[i]);
+		slow = test_stat_rms(&test_slow[i]);
+
+		if (!test_quiet)
+			printf("noise %-8s     input %.1f, block %.2f "
+			       "(%.2f expected), interval %.2f max %.0f "
+			       "counts rms\n", name[i], rms, fast,
+			       rms / sqrt(samples[i]), slow,
+			       test_slow[i].max);
+
+		CHECK(fast < 1.15 * rms / sqrt(samples[i]),
+		      "%s block noise %.2f counts rms", name[i], fast);
+		/* Three standard errors of the mean of the independent samples */
+		mean = test_fast[i].sum / test_fast[i].n;
+		CHECK(fabs(mean) < 3 * rms / sqrt(test_fast[i].n *
+						 samples[i] / blocks[i]),
+		      "%s block average off by %.2f counts", name[i], mean);
+		CHECK(test_slow[i].n >= 4, "%s only %u interval values",
+		      name[i], test_slow[i].n);
+		CHECK(test_slow[i].max <= 1,
+		      "%s interval average off by %.0f counts", name[i],
+		      test_slow[i].max);
+	}
+}
+
+static void test_speed(void)
+{
+	const u32 blocks = 1000000;
+	const double budget_ns = 1e9 * ADC_TEST_PERIOD;
+	u64 start_ns, ns;
+	u32 sum = 0;
+	u32 n;
+
+	test_init();
+	adc_set_callback(NULL);
+
+	start_ns = test_ns();
+	for (n = 0; n < blocks; n++) {
+		dma1_channel1_irq_handler();
+		sum += adc_data.current;
+	}
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("block processing:  %.2f ns/block, %.3f%% of the "
+		       "%.2f us PWM period (%u)\n", (double)ns / blocks,
+		       100 * (double)ns / blocks / budget_ns,
+		       budget_ns / 1000, sum & 1);
+
+	if (test_bench)
+		CHECK((double)ns / blocks < budget_ns / 20,
+		      "block processing %.2f ns above 5%% of the PWM period",
+		      (double)ns / blocks);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_period();
+	test_sensor_rate();
+	test_noise();
+	test_speed();
+
+	return test_report("ADC");
+}
@@ -0,0 +1,332 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   bemf_fit_test.c
+ *
+ * @brief  BEMF zero crossing estimator accuracy and cost benchmark.
+ *
+ * Samples the sinusoidal BEMF of the floating phase once per PWM period
+ * with a random offset to the crossing, the way the ADC samples it for the
+ * sampling commutation process, and adds measurement noise and switching
+ * spikes. The crossing is estimated once the newest sample is past zero,
+ * by the line fit over the samples of the commutation step and by the two
+ * point interpolation it replaces. A crossing the fit does not confirm is
+ * waited for with the next samples, as the commutation process does. The
+ * errors are reported in electrical degrees.
+ *
+ * Checks that the fit finds an exact line crossing to the tick, refuses
+ * samples sloping the wrong way and does not take a spike for a crossing.
+ * Over many crossings it has to be as good as the interpolation without
+ * noise and better with noise or spikes. A spike on the first sample of a
+ * step still gets interpolated, so spikes are not rejected completely. The
+ * cost per estimate is reported as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+
+#include "bemf_fit.h"
+
+#include "test.h"
+
+/**
+ * Commutation timer clock [Hz].
+ */
+#define BEMF_FIT_TEST_CLOCK 14400000
+
+/**
+ * ADC sampling interval, one PWM period at 16 kHz [ticks].
+ */
+#define BEMF_FIT_TEST_PERIOD 900
+
+/**
+ * Samples the crossing is fitted over.
+ */
+#define BEMF_FIT_TEST_K 5
+
+/**
+ * Distance from the fitted line rejecting a sample [ADC counts].
+ */
+#define BEMF_FIT_TEST_RESIDUAL 200
+
+/**
+ * BEMF amplitude at 60000 electrical rpm [ADC counts].
+ */
+#define BEMF_FIT_TEST_AMPLITUDE 2000
+
+/**
+ * Switching spike height [ADC counts].
+ */
+#define BEMF_FIT_TEST_SPIKE 800
+
+/**
+ * Crossings estimated per case.
+ */
+#define BEMF_FIT_TEST_CROSSINGS 4000
+
+/**
+ * Sampling condition.
+ */
+struct bemf_fit_test_case {
+	const char *name;	/**< Case name */
+	double erpm;		/**< Electrical speed [rpm] */
+	s32 noise;		/**< Uniform noise amplitude [ADC counts] */
+	double spikes;		/**< Probability of a sample being a spike */
+};
+
+static const struct bemf_fit_test_case bemf_fit_test_cases[] = {
+	{ "clean 6k:", 6000, 0, 0 },
+	{ "clean 20k:", 20000, 0, 0 },
+	{ "clean 50k:", 50000, 0, 0 },
+	{ "noise 12k:", 12000, 20, 0 },
+	{ "noise 30k:", 30000, 20, 0 },
+	{ "spikes 6k:", 6000, 10, 0.1 },
+	{ "spikes 12k:", 12000, 10, 0.1 },
+};
+
+static u32 test_rand_state = 12345;
+
+/**
+ * Uniform pseudo random number in 0..1, reproducible.
+ */
+static double test_rand(void)
+{
+	test_rand_state = test_rand_state * 1103515245 + 12345;
+
+	return (double)(test_rand_state >> 8) / (double)(1 << 24);
+}
+
+/**
+ * Exact line samples give the crossing to the tick, samples sloping the
+ * wrong way or all at the same time give none.
+ */
+static void test_line(void)
+{
+	struct bemf_fit fit;
+	enum bemf_fit_result result;
+	u32 time = 0;
+	int i;
+
+	/* Rising through zero at 0xFFFFF000 + 2000, across a timer wrap */
+	bemf_fit_init(&fit, 4, 100);
+	for (i = 0; i < 4; i++)
+		bemf_fit_add(&fit, 0xFFFFF000 + (u32)(i * 900),
+			     (s16)((i * 900 - 2000) / 4));
+	result = bemf_fit_crossing(&fit, true, &time);
+	CHECK((result == bf_crossing) && (time == 0xFFFFF000 + 2000),
+	      "line: crossing %d %08x", result, time);
+	CHECK(bemf_fit_crossing(&fit, false, &time) == bf_pending,
+	      "line: rising taken as falling");
+
+	/* One spike among exact samples is dropped */
+	bemf_fit_init(&fit, 5, 100);
+	for (i = 0; i < 5; i++)
+		bemf_fit_add(&fit, (u32)(i * 900),
+			     (s16)((1700 - i * 900) / 2 + ((i == 1) ? 500 : 0)));
+	result = bemf_fit_crossing(&fit, false, &time);
+	CHECK((result == bf_crossing) && (time >= 1699) && (time <= 1701),
+	      "line: crossing with spike %d %u", result, time);
+
+	/* A spike on the newest sample is no crossing yet */
+	bemf_fit_init(&fit, 5, 100);
+	for (i = 0; i < 5; i++)
+		bemf_fit_add(&fit, (u32)(i * 900),
+			     (s16)((i * 900 - 6000) / 2 + ((i == 4) ? 800 : 0)));
+	CHECK(bemf_fit_crossing(&fit, true, &time) == bf_pending,
+	      "line: spike taken as crossing");
+
+	/* More samples than k keep the newest */
+	bemf_fit_init(&fit, 3, 100);
+	for (i = 0; i < 6; i++)
+		bemf_fit_add(&fit, (u32)(i * 900),
+			     (s16)((i < 3) ? -1000 : (i * 900 - 4000)));
+	result = bemf_fit_crossing(&fit, true, &time);
+	CHECK((result == bf_crossing) && (time == 4000),
+	      "line: window crossing %d %u", result, time);
+
+	/* Single samples and samples at the same time */
+	bemf_fit_reset(&fit);
+	bemf_fit_add(&fit, 100, 5);
+	CHECK(bemf_fit_crossing(&fit, true, &time) == bf_unknown,
+	      "line: single sample");
+	bemf_fit_add(&fit, 100, 7);
+	CHECK(bemf_fit_crossing(&fit, true, &time) == bf_unknown,
+	      "line: same time");
+}
+
+/**
+ * Two point interpolation of the commutation process, kept between the two
+ * samples like comm_process_interpolate().
+ */
+static u32 test_interpolate(u32 prev_time, s32 prev, u32 time, s32 value)
+{
+	s32 rise = value - prev;
+	s32 adjust;
+
+	if (rise <= 0)
+		return time;
+
+	adjust = (-prev * (s32)(time - prev_time)) / rise;
+	if (adjust < 0)
+		adjust = 0;
+	if (adjust > (s32)(time - prev_time))
+		adjust = (s32)(time - prev_time);
+
+	return prev_time + (u32)adjust;
+}
+
+/**
+ * BEMF sample, with noise and spikes.
+ */
+static s32 test_sample(const struct bemf_fit_test_case *c, double amplitude,
+		       double period, s32 t)
+{
+	s32 value = (s32)lround(amplitude * sin(2 * M_PI * t / period));
+
+	if (c->noise > 0)
+		value += (s32)lround((2 * test_rand() - 1) * c->noise);
+	if (test_rand() < c->spikes)
+		value += (test_rand() < 0.5) ? BEMF_FIT_TEST_SPIKE :
+			-BEMF_FIT_TEST_SPIKE;
+
+	return value;
+}
+
+/**
+ * Estimate crossings under one sampling condition.
+ */
+static void test_case(const struct bemf_fit_test_case *c)
+{
+	double period = 60.0 / c->erpm * BEMF_FIT_TEST_CLOCK;
+	double amplitude = BEMF_FIT_TEST_AMPLITUDE * c->erpm / 60000;
+	s32 step = (s32)(period / 6);
+	double fit_err = 0;
+	double interp_err = 0;
+	double fit_max = 0;
+	double err;
+	struct bemf_fit fit;
+	enum bemf_fit_result result;
+	bool interpolated;
+	u32 crossing;
+	u32 prev_time;
+	s32 prev;
+	u32 time;
+	s32 value;
+	u32 est;
+	u32 interp;
+	u64 start;
+	u64 ns = 0;
+	int calls = 0;
+	int fallbacks = 0;
+	int n;
+
+	bemf_fit_init(&fit, BEMF_FIT_TEST_K, BEMF_FIT_TEST_RESIDUAL);
+
+	for (n = 0; n < BEMF_FIT_TEST_CROSSINGS; n++) {
+		/* Crossing 30 degrees into the step, random PWM phase */
+		crossing = 0x7FFF0000 + (u32)(n * 7919);
+		time = crossing - (u32)(step / 2) +
+			(u32)(test_rand() * BEMF_FIT_TEST_PERIOD);
+		bemf_fit_reset(&fit);
+
+		/* The first sample of the step is held off */
+		prev_time = time;
+		prev = test_sample(c, amplitude, period,
+				   (s32)(time - crossing));
+		interpolated = false;
+		est = crossing + (u32)(step / 2);
+		interp = est;
+		result = bf_pending;
+
+		while ((s32)(time - crossing) < step / 2) {
+			time += BEMF_FIT_TEST_PERIOD;
+			value = test_sample(c, amplitude, period,
+					    (s32)(time - crossing));
+			bemf_fit_add(&fit, time, (s16)value);
+
+			if ((value >= 0) && (value > prev)) {
+				if (!interpolated) {
+					interp = test_interpolate(prev_time,
+								  prev, time,
+								  value);
+					interpolated = true;
+				}
+
+				start = test_ns();
+				result = bemf_fit_crossing(&fit, true, &est);
+				ns += test_ns() - start;
+				calls++;
+
+				if (result == bf_unknown) {
+					est = test_interpolate(prev_time,
+							       prev, time,
+							       value);
+					fallbacks++;
+				}
+			}
+
+			if ((result != bf_pending) && interpolated)
+				break;
+
+			prev_time = time;
+			prev = value;
+		}
+
+		/* Missed crossings count as commutating at the step end */
+		err = fabs((s32)(est - crossing) * 360.0 / period);
+		fit_err += err;
+		fit_max = fmax(fit_max, err);
+		interp_err += fabs((s32)(interp - crossing) * 360.0 / period);
+	}
+
+	fit_err /= BEMF_FIT_TEST_CROSSINGS;
+	interp_err /= BEMF_FIT_TEST_CROSSINGS;
+
+	if (!test_quiet)
+		printf("%-13s fit %6.2f deg (max %6.2f), interpolation "
+		       "%6.2f deg, %4d fallbacks, %5.1f ns\n", c->name,
+		       fit_err, fit_max, interp_err, fallbacks,
+		       (double)ns / calls);
+
+	if ((c->noise == 0) && (c->spikes == 0))
+		CHECK(fit_err <= interp_err + 0.1,
+		      "%s fit %.2f deg, interpolation %.2f deg", c->name,
+		      fit_err, interp_err);
+	else
+		CHECK(fit_err < interp_err,
+		      "%s fit %.2f deg, interpolation %.2f deg", c->name,
+		      fit_err, interp_err);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+
+	test_parse_args(argc, argv);
+
+	test_line();
+	for (i = 0; i < sizeof(bemf_fit_test_cases) /
+		     sizeof(bemf_fit_test_cases[0]); i++)
+		test_case(&bemf_fit_test_cases[i]);
+
+	return test_report("BEMF fit");
+}
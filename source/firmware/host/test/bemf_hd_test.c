@@ -0,0 +1,400 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   bemf_hd_test.c
+ *
+ * @brief  BEMF comparator edge qualification tests.
+ *
+ * Checks the N of M vote on its own, then runs the hardware BEMF detection
+ * on the EXTI, GPIO and timer models. A comparator glitch must be rejected
+ * without a capture, also at a commutation time of only a few PWM periods,
+ * a clean edge must be captured at the time of the edge and a bouncing edge
+ * must cost only a few comparator interrupts. A commutation that gets due
+ * while an edge is voted on must wait for the vote. Edges outside of the
+ * crossing window must not be seen at all, neither must edges of phases
+ * the active commutation step drives.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+#include "types.h"
+
+#include <stm32/tim.h>
+
+#include "bemf_vote.h"
+#include "comm_tim.h"
+#include "pwm/pwm.h"
+#include "driver/bemf_hardware_detect.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Simulation time step [s].
+ */
+#define BEMF_HD_TEST_DT 1e-6
+
+/**
+ * Commutation time used for the driver tests, long enough to vote on.
+ */
+#define BEMF_HD_TEST_FREQ 20000
+
+/**
+ * Short commutation time at high speed that is still voted on, five PWM
+ * periods [commutation timer ticks].
+ */
+#define BEMF_HD_TEST_FAST_FREQ 500
+
+/**
+ * PWM period, TIM1 counts at the core clock without prescaler [s].
+ */
+#define BEMF_HD_TEST_PWM_PERIOD \
+	(((PWM__BASE_CLOCK / PWM__FREQUENCY) + 1) / HAL_CORE_CLOCK)
+
+/**
+ * Time to run after an edge, longer than the longest vote [s].
+ */
+#define BEMF_HD_TEST_SETTLE ((BEMF_HD__VOTE_M + 2) * BEMF_HD_TEST_PWM_PERIOD)
+
+/**
+ * Feed a vote with samples given as a string of '1' and '0'.
+ *
+ * @return Result after the last sample
+ */
+static enum bemf_vote_result test_vote_run(u8 n, u8 m, const char *samples)
+{
+	struct bemf_vote vote;
+	enum bemf_vote_result result = bv_pending;
+
+	bemf_vote_init(&vote, n, m);
+	bemf_vote_start(&vote, true);
+	for (; *samples != '\0'; samples++)
+		result = bemf_vote_sample(&vote, *samples == '1');
+
+	return result;
+}
+
+/**
+ * Check the vote outcome for a few sample sequences.
+ */
+static void test_vote(void)
+{
+	static const struct {
+		u8 n;
+		u8 m;
+		const char *samples;
+		enum bemf_vote_result result;
+	} cases[] = {
+		{ 2, 3, "1", bv_pending },
+		{ 2, 3, "11", bv_confirmed },
+		{ 2, 3, "011", bv_confirmed },
+		{ 2, 3, "101", bv_confirmed },
+		{ 2, 3, "0", bv_pending },
+		{ 2, 3, "00", bv_rejected },
+		{ 2, 3, "100", bv_rejected },
+		{ 1, 1, "1", bv_confirmed },
+		{ 1, 1, "0", bv_rejected },
+		{ 3, 5, "10101", bv_confirmed },
+		{ 3, 5, "1001", bv_pending },
+		{ 3, 5, "10010", bv_rejected },
+		/* n is clamped to m, m to at least one sample */
+		{ 4, 2, "1", bv_pending },
+		{ 4, 2, "11", bv_confirmed },
+		{ 0, 2, "10", bv_rejected },
+		{ 0, 0, "1", bv_confirmed },
+	};
+	enum bemf_vote_result result;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		result = test_vote_run(cases[i].n, cases[i].m,
+				       cases[i].samples);
+		CHECK(result == cases[i].result,
+		      "vote %u of %u on %s: result %d, expected %d",
+		      cases[i].n, cases[i].m, cases[i].samples, result,
+		      cases[i].result);
+	}
+
+	if (!test_quiet)
+		printf("vote:          %u sequences\n", i);
+}
+
+static void test_step(void)
+{
+	hal_tim_advance(BEMF_HD_TEST_DT);
+	hal_irq_service();
+}
+
+static void test_run(double duration)
+{
+	double t;
+
+	for (t = 0; t < duration; t += BEMF_HD_TEST_DT)
+		test_step();
+}
+
+/**
+ * Bring up PWM, commutation timer and BEMF detection with all comparators
+ * low and the crossing window open.
+ */
+static void test_init_freq(u32 freq)
+{
+	int x;
+
+	hal_reset();
+	for (x = 0; x < 3; x++)
+		hal_bemf_set(x, false);
+
+	pwm_init();
+	comm_tim_init();
+	bemf_hd_init();
+
+	PWM_SET(PWM__MAX_POWER / 2);
+	TIM_SetCompare1(TIM1, pwm_duty());
+	comm_tim_data.freq = freq;
+	comm_tim_trigger_comm = false;
+
+	test_run(BEMF_HD_TEST_SETTLE);
+	bemf_hd_data.trigger = false;
+}
+
+static void test_init(void)
+{
+	test_init_freq(BEMF_HD_TEST_FREQ);
+}
+
+static u32 test_exti(void)
+{
+	return hal_irq_stats[hal_irq_exti15_10].count;
+}
+
+/**
+ * A comparator pulse shorter than a PWM period is no crossing, also at a
+ * commutation time of only a few PWM periods.
+ *
+ * @param name Test name
+ * @param freq Commutation time [commutation timer ticks]
+ */
+static void test_glitch(const char *name, u32 freq)
+{
+	test_init_freq(freq);
+
+	hal_bemf_set(0, true);
+	test_step();
+	test_step();
+	hal_bemf_set(0, false);
+	test_run(BEMF_HD_TEST_SETTLE);
+
+	if (!test_quiet)
+		printf("%-14s %u rejected, trigger %d\n", name,
+		       bemf_hd_data.glitches, bemf_hd_data.trigger);
+
+	CHECK(!bemf_hd_data.trigger, "%s taken as a crossing", name);
+	CHECK(bemf_hd_data.glitches == 1, "%s %u edges rejected", name,
+	      bemf_hd_data.glitches);
+}
+
+/**
+ * A clean edge is taken with the time it happened at, not the time the
+ * vote confirmed it.
+ */
+static void test_edge(void)
+{
+	u32 time;
+
+	test_init();
+
+	time = comm_tim_now();
+	hal_bemf_set(1, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+
+	if (!test_quiet)
+		printf("edge:          source %d, capture %+d ticks\n",
+		       bemf_hd_data.source,
+		       (s32)(comm_tim_data.last_capture_time - time));
+
+	CHECK(bemf_hd_data.trigger, "edge: not taken as a crossing");
+	CHECK(bemf_hd_data.source == bemf_hd_phase_v_rising,
+	      "edge: source %d", bemf_hd_data.source);
+	CHECK((comm_tim_data.last_capture_time - time) <=
+	      (u32)(BEMF_HD_TEST_DT * COMM_TIM_CLOCK) + 1,
+	      "edge: capture %d ticks after the edge",
+	      (s32)(comm_tim_data.last_capture_time - time));
+	CHECK(bemf_hd_data.glitches == 0, "edge: %u edges rejected",
+	      bemf_hd_data.glitches);
+}
+
+/**
+ * A bouncing edge is taken once and the bounces do not reach the EXTI
+ * handler while the vote runs.
+ */
+static void test_bounce(void)
+{
+	const int bounces = 20;
+	u32 exti;
+	u32 time;
+	int i;
+
+	test_init();
+
+	exti = test_exti();
+	time = comm_tim_now();
+	for (i = 0; i < bounces; i++) {
+		hal_bemf_set(2, (i & 1) == 0);
+		test_step();
+	}
+	hal_bemf_set(2, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+	exti = test_exti() - exti;
+
+	if (!test_quiet)
+		printf("bounce:        %d edges, %u interrupts, source %d, "
+		       "capture %+d ticks\n", bounces, exti,
+		       bemf_hd_data.source,
+		       (s32)(comm_tim_data.last_capture_time - time));
+
+	CHECK(bemf_hd_data.trigger, "bounce: not taken as a crossing");
+	CHECK(bemf_hd_data.source == bemf_hd_phase_w_rising,
+	      "bounce: source %d", bemf_hd_data.source);
+	CHECK(exti <= 2, "bounce: %u interrupts for %d edges", exti, bounces);
+}
+
+/**
+ * An edge that comes shortly before the commutation of the running step is
+ * due holds the commutation until its vote ends, it is taken as the
+ * crossing and the step is commutated once, from the edge.
+ */
+static void test_late(void)
+{
+	u32 time;
+	u32 comms;
+
+	test_init_freq(BEMF_HD_TEST_FAST_FREQ);
+
+	/* Commutation due a fraction of a PWM period from now */
+	comm_tim_data.last_capture_time = comm_tim_now() -
+		BEMF_HD_TEST_FAST_FREQ + (BEMF_HD_PWM_TICKS / 4);
+	comm_tim_update_freq();
+	comm_tim_trigger_comm = true;
+
+	comms = hal_irq_stats[hal_irq_tim1_trg_com].count;
+	time = comm_tim_now();
+	hal_bemf_set(0, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+	comms = hal_irq_stats[hal_irq_tim1_trg_com].count - comms;
+
+	if (!test_quiet)
+		printf("late edge:     %u commutations while voting, trigger %d, "
+		       "capture %+d ticks\n", comms, bemf_hd_data.trigger,
+		       (s32)(comm_tim_data.last_capture_time - time));
+
+	CHECK(bemf_hd_data.trigger, "late edge: not taken as a crossing");
+	CHECK(comms == 0, "late edge: %u commutations while voting", comms);
+
+	comm_tim_trigger_comm = false;
+}
+
+/**
+ * Edges are not seen while the window is closed, and an edge that happened
+ * meanwhile is no crossing once it opens again.
+ */
+static void test_window(void)
+{
+	u32 exti;
+
+	test_init();
+
+	exti = test_exti();
+	bemf_hd_window_close();
+	hal_bemf_set(0, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+	bemf_hd_window_open();
+	test_run(BEMF_HD_TEST_SETTLE);
+	exti = test_exti() - exti;
+
+	if (!test_quiet)
+		printf("window:        %u interrupts, trigger %d\n", exti,
+		       bemf_hd_data.trigger);
+
+	CHECK(exti == 0, "window: %u interrupts while closed", exti);
+	CHECK(!bemf_hd_data.trigger, "window: edge taken while closed");
+}
+
+/**
+ * Only the comparator of the floating phase opens a crossing.
+ */
+static void test_floating(void)
+{
+	test_init();
+
+	/* Phase B floating */
+	pwm_floating = 1 << 1;
+	hal_bemf_set(0, true);
+	hal_bemf_set(2, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+
+	CHECK(!bemf_hd_data.trigger, "floating: driven phase taken");
+	CHECK(bemf_hd_data.driven != 0, "floating: driven phase edges not seen");
+
+	hal_bemf_set(1, true);
+	test_run(BEMF_HD_TEST_SETTLE);
+
+	if (!test_quiet)
+		printf("floating:      edges %u %u %u, %u driven, source %d\n",
+		       bemf_hd_data.edges[0], bemf_hd_data.edges[1],
+		       bemf_hd_data.edges[2], bemf_hd_data.driven,
+		       bemf_hd_data.source);
+
+	CHECK(bemf_hd_data.trigger, "floating: floating phase not taken");
+	CHECK(bemf_hd_data.source == bemf_hd_phase_v_rising,
+	      "floating: source %d", bemf_hd_data.source);
+	CHECK((bemf_hd_data.edges[0] == 0) && (bemf_hd_data.edges[1] == 1) &&
+	      (bemf_hd_data.edges[2] == 0), "floating: edges %u %u %u",
+	      bemf_hd_data.edges[0], bemf_hd_data.edges[1],
+	      bemf_hd_data.edges[2]);
+
+	pwm_floating = 0;
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_vote();
+	test_floating();
+#ifdef BEMF_HD__QUALIFY
+	test_glitch("glitch:", BEMF_HD_TEST_FREQ);
+	test_glitch("fast glitch:", BEMF_HD_TEST_FAST_FREQ);
+	test_edge();
+	test_bounce();
+	test_late();
+	test_window();
+#endif
+
+	return test_report("BEMF detection");
+}
@@ -0,0 +1,486 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   can_test.c
+ *
+ * @brief  CAN governor transport tests.
+ *
+ * Runs the CAN driver on the CAN model as node CAN__DEFAULT_ADDR with the
+ * governor protocol handled from an emulated main loop, while the test
+ * plays the master and a number of other nodes on the same bus. Checks
+ * that register writes addressed to the node and to all nodes arrive
+ * complete and in order, that traffic for the other nodes never passes the
+ * filter banks, that register reads are answered in order in frames of at
+ * most GP_CAN_PAYLOAD bytes on the answer identifier of the node, and that
+ * the number of interrupts follows the number of frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "driver/can.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Simulation time step [s].
+ */
+#define CAN_TEST_DT 1e-6
+
+/**
+ * Node id of the controller under test.
+ */
+#define CAN_TEST_NODE CAN__DEFAULT_ADDR
+
+/**
+ * Number of other nodes on the bus.
+ */
+#define CAN_TEST_OTHERS 3
+
+/**
+ * Number of test registers, starting at address 1.
+ */
+#define CAN_TEST_REGS 4
+
+/**
+ * Largest number of register writes recorded.
+ */
+#define CAN_TEST_MAX_WRITES 1024
+
+/**
+ * Test state shared with the governor hooks.
+ */
+struct can_test {
+	u16 regs[CAN_TEST_REGS];		/**< Test registers */
+	u16 written[CAN_TEST_MAX_WRITES];	/**< Values seen by the hook */
+	u8 written_addr[CAN_TEST_MAX_WRITES];	/**< Addresses seen by the hook */
+	int writes;				/**< Register changed hook calls */
+	u8 tx[4096];				/**< Answer bytes of the node */
+	int tx_len;				/**< Number of answer bytes */
+	int tx_frames;				/**< Number of answer frames */
+	int tx_bad_frames;			/**< Frames with wrong id or size */
+	u8 req[GP_CAN_PAYLOAD];			/**< Request frame being packed */
+	int req_len;				/**< Bytes in the request frame */
+	int req_frames;				/**< Request frames sent */
+	bool stalled;				/**< Main loop not processing */
+};
+
+static struct can_test test;
+
+static void test_trigger_output(void *data)
+{
+	(void)data;
+	can_enable_send();
+}
+
+static void test_register_changed(void *data, u8 addr)
+{
+	(void)data;
+
+	if (test.writes < CAN_TEST_MAX_WRITES) {
+		test.written_addr[test.writes] = addr;
+		test.written[test.writes] = test.regs[addr - 1];
+	}
+	test.writes++;
+}
+
+static void test_init(void)
+{
+	int i;
+
+	hal_reset();
+	(void)gpc_init(test_trigger_output, NULL, test_register_changed, NULL);
+	for (i = 0; i < CAN_TEST_REGS; i++) {
+		test.regs[i] = 0;
+		(void)gpc_setup_reg((u8)(i + 1), &test.regs[i]);
+	}
+	can_init();
+
+	test.writes = 0;
+	test.tx_len = 0;
+	test.tx_frames = 0;
+	test.tx_bad_frames = 0;
+	test.req_len = 0;
+	test.req_frames = 0;
+	test.stalled = false;
+}
+
+/**
+ * Put a frame of another node or the master on the bus.
+ */
+static void test_frame(u32 id, const u8 *data, int len)
+{
+	struct hal_can_frame frame;
+	int i;
+
+	frame.id = id;
+	frame.ext = false;
+	frame.len = (u8)len;
+	for (i = 0; i < 8; i++)
+		frame.data[i] = (i < len) ? data[i] : 0;
+
+	(void)hal_can_rx(&frame);
+}
+
+/**
+ * Send the request frame packed so far to a node.
+ */
+static void test_flush(u8 node)
+{
+	if (test.req_len == 0)
+		return;
+
+	test_frame(GP_CAN_REQUEST_ID(node), test.req, test.req_len);
+	test.req_len = 0;
+	test.req_frames++;
+}
+
+/**
+ * Pack a request packet into the request frame, packets are never split
+ * across frames.
+ */
+static void test_request(u8 node, const u8 *packet, int len)
+{
+	int i;
+
+	if (test.req_len + len > GP_CAN_PAYLOAD)
+		test_flush(node);
+
+	for (i = 0; i < len; i++)
+		test.req[test.req_len++] = packet[i];
+}
+
+static void test_request_write(u8 node, u8 addr, u16 value)
+{
+	u8 packet[3];
+
+	packet[0] = GP_MODE_WRITE | (addr & GP_ADDR_MASK);
+	packet[1] = value & 0xFF;
+	packet[2] = value >> 8;
+	test_request(node, packet, 3);
+}
+
+static void test_request_read(u8 node, u8 addr)
+{
+	u8 packet = GP_MODE_READ | GP_MODE_PEEK | (addr & GP_ADDR_MASK);
+
+	test_request(node, &packet, 1);
+}
+
+/**
+ * Run the CAN model together with the main loop part of the driver.
+ */
+static void test_run(double duration)
+{
+	struct hal_can_frame frame;
+	double t;
+	int i;
+
+	for (t = 0; t < duration; t += CAN_TEST_DT) {
+		hal_can_advance(CAN_TEST_DT);
+		hal_irq_service();
+
+		if (can_rx_trigger && !test.stalled) {
+			can_rx_trigger = false;
+			can_process_rx();
+		}
+
+		while (hal_can_tx_pop(&frame) == 0) {
+			test.tx_frames++;
+			if ((frame.id != GP_CAN_ANSWER_ID(CAN_TEST_NODE)) ||
+			    frame.ext || (frame.len == 0) ||
+			    (frame.len > GP_CAN_PAYLOAD))
+				test.tx_bad_frames++;
+			for (i = 0; i < frame.len; i++) {
+				if (test.tx_len < (int)sizeof(test.tx))
+					test.tx[test.tx_len] = frame.data[i];
+				test.tx_len++;
+			}
+		}
+	}
+}
+
+static u32 test_irqs(enum hal_irq irq)
+{
+	return hal_irq_stats[irq].count;
+}
+
+/**
+ * Value of the n-th register write of a test sequence.
+ */
+static u16 test_value(int n)
+{
+	return (u16)(0x1234 + (n * 0x0101));
+}
+
+/**
+ * Node id of the n-th other node on the bus.
+ */
+static u8 test_other(int n)
+{
+	return (u8)(CAN_TEST_NODE + 1 + (n % CAN_TEST_OTHERS));
+}
+
+/**
+ * Send register writes to the node interleaved with writes to the other
+ * nodes and check that only ours arrive, in order.
+ *
+ * @param name Test name
+ * @param node Node id the writes are addressed to, ours or broadcast
+ * @param total Number of register writes
+ */
+static void test_writes(const char *name, u8 node, int total)
+{
+	int wrong = 0;
+	int ours, others;
+	int n, o;
+
+	test_init();
+
+	for (n = 0; n < total; n++) {
+		test_request_write(node, (u8)((n % CAN_TEST_REGS) + 1),
+				   test_value(n));
+		/* Keep the bus busy with traffic for the other nodes */
+		if ((n % 2) == 1) {
+			test_flush(node);
+			for (o = 0; o < CAN_TEST_OTHERS; o++) {
+				test_request_write(test_other(o), 1, 0xDEAD);
+				test_request_write(test_other(o), 2, 0xBEEF);
+				test_flush(test_other(o));
+			}
+		}
+	}
+	test_flush(node);
+
+	ours = (total + 1) / 2;
+	others = test.req_frames - ours;
+
+	test_run((test.req_frames + 10) * 120e-6);
+
+	for (n = 0; (n < total) && (n < test.writes); n++) {
+		if ((test.written_addr[n] != (n % CAN_TEST_REGS) + 1) ||
+		    (test.written[n] != test_value(n)))
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("%-18s %d writes in %d frames, %d frames for other "
+		       "nodes, %u rejected, %u rx interrupts, %d wrong\n", name,
+		       total, ours, others, hal_can_stats.rx_rejected,
+		       test_irqs(hal_irq_usb_lp_can_rx0), wrong);
+
+	CHECK(test.writes == total, "%s: %d of %d writes arrived", name,
+	      test.writes, total);
+	CHECK(wrong == 0, "%s: %d writes wrong or out of order", name, wrong);
+	CHECK(hal_can_stats.rx_frames == (u32)ours,
+	      "%s: %u of %d frames accepted", name, hal_can_stats.rx_frames,
+	      ours);
+	CHECK(hal_can_stats.rx_rejected == (u32)others,
+	      "%s: %u of %d frames for other nodes rejected", name,
+	      hal_can_stats.rx_rejected, others);
+	CHECK(hal_can_stats.rx_overruns == 0 && can_rx_overruns == 0,
+	      "%s: %u frames and %u bytes lost", name,
+	      hal_can_stats.rx_overruns, can_rx_overruns);
+	CHECK(test_irqs(hal_irq_usb_lp_can_rx0) <= (u32)ours,
+	      "%s: %u rx interrupts for %d frames", name,
+	      test_irqs(hal_irq_usb_lp_can_rx0), ours);
+}
+
+/**
+ * Send a frame with a data length code above 8 and check that only the 8
+ * data bytes reach the governor.
+ */
+static void test_long_dlc(void)
+{
+	int wrong = 0;
+	int n;
+
+	test_init();
+
+	test_request_write(CAN_TEST_NODE, 1, test_value(0));
+	test_request_write(CAN_TEST_NODE, 2, test_value(1));
+	test_request_read(CAN_TEST_NODE, 1);
+	test_request_read(CAN_TEST_NODE, 2);
+	test_frame(GP_CAN_REQUEST_ID(CAN_TEST_NODE), test.req, 15);
+	test.req_len = 0;
+	test.req_frames++;
+
+	test_request_write(CAN_TEST_NODE, 3, test_value(2));
+	test_flush(CAN_TEST_NODE);
+
+	test_run(10 * 120e-6);
+
+	for (n = 0; (n < 3) && (n < test.writes); n++) {
+		if ((test.written_addr[n] != n + 1) ||
+		    (test.written[n] != test_value(n)))
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("long dlc:          %d of 3 writes, %d answer bytes, "
+		       "%d wrong\n", test.writes, test.tx_len, wrong);
+
+	CHECK(test.writes == 3, "%d of 3 writes around a long DLC frame",
+	      test.writes);
+	CHECK(wrong == 0, "%d writes wrong around a long DLC frame", wrong);
+	CHECK(test.tx_len == 6, "%d answer bytes for 2 reads", test.tx_len);
+}
+
+/**
+ * Stall the main loop until the receive buffer overflows in the middle of
+ * a register write and check that the overrun is counted and that the
+ * governor parser picks up the next writes.
+ */
+static void test_overrun(void)
+{
+	const int stalled = 60;
+	const int after = 4;
+	u32 overruns;
+	int wrong = 0;
+	int n;
+
+	test_init();
+
+	test.stalled = true;
+	for (n = 0; n < stalled; n++) {
+		test_request_write(CAN_TEST_NODE, 2, test_value(n));
+		/* Leave a write cut in half at the end of every frame */
+		if (test.req_len == 6) {
+			test.req[test.req_len++] = GP_MODE_WRITE | 1;
+			test_flush(CAN_TEST_NODE);
+		}
+	}
+	test_flush(CAN_TEST_NODE);
+	test_run((test.req_frames + 10) * 120e-6);
+	test.stalled = false;
+	test_run(10 * 120e-6);
+
+	overruns = can_rx_overruns;
+	CHECK(overruns != 0, "no receive overruns after a stall");
+	CHECK(test.writes == 0, "%d writes handled from an overrun buffer",
+	      test.writes);
+
+	for (n = 0; n < after; n++)
+		test_request_write(CAN_TEST_NODE, 3, test_value(n));
+	test_flush(CAN_TEST_NODE);
+	test_run((after + 10) * 120e-6);
+
+	for (n = 0; (n < after) && (n < test.writes); n++) {
+		if ((test.written_addr[n] != 3) ||
+		    (test.written[n] != test_value(n)))
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("overrun:           %u bytes lost while stalled, %d of %d "
+		       "writes after, %d wrong\n", overruns, test.writes, after,
+		       wrong);
+
+	CHECK(test.writes == after, "%d of %d writes after an overrun",
+	      test.writes, after);
+	CHECK(wrong == 0, "%d writes wrong after an overrun", wrong);
+	CHECK(can_rx_overruns == overruns, "%u bytes lost after the stall",
+	      can_rx_overruns - overruns);
+}
+
+/**
+ * Read the test registers in bursts and check the answers.
+ */
+static void test_reads(void)
+{
+	const int bursts = 20;
+	const int per_burst = 40;
+	int total = bursts * per_burst;
+	int wrong = 0;
+	int b, i, n, o;
+	u8 addr;
+
+	test_init();
+	for (i = 0; i < CAN_TEST_REGS; i++)
+		test.regs[i] = (u16)(0xA000 + (i * 0x0111));
+
+	for (b = 0, n = 0; b < bursts; b++) {
+		for (i = 0; i < per_burst; i++, n++)
+			test_request_read(CAN_TEST_NODE,
+					  (u8)((n % CAN_TEST_REGS) + 1));
+		test_flush(CAN_TEST_NODE);
+
+		/* Requests to the other nodes win the arbitration */
+		for (o = 0; o < CAN_TEST_OTHERS; o++)
+			for (i = 0; i < 5; i++)
+				test_frame(GP_CAN_REQUEST_ID(test_other(o)),
+					   test.req, GP_CAN_PAYLOAD);
+
+		/* Requests, answers and the other traffic */
+		test_run(((per_burst / 8) + (per_burst * 3 / 8) +
+			  (CAN_TEST_OTHERS * 5) + 10) * 120e-6);
+	}
+
+	for (n = 0; (n < total) && ((n * 3) + 2 < test.tx_len); n++) {
+		addr = (u8)((n % CAN_TEST_REGS) + 1);
+		if ((test.tx[n * 3] != addr) ||
+		    (test.tx[(n * 3) + 1] != (test.regs[addr - 1] & 0xFF)) ||
+		    (test.tx[(n * 3) + 2] != (test.regs[addr - 1] >> 8)))
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("reads:             %d reads in %d frames, %d bytes "
+		       "answered in %d frames, %u tx interrupts, %d wrong\n",
+		       total, test.req_frames, test.tx_len, test.tx_frames,
+		       test_irqs(hal_irq_usb_hp_can_tx), wrong);
+
+	CHECK(test.tx_len == total * 3, "%d of %d answer bytes", test.tx_len,
+	      total * 3);
+	CHECK(wrong == 0, "%d answers wrong", wrong);
+	CHECK(test.tx_bad_frames == 0, "%d answer frames with wrong id or size",
+	      test.tx_bad_frames);
+	/* Full frames, one short frame per burst and at the buffer wrap */
+	CHECK(test.tx_frames <= (total * 3 / GP_CAN_PAYLOAD) + (bursts * 2),
+	      "%d answer frames for %d bytes", test.tx_frames, total * 3);
+	CHECK(test_irqs(hal_irq_usb_hp_can_tx) <= (u32)test.tx_frames,
+	      "%u tx interrupts for %d frames", test_irqs(hal_irq_usb_hp_can_tx),
+	      test.tx_frames);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_writes("node writes:", CAN_TEST_NODE, 200);
+	test_writes("broadcast writes:", GP_CAN_NODE_BROADCAST, 200);
+	test_reads();
+	test_long_dlc();
+	test_overrun();
+
+	return test_report("CAN");
+}
@@ -0,0 +1,320 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   comm_map_test.c
+ *
+ * @brief  Commutation advance and blanking map tests.
+ *
+ * Checks that the maps of @ref comm_map.h give the configured points at
+ * their crossing periods, interpolate linearly and without steps in between
+ * and hold the first and last point outside of the map, also while the
+ * governor leaves the points unsorted during a rewrite. The index and value
+ * registers are driven the way the governor hook in gprot.c does it. The
+ * default advance map is checked to never retard the commutation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "gprot.h"
+#include "comm_map.h"
+
+#include "test.h"
+
+/**
+ * Longest crossing period swept by the tests [commutation timer ticks].
+ */
+#define COMM_MAP_TEST_MAX_PERIOD 70000
+
+/**
+ * Governor write to a map register.
+ */
+static void test_write(u8 addr, u16 value)
+{
+	if (addr == GPROT_COMM_MAP_INDEX_REG_ADDR)
+		comm_map.index = value;
+	else
+		comm_map.value = value;
+	comm_map_handle_reg(addr);
+}
+
+/**
+ * Governor read of a map entry.
+ */
+static u16 test_read(u16 index)
+{
+	test_write(GPROT_COMM_MAP_INDEX_REG_ADDR, index);
+	return comm_map.value;
+}
+
+/**
+ * Check that a looked up advance and blanking time is within the range of
+ * the map points.
+ */
+static bool test_in_points(s16 advance, u16 blank)
+{
+	const struct comm_map_point *p = comm_map.point;
+	s16 advance_min = p[0].advance;
+	s16 advance_max = p[0].advance;
+	u16 blank_min = p[0].blank;
+	u16 blank_max = p[0].blank;
+	int i;
+
+	for (i = 1; i < COMM_MAP_POINTS; i++) {
+		if (p[i].advance < advance_min)
+			advance_min = p[i].advance;
+		if (p[i].advance > advance_max)
+			advance_max = p[i].advance;
+		if (p[i].blank < blank_min)
+			blank_min = p[i].blank;
+		if (p[i].blank > blank_max)
+			blank_max = p[i].blank;
+	}
+
+	return (advance >= advance_min) && (advance <= advance_max) &&
+		(blank >= blank_min) && (blank <= blank_max);
+}
+
+/**
+ * Check the map points and the clamping outside of the map.
+ */
+static void test_points(void)
+{
+	const struct comm_map_point *p = comm_map.point;
+	s16 advance;
+	u16 blank;
+	int i;
+
+	comm_map_init();
+
+	for (i = 0; i < COMM_MAP_POINTS; i++) {
+		comm_map_lookup(&comm_map, p[i].period, &advance, &blank);
+		CHECK((advance == p[i].advance) && (blank == p[i].blank),
+		      "point %d: %d ticks advance, %u ticks blanking at %u "
+		      "ticks, configured %d and %u", i, advance, blank,
+		      p[i].period, p[i].advance, p[i].blank);
+	}
+
+	comm_map_lookup(&comm_map, 0, &advance, &blank);
+	CHECK((advance == p[0].advance) && (blank == p[0].blank),
+	      "below the map: %d ticks advance, %u ticks blanking", advance,
+	      blank);
+
+	comm_map_lookup(&comm_map, COMM_MAP_TEST_MAX_PERIOD, &advance, &blank);
+	CHECK((advance == p[COMM_MAP_POINTS - 1].advance) &&
+	      (blank == p[COMM_MAP_POINTS - 1].blank),
+	      "above the map: %d ticks advance, %u ticks blanking", advance,
+	      blank);
+
+	if (!test_quiet)
+		printf("points:            %d points from %u to %u ticks\n",
+		       COMM_MAP_POINTS, p[0].period,
+		       p[COMM_MAP_POINTS - 1].period);
+}
+
+/**
+ * Sweep the crossing period and check that the maps stay in between the
+ * neighbouring points and do not step.
+ *
+ * @param name Test name
+ */
+static void test_sweep(const char *name)
+{
+	const struct comm_map_point *p = comm_map.point;
+	s16 advance;
+	u16 blank;
+	s16 last_advance = 0;
+	u16 last_blank = 0;
+	int outside = 0;
+	int max_step = 0;
+	u32 period;
+	int i;
+
+	for (period = 0; period < COMM_MAP_TEST_MAX_PERIOD; period++) {
+		comm_map_lookup(&comm_map, period, &advance, &blank);
+
+		for (i = 0; (i < COMM_MAP_POINTS - 1) &&
+			     (period > p[i + 1].period); i++)
+			;
+		if (period > p[i].period) {
+			if ((advance < p[i].advance && advance < p[i + 1].advance) ||
+			    (advance > p[i].advance && advance > p[i + 1].advance) ||
+			    (blank < p[i].blank && blank < p[i + 1].blank) ||
+			    (blank > p[i].blank && blank > p[i + 1].blank))
+				outside++;
+		}
+
+		if (period > 0) {
+			if (abs(advance - last_advance) > max_step)
+				max_step = abs(advance - last_advance);
+			if (abs(blank - last_blank) > max_step)
+				max_step = abs(blank - last_blank);
+		}
+		last_advance = advance;
+		last_blank = blank;
+	}
+
+	if (!test_quiet)
+		printf("%-18s %d outside of the points, %d ticks largest step\n",
+		       name, outside, max_step);
+
+	CHECK(outside == 0, "%s: %d periods outside of the points", name,
+	      outside);
+	/* Steepest segment of the test maps is below one tick per tick */
+	CHECK(max_step <= 1, "%s: map steps by %d ticks", name, max_step);
+}
+
+/**
+ * Pin the sign convention of the default advance map.
+ *
+ * The map advance is added to the crossing period, so negative entries
+ * commutate earlier. The defaults must never retard the commutation against
+ * the constant advance and must not advance less at higher speed.
+ */
+static void test_default_advance(void)
+{
+	s16 advance;
+	s16 last_advance = 0;
+	u16 blank;
+	int retarded = 0;
+	int decreasing = 0;
+	u32 period;
+
+	comm_map_init();
+
+	for (period = COMM_MAP_TEST_MAX_PERIOD; period > 0; period--) {
+		comm_map_lookup(&comm_map, period, &advance, &blank);
+
+		if (advance > 0)
+			retarded++;
+		if ((period < COMM_MAP_TEST_MAX_PERIOD) &&
+		    (advance > last_advance))
+			decreasing++;
+		last_advance = advance;
+	}
+
+	if (!test_quiet)
+		printf("default advance:   %d periods retarded, %d periods with "
+		       "less advance at higher speed\n", retarded, decreasing);
+
+	CHECK(retarded == 0, "default advance retards at %d periods",
+	      retarded);
+	CHECK(decreasing == 0, "default advance drops with speed at %d "
+	      "periods", decreasing);
+}
+
+/**
+ * Rewrite the maps over the governor registers.
+ */
+static void test_registers(void)
+{
+	static const u16 period[COMM_MAP_POINTS] = {
+		1500, 2500, 5000, 10000, 20000
+	};
+	static const s16 advance[COMM_MAP_POINTS] = {
+		-800, -400, 0, 200, 200
+	};
+	static const u16 blank[COMM_MAP_POINTS] = {
+		100, 200, 600, 1200, 1200
+	};
+	const struct comm_map_point *p = comm_map.point;
+	int wrong = 0;
+	s16 a;
+	u16 b;
+	int i;
+
+	comm_map_init();
+
+	for (i = 0; i < COMM_MAP_POINTS; i++) {
+		if ((test_read((u16)(i * COMM_MAP_FIELDS)) != p[i].period) ||
+		    ((s16)test_read((u16)(i * COMM_MAP_FIELDS + 1)) !=
+		     p[i].advance) ||
+		    (test_read((u16)(i * COMM_MAP_FIELDS + 2)) != p[i].blank))
+			wrong++;
+	}
+	CHECK(wrong == 0, "%d default points read back wrong", wrong);
+
+	/* Longest period first, the points are unsorted in between */
+	for (i = COMM_MAP_POINTS - 1; i >= 0; i--) {
+		test_write(GPROT_COMM_MAP_INDEX_REG_ADDR,
+			   (u16)(i * COMM_MAP_FIELDS));
+		test_write(GPROT_COMM_MAP_VALUE_REG_ADDR, period[i]);
+		test_write(GPROT_COMM_MAP_INDEX_REG_ADDR,
+			   (u16)(i * COMM_MAP_FIELDS + 1));
+		test_write(GPROT_COMM_MAP_VALUE_REG_ADDR, (u16)advance[i]);
+		test_write(GPROT_COMM_MAP_INDEX_REG_ADDR,
+			   (u16)(i * COMM_MAP_FIELDS + 2));
+		test_write(GPROT_COMM_MAP_VALUE_REG_ADDR, blank[i]);
+
+		comm_map_lookup(&comm_map, period[i] - 1, &a, &b);
+		CHECK(test_in_points(a, b), "rewriting point %d: %d ticks "
+		      "advance, %u ticks blanking", i, a, b);
+	}
+
+	for (i = 0, wrong = 0; i < COMM_MAP_POINTS; i++) {
+		if ((p[i].period != period[i]) || (p[i].advance != advance[i]) ||
+		    (p[i].blank != blank[i]))
+			wrong++;
+	}
+	CHECK(wrong == 0, "%d points written wrong", wrong);
+
+	comm_map_lookup(&comm_map, (period[0] + period[1]) / 2, &a, &b);
+	CHECK((a == (advance[0] + advance[1]) / 2) &&
+	      (b == (blank[0] + blank[1]) / 2),
+	      "rewritten map: %d ticks advance, %u ticks blanking in between "
+	      "the first points", a, b);
+
+	/* An out of range index selects the first entry */
+	CHECK(test_read(COMM_MAP_POINTS * COMM_MAP_FIELDS) == period[0],
+	      "out of range index reads %u", comm_map.value);
+	CHECK(comm_map.index == 0, "out of range index left at %u",
+	      comm_map.index);
+
+	if (!test_quiet)
+		printf("registers:         %d values written, %d wrong\n",
+		       COMM_MAP_POINTS * COMM_MAP_FIELDS, wrong);
+
+	test_sweep("rewritten sweep:");
+
+	/* Duplicate period, as while moving a point over its neighbour */
+	test_write(GPROT_COMM_MAP_INDEX_REG_ADDR, 2 * COMM_MAP_FIELDS);
+	test_write(GPROT_COMM_MAP_VALUE_REG_ADDR, period[1]);
+	comm_map_lookup(&comm_map, period[1], &a, &b);
+	CHECK(a == advance[1], "duplicate period: %d ticks advance", a);
+	comm_map_lookup(&comm_map, (period[1] + period[3]) / 2, &a, &b);
+	CHECK((a == (advance[1] + advance[3]) / 2) &&
+	      (b == (blank[1] + blank[3]) / 2),
+	      "duplicate period: %d ticks advance, %u ticks blanking over "
+	      "the skipped point", a, b);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_points();
+	test_sweep("default sweep:");
+	test_default_advance();
+	test_registers();
+
+	return test_report("map");
+}
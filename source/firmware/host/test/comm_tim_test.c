@@ -0,0 +1,176 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   comm_tim_test.c
+ *
+ * @brief  32 bit commutation time base tests.
+ *
+ * Runs the commutation timer on the TIM2 model. Checks that the time base
+ * follows the elapsed time without jumps across many TIM2 wraps, and that
+ * commutation times shorter and longer than one wrap are hit on time, once
+ * and in the right wrap, followed by the next one two periods later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#include "comm_tim.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Simulation time step [s].
+ */
+#define COMM_TIM_TEST_DT 1e-6
+
+/**
+ * Largest accepted timing error, one simulation step in timer ticks.
+ */
+#define COMM_TIM_TEST_MAX_ERROR 15
+
+static void test_step(void)
+{
+	hal_tim_advance(COMM_TIM_TEST_DT);
+	hal_irq_service();
+}
+
+/**
+ * Follow the time base over a quarter second.
+ */
+static void test_time_base(void)
+{
+	const int steps = 250000;
+	u32 start;
+	u32 prev;
+	u32 now;
+	s32 err;
+	s32 max_err = 0;
+	int backwards = 0;
+	int i;
+
+	hal_reset();
+	comm_tim_init();
+
+	start = comm_tim_now();
+	prev = start;
+	for (i = 1; i <= steps; i++) {
+		test_step();
+		now = comm_tim_now();
+		if ((s32)(now - prev) < 0)
+			backwards++;
+		prev = now;
+
+		err = (s32)(now - start) -
+			(s32)((double)i * COMM_TIM_TEST_DT * COMM_TIM_CLOCK);
+		if (err < 0)
+			err = -err;
+		if (err > max_err)
+			max_err = err;
+	}
+
+	if (!test_quiet)
+		printf("time base:     %u ticks in %d wraps, max error %d, "
+		       "%d backwards\n", prev - start, (int)((prev - start) >> 16),
+		       max_err, backwards);
+
+	CHECK(backwards == 0, "time base went backwards %d times", backwards);
+	CHECK(max_err <= COMM_TIM_TEST_MAX_ERROR, "time base error %d ticks",
+	      max_err);
+}
+
+/**
+ * Run until the commutation timer fires or the timeout expires.
+ *
+ * @return time of the commutation timer event
+ */
+static u32 test_wait_event(u32 timeout)
+{
+	u32 start = comm_tim_now();
+
+	comm_tim_trigger = false;
+	while (!comm_tim_trigger && ((comm_tim_now() - start) < timeout))
+		test_step();
+
+	return comm_tim_now();
+}
+
+/**
+ * Schedule a commutation freq ticks ahead and check the event and the
+ * following one.
+ */
+static void test_freq(u32 freq)
+{
+	u32 start;
+	u32 first;
+	u32 second;
+	s32 err1;
+	s32 err2;
+
+	hal_reset();
+	comm_tim_init();
+
+	/* Let the time base run a few wraps first */
+	while (comm_tim_now() < 0x28000)
+		test_step();
+
+	comm_tim_data.freq = freq;
+	comm_tim_update_capture();
+	start = comm_tim_data.last_capture_time;
+
+	first = test_wait_event(freq * 3);
+	err1 = (s32)(first - (start + freq));
+	CHECK(comm_tim_data.last_capture_time == start + freq,
+	      "freq %u: capture time off by %d", freq,
+	      (s32)(comm_tim_data.last_capture_time - (start + freq)));
+
+	second = test_wait_event(freq * 3);
+	err2 = (s32)(second - (start + (3 * freq)));
+
+	if (!test_quiet)
+		printf("freq %7u:  first event %+d, second %+d ticks\n", freq,
+		       err1, err2);
+
+	CHECK((err1 >= 0) && (err1 <= COMM_TIM_TEST_MAX_ERROR),
+	      "freq %u: first event off by %d ticks", freq, err1);
+	CHECK((err2 >= 0) && (err2 <= COMM_TIM_TEST_MAX_ERROR),
+	      "freq %u: second event off by %d ticks", freq, err2);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_time_base();
+	test_freq(2000);
+	test_freq(40000);
+	test_freq(65535);
+	test_freq(100000);
+	test_freq(500000);
+
+	return test_report("commutation timer");
+}
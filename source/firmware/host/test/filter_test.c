@@ -0,0 +1,309 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   filter_test.c
+ *
+ * @brief  Fixed point filter tests.
+ *
+ * Compares the filters of @ref filter.h against floating point references
+ * and the division based IIR form they replace, and measures the cost per
+ * sample of both IIR implementations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+
+#include "filter.h"
+
+#include "test.h"
+
+/**
+ * Number of samples fed through the filters per test.
+ */
+#define FILTER_TEST_SAMPLES 100000
+
+/**
+ * Deterministic sample source, noisy 12 bit ADC like signal with steps.
+ */
+static s32 test_sample(u32 n)
+{
+	static u32 seed = 1;
+	s32 level = ((n / 5000) & 1) ? 3000 : 1000;
+
+	seed = seed * 1103515245 + 12345;
+
+	return level + (s32)((seed >> 16) & 0xff) - 128;
+}
+
+/**
+ * Division based IIR filter as used by the firmware before.
+ */
+static s32 test_legacy_iir(s32 value, s32 new_value, u32 iir)
+{
+	return ((value * iir) + new_value) / (iir + 1);
+}
+
+/**
+ * The shift IIR has to follow the exact floating point filter within
+ * rounding, the division based filter with iir = 2^shift - 1 is the same
+ * filter truncated to sample precision on every step.
+ */
+static void test_iir_equivalence(void)
+{
+	u16 shift;
+
+	for (shift = 1; shift <= 6; shift++) {
+		struct filter_iir f;
+		double ref = 1000;
+		s32 legacy = 1000;
+		double max_err = 0;
+		double max_legacy_err = 0;
+		u32 n;
+
+		filter_iir_init(&f, shift, 1000);
+
+		for (n = 0; n < FILTER_TEST_SAMPLES; n++) {
+			s32 x = test_sample(n);
+			s32 y = filter_iir_update(&f, x);
+
+			ref += (x - ref) / (double)(1 << shift);
+			legacy = test_legacy_iir(legacy, x, (1 << shift) - 1);
+
+			max_err = fmax(max_err, fabs(y - ref));
+			max_legacy_err = fmax(max_legacy_err, fabs(legacy - ref));
+		}
+
+		if (!test_quiet)
+			printf("iir shift %d:       max error %.3f (division %.3f)\n",
+			       shift, max_err, max_legacy_err);
+
+		CHECK(max_err <= 0.5 + 1.0 / (1 << (FILTER_IIR_FRAC_BITS - shift)),
+		      "iir shift %d max error %.3f", shift, max_err);
+		CHECK(max_err <= max_legacy_err,
+		      "iir shift %d worse than division", shift);
+	}
+}
+
+/**
+ * The shift IIR has to settle exactly on a constant input from both sides.
+ */
+static void test_iir_settle(void)
+{
+	struct filter_iir f;
+	s32 y = 0;
+	int n;
+
+	filter_iir_init(&f, 6, 0);
+	for (n = 0; n < 2000; n++)
+		y = filter_iir_update(&f, 1234);
+	CHECK(y == 1234, "iir rising settle %d", (int)y);
+
+	for (n = 0; n < 2000; n++)
+		y = filter_iir_update(&f, -17);
+	CHECK(y == -17, "iir falling settle %d", (int)y);
+
+	/* out of range pole shift from the governor must not break the filter */
+	f.shift = 40;
+	y = filter_iir_update(&f, -17);
+	CHECK(y == -17, "iir clamped shift %d", (int)y);
+}
+
+/**
+ * Full scale inputs must saturate the IIR and the alpha beta tracker instead
+ * of wrapping their accumulators.
+ */
+static void test_overflow(void)
+{
+	struct filter_iir iir;
+	struct filter_ab ab;
+	s32 y = 0;
+	int n;
+
+	filter_iir_init(&iir, 2, -0x7fffffff);
+	for (n = 0; n < 200; n++)
+		y = filter_iir_update(&iir, 0x7fffffff);
+	CHECK(y == FILTER_IIR_MAX_INPUT, "iir full scale step %d", (int)y);
+
+	for (n = 0; n < 200; n++) {
+		y = filter_iir_update(&iir, (n & 1) ? 0x7fffffff : -0x7fffffff);
+		if (y > FILTER_IIR_MAX_INPUT || y < -FILTER_IIR_MAX_INPUT)
+			break;
+	}
+	CHECK(n == 200, "iir alternating full scale out of range %d",
+	      (int)y);
+
+	filter_ab_init(&ab, 2, 4, 0);
+	for (n = 0; n < 1000; n++) {
+		y = filter_ab_update(&ab, 0x7fffffff);
+		if (y < 0)
+			break;
+	}
+	CHECK(y == FILTER_AB_MAX_INPUT, "alpha beta full scale step %d",
+	      (int)y);
+
+	for (n = 0; n < 1000; n++) {
+		y = filter_ab_update(&ab, (n & 1) ? 0x7fffffff : -0x7fffffff);
+		if (y > FILTER_AB_MAX_INPUT || y < -FILTER_AB_MAX_INPUT)
+			break;
+	}
+	CHECK(n == 1000, "alpha beta alternating full scale out of range %d",
+	      (int)y);
+}
+
+/**
+ * Second order Butterworth low pass at 1/20 of the sample rate against a
+ * floating point implementation of the same quantized coefficients.
+ */
+static void test_biquad(void)
+{
+	const double q = 1 << FILTER_BIQUAD_FRAC_BITS;
+	const double w = tan(M_PI / 20);
+	const double norm = 1 / (1 + sqrt(2) * w + w * w);
+	s32 b0 = (s32)lround(w * w * norm * q);
+	s32 b1 = 2 * b0;
+	s32 b2 = b0;
+	s32 a1 = (s32)lround(2 * (w * w - 1) * norm * q);
+	s32 a2 = (s32)lround((1 - sqrt(2) * w + w * w) * norm * q);
+	struct filter_biquad f;
+	double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+	double max_err = 0;
+	s32 y = 0;
+	u32 n;
+
+	/* make the quantized filter unity gain at DC */
+	a1 = (b0 + b1 + b2) - (s32)q - a2;
+
+	filter_biquad_init(&f, b0, b1, b2, a1, a2);
+
+	for (n = 0; n < FILTER_TEST_SAMPLES; n++) {
+		s32 x = test_sample(n);
+		double ref = (b0 * (double)x + b1 * x1 + b2 * x2 -
+			      a1 * y1 - a2 * y2) / q;
+
+		y = filter_biquad_update(&f, x);
+
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = ref;
+
+		max_err = fmax(max_err, fabs(y - ref));
+	}
+
+	if (!test_quiet)
+		printf("biquad:            max error %.3f\n", max_err);
+
+	CHECK(max_err < 4, "biquad max error %.3f", max_err);
+
+	for (n = 0; n < 2000; n++)
+		y = filter_biquad_update(&f, 2047);
+	CHECK(y == 2047, "biquad settle %d", (int)y);
+}
+
+/**
+ * The moving average has to be bit exact against a plain window sum.
+ */
+static void test_ma(void)
+{
+	static s32 window[1 << FILTER_MA_MAX_SHIFT];
+	struct filter_ma f;
+	u16 shift;
+
+	for (shift = 0; shift <= FILTER_MA_MAX_SHIFT; shift++) {
+		int size = 1 << shift;
+		int mismatches = 0;
+		u32 n;
+		int i;
+
+		filter_ma_init(&f, shift, 500);
+		for (i = 0; i < size; i++)
+			window[i] = 500;
+
+		for (n = 0; n < FILTER_TEST_SAMPLES; n++) {
+			s32 x = test_sample(n);
+			s32 sum = 0;
+
+			window[n % size] = x;
+			for (i = 0; i < size; i++)
+				sum += window[i];
+
+			if (filter_ma_update(&f, x) != (sum >> shift))
+				mismatches++;
+		}
+
+		CHECK(mismatches == 0, "moving average window %d: %d mismatches",
+		      size, mismatches);
+	}
+}
+
+/**
+ * Cost per sample of the division based and the shift based IIR filter.
+ */
+static void test_iir_speed(void)
+{
+	static s32 samples[4096];
+	volatile u32 iir = 7;
+	volatile u16 shift = 3;
+	struct filter_iir f;
+	s32 legacy = 0;
+	u64 start, legacy_ns, shift_ns;
+	const u32 rounds = 200;
+	u32 r, i;
+
+	for (i = 0; i < 4096; i++)
+		samples[i] = test_sample(i);
+
+	start = test_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < 4096; i++)
+			legacy = test_legacy_iir(legacy, samples[i], iir);
+	legacy_ns = test_ns() - start;
+
+	filter_iir_init(&f, shift, 0);
+	start = test_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < 4096; i++)
+			(void)filter_iir_update(&f, samples[i]);
+	shift_ns = test_ns() - start;
+
+	if (!test_quiet) {
+		printf("division iir:      %.2f ns/sample (%d)\n",
+		       (double)legacy_ns / (rounds * 4096), (int)legacy);
+		printf("shift iir:         %.2f ns/sample (%d)\n",
+		       (double)shift_ns / (rounds * 4096),
+		       (int)filter_iir_output(&f));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_iir_equivalence();
+	test_iir_settle();
+	test_overflow();
+	test_biquad();
+	test_ma();
+	test_iir_speed();
+
+	return test_report("filter");
+}
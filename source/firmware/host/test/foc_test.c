@@ -0,0 +1,437 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   foc_test.c
+ *
+ * @brief  Field oriented control engine tests.
+ *
+ * Checks the fixed point transforms and the space vector modulation of
+ * @ref foc.h against floating point references, closes the current loop
+ * around the motor model running as PMSM and measures the cost of one
+ * control cycle against the PWM period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "foc.h"
+#include "motor.h"
+
+#include "test.h"
+
+/**
+ * PWM period in timer counts.
+ */
+#define FOC_TEST_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * Motor model integration steps per PWM period.
+ */
+#define FOC_TEST_STEPS 50
+
+/**
+ * Integration step in which the phase currents are sampled, the TIM1 CC4
+ * ADC trigger point of the default pwm_offset of 187 counts.
+ */
+#define FOC_TEST_SAMPLE_STEP ((187 * FOC_TEST_STEPS) / FOC_TEST_PERIOD)
+
+/**
+ * Current measurement full scale [A].
+ */
+#define FOC_TEST_I_FS 20.0
+
+/**
+ * Current controller bandwidth [rad/s].
+ */
+#define FOC_TEST_BANDWIDTH (2 * M_PI * 800)
+
+/**
+ * Current controller closed around the motor model.
+ */
+struct foc_test_plant {
+	struct motor m;		/**< Motor plant */
+	struct foc foc;		/**< Current controller */
+	u16 duty[3];		/**< Compare values of the running period */
+	double time;		/**< Simulated time [s] */
+};
+
+/**
+ * Current loop tracking statistics.
+ */
+struct foc_test_stats {
+	double iq_sq;		/**< Sum of the squared q current errors [A^2] */
+	double id_max;		/**< Largest d current magnitude [A] */
+	double torque_err;	/**< Largest torque error [Nm] */
+	double v_max;		/**< Largest voltage command magnitude, Q15 */
+	int samples;		/**< Number of samples */
+};
+
+/**
+ * Deterministic pseudo random number in the range [-1, 1).
+ */
+static double test_rand(void)
+{
+	static u32 seed = 1;
+
+	seed = seed * 1103515245 + 12345;
+
+	return (double)(seed >> 8) / (1 << 23) - 1.0;
+}
+
+/**
+ * The interpolated sine table has to be within 1.5 LSB of the exact sine.
+ */
+static void test_sin_cos(void)
+{
+	double max_err = 0;
+	u32 angle;
+	s16 s, c;
+
+	for (angle = 0; angle < 0x10000; angle++) {
+		double a = angle * 2 * M_PI / 65536;
+
+		foc_sin_cos((u16)angle, &s, &c);
+		max_err = fmax(max_err, fabs(s - 32767 * sin(a)));
+		max_err = fmax(max_err, fabs(c - 32767 * cos(a)));
+	}
+
+	if (!test_quiet)
+		printf("sin/cos:           max error %.3f LSB\n", max_err);
+
+	CHECK(max_err <= 1.5, "sin/cos max error %.3f", max_err);
+}
+
+/**
+ * Clarke and Park transforms against floating point, and the inverse Park
+ * transform has to take the vector back.
+ */
+static void test_transforms(void)
+{
+	double max_err = 0;
+	double max_inv_err = 0;
+	int n;
+
+	for (n = 0; n < 100000; n++) {
+		double amp = 16000 * fabs(test_rand());
+		double phi = M_PI * test_rand();
+		u16 angle = (u16)(s32)(32768 * test_rand());
+		double theta = angle * 2 * M_PI / 65536;
+		s16 a = (s16)lround(amp * cos(phi));
+		s16 b = (s16)lround(amp * cos(phi - 2 * M_PI / 3));
+		double alpha = a;
+		double beta = (a + 2.0 * b) / sqrt(3);
+		struct foc_vec dq;
+		struct foc_vec ab;
+		s16 s, c;
+
+		foc_sin_cos(angle, &s, &c);
+		dq = foc_park(foc_clarke(a, b), s, c);
+
+		max_err = fmax(max_err, fabs(dq.x - (alpha * cos(theta) +
+						    beta * sin(theta))));
+		max_err = fmax(max_err, fabs(dq.y - (beta * cos(theta) -
+						    alpha * sin(theta))));
+
+		ab = foc_inv_park(dq, s, c);
+		max_inv_err = fmax(max_inv_err, fabs(ab.x - alpha));
+		max_inv_err = fmax(max_inv_err, fabs(ab.y - beta));
+	}
+
+	if (!test_quiet)
+		printf("clarke/park:       max error %.3f LSB, round trip %.3f LSB\n",
+		       max_err, max_inv_err);
+
+	CHECK(max_err <= 3, "clarke/park max error %.3f", max_err);
+	CHECK(max_inv_err <= 4, "park round trip max error %.3f", max_inv_err);
+}
+
+/**
+ * The modulated phase voltages have to reproduce the commanded vector
+ * within the compare value resolution, up to the linear modulation limit.
+ */
+static void test_svpwm(void)
+{
+	const double period = FOC_TEST_PERIOD;
+	double max_err = 0;
+	int out_of_range = 0;
+	int n;
+
+	for (n = 0; n < 100000; n++) {
+		double amp = FOC_V_MAX * fabs(test_rand());
+		double phi = M_PI * test_rand();
+		struct foc_vec ab;
+		u16 duty[3];
+		double va, vb, vc;
+		int x;
+
+		ab.x = (s16)(amp * cos(phi));
+		ab.y = (s16)(amp * sin(phi));
+
+		foc_svpwm(ab, FOC_TEST_PERIOD, duty);
+
+		for (x = 0; x < 3; x++)
+			if (duty[x] > FOC_TEST_PERIOD)
+				out_of_range++;
+
+		va = duty[0] / period;
+		vb = duty[1] / period;
+		vc = duty[2] / period;
+
+		max_err = fmax(max_err, fabs((2 * va - vb - vc) / 3 -
+					     ab.x / 32768.0));
+		max_err = fmax(max_err, fabs((vb - vc) / sqrt(3) -
+					     ab.y / 32768.0));
+	}
+
+	if (!test_quiet)
+		printf("svpwm:             max error %.3f counts\n",
+		       max_err * period);
+
+	CHECK(out_of_range == 0, "svpwm %d compare values out of range",
+	      out_of_range);
+	CHECK(max_err * period <= 1.5, "svpwm max error %.3f counts",
+	      max_err * period);
+}
+
+static void test_plant_init(struct foc_test_plant *p)
+{
+	struct motor_params mp;
+	double kp;
+	double ki;
+
+	motor_params_default(&mp);
+	mp.bemf = motor_bemf_sinusoidal;
+	motor_init(&p->m, &mp);
+
+	/* Pole zero cancellation of the phase R/L, gains in volts per amp
+	 * converted to Q15 supply voltage per current unit.
+	 */
+	kp = mp.l * FOC_TEST_BANDWIDTH * FOC_TEST_I_FS / mp.vbus;
+	ki = mp.r * FOC_TEST_BANDWIDTH / PWM__FREQUENCY * FOC_TEST_I_FS /
+		mp.vbus;
+
+	foc_init(&p->foc, (s32)lround(kp * (1 << FOC_PI_FRAC_BITS)),
+		 (s32)lround(ki * (1 << FOC_PI_FRAC_BITS)),
+		 FOC_V_MAX * 97 / 100, FOC_TEST_PERIOD);
+
+	p->duty[0] = p->foc.duty[0];
+	p->duty[1] = p->foc.duty[1];
+	p->duty[2] = p->foc.duty[2];
+	p->time = 0;
+}
+
+/**
+ * Run the closed current loop.
+ *
+ * The phase currents are sampled at the ADC trigger point and the new
+ * compare values take effect at the start of the next period, like the
+ * preloaded TIM1 compare registers do.
+ *
+ * @param p Plant and controller
+ * @param time Time to run [s]
+ * @param id_ref Flux current reference [A]
+ * @param iq_ref Torque current reference [A]
+ * @param settle Time after which the tracking statistics are collected [s]
+ * @param stats Tracking statistics output
+ */
+static void test_plant_run(struct foc_test_plant *p, double time,
+			   double id_ref, double iq_ref, double settle,
+			   struct foc_test_stats *stats)
+{
+	const double dt = 1.0 / PWM__FREQUENCY / FOC_TEST_STEPS;
+	const double ke = p->m.p.ke;
+	double end = p->time + time;
+	double start = p->time + settle;
+	u16 next[3];
+	int step;
+	int x;
+
+	p->foc.i_ref.x = test_current(id_ref, FOC_TEST_I_FS);
+	p->foc.i_ref.y = test_current(iq_ref, FOC_TEST_I_FS);
+
+	stats->iq_sq = 0;
+	stats->id_max = 0;
+	stats->torque_err = 0;
+	stats->v_max = 0;
+	stats->samples = 0;
+
+	while (p->time < end) {
+		for (x = 0; x < 3; x++)
+			next[x] = p->duty[x];
+
+		for (step = 0; step < FOC_TEST_STEPS; step++) {
+			double high[3];
+			double low[3];
+
+			if (step == FOC_TEST_SAMPLE_STEP) {
+				double theta = test_flux_angle(&p->m);
+				double alpha = p->m.i[0];
+				double beta = (p->m.i[0] + 2 * p->m.i[1]) /
+					sqrt(3);
+				double id = alpha * cos(theta) +
+					beta * sin(theta);
+				double iq = beta * cos(theta) -
+					alpha * sin(theta);
+				s16 i_a = test_current(p->m.i[0], FOC_TEST_I_FS);
+				s16 i_b = test_current(p->m.i[1], FOC_TEST_I_FS);
+
+				foc_update(&p->foc, i_a, i_b,
+					   (u16)lround(theta * 65536 /
+						       (2 * M_PI)));
+				for (x = 0; x < 3; x++)
+					next[x] = p->foc.duty[x];
+
+				if (p->time >= start) {
+					stats->iq_sq += (iq - iq_ref) *
+						(iq - iq_ref);
+					stats->id_max = fmax(stats->id_max,
+							     fabs(id - id_ref));
+					stats->torque_err =
+						fmax(stats->torque_err,
+						     fabs(p->m.torque -
+							  1.5 * ke * iq_ref));
+					stats->samples++;
+				}
+				stats->v_max = fmax(stats->v_max,
+						    hypot(p->foc.v.x,
+							  p->foc.v.y));
+			}
+
+			for (x = 0; x < 3; x++) {
+				high[x] = (double)p->duty[x] / FOC_TEST_PERIOD;
+				low[x] = 1 - high[x];
+			}
+			motor_step(&p->m, high, low, dt);
+			p->time += dt;
+		}
+
+		for (x = 0; x < 3; x++)
+			p->duty[x] = next[x];
+	}
+}
+
+/**
+ * Torque current step from standstill, running into the voltage limit and
+ * getting out of it again.
+ */
+static void test_current_loop(void)
+{
+	struct foc_test_plant p;
+	struct foc_test_stats stats;
+	const double iq_ref = 5.0;
+	double iq_rms;
+	double torque_ref;
+
+	test_plant_init(&p);
+	torque_ref = 1.5 * p.m.p.ke * iq_ref;
+
+	/* Accelerating well within the voltage limit */
+	test_plant_run(&p, 0.04, 0, iq_ref, 0.002, &stats);
+	iq_rms = sqrt(stats.iq_sq / stats.samples);
+
+	if (!test_quiet)
+		printf("current loop:      iq error %.3f A rms, id %.3f A max, "
+		       "torque error %.2f%%, %.0f rpm\n", iq_rms,
+		       stats.id_max, 100 * stats.torque_err / torque_ref,
+		       motor_rpm(&p.m));
+
+	CHECK(iq_rms < 0.02 * iq_ref, "iq error %.3f A rms", iq_rms);
+	CHECK(stats.id_max < 0.05 * iq_ref, "id error %.3f A", stats.id_max);
+	CHECK(stats.torque_err < 0.05 * torque_ref, "torque error %.2f%%",
+	      100 * stats.torque_err / torque_ref);
+	CHECK(motor_rpm(&p.m) > 1000, "motor not accelerating, %.0f rpm",
+	      motor_rpm(&p.m));
+
+	/* Up to the speed where the voltage circle is exhausted */
+	test_plant_run(&p, 0.4, 0, iq_ref, 0.4, &stats);
+
+	if (!test_quiet)
+		printf("voltage limit:     |v| %.0f of %d, %.0f rpm\n",
+		       stats.v_max, p.foc.v_limit, motor_rpm(&p.m));
+
+	CHECK(stats.v_max <= p.foc.v_limit + 1, "voltage vector %.0f above %d",
+	      stats.v_max, p.foc.v_limit);
+	CHECK(stats.v_max >= p.foc.v_limit - 2, "voltage limit not reached");
+
+	/* Leaving saturation must not be delayed by integrator windup */
+	test_plant_run(&p, 0.01, 0, 0, 0.002, &stats);
+	iq_rms = sqrt(stats.iq_sq / stats.samples);
+
+	if (!test_quiet)
+		printf("saturation exit:   iq error %.3f A rms\n", iq_rms);
+
+	CHECK(iq_rms < 0.02 * iq_ref, "iq error after saturation %.3f A rms",
+	      iq_rms);
+}
+
+/**
+ * Cost of one control cycle against the PWM period.
+ *
+ * Wall clock figures depend on the load of the host, the budget is only
+ * enforced with -b.
+ */
+static void test_speed(void)
+{
+	const u32 cycles = 1000000;
+	const double budget_ns = 1e9 / PWM__FREQUENCY;
+	struct foc foc;
+	u64 start_ns, ns;
+	u64 start_cycles, tsc;
+	u32 n;
+
+	foc_init(&foc, 2000, 400, FOC_V_MAX, FOC_TEST_PERIOD);
+	foc.i_ref.y = 4000;
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < cycles; n++)
+		foc_update(&foc, (s16)(n & 0x3ff), (s16)-(n & 0x1ff),
+			   (u16)(n * 97));
+	tsc = test_cycles() - start_cycles;
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("foc update:        %.2f ns %.2f cycles/call, "
+		       "%.3f%% of the %.1f us PWM period\n",
+		       (double)ns / cycles, (double)tsc / cycles,
+		       100 * (double)ns / cycles / budget_ns,
+		       budget_ns / 1000);
+
+	if (test_bench)
+		CHECK((double)ns / cycles < budget_ns / 20,
+		      "foc update %.2f ns above 5%% of the PWM period",
+		      (double)ns / cycles);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_sin_cos();
+	test_transforms();
+	test_svpwm();
+	test_current_loop();
+	test_speed();
+
+	return test_report("foc");
+}
@@ -0,0 +1,558 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   hall_test.c
+ *
+ * @brief  Hall sensor commutation tests.
+ *
+ * Feeds simulated Hall edges into the commutation table and the speed
+ * measurement of @ref hall.h, calibrates the Hall to phase mapping for
+ * different sensor wirings and placements, and finally runs the motor
+ * model with the calibrated mapping from standstill. The cost of one edge
+ * is measured against the PWM period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "foc.h"
+#include "hall.h"
+#include "motor.h"
+
+#include "test.h"
+
+/**
+ * PWM period in timer counts.
+ */
+#define HALL_TEST_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * Hall capture timer clock [Hz].
+ */
+#define HALL_TEST_TIM_FREQ (72000000.0 / (HALL__TIM_PRESCALER + 1))
+
+/**
+ * Motor model integration step [s].
+ */
+#define HALL_TEST_DT 1e-6
+
+/**
+ * Calibration soft timer period [s], the sys tick runs at 100kHz.
+ */
+#define HALL_TEST_CAL_TICK (HALL__CAL_TICK * 1e-5)
+
+/**
+ * Duty cycle of the block commutation runs.
+ */
+#define HALL_TEST_DUTY 0.5
+
+/**
+ * Simulated Hall sensor wiring and placement.
+ */
+struct hall_test_sensors {
+	double offset;		/**< Angle of the first sensor [rad] */
+	int bit[3];		/**< Input bit each sensor is wired to */
+	bool stuck;		/**< Sensor on bit 0 stuck low */
+};
+
+/**
+ * The six ways to wire three sensors to three inputs.
+ */
+static const int hall_test_wirings[6][3] = {
+	{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+};
+
+/**
+ * Phase drive of the block commutation steps, in the order of the
+ * 6step h_pwm_l_on scheme: high side PWM on the first phase, low side on
+ * on the second.
+ */
+static const int hall_test_steps[HALL_STEPS][2] = {
+	{0, 2}, {0, 1}, {2, 1}, {2, 0}, {1, 0}, {1, 2}
+};
+
+/**
+ * Hall state at an angle, three sensors 120 degrees apart each high for
+ * half a revolution.
+ */
+static u8 test_hall_state(const struct hall_test_sensors *s, double angle)
+{
+	u8 state = 0;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (sin(angle - s->offset - i * 2 * M_PI / 3) > 0)
+			state |= 1 << s->bit[i];
+	}
+
+	if (s->stuck)
+		state &= ~1;
+
+	return state;
+}
+
+/**
+ * Commutation angle [rad] of a 16 bit angle.
+ */
+static double test_rad(u16 angle)
+{
+	return angle * 2 * M_PI / 65536;
+}
+
+/**
+ * Wrap an angle into -pi to pi.
+ */
+static double test_wrap(double x)
+{
+	return remainder(x, 2 * M_PI);
+}
+
+/**
+ * Default mapping from the configuration.
+ */
+static void test_default_map(u8 map[HALL_STATES])
+{
+	map[0] = HALL_INVALID;
+	map[1] = HALL__MAP_1;
+	map[2] = HALL__MAP_2;
+	map[3] = HALL__MAP_3;
+	map[4] = HALL__MAP_4;
+	map[5] = HALL__MAP_5;
+	map[6] = HALL__MAP_6;
+	map[7] = HALL_INVALID;
+}
+
+/**
+ * Commutation steps and speed measurement from simulated edges.
+ *
+ * The sensor misplacement makes the single capture deltas uneven, the
+ * period has to be exact anyway once a full revolution was measured.
+ */
+static void test_edges(void)
+{
+	static const s16 misplacement[HALL_STEPS] = {60, -40, 20, -50, 30, -20};
+	u8 map[HALL_STATES];
+	u8 state_of[HALL_STEPS];
+	struct hall hall;
+	u8 step = 0;
+	u8 ret;
+	int bad_step = 0;
+	int bad_period = 0;
+	int n;
+	int i;
+
+	test_default_map(map);
+	for (i = 1; i < HALL_STATES - 1; i++)
+		state_of[map[i]] = (u8)i;
+
+	hall_init(&hall, map, state_of[0]);
+	CHECK(hall_step(&hall) == 0, "initial step %d", hall_step(&hall));
+	CHECK(hall_period(&hall) == 0, "initial period %u", hall_period(&hall));
+
+	for (n = 0; n < 60; n++) {
+		step = (step + 1) % HALL_STEPS;
+		ret = hall_edge(&hall, state_of[step], 1000 + misplacement[step]);
+
+		if (ret != step)
+			bad_step++;
+
+		if (n == 0) {
+			/* The capture timer was not synced to an edge yet */
+			if (hall_period(&hall) != 0)
+				bad_period++;
+		} else if (n < HALL_STEPS) {
+			if (hall_period(&hall) == 0)
+				bad_period++;
+		} else if (hall_period(&hall) != 6000) {
+			bad_period++;
+		}
+	}
+	CHECK(bad_step == 0, "%d edges commutated to the wrong step", bad_step);
+	CHECK(bad_period == 0, "%d edges with a wrong period", bad_period);
+
+	/* Reversal restarts the measurement, but still commutates */
+	ret = hall_edge(&hall, state_of[(step + HALL_STEPS - 1) % HALL_STEPS],
+			1000);
+	CHECK(ret == (step + HALL_STEPS - 1) % HALL_STEPS,
+	      "reversal step %d", ret);
+	CHECK(hall_period(&hall) == 0, "reversal period %u",
+	      hall_period(&hall));
+	step = ret;
+
+	ret = hall_edge(&hall, state_of[(step + 1) % HALL_STEPS], 1200);
+	CHECK(hall_period(&hall) == 7200, "period after reversal %u",
+	      hall_period(&hall));
+	step = ret;
+
+	/* Skipped state */
+	step = (step + 2) % HALL_STEPS;
+	ret = hall_edge(&hall, state_of[step], 1000);
+	CHECK(ret == step, "skipped state step %d", ret);
+	CHECK(hall_period(&hall) == 0, "skipped state period %u",
+	      hall_period(&hall));
+
+	/* Broken sensor */
+	ret = hall_edge(&hall, 7, 1000);
+	CHECK(ret == HALL_INVALID, "state 111 step %d", ret);
+	ret = hall_edge(&hall, state_of[step], 1000);
+	CHECK(ret == step, "step after state 111 %d", ret);
+	step = (step + 1) % HALL_STEPS;
+	(void)hall_edge(&hall, state_of[step], 1000);
+	CHECK(hall_period(&hall) == 6000, "period after state 111 %u",
+	      hall_period(&hall));
+
+	/* Standstill, the first edge after it only restarts the timer */
+	hall_timeout(&hall);
+	CHECK(hall_period(&hall) == 0, "timeout period %u", hall_period(&hall));
+	step = (step + 1) % HALL_STEPS;
+	ret = hall_edge(&hall, state_of[step], 40000);
+	CHECK(ret == step, "step after timeout %d", ret);
+	CHECK(hall_period(&hall) == 0, "period after timeout %u",
+	      hall_period(&hall));
+
+	if (!test_quiet)
+		printf("edges:             %d steps, %d period errors\n",
+		       bad_step, bad_period);
+}
+
+/**
+ * Run the calibration sweep on an ideal rotor that lags the field.
+ *
+ * @return hall_cal_finish() result
+ */
+static int test_calibrate(const struct hall_test_sensors *s, double lag,
+			  u16 sweep_span, u8 map[HALL_STATES])
+{
+	struct hall_cal cal;
+	u16 angle = 0;
+	u32 n;
+
+	hall_cal_reset(&cal);
+
+	for (n = 0; n < sweep_span; n++) {
+		hall_cal_sample(&cal, angle, test_hall_state(s, test_rad(angle) - lag));
+		angle += HALL__CAL_STEP;
+	}
+	for (n = 0; n < sweep_span; n++) {
+		hall_cal_sample(&cal, angle, test_hall_state(s, test_rad(angle) + lag));
+		angle -= HALL__CAL_STEP;
+	}
+
+	return hall_cal_finish(&cal, map);
+}
+
+/**
+ * Calibration for all sensor wirings and a range of placements.
+ *
+ * Over a full revolution the field driven from the calibrated mapping has
+ * to stay within 90 +/- 60 degrees ahead of the rotor, so the torque never
+ * drops below half of the peak.
+ */
+static void test_calibration(void)
+{
+	const u16 sweep = 0x10000 / HALL__CAL_STEP;
+	struct hall_test_sensors s;
+	double min_lead = 1e9;
+	double max_lead = -1e9;
+	double torque_min = 1e9;
+	int failed = 0;
+	int runs = 0;
+	int w;
+	int o;
+	int l;
+	int n;
+
+	s.stuck = false;
+
+	for (w = 0; w < 6; w++) {
+		for (o = 0; o < 16; o++) {
+			for (l = 0; l < 2; l++) {
+				u8 map[HALL_STATES];
+				double torque = 0;
+
+				s.bit[0] = hall_test_wirings[w][0];
+				s.bit[1] = hall_test_wirings[w][1];
+				s.bit[2] = hall_test_wirings[w][2];
+				s.offset = o * 2 * M_PI / 16;
+
+				runs++;
+				if (test_calibrate(&s, l * 20 * M_PI / 180, sweep,
+						   map) != 0) {
+					failed++;
+					continue;
+				}
+
+				for (n = 0; n < 3600; n++) {
+					double rotor = n * 2 * M_PI / 3600;
+					u8 step = map[test_hall_state(&s, rotor)];
+					double lead;
+
+					if (step == HALL_INVALID) {
+						failed++;
+						break;
+					}
+
+					lead = test_wrap(step * 2 * M_PI / HALL_STEPS -
+							 rotor) * 180 / M_PI;
+					min_lead = fmin(min_lead, lead);
+					max_lead = fmax(max_lead, lead);
+					torque += sin(lead * M_PI / 180) / 3600;
+				}
+				torque_min = fmin(torque_min, torque);
+			}
+		}
+	}
+
+	if (!test_quiet)
+		printf("calibration:       %d of %d failed, field lead %.1f to "
+		       "%.1f deg, mean torque %.3f of peak\n",
+		       failed, runs, min_lead, max_lead, torque_min);
+
+	CHECK(failed == 0, "%d of %d calibrations failed", failed, runs);
+	CHECK(min_lead >= 29 && max_lead <= 151,
+	      "field lead %.1f to %.1f deg", min_lead, max_lead);
+	CHECK(torque_min > 0.82, "mean torque %.3f of peak", torque_min);
+}
+
+/**
+ * Broken sensors and an incomplete sweep have to fail the calibration and
+ * leave the mapping alone.
+ */
+static void test_calibration_fail(void)
+{
+	const u16 sweep = 0x10000 / HALL__CAL_STEP;
+	struct hall_test_sensors s = { 0.3, {0, 1, 2}, true };
+	u8 map[HALL_STATES];
+	u8 ref[HALL_STATES];
+	int i;
+
+	test_default_map(map);
+	test_default_map(ref);
+
+	CHECK(test_calibrate(&s, 0, sweep, map) != 0,
+	      "stuck sensor calibrated");
+
+	s.stuck = false;
+	s.bit[1] = 0;
+	CHECK(test_calibrate(&s, 0, sweep, map) != 0,
+	      "two sensors on one input calibrated");
+
+	s.bit[1] = 1;
+	CHECK(test_calibrate(&s, 0, sweep / 2, map) != 0,
+	      "half revolution sweep calibrated");
+
+	for (i = 0; i < HALL_STATES; i++)
+		CHECK(map[i] == ref[i], "failed calibration changed state %d", i);
+}
+
+/**
+ * Calibrate on the motor model, turning the field through the space vector
+ * modulation the way comm_process_cal_callback() does.
+ */
+static int test_motor_calibrate(struct motor *m,
+				const struct hall_test_sensors *s,
+				u8 map[HALL_STATES])
+{
+	const u16 sweep = 0x10000 / HALL__CAL_STEP;
+	const u32 sub = (u32)lround(HALL_TEST_CAL_TICK / HALL_TEST_DT);
+	struct foc_vec v = { HALL__CAL_VOLTAGE, 0 };
+	struct hall_cal cal;
+	u16 angle = 0;
+	u16 tick;
+	u32 n;
+
+	hall_cal_reset(&cal);
+
+	for (tick = 0; tick <= HALL__CAL_SETTLE + 2 * sweep; tick++) {
+		double high[3];
+		double low[3];
+		u16 duty[3];
+		s16 sin_a;
+		s16 cos_a;
+		int x;
+
+		if (tick >= HALL__CAL_SETTLE) {
+			hall_cal_sample(&cal, angle,
+					test_hall_state(s, test_flux_angle(m)));
+			if (tick < HALL__CAL_SETTLE + sweep)
+				angle += HALL__CAL_STEP;
+			else
+				angle -= HALL__CAL_STEP;
+		}
+
+		foc_sin_cos((u16)(0x10000 / 12 - angle), &sin_a, &cos_a);
+		foc_svpwm(foc_inv_park(v, sin_a, cos_a), HALL_TEST_PERIOD,
+			  duty);
+
+		for (x = 0; x < 3; x++) {
+			high[x] = (double)duty[x] / HALL_TEST_PERIOD;
+			low[x] = 1 - high[x];
+		}
+
+		for (n = 0; n < sub; n++)
+			motor_step(m, high, low, HALL_TEST_DT);
+	}
+
+	return hall_cal_finish(&cal, map);
+}
+
+/**
+ * Calibrate on the motor model and start it from standstill at different
+ * rotor angles with block commutation driven by the Hall edges.
+ *
+ * Every start has to accelerate forward through the commutation sequence
+ * right away, and the measured period has to match the motor speed.
+ */
+static void test_motor(void)
+{
+	struct hall_test_sensors s = { 1.0, {2, 0, 1}, false };
+	struct motor_params p;
+	struct motor m;
+	u8 map[HALL_STATES];
+	double min_rpm = 1e9;
+	double max_period_err = 0;
+	int backward = 0;
+	int start;
+
+	motor_params_default(&p);
+	motor_init(&m, &p);
+
+	if (test_motor_calibrate(&m, &s, map) != 0) {
+		CHECK(false, "motor model calibration failed");
+		return;
+	}
+
+	for (start = 0; start < 12; start++) {
+		struct hall hall;
+		double since_edge = 0;
+		double t;
+		u8 state;
+		u8 step;
+
+		motor_init(&m, &p);
+		m.theta = (start * 2 * M_PI / 12 + 0.1) / p.pole_pairs;
+
+		state = test_hall_state(&s, test_flux_angle(&m));
+		hall_init(&hall, map, state);
+		step = hall_step(&hall);
+
+		for (t = 0; t < 0.2; t += HALL_TEST_DT) {
+			double high[3] = {0, 0, 0};
+			double low[3] = {0, 0, 0};
+			u8 new_state;
+			u8 prev = step;
+
+			high[hall_test_steps[step][0]] = HALL_TEST_DUTY;
+			low[hall_test_steps[step][1]] = 1;
+			motor_step(&m, high, low, HALL_TEST_DT);
+			since_edge += HALL_TEST_DT;
+
+			new_state = test_hall_state(&s, test_flux_angle(&m));
+			if (new_state == state)
+				continue;
+
+			state = new_state;
+			step = hall_edge(&hall, state,
+					 (u16)lround(since_edge * HALL_TEST_TIM_FREQ));
+			since_edge = 0;
+
+			if (step != (prev + 1) % HALL_STEPS)
+				backward++;
+		}
+
+		min_rpm = fmin(min_rpm, fabs(motor_rpm(&m)));
+
+		if (hall_period(&hall) != 0) {
+			double period = hall_period(&hall) / HALL_TEST_TIM_FREQ;
+			double ref = 2 * M_PI / (fabs(m.omega) * p.pole_pairs);
+
+			max_period_err = fmax(max_period_err,
+					      fabs(period - ref) / ref);
+		} else {
+			max_period_err = 1;
+		}
+	}
+
+	if (!test_quiet)
+		printf("motor start:       min %.0f rpm after 0.2 s, %d out of "
+		       "sequence edges, period error %.2f%%\n",
+		       min_rpm, backward, 100 * max_period_err);
+
+	CHECK(backward == 0, "%d out of sequence edges", backward);
+	CHECK(min_rpm > 5000, "slowest start %.0f rpm", min_rpm);
+	CHECK(max_period_err < 0.02, "period error %.2f%%",
+	      100 * max_period_err);
+}
+
+static void test_speed(void)
+{
+	const u32 cycles = 1000000;
+	const double budget_ns = 1e9 / PWM__FREQUENCY;
+	u8 map[HALL_STATES];
+	u8 state_of[HALL_STEPS];
+	struct hall hall;
+	u64 start_ns, ns;
+	u64 start_cycles, tsc;
+	u32 sum = 0;
+	u32 n;
+	int i;
+
+	test_default_map(map);
+	for (i = 1; i < HALL_STATES - 1; i++)
+		state_of[map[i]] = (u8)i;
+
+	hall_init(&hall, map, state_of[0]);
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < cycles; n++)
+		sum += hall_edge(&hall, state_of[(n + 1) % HALL_STEPS],
+				 (u16)(1000 + (n & 0xff)));
+	tsc = test_cycles() - start_cycles;
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("hall edge:         %.2f ns %.2f cycles/call, "
+		       "%.3f%% of the %.1f us PWM period (%u)\n",
+		       (double)ns / cycles, (double)tsc / cycles,
+		       100 * (double)ns / cycles / budget_ns,
+		       budget_ns / 1000, sum & 1);
+
+	if (test_bench)
+		CHECK((double)ns / cycles < budget_ns / 20,
+		      "hall edge %.2f ns above 5%% of the PWM period",
+		      (double)ns / cycles);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_edges();
+	test_calibration();
+	test_calibration_fail();
+	test_motor();
+	test_speed();
+
+	return test_report("hall");
+}
@@ -0,0 +1,353 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   i2c_test.c
+ *
+ * @brief  I2C slave register interface tests.
+ *
+ * Runs the I2C driver on the I2C model with an emulated bus master and the
+ * main loop part of the driver. Checks that setpoint writes reach the
+ * governor register map in order, within a few microseconds of their last
+ * byte and outside of interrupt context, that writes to registers that do
+ * not exist or are read only are rejected, that telemetry reads return
+ * whole registers and that a pointer write selects the registers read
+ * next. A transfer to another address must not be acknowledged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "config.h"
+#include "gprot.h"
+#include "driver/i2c.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Simulation time step [s].
+ */
+#define I2C_TEST_DT 1e-6
+
+/**
+ * Number of setpoint test registers, starting at address 1.
+ */
+#define I2C_TEST_REGS 4
+
+/**
+ * Largest number of register writes recorded.
+ */
+#define I2C_TEST_MAX_WRITES 256
+
+/**
+ * Longest accepted time from the last byte of a register write to the
+ * register changed hook [s].
+ */
+#define I2C_TEST_MAX_LATENCY 5e-6
+
+/**
+ * Test state shared with the governor hooks.
+ */
+struct i2c_test {
+	u16 regs[I2C_TEST_REGS];		/**< Setpoint test registers */
+	u16 rpm;				/**< Speed telemetry register */
+	u16 current;				/**< Current telemetry register */
+	u16 voltage;				/**< Voltage telemetry register */
+	u16 temp;				/**< Temperature telemetry register */
+	u16 written[I2C_TEST_MAX_WRITES];	/**< Values seen by the hook */
+	u8 written_addr[I2C_TEST_MAX_WRITES];	/**< Addresses seen by the hook */
+	int writes;				/**< Register changed hook calls */
+	int isr_writes;				/**< Hook calls from an interrupt handler */
+	double latency;				/**< Longest hook latency [s] */
+};
+
+static struct i2c_test test;
+
+static void test_trigger_output(void *data)
+{
+	(void)data;
+}
+
+static void test_register_changed(void *data, u8 addr)
+{
+	double latency = hal_i2c_stats.time - hal_i2c_stats.rx_time;
+
+	(void)data;
+
+	if (test.writes < I2C_TEST_MAX_WRITES) {
+		test.written_addr[test.writes] = addr;
+		test.written[test.writes] = test.regs[addr - 1];
+	}
+	test.writes++;
+	if (hal_in_isr())
+		test.isr_writes++;
+
+	if (latency > test.latency)
+		test.latency = latency;
+}
+
+static void test_init(void)
+{
+	int i;
+
+	hal_reset();
+	(void)gpc_init(test_trigger_output, NULL, test_register_changed, NULL);
+	for (i = 0; i < I2C_TEST_REGS; i++) {
+		test.regs[i] = 0;
+		(void)gpc_setup_reg((u8)(i + 1), &test.regs[i]);
+	}
+
+	test.rpm = 12345;
+	test.current = 0x0234;
+	test.voltage = 0x0ABC;
+	test.temp = 0x0789;
+	(void)gpc_setup_reg(GPROT_SPEED_RPM_REG_ADDR, &test.rpm);
+	(void)gpc_setup_reg(GPROT_ADC_CURRENT_REG_ADDR, &test.current);
+	(void)gpc_setup_reg(GPROT_ADC_BATTERY_VOLTAGE_REG_ADDR, &test.voltage);
+	(void)gpc_setup_reg(GPROT_ADC_TEMPERATURE_REG_ADDR, &test.temp);
+
+	i2c_init();
+
+	test.writes = 0;
+	test.isr_writes = 0;
+	test.latency = 0;
+}
+
+/**
+ * Run the I2C model together with the main loop part of the driver until
+ * the bus master is done.
+ */
+static void test_run(void)
+{
+	double t;
+
+	for (t = 0; hal_i2c_busy() && (t < 0.1); t += I2C_TEST_DT) {
+		hal_i2c_advance(I2C_TEST_DT);
+		hal_irq_service();
+
+		if (i2c_rx_trigger) {
+			i2c_rx_trigger = false;
+			i2c_process_rx();
+		}
+	}
+}
+
+static void test_write(u8 ptr, const u16 *values, int n)
+{
+	u8 data[1 + (2 * I2C_TEST_REGS)];
+	int i;
+
+	data[0] = ptr;
+	for (i = 0; i < n; i++) {
+		data[1 + (i * 2)] = values[i] & 0xFF;
+		data[2 + (i * 2)] = values[i] >> 8;
+	}
+
+	(void)hal_i2c_write(I2C__ADDR, data, 1 + (n * 2));
+}
+
+/**
+ * Read n registers and return the number of values received.
+ */
+static int test_read(u16 *values, int n)
+{
+	int lo, hi;
+	int i;
+
+	(void)hal_i2c_read(I2C__ADDR, n * 2);
+	test_run();
+
+	for (i = 0; i < n; i++) {
+		if (((lo = hal_i2c_read_pop()) < 0) ||
+		    ((hi = hal_i2c_read_pop()) < 0))
+			break;
+		values[i] = (u16)(lo | (hi << 8));
+	}
+
+	return i;
+}
+
+/**
+ * Write setpoints, single and several per transfer, and check that they
+ * arrive in order and promptly.
+ */
+static void test_setpoints(void)
+{
+	const int transfers = 50;
+	u16 values[I2C_TEST_REGS];
+	int total = 0;
+	int wrong = 0;
+	int n, i, k;
+
+	test_init();
+
+	for (n = 0; n < transfers; n++) {
+		k = (n % I2C_TEST_REGS) + 1;
+		for (i = 0; i < k; i++)
+			values[i] = (u16)(0x1234 + ((total + i) * 0x0101));
+		test_write(1, values, k);
+		test_run();
+		total += k;
+	}
+
+	for (n = 0, k = 0; (n < transfers) && (k < test.writes); n++) {
+		for (i = 0; (i <= (n % I2C_TEST_REGS)) && (k < test.writes);
+		     i++, k++) {
+			if ((test.written_addr[k] != i + 1) ||
+			    (test.written[k] != (u16)(0x1234 + (k * 0x0101))))
+				wrong++;
+		}
+	}
+
+	if (!test_quiet)
+		printf("setpoints:   %d writes in %d transfers, %d wrong, "
+		       "latency %.1f us, stretched %.1f us\n", test.writes,
+		       transfers, wrong, test.latency * 1e6,
+		       hal_i2c_stats.stretch * 1e6);
+
+	CHECK(test.writes == total, "%d of %d setpoint writes arrived",
+	      test.writes, total);
+	CHECK(wrong == 0, "%d setpoint writes wrong or out of order", wrong);
+	CHECK(test.isr_writes == 0, "%d hook calls from the interrupt",
+	      test.isr_writes);
+	CHECK(test.latency <= I2C_TEST_MAX_LATENCY,
+	      "setpoint latency %.1f us", test.latency * 1e6);
+	CHECK(i2c_rejected == 0, "%u setpoint writes rejected", i2c_rejected);
+	CHECK(i2c_errors == 0, "%u bus errors", i2c_errors);
+}
+
+/**
+ * Write to a register that does not exist and to the telemetry.
+ */
+static void test_rejected(void)
+{
+	u16 value = 0x5555;
+
+	test_init();
+
+	test_write(I2C_TEST_REGS + 1, &value, 1);
+	test_run();
+	test_write(I2C_TELEMETRY_ADDR, &value, 1);
+	test_run();
+
+	if (!test_quiet)
+		printf("rejected:    %u of 2 writes rejected\n", i2c_rejected);
+
+	CHECK(i2c_rejected == 2, "%u of 2 writes rejected", i2c_rejected);
+	CHECK(test.writes == 0, "%d rejected writes reached the hook",
+	      test.writes);
+	CHECK(test.rpm == 12345, "telemetry overwritten: %u", test.rpm);
+}
+
+/**
+ * Read the telemetry block twice and a pointer selected register.
+ */
+static void test_telemetry(void)
+{
+	const u16 expect[I2C_TELEMETRY_REGS] = {
+		12345, 0x0234, 0x0ABC, 0x0789
+	};
+	u16 values[I2C_TELEMETRY_REGS];
+	int wrong = 0;
+	int got;
+	int r, i;
+
+	test_init();
+
+	for (r = 0; r < 2; r++) {
+		got = test_read(values, I2C_TELEMETRY_REGS);
+		CHECK(got == I2C_TELEMETRY_REGS, "read %d: %d of %d registers",
+		      r, got, I2C_TELEMETRY_REGS);
+		for (i = 0; i < got; i++)
+			if (values[i] != expect[i])
+				wrong++;
+	}
+
+	/* A write leaves the pointer at the telemetry */
+	test.regs[1] = 0x4242;
+	values[0] = 0x1111;
+	test_write(1, values, 1);
+	test_run();
+	got = test_read(values, 1);
+	if ((got != 1) || (values[0] != expect[0]))
+		wrong++;
+
+	/* A pointer only write selects the registers read next */
+	test_write(2, NULL, 0);
+	test_run();
+	got = test_read(values, 1);
+	if ((got != 1) || (values[0] != 0x4242))
+		wrong++;
+
+	if (!test_quiet)
+		printf("telemetry:   %u bytes read, %d wrong\n",
+		       hal_i2c_stats.tx_bytes, wrong);
+
+	CHECK(wrong == 0, "%d telemetry reads wrong", wrong);
+	CHECK(hal_i2c_read_pop() < 0, "extra bytes read");
+	CHECK(i2c_errors == 0, "%u bus errors", i2c_errors);
+}
+
+/**
+ * Address another slave on the bus.
+ */
+static void test_other_address(void)
+{
+	u8 data[3] = { 1, 0x34, 0x12 };
+
+	test_init();
+
+	(void)hal_i2c_write(I2C__ADDR + 1, data, sizeof(data));
+	test_run();
+
+	if (!test_quiet)
+		printf("other slave: %u nacks, %u interrupts\n",
+		       hal_i2c_stats.nacks,
+		       hal_irq_stats[hal_irq_i2c1_ev].count);
+
+	CHECK(hal_i2c_stats.nacks == 1, "%u nacks for another address",
+	      hal_i2c_stats.nacks);
+	CHECK(hal_irq_stats[hal_irq_i2c1_ev].count == 0,
+	      "%u interrupts for another address",
+	      hal_irq_stats[hal_irq_i2c1_ev].count);
+	CHECK(test.writes == 0, "%d writes for another address", test.writes);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_setpoints();
+	test_rejected();
+	test_telemetry();
+	test_other_address();
+
+	return test_report("I2C");
+}
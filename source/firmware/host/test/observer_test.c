@@ -0,0 +1,459 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   observer_test.c
+ *
+ * @brief  Sensorless rotor angle observer tests.
+ *
+ * Spins the motor model running as PMSM with the field oriented current
+ * controller, first on the true rotor angle while the observer runs along,
+ * then on the observer angle alone. The estimated angle and speed are
+ * compared to the motor model, and the cost of one observer update is
+ * measured against the PWM period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "foc.h"
+#include "observer.h"
+#include "motor.h"
+
+#include "test.h"
+
+/**
+ * PWM period in timer counts.
+ */
+#define OBS_TEST_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * Motor model integration steps per PWM period.
+ */
+#define OBS_TEST_STEPS 50
+
+/**
+ * Integration step in which the phase currents are sampled, the TIM1 CC4
+ * ADC trigger point of the default pwm_offset of 187 counts.
+ */
+#define OBS_TEST_SAMPLE_STEP ((187 * OBS_TEST_STEPS) / OBS_TEST_PERIOD)
+
+/**
+ * Current measurement full scale [A].
+ */
+#define OBS_TEST_I_FS 20.0
+
+/**
+ * Current controller bandwidth [rad/s].
+ */
+#define OBS_TEST_BANDWIDTH (2 * M_PI * 800)
+
+/**
+ * Observer flux magnitude correction gain [1/s].
+ */
+#define OBS_TEST_GAIN 500
+
+/**
+ * Observer angle tracking bandwidth [Hz].
+ */
+#define OBS_TEST_PLL_BW 200
+
+/**
+ * Motor, current controller and observer.
+ */
+struct obs_test_plant {
+	struct motor m;		/**< Motor plant */
+	struct foc foc;		/**< Current controller */
+	struct observer obs;	/**< Observer under test */
+	u16 duty[3];		/**< Compare values of the running period */
+	u16 prev[3];		/**< Compare values of the previous period */
+	double time;		/**< Simulated time [s] */
+};
+
+/**
+ * Observer tracking statistics.
+ */
+struct obs_test_stats {
+	double angle_sq;	/**< Sum of the squared angle errors [deg^2] */
+	double angle_max;	/**< Largest angle error magnitude [deg] */
+	double speed_err;	/**< Largest relative speed error */
+	double iq_sq;		/**< Sum of the squared q current errors [A^2] */
+	int samples;		/**< Number of samples */
+};
+
+/**
+ * Observer parameters of the motor model in the observer units.
+ */
+static void test_observer_params(const struct motor_params *mp,
+				 struct observer_params *p)
+{
+	p->r = (u32)lround(mp->r * 1e6);
+	p->l = (u32)lround(mp->l * 1e9);
+	p->flux = (u32)lround(mp->ke / mp->pole_pairs * 1e9);
+	p->v_fs = (u32)lround(mp->vbus * 1e3);
+	p->i_fs = (u32)lround(OBS_TEST_I_FS * 1e3);
+	p->period = 1000000000 / PWM__FREQUENCY;
+	p->gain = OBS_TEST_GAIN;
+	p->pll_bw = OBS_TEST_PLL_BW;
+}
+
+static void test_plant_init(struct obs_test_plant *p,
+			    const struct observer_params *op)
+{
+	struct motor_params mp;
+	double kp;
+	double ki;
+	int x;
+
+	motor_params_default(&mp);
+	mp.bemf = motor_bemf_sinusoidal;
+	motor_init(&p->m, &mp);
+
+	kp = mp.l * OBS_TEST_BANDWIDTH * OBS_TEST_I_FS / mp.vbus;
+	ki = mp.r * OBS_TEST_BANDWIDTH / PWM__FREQUENCY * OBS_TEST_I_FS /
+		mp.vbus;
+
+	foc_init(&p->foc, (s32)lround(kp * (1 << FOC_PI_FRAC_BITS)),
+		 (s32)lround(ki * (1 << FOC_PI_FRAC_BITS)),
+		 FOC_V_MAX * 97 / 100, OBS_TEST_PERIOD);
+
+	if (op != NULL) {
+		observer_init(&p->obs, op);
+	} else {
+		struct observer_params exact;
+
+		test_observer_params(&mp, &exact);
+		observer_init(&p->obs, &exact);
+	}
+	observer_reset(&p->obs, (u16)lround(test_flux_angle(&p->m) * 65536 /
+					    (2 * M_PI)));
+
+	for (x = 0; x < 3; x++) {
+		p->duty[x] = p->foc.duty[x];
+		p->prev[x] = p->foc.duty[x];
+	}
+	p->time = 0;
+}
+
+/**
+ * Mean stator voltage since the last sample.
+ *
+ * The sample is taken within the period, the compare values of the
+ * previous period were applied up to the start of the running one.
+ */
+static struct foc_vec test_voltage(const struct obs_test_plant *p)
+{
+	const double w = (double)OBS_TEST_SAMPLE_STEP / OBS_TEST_STEPS;
+	double v[3];
+	double mean;
+	int x;
+
+	for (x = 0; x < 3; x++)
+		v[x] = (w * p->duty[x] + (1 - w) * p->prev[x]) /
+			OBS_TEST_PERIOD;
+	mean = (v[0] + v[1] + v[2]) / 3;
+
+	return foc_clarke((s16)lround((v[0] - mean) * 32767),
+			  (s16)lround((v[1] - mean) * 32767));
+}
+
+static double test_wrap(double a)
+{
+	a = fmod(a, 2 * M_PI);
+	if (a > M_PI)
+		a -= 2 * M_PI;
+	if (a < -M_PI)
+		a += 2 * M_PI;
+	return a;
+}
+
+/**
+ * Run the current loop with the observer running along.
+ *
+ * @param p Plant, controller and observer
+ * @param time Time to run [s]
+ * @param iq_ref Torque current reference [A]
+ * @param sensorless Run the current controller on the observer angle
+ * @param settle Time after which the statistics are collected [s]
+ * @param stats Statistics output
+ */
+static void test_plant_run(struct obs_test_plant *p, double time,
+			   double iq_ref, bool sensorless, double settle,
+			   struct obs_test_stats *stats)
+{
+	const double dt = 1.0 / PWM__FREQUENCY / OBS_TEST_STEPS;
+	double end = p->time + time;
+	double start = p->time + settle;
+	u16 next[3];
+	int step;
+	int x;
+
+	p->foc.i_ref.x = 0;
+	p->foc.i_ref.y = test_current(iq_ref, OBS_TEST_I_FS);
+
+	stats->angle_sq = 0;
+	stats->angle_max = 0;
+	stats->speed_err = 0;
+	stats->iq_sq = 0;
+	stats->samples = 0;
+
+	while (p->time < end) {
+		for (x = 0; x < 3; x++)
+			next[x] = p->duty[x];
+
+		for (step = 0; step < OBS_TEST_STEPS; step++) {
+			double high[3];
+			double low[3];
+
+			if (step == OBS_TEST_SAMPLE_STEP) {
+				double theta = test_flux_angle(&p->m);
+				s16 i_a = test_current(p->m.i[0],
+						       OBS_TEST_I_FS);
+				s16 i_b = test_current(p->m.i[1],
+						       OBS_TEST_I_FS);
+				u16 angle;
+
+				observer_update(&p->obs, test_voltage(p),
+						foc_clarke(i_a, i_b));
+
+				if (sensorless)
+					angle = observer_angle(&p->obs);
+				else
+					angle = (u16)lround(theta * 65536 /
+							    (2 * M_PI));
+				foc_update(&p->foc, i_a, i_b, angle);
+				for (x = 0; x < 3; x++)
+					next[x] = p->foc.duty[x];
+
+				if (p->time >= start) {
+					double err = test_wrap(
+						observer_angle(&p->obs) * 2 *
+						M_PI / 65536 - theta) * 180 /
+						M_PI;
+					double omega = p->m.omega *
+						p->m.p.pole_pairs;
+					double speed = (double)p->obs.speed /
+						4294967296.0 * 2 * M_PI *
+						PWM__FREQUENCY;
+					double alpha = p->m.i[0];
+					double beta = (p->m.i[0] +
+						       2 * p->m.i[1]) / sqrt(3);
+					double iq = beta * cos(theta) -
+						alpha * sin(theta);
+
+					stats->angle_sq += err * err;
+					stats->angle_max =
+						fmax(stats->angle_max,
+						     fabs(err));
+					stats->speed_err =
+						fmax(stats->speed_err,
+						     fabs(speed - omega) /
+						     omega);
+					stats->iq_sq += (iq - iq_ref) *
+						(iq - iq_ref);
+					stats->samples++;
+				}
+			}
+
+			for (x = 0; x < 3; x++) {
+				high[x] = (double)p->duty[x] / OBS_TEST_PERIOD;
+				low[x] = 1 - high[x];
+			}
+			motor_step(&p->m, high, low, dt);
+			p->time += dt;
+		}
+
+		for (x = 0; x < 3; x++) {
+			p->prev[x] = p->duty[x];
+			p->duty[x] = next[x];
+		}
+	}
+}
+
+/**
+ * Observer running along a sensored current loop, then replacing the
+ * angle sensor.
+ */
+static void test_tracking(void)
+{
+	struct obs_test_plant p;
+	struct obs_test_stats stats;
+	const double iq_ref = 3.0;
+	double rpm;
+
+	test_plant_init(&p, NULL);
+
+	/* Start up on the true angle */
+	test_plant_run(&p, 0.05, iq_ref, false, 0.02, &stats);
+
+	if (!test_quiet)
+		printf("sensored:          angle error %.2f deg rms, "
+		       "%.2f deg max, speed error %.2f%%, %.0f rpm\n",
+		       sqrt(stats.angle_sq / stats.samples), stats.angle_max,
+		       100 * stats.speed_err, motor_rpm(&p.m));
+
+	CHECK(sqrt(stats.angle_sq / stats.samples) < 2,
+	      "sensored angle error %.2f deg rms",
+	      sqrt(stats.angle_sq / stats.samples));
+	CHECK(stats.angle_max < 5, "sensored angle error %.2f deg max",
+	      stats.angle_max);
+	CHECK(stats.speed_err < 0.05, "sensored speed error %.2f%%",
+	      100 * stats.speed_err);
+
+	/* Hand the angle over to the observer */
+	rpm = motor_rpm(&p.m);
+	test_plant_run(&p, 0.1, iq_ref, true, 0.01, &stats);
+
+	if (!test_quiet)
+		printf("sensorless:        angle error %.2f deg rms, "
+		       "%.2f deg max, iq error %.3f A rms, %.0f rpm\n",
+		       sqrt(stats.angle_sq / stats.samples), stats.angle_max,
+		       sqrt(stats.iq_sq / stats.samples), motor_rpm(&p.m));
+
+	CHECK(sqrt(stats.angle_sq / stats.samples) < 2,
+	      "sensorless angle error %.2f deg rms",
+	      sqrt(stats.angle_sq / stats.samples));
+	CHECK(stats.angle_max < 5, "sensorless angle error %.2f deg max",
+	      stats.angle_max);
+	CHECK(sqrt(stats.iq_sq / stats.samples) < 0.05 * iq_ref,
+	      "sensorless iq error %.3f A rms",
+	      sqrt(stats.iq_sq / stats.samples));
+	CHECK(motor_rpm(&p.m) > rpm, "motor not accelerating sensorless, "
+	      "%.0f rpm", motor_rpm(&p.m));
+}
+
+/**
+ * Observer started from standstill on a spinning rotor, as when catching a
+ * windmilling motor.
+ */
+static void test_catch(void)
+{
+	struct obs_test_plant p;
+	struct obs_test_stats stats;
+
+	test_plant_init(&p, NULL);
+	test_plant_run(&p, 0.03, 3.0, false, 0.03, &stats);
+
+	observer_reset(&p.obs, 0);
+	test_plant_run(&p, 0.03, 3.0, false, 0.01, &stats);
+
+	if (!test_quiet)
+		printf("catch spinning:    angle error %.2f deg rms, "
+		       "%.2f deg max after 10 ms, %.0f rpm\n",
+		       sqrt(stats.angle_sq / stats.samples), stats.angle_max,
+		       motor_rpm(&p.m));
+
+	CHECK(stats.angle_max < 5, "catch spinning angle error %.2f deg max "
+	      "after 10 ms", stats.angle_max);
+}
+
+/**
+ * Observer with 20% resistance and inductance and 5% flux linkage errors
+ * taking over a spinning rotor.
+ */
+static void test_mismatch(void)
+{
+	struct obs_test_plant p;
+	struct obs_test_stats stats;
+	struct motor_params mp;
+	struct observer_params op;
+
+	motor_params_default(&mp);
+	test_observer_params(&mp, &op);
+	op.r = op.r * 6 / 5;
+	op.l = op.l * 6 / 5;
+	op.flux = op.flux * 19 / 20;
+
+	test_plant_init(&p, &op);
+	test_plant_run(&p, 0.03, 3.0, false, 0.03, &stats);
+
+	observer_reset(&p.obs, 0);
+	test_plant_run(&p, 0.03, 3.0, false, 0.01, &stats);
+
+	if (!test_quiet)
+		printf("parameter error:   angle error %.2f deg rms, "
+		       "%.2f deg max, speed error %.2f%%, %.0f rpm\n",
+		       sqrt(stats.angle_sq / stats.samples), stats.angle_max,
+		       100 * stats.speed_err, motor_rpm(&p.m));
+
+	CHECK(stats.angle_max < 15, "parameter error angle error %.2f deg max",
+	      stats.angle_max);
+	CHECK(stats.speed_err < 0.1, "parameter error speed error %.2f%%",
+	      100 * stats.speed_err);
+}
+
+/**
+ * Cost of one observer update against the PWM period.
+ */
+static void test_speed(void)
+{
+	const u32 cycles = 1000000;
+	const double budget_ns = 1e9 / PWM__FREQUENCY;
+	struct observer_params op;
+	struct motor_params mp;
+	struct observer obs;
+	struct foc_vec v;
+	struct foc_vec i;
+	u64 start_ns, ns;
+	u64 start_cycles, tsc;
+	u32 n;
+
+	motor_params_default(&mp);
+	test_observer_params(&mp, &op);
+	observer_init(&obs, &op);
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < cycles; n++) {
+		v.x = (s16)(n & 0x3ff);
+		v.y = (s16)-(n & 0x1ff);
+		i.x = (s16)(n & 0x7f);
+		i.y = (s16)(n & 0xff);
+		observer_update(&obs, v, i);
+	}
+	tsc = test_cycles() - start_cycles;
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("observer update:   %.2f ns %.2f cycles/call, "
+		       "%.3f%% of the %.1f us PWM period\n",
+		       (double)ns / cycles, (double)tsc / cycles,
+		       100 * (double)ns / cycles / budget_ns,
+		       budget_ns / 1000);
+
+	if (test_bench)
+		CHECK((double)ns / cycles < budget_ns / 20,
+		      "observer update %.2f ns above 5%% of the PWM period",
+		      (double)ns / cycles);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_tracking();
+	test_catch();
+	test_mismatch();
+	test_speed();
+
+	return test_report("observer");
+}
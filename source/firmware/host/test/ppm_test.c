@@ -0,0 +1,431 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   ppm_test.c
+ *
+ * @brief  RC pulse decoder and throttle curve tests.
+ *
+ * Feeds the decoder of @ref ppm.h with synthetic RC pulse trains the way
+ * the TIM2 capture interrupt does it: pulse widths in commutation timer
+ * ticks and the time of the pulse in sys tick counts. Checks the throttle
+ * curve against its points, that the decoder only arms after idle frames,
+ * that glitches, out of range pulses and extra pulses within a frame are
+ * rejected without disturbing the throttle, that jittery frames at the
+ * usual frame rates pass and that a signal loss drops the throttle after
+ * the timeout. The cost of decoding one pulse is measured against the PWM
+ * period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "comm_tim.h"
+#include "ppm.h"
+
+#include "test.h"
+
+/**
+ * Convert microseconds to capture timer ticks, same as ppm_process.c.
+ */
+#define PPM_TEST_TICKS(US) (((u32)(US) * (COMM_TIM_CLOCK / 100000)) / 10)
+
+/**
+ * Sys tick counts per millisecond.
+ */
+#define PPM_TEST_MS 100
+
+/**
+ * Decoder under test and the time of the pulse train.
+ */
+struct ppm_test {
+	struct ppm_config config;	/**< Decoder configuration */
+	struct ppm ppm;			/**< Decoder state */
+	u32 time;			/**< Time of the last pulse [sys ticks] */
+};
+
+/**
+ * Set up the decoder with the configuration of the firmware.
+ */
+static void test_init(struct ppm_test *t)
+{
+	struct ppm_config *config = &t->config;
+
+	config->width_min = PPM_TEST_TICKS(PPM__WIDTH_MIN);
+	config->width_max = PPM_TEST_TICKS(PPM__WIDTH_MAX);
+	config->idle = PPM_TEST_TICKS(PPM__IDLE);
+	config->full = PPM_TEST_TICKS(PPM__FULL);
+	config->deadband = PPM_TEST_TICKS(PPM__DEADBAND);
+	config->period_min = PPM__PERIOD_MIN;
+	config->period_max = PPM__PERIOD_MAX;
+	config->timeout = PPM__TIMEOUT;
+	config->arm_frames = PPM__ARM_FRAMES;
+	config->curve[0] = PPM__CURVE_0;
+	config->curve[1] = PPM__CURVE_1;
+	config->curve[2] = PPM__CURVE_2;
+	config->curve[3] = PPM__CURVE_3;
+	config->curve[4] = PPM__CURVE_4;
+
+	ppm_init(&t->ppm, config);
+	/* Start somewhere near the sys tick counter wrap */
+	t->time = 0xFFFFFFFF - (50 * PPM_TEST_MS);
+}
+
+/**
+ * Send one pulse after a pause.
+ *
+ * @param t Test state
+ * @param width Pulse width [us]
+ * @param period Time since the last pulse [sys ticks]
+ * @return Result of ppm_pulse()
+ */
+static bool test_pulse(struct ppm_test *t, u32 width, u32 period)
+{
+	t->time += period;
+
+	return ppm_pulse(&t->ppm, (u16)PPM_TEST_TICKS(width), t->time, false);
+}
+
+/**
+ * Send a number of regular 50Hz frames.
+ *
+ * @return Number of frames that gave a new throttle value
+ */
+static int test_frames(struct ppm_test *t, u32 width, int frames)
+{
+	int valid = 0;
+	int i;
+
+	for (i = 0; i < frames; i++)
+		if (test_pulse(t, width, 20 * PPM_TEST_MS))
+			valid++;
+
+	return valid;
+}
+
+/**
+ * Send idle frames until the decoder arms.
+ */
+static void test_arm(struct ppm_test *t)
+{
+	(void)test_frames(t, PPM__IDLE, PPM__ARM_FRAMES + 1);
+}
+
+/**
+ * Check the throttle curve at its points, the deadband and that it is
+ * monotonic in between, with the configured and with an expo like curve.
+ */
+static void test_curve(void)
+{
+	static const s16 expo[PPM_CURVE_POINTS] = {
+		0, 2000, 8000, 18000, 32767
+	};
+	struct ppm_test t;
+	u32 span;
+	u32 width;
+	s16 power;
+	s16 last;
+	int wrong = 0;
+	int k;
+	int c;
+
+	test_init(&t);
+
+	for (c = 0; c < 2; c++) {
+		if (c == 1)
+			for (k = 0; k < PPM_CURVE_POINTS; k++)
+				t.config.curve[k] = expo[k];
+
+		span = t.config.full - t.config.idle - t.config.deadband;
+		for (k = 0; k < PPM_CURVE_POINTS; k++) {
+			width = t.config.idle + t.config.deadband +
+				((span * k) / (PPM_CURVE_POINTS - 1));
+			power = ppm_curve(&t.config, (u16)width);
+			CHECK(abs(power - t.config.curve[k]) <= 1,
+			      "curve %d point %d: %d instead of %d", c, k,
+			      power, t.config.curve[k]);
+		}
+
+		last = ppm_curve(&t.config, t.config.width_min);
+		for (width = t.config.width_min; width <= t.config.width_max;
+		     width++) {
+			power = ppm_curve(&t.config, (u16)width);
+			if (power < last)
+				wrong++;
+			last = power;
+		}
+		CHECK(wrong == 0, "curve %d: %d steps down", c, wrong);
+	}
+
+	CHECK(ppm_curve(&t.config, t.config.idle + t.config.deadband) == 0,
+	      "throttle at the end of the deadband");
+	CHECK(ppm_curve(&t.config, t.config.width_min) == 0,
+	      "throttle below idle");
+	CHECK(ppm_curve(&t.config, t.config.width_max) ==
+	      t.config.curve[PPM_CURVE_POINTS - 1], "throttle above full");
+
+	if (!test_quiet)
+		printf("curve:             points hit, monotonic over %u "
+		       "widths, %d at mid throttle with the expo curve\n",
+		       t.config.width_max - t.config.width_min + 1,
+		       ppm_curve(&t.config, (t.config.idle +
+					     t.config.deadband +
+					     t.config.full) / 2));
+}
+
+/**
+ * A transmitter left at some throttle must not arm the decoder, idle frames
+ * arm it and from then on every frame sets the throttle.
+ */
+static void test_arming(void)
+{
+	struct ppm_test t;
+	int valid;
+	int frames;
+
+	test_init(&t);
+
+	valid = test_frames(&t, 1500, 100);
+	CHECK((valid == 0) && !t.ppm.armed && (t.ppm.power == 0),
+	      "armed at mid throttle after %d frames", valid);
+
+	for (frames = 1; frames <= 100; frames++)
+		if (test_pulse(&t, PPM__IDLE, 20 * PPM_TEST_MS))
+			break;
+
+	CHECK(frames == PPM__ARM_FRAMES, "armed after %d idle frames",
+	      frames);
+	CHECK(t.ppm.power == 0, "throttle %d when armed", t.ppm.power);
+
+	/* The new throttle is there with the first frame */
+	CHECK(test_pulse(&t, PPM__FULL, 20 * PPM_TEST_MS) &&
+	      (t.ppm.power == PPM__CURVE_4), "throttle %d after full step",
+	      t.ppm.power);
+	CHECK(test_pulse(&t, PPM__IDLE, 20 * PPM_TEST_MS) &&
+	      (t.ppm.power == PPM__CURVE_0), "throttle %d after idle step",
+	      t.ppm.power);
+
+	if (!test_quiet)
+		printf("arming:            not armed by 100 frames at mid "
+		       "throttle, armed by %d idle frames\n", frames);
+}
+
+/**
+ * Mix glitches, out of range pulses and extra pulses into a frame train and
+ * check that all of them are rejected while the frames still pass.
+ */
+static void test_rejects(void)
+{
+	struct ppm_test t;
+	s16 power;
+	int injected = 0;
+	int valid = 0;
+	int wrong = 0;
+	int i;
+
+	test_init(&t);
+	test_arm(&t);
+	(void)test_pulse(&t, 1500, 20 * PPM_TEST_MS);
+	power = t.ppm.power;
+
+	for (i = 0; i < 200; i++) {
+		/* Full throttle noise that must never get through */
+		switch (i % 4) {
+		case 0:
+			t.time += 5 * PPM_TEST_MS;
+			if (ppm_pulse(&t.ppm, (u16)PPM_TEST_TICKS(PPM__FULL),
+				      t.time, true))
+				wrong++;
+			t.time += 15 * PPM_TEST_MS;
+			break;
+		case 1:
+			if (test_pulse(&t, 300, 7 * PPM_TEST_MS))
+				wrong++;
+			t.time += 13 * PPM_TEST_MS;
+			break;
+		case 2:
+			if (test_pulse(&t, PPM__WIDTH_MAX + 300,
+				       9 * PPM_TEST_MS))
+				wrong++;
+			t.time += 11 * PPM_TEST_MS;
+			break;
+		default:
+			/* Valid width, but only 1ms into the frame */
+			if (test_pulse(&t, PPM__FULL, 1 * PPM_TEST_MS))
+				wrong++;
+			t.time += 19 * PPM_TEST_MS;
+			break;
+		}
+		injected++;
+
+		t.time -= 20 * PPM_TEST_MS;
+		if (test_pulse(&t, 1500, 20 * PPM_TEST_MS))
+			valid++;
+		if (t.ppm.power != power)
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("rejects:           %d of %d bad pulses rejected, %d of "
+		       "200 frames passed, %d wrong\n", t.ppm.errors, injected,
+		       valid, wrong);
+
+	CHECK(t.ppm.errors == injected, "%d of %d bad pulses rejected",
+	      t.ppm.errors, injected);
+	CHECK(valid == 200, "%d of 200 frames passed", valid);
+	CHECK(wrong == 0, "%d bad pulses changed the throttle", wrong);
+	CHECK(t.ppm.armed, "disarmed by bad pulses");
+}
+
+/**
+ * Frames with period and width jitter at frame rates from 50Hz to 333Hz.
+ */
+static void test_jitter(void)
+{
+	static const u32 periods[] = { 20, 11, 3 };
+	struct ppm_test t;
+	u32 width;
+	u32 period;
+	int wrong = 0;
+	int p;
+	int i;
+
+	srand(42);
+
+	for (p = 0; p < (int)(sizeof(periods) / sizeof(periods[0])); p++) {
+		test_init(&t);
+		test_arm(&t);
+
+		for (i = 0; i < 1000; i++) {
+			width = 1200 + (u32)(rand() % 600);
+			period = (periods[p] * PPM_TEST_MS) - 20 +
+				(u32)(rand() % 41);
+			if (!test_pulse(&t, width, period) ||
+			    (t.ppm.power !=
+			     ppm_curve(&t.config,
+				       (u16)PPM_TEST_TICKS(width))))
+				wrong++;
+		}
+	}
+
+	if (!test_quiet)
+		printf("jitter:            3000 frames at 50Hz to 333Hz with "
+		       "+/-200us jitter, %d wrong\n", wrong);
+
+	CHECK(wrong == 0, "%d jittery frames rejected or wrong", wrong);
+}
+
+/**
+ * Stop the pulse train of an armed decoder, the throttle has to be held up
+ * to the timeout and go to zero right after it. Back on signal the decoder
+ * has to be armed again.
+ */
+static void test_failsafe(void)
+{
+	struct ppm_test t;
+	u32 lost;
+	int trips = 0;
+	int held = 0;
+	int frames;
+	u32 dt;
+
+	test_init(&t);
+	test_arm(&t);
+	(void)test_pulse(&t, 1600, 20 * PPM_TEST_MS);
+	lost = t.time;
+
+	for (dt = 0; dt <= (2 * PPM__TIMEOUT); dt++) {
+		if (ppm_check(&t.ppm, lost + dt)) {
+			trips++;
+			CHECK(dt == PPM__TIMEOUT + 1,
+			      "failsafe after %u sys ticks", dt);
+		}
+		if ((dt <= PPM__TIMEOUT) && (t.ppm.power != 0))
+			held++;
+	}
+
+	CHECK(trips == 1, "%d failsafe trips", trips);
+	CHECK(held == PPM__TIMEOUT + 1, "throttle held for %d of %d sys ticks",
+	      held, PPM__TIMEOUT + 1);
+	CHECK(!t.ppm.armed && (t.ppm.power == 0),
+	      "throttle %d after the signal loss", t.ppm.power);
+	CHECK(t.ppm.failsafes == 1, "%d failsafes counted", t.ppm.failsafes);
+
+	t.time = lost + (2 * PPM__TIMEOUT);
+	frames = test_frames(&t, 1600, 50);
+	CHECK((frames == 0) && (t.ppm.power == 0),
+	      "throttle %d back on signal without arming", t.ppm.power);
+
+	test_arm(&t);
+	CHECK(t.ppm.armed, "not armed again");
+
+	if (!test_quiet)
+		printf("failsafe:          throttle cut %.1f ms after the last "
+		       "frame, rearmed by idle frames\n",
+		       (PPM__TIMEOUT + 1) / (double)PPM_TEST_MS);
+}
+
+static void test_speed(void)
+{
+	const u32 pulses = 1000000;
+	const double budget_ns = 1e9 / PWM__FREQUENCY;
+	struct ppm_test t;
+	u64 start_ns, ns;
+	u32 sum = 0;
+	u32 n;
+
+	test_init(&t);
+	test_arm(&t);
+
+	start_ns = test_ns();
+	for (n = 0; n < pulses; n++) {
+		t.time += 20 * PPM_TEST_MS;
+		(void)ppm_pulse(&t.ppm, (u16)(t.config.idle + (n & 0x1fff)),
+				t.time, false);
+		sum += (u32)t.ppm.power;
+	}
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("pulse decode:      %.2f ns/pulse, %.3f%% of the %.1f us "
+		       "PWM period (%u)\n", (double)ns / pulses,
+		       100 * (double)ns / pulses / budget_ns, budget_ns / 1000,
+		       sum & 1);
+
+	if (test_bench)
+		CHECK((double)ns / pulses < budget_ns / 20,
+		      "pulse decode %.2f ns above 5%% of the PWM period",
+		      (double)ns / pulses);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_curve();
+	test_arming();
+	test_rejects();
+	test_jitter();
+	test_failsafe();
+	test_speed();
+
+	return test_report("PPM");
+}
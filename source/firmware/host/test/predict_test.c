@@ -0,0 +1,297 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   predict_test.c
+ *
+ * @brief  Commutation time prediction benchmark.
+ *
+ * Runs the motor model with ideal block commutation through acceleration
+ * profiles and records the BEMF zero crossings in commutation timer ticks,
+ * with some detection jitter added. Both commutation time estimators, the
+ * single pole IIR filter and the alpha beta tracker, are fed with the half
+ * crossing intervals the way the commutation process does it. Their
+ * prediction of the next half interval is compared against the one that
+ * actually follows and the error is reported in electrical degrees.
+ *
+ * Checks that the tracker is clearly better than the IIR filter while the
+ * speed ramps up or down and not noticeably worse at constant speed or with
+ * a speed ripple, where the detection jitter dominates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "filter.h"
+#include "comm_tim.h"
+#include "motor.h"
+
+#include "test.h"
+
+/**
+ * Motor model integration step [s].
+ */
+#define PREDICT_TEST_DT 1e-6
+
+/**
+ * Time the motor runs before a profile starts [s].
+ */
+#define PREDICT_TEST_SETTLE 0.5
+
+/**
+ * Duration of a profile, the duty cycle ramps over all of it [s].
+ */
+#define PREDICT_TEST_TIME 0.1
+
+/**
+ * Largest detection jitter of a crossing [ticks].
+ */
+#define PREDICT_TEST_JITTER 50
+
+/**
+ * Largest number of crossings recorded per profile.
+ */
+#define PREDICT_TEST_MAX_CROSSINGS 16384
+
+/**
+ * Acceleration profile.
+ */
+struct predict_test_profile {
+	const char *name;	/**< Profile name */
+	double duty_start;	/**< Duty cycle while settling */
+	double duty_end;	/**< Duty cycle at the end of the profile */
+	double ripple;		/**< Duty cycle ripple amplitude */
+	double ripple_freq;	/**< Duty cycle ripple frequency [Hz] */
+	double k_fan;		/**< Fan load coefficient [Nm/(rad/s)^2] */
+	bool ramp;		/**< Check that the tracker beats the IIR filter */
+};
+
+static const struct predict_test_profile predict_test_profiles[] = {
+	{ "steady:", 0.5, 0.5, 0, 0, 1e-9, false },
+	{ "accelerate:", 0.2, 1.0, 0, 0, 1e-9, true },
+	{ "brake:", 1.0, 0.0, 0, 0, 2e-7, true },
+	{ "ripple:", 0.6, 0.6, 0.3, 50, 1e-9, false },
+};
+
+/**
+ * Recorded crossings of one profile.
+ */
+struct predict_test_run {
+	double time[PREDICT_TEST_MAX_CROSSINGS];	/**< True crossing times [s] */
+	s32 ticks[PREDICT_TEST_MAX_CROSSINGS];		/**< Detected crossing times [ticks] */
+	int n;						/**< Number of crossings */
+	double rpm_start;				/**< Speed at the start [rpm] */
+	double rpm_end;					/**< Speed at the end [rpm] */
+};
+
+static struct predict_test_run run;
+
+static u32 test_rand_state = 12345;
+
+/**
+ * Uniform pseudo random number in -max..max, reproducible.
+ */
+static s32 test_jitter(s32 max)
+{
+	test_rand_state = test_rand_state * 1103515245 + 12345;
+
+	return (s32)((test_rand_state >> 16) % (u32)(2 * max + 1)) - max;
+}
+
+/**
+ * Drive the motor with ideal block commutation for one integration step.
+ */
+static void test_step(struct motor *m, double duty)
+{
+	double high[3] = {0, 0, 0};
+	double low[3] = {0, 0, 0};
+	double theta_e = m->theta * m->p.pole_pairs;
+	double shape;
+	double top = -2;
+	double bottom = 2;
+	int hi = 0;
+	int lo = 0;
+	int x;
+
+	for (x = 0; x < 3; x++) {
+		shape = sin(theta_e - x * 2 * M_PI / 3);
+		if (shape > top) {
+			top = shape;
+			hi = x;
+		}
+		if (shape < bottom) {
+			bottom = shape;
+			lo = x;
+		}
+	}
+
+	high[hi] = duty;
+	low[lo] = 1;
+
+	motor_step(m, high, low, PREDICT_TEST_DT);
+}
+
+/**
+ * Run a profile and record its crossings.
+ */
+static void test_record(const struct predict_test_profile *prof)
+{
+	struct motor_params p;
+	struct motor m;
+	double t;
+	double duty;
+	double frac;
+	long sector;
+	long prev_sector;
+
+	motor_params_default(&p);
+	p.k_fan = prof->k_fan;
+	motor_init(&m, &p);
+	m.theta = 0.3 / p.pole_pairs;
+
+	for (t = 0; t < PREDICT_TEST_SETTLE; t += PREDICT_TEST_DT)
+		test_step(&m, prof->duty_start);
+
+	run.n = 0;
+	run.rpm_start = motor_rpm(&m);
+	prev_sector = lround(floor(m.theta * p.pole_pairs / (M_PI / 3)));
+
+	for (t = 0; t < PREDICT_TEST_TIME; t += PREDICT_TEST_DT) {
+		frac = t / PREDICT_TEST_TIME;
+		duty = prof->duty_start +
+			((prof->duty_end - prof->duty_start) * frac);
+		duty += prof->ripple * sin(2 * M_PI * prof->ripple_freq * t);
+		if (duty < 0)
+			duty = 0;
+		if (duty > 1)
+			duty = 1;
+
+		test_step(&m, duty);
+
+		sector = lround(floor(m.theta * p.pole_pairs / (M_PI / 3)));
+		if ((sector != prev_sector) &&
+		    (run.n < PREDICT_TEST_MAX_CROSSINGS)) {
+			run.time[run.n] = t;
+			run.ticks[run.n] = (s32)lround(t * COMM_TIM_CLOCK) +
+				test_jitter(PREDICT_TEST_JITTER);
+			run.n++;
+		}
+		prev_sector = sector;
+	}
+
+	run.rpm_end = motor_rpm(&m);
+}
+
+/**
+ * Prediction error statistics of one estimator [electrical degrees].
+ */
+struct predict_test_error {
+	double sum;	/**< Sum of absolute errors */
+	double max;	/**< Largest absolute error */
+	int n;		/**< Number of predictions */
+};
+
+static void test_error_add(struct predict_test_error *e, s32 pred, int k)
+{
+	double half = (run.time[k + 1] - run.time[k]) * COMM_TIM_CLOCK / 2;
+	double err = fabs((pred - half) / (2 * half)) * 60;
+
+	e->sum += err;
+	if (err > e->max)
+		e->max = err;
+	e->n++;
+}
+
+static double test_error_mean(const struct predict_test_error *e)
+{
+	return (e->n != 0) ? e->sum / e->n : 0;
+}
+
+/**
+ * Benchmark both estimators on a profile.
+ */
+static void test_profile(const struct predict_test_profile *prof)
+{
+	struct predict_test_error iir_err = { 0, 0, 0 };
+	struct predict_test_error ab_err = { 0, 0, 0 };
+	struct filter_iir iir;
+	struct filter_ab ab;
+	s32 half;
+	s32 iir_pred;
+	s32 ab_pred;
+	int k;
+
+	test_record(prof);
+
+	if (run.n < 20) {
+		CHECK(false, "%s only %d crossings", prof->name, run.n);
+		return;
+	}
+
+	half = (run.ticks[1] - run.ticks[0]) / 2;
+	filter_iir_init(&iir, COMMP__IIR_SHIFT, half);
+	filter_ab_init(&ab, COMMP__PREDICT_ALPHA_SHIFT,
+		       COMMP__PREDICT_BETA_SHIFT, half);
+
+	for (k = 2; k < run.n - 1; k++) {
+		half = (run.ticks[k] - run.ticks[k - 1]) / 2;
+		iir_pred = filter_iir_update(&iir, half);
+		ab_pred = filter_ab_update(&ab, half);
+
+		/* Let both settle on the first crossings */
+		if (k < 10)
+			continue;
+
+		test_error_add(&iir_err, iir_pred, k);
+		test_error_add(&ab_err, ab_pred, k);
+	}
+
+	if (!test_quiet)
+		printf("%-12s %5.0f -> %5.0f rpm, %5d crossings, iir %5.2f "
+		       "(max %5.2f), alpha beta %5.2f (max %5.2f) deg\n",
+		       prof->name, run.rpm_start, run.rpm_end, run.n,
+		       test_error_mean(&iir_err), iir_err.max,
+		       test_error_mean(&ab_err), ab_err.max);
+
+	if (prof->ramp)
+		CHECK(test_error_mean(&ab_err) < test_error_mean(&iir_err) / 2,
+		      "%s alpha beta error %.2f deg, iir %.2f deg", prof->name,
+		      test_error_mean(&ab_err), test_error_mean(&iir_err));
+	else
+		CHECK(test_error_mean(&ab_err) <
+		      test_error_mean(&iir_err) + 0.5,
+		      "%s alpha beta error %.2f deg, iir %.2f deg", prof->name,
+		      test_error_mean(&ab_err), test_error_mean(&iir_err));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned i;
+
+	test_parse_args(argc, argv);
+
+	for (i = 0; i < sizeof(predict_test_profiles) /
+		     sizeof(predict_test_profiles[0]); i++)
+		test_profile(&predict_test_profiles[i]);
+
+	return test_report("prediction");
+}
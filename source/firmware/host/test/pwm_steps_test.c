@@ -0,0 +1,473 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   pwm_steps_test.c
+ *
+ * @brief  Commutation step table tests.
+ *
+ * Runs every PWM scheme through the table driven step engine and through the
+ * sequence of pwm_utils.h manipulators the scheme used to call, and checks
+ * that both leave TIM1 CCER, CCMR1 and CCMR2 in exactly the same state.
+ * The registers are filled with random content before every step so that
+ * the bits not owned by the commutation steps are covered as well.
+ *
+ * Also checks live scheme switching through the dispatch table and measures
+ * what the runtime scheme selection costs per commutation compared to a
+ * scheme fixed at compile time.
+ *
+ * The sinusoidal scheme is checked against a floating point reference of its
+ * modulation waveform and for the angle interpolation within a step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "types.h"
+
+#include "comm_tim.h"
+
+#include "pwm/pwm.h"
+#include "pwm/pwm_utils.h"
+#include "pwm/pwm_steps.h"
+#include "pwm/pwm_schemes.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Number of electrical revolutions every scheme is run for.
+ */
+#define PWM_STEPS_TEST_REVOLUTIONS 50
+
+/**
+ * Reference step, one pwm_utils.h manipulator.
+ */
+typedef void (*ref_step)(void);
+
+/**
+ * Define a reference step calling a pwm_utils.h manipulator.
+ */
+#define REF_STEP(NAME) \
+	static void ref_##NAME(void) \
+	{ \
+		pwm_set_##NAME(); \
+	}
+
+/*
+ * Manipulator sequences of the switch based scheme implementations, in the
+ * order they were called starting from the first commutation.
+ */
+REF_STEP(a_high_b_lpwm_c_off)
+REF_STEP(a_high_b_off__c_lpwm)
+REF_STEP(a_hpwm_b_low__c_off)
+REF_STEP(a_hpwm_b_off__c_low)
+REF_STEP(a_hpwm_b_off__c_off)
+REF_STEP(a_low__b_hpwm_c_off)
+REF_STEP(a_low__b_off__c_hpwm)
+REF_STEP(a_lpwm_b_high_c_off)
+REF_STEP(a_lpwm_b_off__c_high)
+REF_STEP(a_lpwm_b_off__c_off)
+REF_STEP(a_off__b_high_c_lpwm)
+REF_STEP(a_off__b_hpwm_c_low)
+REF_STEP(a_off__b_hpwm_c_off)
+REF_STEP(a_off__b_low__c_hpwm)
+REF_STEP(a_off__b_lpwm_c_high)
+REF_STEP(a_off__b_lpwm_c_off)
+REF_STEP(a_off__b_off__c_hpwm)
+REF_STEP(a_off__b_off__c_lpwm)
+
+static const ref_step ref_6step_pwm_on_drive[] = {
+	ref_a_high_b_lpwm_c_off,
+	ref_a_off__b_low__c_hpwm,
+	ref_a_lpwm_b_off__c_high,
+	ref_a_low__b_hpwm_c_off,
+	ref_a_off__b_high_c_lpwm,
+	ref_a_hpwm_b_off__c_low,
+};
+
+static const ref_step ref_6step_pwm_on_brake[] = {
+	ref_a_off__b_hpwm_c_off,
+	ref_a_off__b_off__c_lpwm,
+	ref_a_hpwm_b_off__c_off,
+	ref_a_off__b_lpwm_c_off,
+	ref_a_off__b_off__c_hpwm,
+	ref_a_lpwm_b_off__c_off,
+};
+
+static const ref_step ref_6step_h_pwm_l_on_drive[] = {
+	ref_a_hpwm_b_low__c_off,
+	ref_a_off__b_low__c_hpwm,
+	ref_a_low__b_off__c_hpwm,
+	ref_a_low__b_hpwm_c_off,
+	ref_a_off__b_hpwm_c_low,
+	ref_a_hpwm_b_off__c_low,
+};
+
+static const ref_step ref_6step_h_pwm_l_on_brake[] = {
+	ref_a_lpwm_b_off__c_off,
+	ref_a_off__b_off__c_lpwm,
+	ref_a_off__b_off__c_lpwm,
+	ref_a_off__b_lpwm_c_off,
+	ref_a_off__b_lpwm_c_off,
+	ref_a_lpwm_b_off__c_off,
+};
+
+static const ref_step ref_6step_h_on_l_pwm_drive[] = {
+	ref_a_high_b_lpwm_c_off,
+	ref_a_off__b_lpwm_c_high,
+	ref_a_lpwm_b_off__c_high,
+	ref_a_lpwm_b_high_c_off,
+	ref_a_off__b_high_c_lpwm,
+	ref_a_high_b_off__c_lpwm,
+};
+
+static const ref_step ref_6step_on_pwm_drive[] = {
+	ref_a_hpwm_b_low__c_off,
+	ref_a_off__b_lpwm_c_high,
+	ref_a_low__b_off__c_hpwm,
+	ref_a_lpwm_b_high_c_off,
+	ref_a_off__b_hpwm_c_low,
+	ref_a_high_b_off__c_lpwm,
+};
+
+static const ref_step ref_12step_pwm_on_pwm_drive[] = {
+	ref_a_high_b_off__c_lpwm,
+	ref_a_high_b_lpwm_c_off,
+	ref_a_hpwm_b_low__c_off,
+	ref_a_off__b_low__c_hpwm,
+	ref_a_off__b_lpwm_c_high,
+	ref_a_lpwm_b_off__c_high,
+	ref_a_low__b_off__c_hpwm,
+	ref_a_low__b_hpwm_c_off,
+	ref_a_lpwm_b_high_c_off,
+	ref_a_off__b_high_c_lpwm,
+	ref_a_off__b_hpwm_c_low,
+	ref_a_hpwm_b_off__c_low,
+};
+
+/**
+ * Scheme under test and its reference sequences.
+ */
+struct test_scheme {
+	const char *name;			/**< Scheme name */
+	const struct pwm_step_scheme *scheme;	/**< Step tables */
+	const ref_step *drive;			/**< Reference when driving */
+	const ref_step *brake;			/**< Reference when braking */
+	int steps;				/**< Reference sequence length */
+};
+
+#define TEST_SCHEME(NAME, BRAKE) \
+	{ #NAME, &pwm_scheme_##NAME, ref_##NAME##_drive, ref_##NAME##_##BRAKE, \
+	  sizeof(ref_##NAME##_drive) / sizeof(ref_step) }
+
+static const struct test_scheme test_schemes[] = {
+	TEST_SCHEME(6step_pwm_on, brake),
+	TEST_SCHEME(6step_h_pwm_l_on, brake),
+	TEST_SCHEME(6step_h_on_l_pwm, drive),
+	TEST_SCHEME(6step_on_pwm, drive),
+	TEST_SCHEME(12step_pwm_on_pwm, drive),
+};
+
+static void test_randomize_registers(void)
+{
+	TIM1->CCER = (u16)rand();
+	TIM1->CCMR1 = (u16)rand();
+	TIM1->CCMR2 = (u16)rand();
+}
+
+/**
+ * Run one scheme through both implementations.
+ *
+ * @param t Scheme under test
+ * @param mode_change Switch between driving and braking randomly
+ * @return Number of mismatching steps
+ */
+static int test_scheme(const struct test_scheme *t, bool mode_change)
+{
+	int mismatches = 0;
+	int n;
+
+	if (t->scheme->steps != t->steps) {
+		printf("FAIL %s: %d steps in the table, %d in the reference\n",
+		       t->name, t->scheme->steps, t->steps);
+		return 1;
+	}
+
+	pwm_mode = PWM_DRIVE;
+	pwm_steps_init();
+
+	for (n = 0; n < PWM_STEPS_TEST_REVOLUTIONS * t->steps; n++) {
+		u16 ccer, ccmr1, ccmr2;
+
+		if (mode_change)
+			pwm_mode = (rand() & 1) ? PWM_DRIVE : PWM_BRAKE;
+
+		test_randomize_registers();
+		pwm_step_base.ccer = TIM1->CCER & ~PWM_STEP_CCER_MASK;
+		pwm_step_base.ccmr1 = TIM1->CCMR1 & ~PWM_STEP_CCMR1_MASK;
+		pwm_step_base.ccmr2 = TIM1->CCMR2 & ~PWM_STEP_CCMR2_MASK;
+
+		if (pwm_mode == PWM_DRIVE)
+			t->drive[n % t->steps]();
+		else
+			t->brake[n % t->steps]();
+		ccer = TIM1->CCER;
+		ccmr1 = TIM1->CCMR1;
+		ccmr2 = TIM1->CCMR2;
+
+		test_randomize_registers();
+		pwm_steps_next(t->scheme);
+
+		if ((TIM1->CCER != ccer) || (TIM1->CCMR1 != ccmr1) ||
+		    (TIM1->CCMR2 != ccmr2)) {
+			if (mismatches == 0)
+				printf("FAIL %s %s step %d: "
+				       "CCER %04x/%04x CCMR1 %04x/%04x "
+				       "CCMR2 %04x/%04x\n", t->name,
+				       (pwm_mode == PWM_DRIVE) ? "drive" : "brake",
+				       (n + 1) % t->steps + 1,
+				       TIM1->CCER, ccer, TIM1->CCMR1, ccmr1,
+				       TIM1->CCMR2, ccmr2);
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+/**
+ * Switch schemes through the governor side API and check that the switch
+ * happens with the next commutation and keeps the electrical position.
+ */
+static void test_switch(void)
+{
+	u8 step;
+
+	pwm_mode = PWM_DRIVE;
+	pwm_steps_init();
+	pwm_scheme = pwm_schemes[pwm_scheme_id_6step_pwm_on];
+	pwm_scheme_next = NULL;
+
+	if (pwm_scheme_select(pwm_scheme_id_num) == 0) {
+		printf("FAIL invalid pwm scheme accepted\n");
+		test_failures++;
+	}
+
+	for (step = 0; step < 6; step++) {
+		pwm_step = step;
+		(void)pwm_scheme_select(pwm_scheme_id_12step_pwm_on_pwm);
+		if (pwm_scheme != pwm_schemes[pwm_scheme_id_6step_pwm_on]) {
+			printf("FAIL pwm scheme switched outside commutation\n");
+			test_failures++;
+		}
+
+		pwm_steps_comm();
+		if ((pwm_scheme != &pwm_scheme_12step_pwm_on_pwm) ||
+		    (pwm_step != step * 2 + 1) ||
+		    (TIM1->CCER != (pwm_step_base.ccer |
+				    pwm_scheme->drive[pwm_step].ccer))) {
+			printf("FAIL switch to 12 step from step %d\n", step + 1);
+			test_failures++;
+		}
+
+		(void)pwm_scheme_select(pwm_scheme_id_6step_on_pwm);
+		pwm_steps_comm();
+		if ((pwm_scheme != &pwm_scheme_6step_on_pwm) ||
+		    (pwm_step != (step + 1) % 6)) {
+			printf("FAIL switch to 6 step from step %d\n",
+			       step * 2 + 2);
+			test_failures++;
+		}
+
+		pwm_scheme = pwm_schemes[pwm_scheme_id_6step_pwm_on];
+	}
+
+	/* selecting the active scheme again cancels a pending switch */
+	(void)pwm_scheme_select(pwm_scheme_id_6step_h_on_l_pwm);
+	(void)pwm_scheme_select(pwm_scheme_id_6step_pwm_on);
+	pwm_steps_comm();
+	if (pwm_scheme != &pwm_scheme_6step_pwm_on) {
+		printf("FAIL pending pwm scheme switch not cancelled\n");
+		test_failures++;
+	}
+}
+
+/**
+ * Check the sine scheme waveform and the angle interpolation between two
+ * commutations.
+ */
+static void test_sine(void)
+{
+	const u16 half = (PWM__BASE_CLOCK / PWM__FREQUENCY) / 2;
+	const u16 sector = (u16)(((1UL << 24) / 6) >> 8);
+	const u16 freq = 2000;
+	/* PWM periods per step, a step lasts 2 * freq ticks of 5 TIM1 counts */
+	const int periods = (2 * freq * 5) / (half * 2 + 1);
+	double gain = 1.0;
+	double bound;
+	double err_max = 0;
+	s16 peak = 0;
+	u16 base;
+	u32 angle;
+	int n;
+
+#ifdef PWM__SINE_THIRD_HARMONIC
+	gain = 2.0 / sqrt(3.0);
+#endif
+	/* one table entry of the line to line waveform slope */
+	bound = 2.0 * PWM__SINE_AMPLITUDE * (M_PI / 2) /
+		(1 << PWM__SINE_TABLE_BITS) + 2;
+
+	pwm_scheme_sine_init();
+
+	for (angle = 0; angle < 0x10000; angle++) {
+		double theta = angle * 2 * M_PI / 0x10000;
+		double ref = gain * PWM__SINE_AMPLITUDE *
+			(sin(theta) - sin(theta + 2 * M_PI / 3));
+		s16 a = pwm_scheme_sine_lookup((u16)angle);
+		s16 b = pwm_scheme_sine_lookup((u16)(angle + 21845));
+		double err = fabs((a - b) - ref);
+
+		if (err > err_max)
+			err_max = err;
+		if (a > peak)
+			peak = a;
+	}
+
+	if ((err_max > bound) || (peak < PWM__SINE_AMPLITUDE - 2)) {
+		printf("FAIL sine waveform: line error %.1f (max %.1f), "
+		       "peak %d\n", err_max, bound, peak);
+		test_failures++;
+	}
+
+	pwm_mode = PWM_DRIVE;
+	pwm_val = half;
+	comm_tim_data.freq = freq;
+
+	for (pwm_step = 0; pwm_step < 6; pwm_step++) {
+		u16 end[3];
+
+		pwm_scheme_sine.comm();
+		base = (u16)((2 * pwm_step + 1) * 0x10000 / 12);
+		end[0] = half + (u16)((pwm_scheme_sine_lookup(base + sector) *
+				       (s32)pwm_val) >> 16);
+		end[1] = half + (u16)((pwm_scheme_sine_lookup(base + sector +
+							      21845) *
+				       (s32)pwm_val) >> 16);
+		end[2] = half + (u16)((pwm_scheme_sine_lookup(base + sector -
+							      21845) *
+				       (s32)pwm_val) >> 16);
+
+		for (n = 1; n <= periods + 1; n++) {
+			pwm_scheme_sine.update();
+			if ((n == periods - 2) && (TIM1->CCR1 == end[0]) &&
+			    (TIM1->CCR2 == end[1]) && (TIM1->CCR3 == end[2])) {
+				printf("FAIL sine step %d: end of step after "
+				       "%d periods\n", pwm_step + 1, n);
+				test_failures++;
+			}
+		}
+
+		if ((TIM1->CCR1 != end[0]) || (TIM1->CCR2 != end[1]) ||
+		    (TIM1->CCR3 != end[2])) {
+			printf("FAIL sine step %d: compare values %d %d %d at "
+			       "the end of the step\n", pwm_step + 1,
+			       TIM1->CCR1, TIM1->CCR2, TIM1->CCR3);
+			test_failures++;
+		}
+	}
+
+	if (!test_quiet)
+		printf("sine waveform:     line error %.1f, peak %d, "
+		       "%d periods/step at freq %d\n", err_max, peak, periods,
+		       freq);
+}
+
+/**
+ * Cost per commutation of a compile time fixed scheme and of the runtime
+ * dispatched one.
+ */
+static void test_speed(void)
+{
+	const u32 comms = 10000000;
+	u64 fixed_ns, fixed_cycles, dispatch_ns, dispatch_cycles;
+	u64 start_ns, start_cycles;
+	u32 n;
+
+	pwm_mode = PWM_DRIVE;
+	pwm_scheme = &pwm_scheme_6step_pwm_on;
+	pwm_scheme_next = NULL;
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < comms; n++)
+		pwm_steps_next(&pwm_scheme_6step_pwm_on);
+	fixed_cycles = test_cycles() - start_cycles;
+	fixed_ns = test_ns() - start_ns;
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < comms; n++)
+		pwm_steps_comm();
+	dispatch_cycles = test_cycles() - start_cycles;
+	dispatch_ns = test_ns() - start_ns;
+
+	if (!test_quiet) {
+		printf("fixed scheme:      %.2f ns %.2f cycles/commutation\n",
+		       (double)fixed_ns / comms, (double)fixed_cycles / comms);
+		printf("dispatched scheme: %.2f ns %.2f cycles/commutation\n",
+		       (double)dispatch_ns / comms,
+		       (double)dispatch_cycles / comms);
+		printf("dispatch overhead: %.2f cycles/commutation\n",
+		       ((double)dispatch_cycles - (double)fixed_cycles) /
+		       comms);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+
+	test_parse_args(argc, argv);
+
+	srand(1);
+
+	for (i = 0; i < sizeof(test_schemes) / sizeof(test_schemes[0]); i++) {
+		const struct test_scheme *t = &test_schemes[i];
+		int mismatches;
+
+		mismatches = test_scheme(t, false) + test_scheme(t, true);
+		if (!test_quiet)
+			printf("%-22s %2d steps: %s\n", t->name, t->steps,
+			       mismatches ? "FAIL" : "ok");
+		test_failures += mismatches ? 1 : 0;
+	}
+
+	test_switch();
+	test_sine();
+	test_speed();
+
+	return test_report("pwm scheme");
+}
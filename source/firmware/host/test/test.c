@@ -0,0 +1,141 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   test.c
+ *
+ * @brief  Shared scaffolding of the host unit tests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "types.h"
+
+#include "motor.h"
+
+#include "test.h"
+
+int test_failures;		/**< Number of failed checks */
+bool test_quiet;		/**< Only report failures */
+bool test_bench;		/**< Fail on missed timing budgets */
+
+static void test_usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -q         only report failures\n"
+		"  -b         fail on missed timing budgets\n", name);
+}
+
+/**
+ * Parse the test command line, exits on -h and unknown options.
+ *
+ * @param argc Argument count of main()
+ * @param argv Arguments of main()
+ */
+void test_parse_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qbh")) != -1) {
+		switch (opt) {
+		case 'q':
+			test_quiet = true;
+			break;
+		case 'b':
+			test_bench = true;
+			break;
+		default:
+			test_usage(argv[0]);
+			exit(opt == 'h' ? 0 : 1);
+		}
+	}
+}
+
+/**
+ * Report the failed checks.
+ *
+ * @param name Test name used in the failure summary
+ * @return Exit code of the test
+ */
+int test_report(const char *name)
+{
+	if (test_failures != 0) {
+		printf("%d %s test(s) failed\n", test_failures, name);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Monotonic wall clock time [ns].
+ */
+u64 test_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+/**
+ * CPU time stamp counter, 0 where there is none.
+ */
+u64 test_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Phase current as a saturated Q15 ADC value.
+ *
+ * @param i Current [A]
+ * @param i_fs Full scale current [A]
+ */
+s16 test_current(double i, double i_fs)
+{
+	double counts = i / i_fs * 32768;
+
+	if (counts > 32767)
+		return 32767;
+	if (counts < -32768)
+		return -32768;
+
+	return (s16)lround(counts);
+}
+
+/**
+ * Electrical angle of the rotor flux axis of the motor model.
+ *
+ * Phase A BEMF of the model is ke * omega * sin(theta_e), which puts the
+ * flux axis half a revolution ahead of theta_e.
+ */
+double test_flux_angle(const struct motor *m)
+{
+	return fmod(m->theta * m->p.pole_pairs + M_PI, 2 * M_PI);
+}
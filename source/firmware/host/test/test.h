@@ -0,0 +1,59 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   test.h
+ *
+ * @brief  Shared scaffolding of the host unit tests.
+ *
+ * Failure counting, the command line every test accepts and the timing and
+ * motor model helpers used by more than one test.
+ */
+
+#ifndef __HOST_TEST_H
+#define __HOST_TEST_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+struct motor;
+
+extern int test_failures;
+extern bool test_quiet;
+extern bool test_bench;
+
+/**
+ * Check a test condition and report a failure.
+ */
+#define CHECK(COND, NAME, ARGS...) \
+	do { \
+		if (!(COND)) { \
+			test_failures++; \
+			printf("FAIL " NAME "\n", ## ARGS); \
+		} \
+	} while (0)
+
+void test_parse_args(int argc, char **argv);
+int test_report(const char *name);
+u64 test_ns(void);
+u64 test_cycles(void);
+s16 test_current(double i, double i_fs);
+double test_flux_angle(const struct motor *m);
+
+#endif /* __HOST_TEST_H */
@@ -0,0 +1,398 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   torque_test.c
+ *
+ * @brief  Current limit and torque control tests.
+ *
+ * Runs the current controller of @ref current_ctrl.h once per PWM period
+ * against the motor model driven with block commutation. The bus current
+ * is sampled in the on time the way the PWM synchronous ADC trigger does
+ * it and the new duty cycle takes effect in the following period. Checks
+ * that the current limit cuts the duty in the first period after the
+ * current exceeds it, holds a stalled motor at the limit, stays out of the
+ * way below the limit and that the torque mode follows its setpoint with
+ * the configured slew rate. The cost of one update is measured against the
+ * PWM period.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "types.h"
+#include "config.h"
+
+#include "current_ctrl.h"
+#include "motor.h"
+
+#include "test.h"
+
+/**
+ * PWM period in timer counts.
+ */
+#define TORQUE_TEST_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * Motor model integration step [s].
+ */
+#define TORQUE_TEST_DT 1e-6
+
+/**
+ * Motor model steps per PWM period.
+ */
+#define TORQUE_TEST_SUB ((int)lround(1.0 / (PWM__FREQUENCY * TORQUE_TEST_DT)))
+
+/**
+ * Current sense gain [ADC counts/A] and ADC full scale, same as the host
+ * simulation.
+ */
+#define TORQUE_TEST_ADC_GAIN 62.0
+#define TORQUE_TEST_ADC_MAX 4095
+
+/**
+ * Motor and current loop under test.
+ */
+struct torque_test {
+	struct motor m;		/**< Motor model */
+	struct current_ctrl cc;	/**< Current controller */
+	u16 duty;		/**< Duty cycle of the running period */
+	s16 current;		/**< Current sampled in the last period */
+};
+
+static void test_init(struct torque_test *t, bool stalled)
+{
+	struct motor_params p;
+
+	motor_params_default(&p);
+	if (stalled)
+		p.t_static = 1e3;
+
+	motor_init(&t->m, &p);
+	t->m.theta = 0.3 / p.pole_pairs;
+
+	current_ctrl_init(&t->cc, TORQUE__KP, TORQUE__KI, TORQUE__LIMIT,
+			  TORQUE__SLEW);
+	t->duty = 0;
+	t->current = 0;
+}
+
+/**
+ * Run one PWM period with the present duty cycle.
+ *
+ * Drives the phase with the most positive BEMF shape high and the one with
+ * the most negative low, ideal block commutation. The current is sampled
+ * in the middle of the on time, where the bus shunt carries the current of
+ * the phase switched high, and quantized like the ADC does.
+ */
+static void test_period(struct torque_test *t)
+{
+	double high[3] = {0, 0, 0};
+	double low[3] = {0, 0, 0};
+	double theta_e = t->m.theta * t->m.p.pole_pairs;
+	double shape;
+	double top = -2;
+	double bottom = 2;
+	double counts;
+	int hi = 0;
+	int lo = 0;
+	int x;
+	int n;
+
+	for (x = 0; x < 3; x++) {
+		shape = sin(theta_e - x * 2 * M_PI / 3);
+		if (shape > top) {
+			top = shape;
+			hi = x;
+		}
+		if (shape < bottom) {
+			bottom = shape;
+			lo = x;
+		}
+	}
+
+	high[hi] = (double)t->duty / TORQUE_TEST_PERIOD;
+	low[lo] = 1;
+
+	for (n = 0; n < TORQUE_TEST_SUB; n++) {
+		motor_step(&t->m, high, low, TORQUE_TEST_DT);
+		if (n == TORQUE_TEST_SUB / 2) {
+			counts = TORQUE__CURRENT_OFFSET +
+				TORQUE_TEST_ADC_GAIN * t->m.i[hi];
+			if (counts < 0)
+				counts = 0;
+			if (counts > TORQUE_TEST_ADC_MAX)
+				counts = TORQUE_TEST_ADC_MAX;
+			t->current = (s16)((u16)counts -
+					   TORQUE__CURRENT_OFFSET);
+		}
+	}
+}
+
+/**
+ * Stall the motor at full commanded duty with the current limit active.
+ *
+ * The first period after a sample above the limit has to run with less
+ * duty than commanded. The current can only decay with the winding time
+ * constant from there, it has to peak right after the cut, come back to
+ * within 10% of the limit after a few periods and settle at the limit.
+ */
+static void test_limit_stall(void)
+{
+	struct torque_test t;
+	s16 peak = 0;
+	s32 sum = 0;
+	int first_over = -1;
+	int peak_at = 0;
+	int back_at = -1;
+	bool cut = false;
+	int k;
+
+	test_init(&t, true);
+	t.duty = TORQUE_TEST_PERIOD;
+	current_ctrl_reset(&t.cc, TORQUE__LIMIT, t.duty);
+
+	for (k = 0; k < 400; k++) {
+		test_period(&t);
+
+		if (t.current > peak) {
+			peak = t.current;
+			peak_at = k;
+		}
+		if ((back_at < 0) && (k > peak_at) &&
+		    (t.current < TORQUE__LIMIT * 1.1))
+			back_at = k;
+		if (k >= 300)
+			sum += t.current;
+
+		t.duty = current_ctrl_update(&t.cc, TORQUE__LIMIT, t.current,
+					     TORQUE_TEST_PERIOD);
+
+		if ((first_over < 0) && (t.current > TORQUE__LIMIT)) {
+			first_over = k;
+			cut = t.duty < TORQUE_TEST_PERIOD;
+		}
+	}
+
+	if (!test_quiet)
+		printf("stall limit:       over the limit in period %d, duty "
+		       "cut %s, peak %.1f A in period %d, within 10%% in period "
+		       "%d, held at %.2f A (limit %.2f A)\n",
+		       first_over, cut ? "in the next period" : "late",
+		       peak / TORQUE_TEST_ADC_GAIN, peak_at, back_at,
+		       sum / 100.0 / TORQUE_TEST_ADC_GAIN,
+		       TORQUE__LIMIT / TORQUE_TEST_ADC_GAIN);
+
+	CHECK(first_over >= 0, "stalled current never reached the limit");
+	CHECK(cut, "duty not cut in the period after the limit was exceeded");
+	CHECK(peak_at <= first_over + 1, "current peaked in period %d",
+	      peak_at);
+	CHECK((back_at >= 0) && (back_at <= first_over + 10),
+	      "current back within 10%% of the limit in period %d", back_at);
+	CHECK(fabs(sum / 100.0 - TORQUE__LIMIT) < TORQUE__LIMIT * 0.03,
+	      "stalled current %.1f counts", sum / 100.0);
+}
+
+/**
+ * Run the motor free at a moderate duty, below the current limit the
+ * commanded duty has to pass through unchanged.
+ */
+static void test_limit_passthrough(void)
+{
+	const u16 command = TORQUE_TEST_PERIOD / 4;
+	struct torque_test t;
+	int changed = 0;
+	s16 peak = 0;
+	int k;
+
+	test_init(&t, false);
+	t.duty = command;
+
+	/* Spin up open to steady state first */
+	for (k = 0; k < 8000; k++)
+		test_period(&t);
+
+	current_ctrl_reset(&t.cc, TORQUE__LIMIT, command);
+
+	for (k = 0; k < 2000; k++) {
+		test_period(&t);
+		if (t.current > peak)
+			peak = t.current;
+		t.duty = current_ctrl_update(&t.cc, TORQUE__LIMIT, t.current,
+					     command);
+		if (t.duty != command)
+			changed++;
+	}
+
+	if (!test_quiet)
+		printf("below the limit:   %.0f rpm, peak %.1f A, %d of 2000 "
+		       "periods with changed duty\n", motor_rpm(&t.m),
+		       peak / TORQUE_TEST_ADC_GAIN, changed);
+
+	CHECK(peak < TORQUE__LIMIT, "test current %d above the limit", peak);
+	CHECK(changed == 0, "duty changed in %d periods below the limit",
+	      changed);
+}
+
+/**
+ * Torque mode on a stalled motor, the reference has to rise with the slew
+ * rate, the current has to follow and settle at the setpoint, and a lower
+ * setpoint has to take effect at once.
+ */
+static void test_torque_step(void)
+{
+	const s16 target = TORQUE__LIMIT / 2;
+	struct torque_test t;
+	s16 prev_ref = 0;
+	int max_rise = 0;
+	int settle = -1;
+	s32 sum = 0;
+	int k;
+
+	test_init(&t, true);
+
+	for (k = 0; k < 600; k++) {
+		test_period(&t);
+		if (k >= 500)
+			sum += t.current;
+		if ((settle < 0) &&
+		    (abs(t.current - target) < target * 0.05))
+			settle = k;
+
+		t.duty = current_ctrl_update(&t.cc, target, t.current,
+					     TORQUE_TEST_PERIOD);
+		if (t.cc.ref - prev_ref > max_rise)
+			max_rise = t.cc.ref - prev_ref;
+		prev_ref = t.cc.ref;
+	}
+
+	(void)current_ctrl_update(&t.cc, target / 4, t.current,
+				  TORQUE_TEST_PERIOD);
+
+	if (!test_quiet)
+		printf("torque step:       to %.2f A within 5%% after %d "
+		       "periods, held at %.2f A, reference rise %d/period\n",
+		       target / TORQUE_TEST_ADC_GAIN, settle,
+		       sum / 100.0 / TORQUE_TEST_ADC_GAIN, max_rise);
+
+	CHECK(max_rise <= TORQUE__SLEW, "reference rose %d per period",
+	      max_rise);
+	CHECK((settle >= 0) && (settle < 2 * target / TORQUE__SLEW),
+	      "settled after %d periods", settle);
+	CHECK(fabs(sum / 100.0 - target) < target * 0.03,
+	      "held current %.1f counts", sum / 100.0);
+	CHECK(t.cc.ref == target / 4, "reference %d after the setpoint drop",
+	      t.cc.ref);
+}
+
+/**
+ * Load step on a spinning motor at full commanded duty, the current has to
+ * stay at the limit while the load stalls the motor. At this speed a
+ * commutation step only lasts about two PWM periods, the peak allows for
+ * the current transients of the phase changes.
+ */
+static void test_limit_load(void)
+{
+	struct torque_test t;
+	s16 peak = 0;
+	s32 sum = 0;
+	double rpm;
+	int k;
+
+	test_init(&t, false);
+	current_ctrl_reset(&t.cc, TORQUE__LIMIT, 0);
+
+	/* Accelerate at the limit */
+	for (k = 0; k < 8000; k++) {
+		test_period(&t);
+		t.duty = current_ctrl_update(&t.cc, TORQUE__LIMIT, t.current,
+					     TORQUE_TEST_PERIOD);
+	}
+	rpm = motor_rpm(&t.m);
+
+	t.m.p.t_static = 0.2;
+
+	for (k = 0; k < 4000; k++) {
+		test_period(&t);
+		if (t.current > peak)
+			peak = t.current;
+		if (k >= 3000)
+			sum += t.current;
+		t.duty = current_ctrl_update(&t.cc, TORQUE__LIMIT, t.current,
+					     TORQUE_TEST_PERIOD);
+	}
+
+	if (!test_quiet)
+		printf("load step:         %.0f -> %.0f rpm, peak %.1f A, held "
+		       "at %.2f A\n", rpm, motor_rpm(&t.m),
+		       peak / TORQUE_TEST_ADC_GAIN,
+		       sum / 1000.0 / TORQUE_TEST_ADC_GAIN);
+
+	CHECK(peak < TORQUE__LIMIT * 1.35, "peak current %d counts", peak);
+	CHECK(fabs(sum / 1000.0 - TORQUE__LIMIT) < TORQUE__LIMIT * 0.03,
+	      "current after the load step %.1f counts", sum / 1000.0);
+}
+
+static void test_speed(void)
+{
+	const u32 cycles = 1000000;
+	const double budget_ns = 1e9 / PWM__FREQUENCY;
+	struct current_ctrl cc;
+	u64 start_ns, ns;
+	u64 start_cycles, tsc;
+	u32 sum = 0;
+	u32 n;
+
+	current_ctrl_init(&cc, TORQUE__KP, TORQUE__KI, TORQUE__LIMIT,
+			  TORQUE__SLEW);
+
+	start_ns = test_ns();
+	start_cycles = test_cycles();
+	for (n = 0; n < cycles; n++)
+		sum += current_ctrl_update(&cc, TORQUE__LIMIT,
+					   (s16)(n & 0x3ff),
+					   TORQUE_TEST_PERIOD);
+	tsc = test_cycles() - start_cycles;
+	ns = test_ns() - start_ns;
+
+	if (!test_quiet)
+		printf("current update:    %.2f ns %.2f cycles/call, "
+		       "%.3f%% of the %.1f us PWM period (%u)\n",
+		       (double)ns / cycles, (double)tsc / cycles,
+		       100 * (double)ns / cycles / budget_ns,
+		       budget_ns / 1000, sum & 1);
+
+	if (test_bench)
+		CHECK((double)ns / cycles < budget_ns / 20,
+		      "current update %.2f ns above 5%% of the PWM period",
+		      (double)ns / cycles);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_limit_stall();
+	test_limit_passthrough();
+	test_torque_step();
+	test_limit_load();
+	test_speed();
+
+	return test_report("torque");
+}
@@ -0,0 +1,322 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   usart_test.c
+ *
+ * @brief  DMA USART governor transport tests.
+ *
+ * Runs the USART driver on the USART and DMA models with the governor
+ * protocol handled from an emulated main loop. Checks that register writes
+ * sent in bursts, also bursts longer than the receive buffer, arrive
+ * complete and in order, that register reads are answered correctly also
+ * when the governor output buffer wraps, that a receive buffer overrun is
+ * detected and resynchronizes the governor parser, and that the number of
+ * interrupts follows the number of bursts and not the number of bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "driver/usart.h"
+
+#include "hal.h"
+
+#include "test.h"
+
+/**
+ * Running in demo mode flag, referenced by gprot.c
+ */
+bool demo;
+
+/**
+ * Simulation time step [s].
+ */
+#define USART_TEST_DT 1e-6
+
+/**
+ * Number of test registers, starting at address 1.
+ */
+#define USART_TEST_REGS 4
+
+/**
+ * Largest number of register writes recorded.
+ */
+#define USART_TEST_MAX_WRITES 1024
+
+/**
+ * Test state shared with the governor hooks.
+ */
+struct usart_test {
+	u16 regs[USART_TEST_REGS];		/**< Test registers */
+	u16 written[USART_TEST_MAX_WRITES];	/**< Values seen by the hook */
+	u8 written_addr[USART_TEST_MAX_WRITES];	/**< Addresses seen by the hook */
+	int writes;				/**< Register changed hook calls */
+	u8 tx[4096];				/**< Transmitted bytes */
+	int tx_len;				/**< Number of transmitted bytes */
+	bool stalled;				/**< Main loop not processing */
+};
+
+static struct usart_test test;
+
+static void test_trigger_output(void *data)
+{
+	(void)data;
+	usart_enable_send();
+}
+
+static void test_register_changed(void *data, u8 addr)
+{
+	(void)data;
+
+	if (test.writes < USART_TEST_MAX_WRITES) {
+		test.written_addr[test.writes] = addr;
+		test.written[test.writes] = test.regs[addr - 1];
+	}
+	test.writes++;
+}
+
+static void test_init(void)
+{
+	int i;
+
+	hal_reset();
+	(void)gpc_init(test_trigger_output, NULL, test_register_changed, NULL);
+	for (i = 0; i < USART_TEST_REGS; i++) {
+		test.regs[i] = 0;
+		(void)gpc_setup_reg((u8)(i + 1), &test.regs[i]);
+	}
+	usart_init();
+
+	test.writes = 0;
+	test.tx_len = 0;
+	test.stalled = false;
+}
+
+/**
+ * Run the USART model together with the main loop part of the driver.
+ */
+static void test_run(double duration)
+{
+	double t;
+	int byte;
+
+	for (t = 0; t < duration; t += USART_TEST_DT) {
+		hal_usart_advance(USART_TEST_DT);
+		hal_irq_service();
+
+		if (usart_rx_trigger && !test.stalled) {
+			usart_rx_trigger = false;
+			usart_process_rx();
+		}
+
+		while ((byte = hal_usart_tx_pop()) >= 0) {
+			if (test.tx_len < (int)sizeof(test.tx))
+				test.tx[test.tx_len] = (u8)byte;
+			test.tx_len++;
+		}
+	}
+}
+
+static u32 test_irqs(enum hal_irq irq)
+{
+	return hal_irq_stats[irq].count;
+}
+
+static void test_send_write(u8 addr, u16 value)
+{
+	(void)hal_usart_rx(GP_MODE_WRITE | (addr & GP_ADDR_MASK));
+	(void)hal_usart_rx(value & 0xFF);
+	(void)hal_usart_rx(value >> 8);
+}
+
+/**
+ * Value of the n-th register write of a test sequence.
+ */
+static u16 test_value(int n)
+{
+	return (u16)(0x1234 + (n * 0x0101));
+}
+
+/**
+ * Send register writes in bursts and check that they arrive in order.
+ *
+ * @param name Test name
+ * @param bursts Number of bursts
+ * @param per_burst Number of register writes per burst
+ */
+static void test_writes(const char *name, int bursts, int per_burst)
+{
+	int total = bursts * per_burst;
+	int bytes = total * 3;
+	int wrong = 0;
+	u32 irqs;
+	int b, i, n;
+
+	test_init();
+
+	for (b = 0, n = 0; b < bursts; b++) {
+		for (i = 0; i < per_burst; i++, n++)
+			test_send_write((u8)((n % USART_TEST_REGS) + 1),
+					test_value(n));
+		/* Burst plus some idle time */
+		test_run((per_burst * 3 + 10) * 10.0 / 153600);
+	}
+
+	for (n = 0; (n < total) && (n < test.writes); n++) {
+		if ((test.written_addr[n] != (n % USART_TEST_REGS) + 1) ||
+		    (test.written[n] != test_value(n)))
+			wrong++;
+	}
+
+	irqs = test_irqs(hal_irq_usart1) + test_irqs(hal_irq_dma1_channel5);
+
+	if (!test_quiet)
+		printf("%-18s %d writes in %d bursts, %d bytes, %u rx "
+		       "interrupts (%u idle line), %d wrong\n", name, total,
+		       bursts, bytes, irqs, test_irqs(hal_irq_usart1), wrong);
+
+	CHECK(test.writes == total, "%s: %d of %d writes arrived", name,
+	      test.writes, total);
+	CHECK(wrong == 0, "%s: %d writes wrong or out of order", name, wrong);
+	CHECK(usart_rx_overruns == 0, "%s: %u receive overruns", name,
+	      usart_rx_overruns);
+	CHECK(test_irqs(hal_irq_usart1) == (u32)bursts,
+	      "%s: %u idle line interrupts for %d bursts", name,
+	      test_irqs(hal_irq_usart1), bursts);
+	/* One per burst plus one per half receive buffer */
+	CHECK(irqs <= (u32)(bursts + (bytes / 32) + 1),
+	      "%s: %u rx interrupts for %d bytes in %d bursts", name, irqs,
+	      bytes, bursts);
+}
+
+/**
+ * Stall the main loop while the DMA laps the receive buffer in the middle
+ * of a register write and check that the overrun is counted and that the
+ * governor parser picks up the next writes.
+ */
+static void test_overrun(void)
+{
+	const int stalled = 30;
+	const int after = 4;
+	int wrong = 0;
+	int n;
+
+	test_init();
+
+	/* Leave the parser waiting for the data bytes of a write */
+	(void)hal_usart_rx(GP_MODE_WRITE | 1);
+	test_run(20 * 10.0 / 153600);
+
+	test.stalled = true;
+	for (n = 0; n < stalled; n++)
+		test_send_write(2, test_value(n));
+	test_run((stalled * 3 + 10) * 10.0 / 153600);
+	test.stalled = false;
+	test_run(10 * 10.0 / 153600);
+
+	CHECK(usart_rx_overruns == 1, "%u receive overruns after a stall",
+	      usart_rx_overruns);
+	CHECK(test.writes == 0, "%d writes handled from an overrun buffer",
+	      test.writes);
+
+	for (n = 0; n < after; n++)
+		test_send_write(3, test_value(n));
+	test_run((after * 3 + 10) * 10.0 / 153600);
+
+	for (n = 0; (n < after) && (n < test.writes); n++) {
+		if ((test.written_addr[n] != 3) ||
+		    (test.written[n] != test_value(n)))
+			wrong++;
+	}
+
+	if (!test_quiet)
+		printf("overrun:           %d bytes while stalled, %u overruns, "
+		       "%d of %d writes after, %d wrong\n", stalled * 3 + 1,
+		       usart_rx_overruns, test.writes, after, wrong);
+
+	CHECK(test.writes == after, "%d of %d writes after an overrun",
+	      test.writes, after);
+	CHECK(wrong == 0, "%d writes wrong after an overrun", wrong);
+	CHECK(usart_rx_overruns == 1, "%u receive overruns", usart_rx_overruns);
+}
+
+/**
+ * Read the test registers in bursts and check the answers.
+ */
+static void test_reads(void)
+{
+	const int bursts = 20;
+	const int per_burst = 40;
+	int total = bursts * per_burst;
+	int wrong = 0;
+	u32 irqs;
+	int b, i, n;
+	u8 addr;
+
+	test_init();
+	for (i = 0; i < USART_TEST_REGS; i++)
+		test.regs[i] = (u16)(0xA000 + (i * 0x0111));
+
+	for (b = 0, n = 0; b < bursts; b++) {
+		for (i = 0; i < per_burst; i++, n++)
+			(void)hal_usart_rx(GP_MODE_READ | GP_MODE_PEEK |
+					   ((n % USART_TEST_REGS) + 1));
+		/* Requests, answers and some idle time */
+		test_run((per_burst * 4 + 10) * 10.0 / 153600);
+	}
+
+	for (n = 0; (n < total) && ((n * 3) + 2 < test.tx_len); n++) {
+		addr = (u8)((n % USART_TEST_REGS) + 1);
+		if ((test.tx[n * 3] != addr) ||
+		    (test.tx[(n * 3) + 1] != (test.regs[addr - 1] & 0xFF)) ||
+		    (test.tx[(n * 3) + 2] != (test.regs[addr - 1] >> 8)))
+			wrong++;
+	}
+
+	irqs = test_irqs(hal_irq_dma1_channel4);
+
+	if (!test_quiet)
+		printf("reads:             %d reads in %d bursts, %d bytes "
+		       "answered, %u tx interrupts, %d wrong\n", total, bursts,
+		       test.tx_len, irqs, wrong);
+
+	CHECK(test.tx_len == total * 3, "%d of %d answer bytes", test.tx_len,
+	      total * 3);
+	CHECK(wrong == 0, "%d answers wrong", wrong);
+	/* A few blocks per burst, one more when the output buffer wraps */
+	CHECK(irqs <= (u32)(bursts * 4), "%u tx interrupts for %d bursts",
+	      irqs, bursts);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_args(argc, argv);
+
+	test_writes("write bursts:", 20, 10);
+	test_writes("long burst:", 1, 200);
+	test_overrun();
+	test_reads();
+
+	return test_report("USART");
+}
@@ -0,0 +1,250 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   bemf_fit.c
+ *
+ * @brief  BEMF zero crossing estimation from phase voltage samples.
+ *
+ * Fits a least squares line over the last k samples of the floating phase
+ * and returns the time the line crosses the zero level. The result has the
+ * resolution of the commutation timer instead of one PWM period.
+ *
+ * The sample whose removal improves the fit the most is the outlier
+ * candidate, a spike on the newest or oldest sample pulls the line towards
+ * itself and would otherwise be blamed on its neighbour. If it is further
+ * than max_residual away from the line through the other samples, like one
+ * hit by a switching spike, it is dropped and the line fitted again. Only
+ * the worst sample is dropped, so k should be at least four for the
+ * rejection to work. A line that does not slope in the expected direction
+ * or crosses after the newest sample means the crossing is still to come,
+ * as when a spike on the newest sample looked like one. A crossing further
+ * back than the oldest sample gives no estimate.
+ *
+ * Sums are taken relative to the newest sample in 64 bit, apart from the
+ * crossing time there is one division per sample for the outlier search.
+ */
+
+#include "types.h"
+
+#include "bemf_fit.h"
+
+/**
+ * Least squares sums of a line fit, times relative to the newest sample.
+ */
+struct bemf_fit_sums {
+	s32 n;			/**< Samples */
+	s64 t;			/**< Sum of the times */
+	s64 v;			/**< Sum of the values */
+	s64 num;		/**< Slope numerator, n * sum(t * v) - sum(t) * sum(v) */
+	s64 den;		/**< Slope denominator, n * sum(t * t) - sum(t)^2 */
+};
+
+/**
+ * Initialize a crossing estimator.
+ *
+ * @param fit Estimator state
+ * @param k Samples fitted over, 2..BEMF_FIT_MAX_SAMPLES
+ * @param max_residual Distance from the line making a sample an outlier
+ */
+void bemf_fit_init(struct bemf_fit *fit, u8 k, u16 max_residual)
+{
+	if (k < 2)
+		k = 2;
+	if (k > BEMF_FIT_MAX_SAMPLES)
+		k = BEMF_FIT_MAX_SAMPLES;
+
+	fit->k = k;
+	fit->max_residual = max_residual;
+	bemf_fit_reset(fit);
+}
+
+/**
+ * Drop all samples, called when a new commutation step starts.
+ *
+ * @param fit Estimator state
+ */
+void bemf_fit_reset(struct bemf_fit *fit)
+{
+	fit->count = 0;
+	fit->next = 0;
+}
+
+/**
+ * Add a phase voltage sample, replacing the oldest one once k are stored.
+ *
+ * @param fit Estimator state
+ * @param time Sample time [commutation timer ticks]
+ * @param value Phase voltage minus the zero level [ADC counts]
+ */
+void bemf_fit_add(struct bemf_fit *fit, u32 time, s16 value)
+{
+	fit->time[fit->next] = time;
+	fit->value[fit->next] = value;
+
+	fit->next++;
+	if (fit->next >= fit->k)
+		fit->next = 0;
+	if (fit->count < fit->k)
+		fit->count++;
+}
+
+/**
+ * Sum up all stored samples but one.
+ *
+ * @param fit Estimator state
+ * @param ref Time the sample times are taken relative to
+ * @param skip Slot of the sample left out, -1 for none
+ * @param sums Resulting sums
+ */
+static void bemf_fit_sum(const struct bemf_fit *fit, u32 ref, int skip,
+			 struct bemf_fit_sums *sums)
+{
+	s64 tt = 0;
+	s64 tv = 0;
+	s32 t;
+	int i;
+
+	sums->n = 0;
+	sums->t = 0;
+	sums->v = 0;
+
+	for (i = 0; i < fit->count; i++) {
+		if (i == skip)
+			continue;
+		t = (s32)(fit->time[i] - ref);
+		sums->n++;
+		sums->t += t;
+		sums->v += fit->value[i];
+		tt += (s64)t * t;
+		tv += (s64)t * fit->value[i];
+	}
+
+	sums->num = (sums->n * tv) - (sums->t * sums->v);
+	sums->den = (sums->n * tt) - (sums->t * sums->t);
+}
+
+/**
+ * Find the sample whose removal reduces the squared error of the fit most.
+ *
+ * The residual of sample i from the line over all samples, scaled by
+ * n * den, is r = n * den * v_i - (den * sum(v) - num * sum(t)) -
+ * n * num * t_i. Its distance from the line through the other samples is
+ * r / w with w = (1 - h_i) * n * den = (n - 1) * den - (n * t_i - sum(t))^2
+ * and the leverage h_i, leaving it out reduces the squared error by
+ * r^2 / w up to a common factor.
+ *
+ * @param fit Estimator state
+ * @param ref Time the sample times are taken relative to
+ * @param sums Sums of the fit over all samples
+ * @return Slot of the worst sample if it is an outlier, -1 otherwise
+ */
+static int bemf_fit_outlier(const struct bemf_fit *fit, u32 ref,
+			    const struct bemf_fit_sums *sums)
+{
+	s64 offset = (sums->den * sums->v) - (sums->num * sums->t);
+	s64 worst = 0;
+	s64 distance = 0;
+	s64 r;
+	s64 d;
+	s64 w;
+	s64 q;
+	s32 t;
+	int outlier = -1;
+	int i;
+
+	for (i = 0; i < fit->count; i++) {
+		t = (s32)(fit->time[i] - ref);
+		d = (sums->n * (s64)t) - sums->t;
+		w = ((sums->n - 1) * sums->den) - (d * d);
+		if (w <= 0)
+			continue;
+
+		r = (sums->n * sums->den * fit->value[i]) - offset -
+			(sums->n * sums->num * t);
+		q = r / w;
+		if (q * r > worst) {
+			worst = q * r;
+			distance = (q < 0) ? -q : q;
+			outlier = i;
+		}
+	}
+
+	if (distance <= fit->max_residual)
+		return -1;
+
+	return outlier;
+}
+
+/**
+ * Estimate the BEMF zero crossing time.
+ *
+ * The crossing may be up to one sample interval outside of the fitted
+ * samples, to allow for the quantization of the samples.
+ *
+ * @param fit Estimator state
+ * @param rising true if the phase voltage is expected to rise
+ * @param time Estimated crossing time, only written for bf_crossing
+ * @return Outcome of the estimation
+ */
+enum bemf_fit_result bemf_fit_crossing(const struct bemf_fit *fit, bool rising,
+				       u32 *time)
+{
+	struct bemf_fit_sums sums;
+	u32 ref;
+	s64 t0;
+	s32 first = 0;
+	s32 margin;
+	int skip;
+	int i;
+
+	if (fit->count < 2)
+		return bf_unknown;
+
+	ref = fit->time[(fit->next + fit->k - 1) % fit->k];
+
+	bemf_fit_sum(fit, ref, -1, &sums);
+	if ((sums.n >= 4) && (sums.den > 0)) {
+		skip = bemf_fit_outlier(fit, ref, &sums);
+		if (skip >= 0)
+			bemf_fit_sum(fit, ref, skip, &sums);
+	} else {
+		skip = -1;
+	}
+
+	if (sums.den <= 0)
+		return bf_unknown;
+	if (rising ? (sums.num <= 0) : (sums.num >= 0))
+		return bf_pending;
+
+	/* Zero of the line: mean(t) - mean(v) * den / num */
+	t0 = ((sums.t * sums.num) - (sums.v * sums.den)) / (sums.n * sums.num);
+
+	for (i = 0; i < fit->count; i++)
+		if ((i != skip) && ((s32)(fit->time[i] - ref) < first))
+			first = (s32)(fit->time[i] - ref);
+	margin = -first / (sums.n - 1);
+
+	if (t0 > margin)
+		return bf_pending;
+	if (t0 < (first - margin))
+		return bf_unknown;
+
+	*time = ref + (u32)(s32)t0;
+	return bf_crossing;
+}
@@ -0,0 +1,57 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BEMF_FIT_H
+#define __BEMF_FIT_H
+
+#include "types.h"
+
+/**
+ * Largest number of phase voltage samples a crossing is fitted over.
+ */
+#define BEMF_FIT_MAX_SAMPLES 8
+
+/**
+ * Outcome of a zero crossing estimation.
+ */
+enum bemf_fit_result {
+	bf_crossing,		/**< Crossing found */
+	bf_pending,		/**< The samples show no crossing yet */
+	bf_unknown,		/**< Too few samples for an estimate */
+};
+
+/**
+ * Last phase voltage samples of the floating phase in the current
+ * commutation step.
+ */
+struct bemf_fit {
+	u32 time[BEMF_FIT_MAX_SAMPLES];	/**< Sample times [commutation timer ticks] */
+	s16 value[BEMF_FIT_MAX_SAMPLES]; /**< Samples above the zero level [ADC counts] */
+	u8 k;				/**< Samples fitted over */
+	u8 count;			/**< Samples stored, up to k */
+	u8 next;			/**< Slot of the next sample */
+	u16 max_residual;		/**< Distance from the line making a sample an outlier [ADC counts] */
+};
+
+void bemf_fit_init(struct bemf_fit *fit, u8 k, u16 max_residual);
+void bemf_fit_reset(struct bemf_fit *fit);
+void bemf_fit_add(struct bemf_fit *fit, u32 time, s16 value);
+enum bemf_fit_result bemf_fit_crossing(const struct bemf_fit *fit, bool rising,
+				       u32 *time);
+
+#endif /* __BEMF_FIT_H */
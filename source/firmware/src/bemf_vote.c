@@ -0,0 +1,88 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   bemf_vote.c
+ *
+ * @brief  Majority vote qualification of BEMF comparator edges.
+ *
+ * A comparator edge is only taken for a zero crossing when at least n of
+ * the following m samples of the comparator output show the level the edge
+ * went to. The vote ends as soon as the outcome is certain, so a clean edge
+ * is confirmed after n samples and a short glitch is rejected after
+ * m - n + 1 samples.
+ */
+
+#include "types.h"
+
+#include "bemf_vote.h"
+
+/**
+ * Initialize an edge vote.
+ *
+ * @param vote Vote state
+ * @param n Samples at the new level needed, 1..m
+ * @param m Samples taken at most
+ */
+void bemf_vote_init(struct bemf_vote *vote, u8 n, u8 m)
+{
+	if (m == 0)
+		m = 1;
+	if ((n == 0) || (n > m))
+		n = m;
+
+	vote->n = n;
+	vote->m = m;
+	vote->samples = 0;
+	vote->votes = 0;
+	vote->level = false;
+}
+
+/**
+ * Start the vote on a new edge.
+ *
+ * @param vote Vote state
+ * @param level Comparator level after the edge
+ */
+void bemf_vote_start(struct bemf_vote *vote, bool level)
+{
+	vote->samples = 0;
+	vote->votes = 0;
+	vote->level = level;
+}
+
+/**
+ * Add a comparator sample to the vote.
+ *
+ * @param vote Vote state
+ * @param level Sampled comparator level
+ * @return Outcome of the vote
+ */
+enum bemf_vote_result bemf_vote_sample(struct bemf_vote *vote, bool level)
+{
+	vote->samples++;
+	if (level == vote->level)
+		vote->votes++;
+
+	if (vote->votes >= vote->n)
+		return bv_confirmed;
+	if ((vote->samples - vote->votes) > (vote->m - vote->n))
+		return bv_rejected;
+
+	return bv_pending;
+}
@@ -0,0 +1,48 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BEMF_VOTE_H
+#define __BEMF_VOTE_H
+
+#include "types.h"
+
+/**
+ * Outcome of a BEMF edge qualification.
+ */
+enum bemf_vote_result {
+	bv_pending,		/**< More samples needed */
+	bv_confirmed,		/**< Enough samples at the level of the edge */
+	bv_rejected,		/**< The edge can not get enough samples any more */
+};
+
+/**
+ * N of M majority vote on the comparator level after an edge.
+ */
+struct bemf_vote {
+	u8 n;			/**< Samples at the new level needed */
+	u8 m;			/**< Samples taken at most */
+	u8 samples;		/**< Samples taken so far */
+	u8 votes;		/**< Samples so far at the new level */
+	bool level;		/**< Comparator level after the edge */
+};
+
+void bemf_vote_init(struct bemf_vote *vote, u8 n, u8 m);
+void bemf_vote_start(struct bemf_vote *vote, bool level);
+enum bemf_vote_result bemf_vote_sample(struct bemf_vote *vote, bool level);
+
+#endif /* __BEMF_VOTE_H */
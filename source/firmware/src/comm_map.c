@@ -0,0 +1,168 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   comm_map.c
+ *
+ * @brief  Speed dependent commutation advance and blanking maps.
+ *
+ * The timing advance and the time after a commutation in which the BEMF
+ * comparator edges are ignored, so that the demagnetization of the phase
+ * that just got switched off is not taken for a zero crossing, both depend
+ * on the speed. The maps give them at COMM_MAP_POINTS BEMF crossing periods
+ * and are interpolated linearly in between, crossing periods outside of the
+ * map use the first or last point.
+ *
+ * The defaults come from the COMMP__MAP_* defines of the configuration and
+ * are kept in flash, the maps in use are a copy in RAM the governor can
+ * change through an index and a value register: writing the index register
+ * loads the selected entry into the value register, writing the value
+ * register stores it.
+ */
+
+#include "config.h"
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+
+#include "comm_map.h"
+
+/**
+ * Number of fractional bits of the map interpolation.
+ */
+#define COMM_MAP_FRAC_BITS 12
+
+/**
+ * Default map points from the configuration.
+ */
+static const struct comm_map_point comm_map_default[COMM_MAP_POINTS] = {
+	{COMMP__MAP_PERIOD_0, COMMP__MAP_ADVANCE_0, COMMP__MAP_BLANK_0},
+	{COMMP__MAP_PERIOD_1, COMMP__MAP_ADVANCE_1, COMMP__MAP_BLANK_1},
+	{COMMP__MAP_PERIOD_2, COMMP__MAP_ADVANCE_2, COMMP__MAP_BLANK_2},
+	{COMMP__MAP_PERIOD_3, COMMP__MAP_ADVANCE_3, COMMP__MAP_BLANK_3},
+	{COMMP__MAP_PERIOD_4, COMMP__MAP_ADVANCE_4, COMMP__MAP_BLANK_4},
+};
+
+struct comm_map comm_map; /**< Commutation maps instance */
+
+/**
+ * Load the default maps and set up the governor registers.
+ */
+void comm_map_init(void)
+{
+	int i;
+
+	(void)gpc_setup_reg(GPROT_COMM_MAP_INDEX_REG_ADDR, &comm_map.index);
+	(void)gpc_setup_reg(GPROT_COMM_MAP_VALUE_REG_ADDR, &comm_map.value);
+
+	for (i = 0; i < COMM_MAP_POINTS; i++)
+		comm_map.point[i] = comm_map_default[i];
+
+	comm_map.index = 0;
+	comm_map.value = comm_map.point[0].period;
+}
+
+/**
+ * Interpolate in between two map values.
+ */
+static s32 comm_map_interpolate(s32 a, s32 b, s32 frac)
+{
+	return a + (((b - a) * frac) / (1 << COMM_MAP_FRAC_BITS));
+}
+
+/**
+ * Look up the advance and blanking time of a BEMF crossing period.
+ *
+ * Points not sorted by ascending period, as they can be while the governor
+ * rewrites the map, are skipped.
+ *
+ * @param map Commutation maps
+ * @param period BEMF crossing period [commutation timer ticks]
+ * @param advance Returns the ticks to add to the crossing period
+ * @param blank Returns the blanking time after a commutation [ticks]
+ */
+void comm_map_lookup(const struct comm_map *map, u32 period, s16 *advance,
+		     u16 *blank)
+{
+	const struct comm_map_point *a = &map->point[0];
+	const struct comm_map_point *b;
+	s32 frac;
+	int i;
+
+	for (i = 1; i < COMM_MAP_POINTS; i++) {
+		b = &map->point[i];
+		if (b->period <= a->period)
+			continue;
+		if (period <= a->period)
+			break;
+		if (period < b->period) {
+			frac = (s32)(((period - a->period) <<
+				      COMM_MAP_FRAC_BITS) /
+				     (u32)(b->period - a->period));
+			*advance = (s16)comm_map_interpolate(a->advance,
+							     b->advance, frac);
+			*blank = (u16)comm_map_interpolate(a->blank, b->blank,
+							   frac);
+			return;
+		}
+		a = b;
+	}
+
+	*advance = a->advance;
+	*blank = a->blank;
+}
+
+/**
+ * Handle a governor write to the map index or value register.
+ *
+ * @param addr Register address
+ */
+void comm_map_handle_reg(u8 addr)
+{
+	struct comm_map_point *point;
+
+	if (comm_map.index >= (COMM_MAP_POINTS * COMM_MAP_FIELDS))
+		comm_map.index = 0;
+
+	point = &comm_map.point[comm_map.index / COMM_MAP_FIELDS];
+
+	switch (comm_map.index % COMM_MAP_FIELDS) {
+	case 0:
+		if (addr == GPROT_COMM_MAP_VALUE_REG_ADDR)
+			point->period = comm_map.value;
+		comm_map.value = point->period;
+		break;
+	case 1:
+		if (addr == GPROT_COMM_MAP_VALUE_REG_ADDR)
+			point->advance = (s16)comm_map.value;
+		comm_map.value = (u16)point->advance;
+		break;
+	default:
+		if (addr == GPROT_COMM_MAP_VALUE_REG_ADDR)
+			point->blank = comm_map.value;
+		comm_map.value = point->blank;
+		break;
+	}
+
+	if (addr == GPROT_COMM_MAP_INDEX_REG_ADDR)
+		(void)gpc_register_touched(GPROT_COMM_MAP_VALUE_REG_ADDR);
+}
@@ -0,0 +1,59 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COMM_MAP_H
+#define __COMM_MAP_H
+
+#include "types.h"
+
+/**
+ * Number of points of the commutation maps.
+ */
+#define COMM_MAP_POINTS 5
+
+/**
+ * Number of values of a map point accessible over the governor link.
+ */
+#define COMM_MAP_FIELDS 3
+
+/**
+ * One point of the commutation maps.
+ */
+struct comm_map_point {
+	u16 period;		/**< BEMF crossing period [commutation timer ticks] */
+	s16 advance;		/**< Ticks added to the crossing period, negative advances */
+	u16 blank;		/**< Ticks after a commutation BEMF edges are ignored for */
+};
+
+/**
+ * Commutation maps, points sorted by ascending crossing period.
+ */
+struct comm_map {
+	struct comm_map_point point[COMM_MAP_POINTS];	/**< Map points */
+	u16 index;		/**< Map index register, point * COMM_MAP_FIELDS + field */
+	u16 value;		/**< Map value register, the entry selected by index */
+};
+
+extern struct comm_map comm_map;
+
+void comm_map_init(void);
+void comm_map_lookup(const struct comm_map *map, u32 period, s16 *advance,
+		     u16 *blank);
+void comm_map_handle_reg(u8 addr);
+
+#endif /* __COMM_MAP_H */
@@ -30,6 +30,7 @@ extern volatile bool *comm_process_trigger;
 struct comm_data {
 	bool bemf_crossing_detected; /**< valid BEMF crossing detected flag */
 	u16 calculated_freq;	     /**< calculated commutation frequency */
+	s16 spark_advance;	     /**< commutation timer ticks the BEMF crossing period in comm_tim_data.freq is shortened by */
 	u32 in_range_counter;	     /**< how long are we in a valid direct control window */
 };
 
@@ -44,5 +45,6 @@ void comm_process_closed_loop_on(void);
 void comm_process_closed_loop_off(void);
 void run_comm_process(void);
 bool comm_process_ready(void);
+void comm_process_calibrate(void);
 
 #endif /* __COMM_PROCESS_H */
@@ -0,0 +1,443 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   comm_process_hall.c
+ *
+ * @brief  Hall sensor commutation process implementation.
+ *
+ * The three Hall sensors are connected to the encoder port (PA6, PA7 and
+ * PB0, TIM3 channel 1 to 3). TIM3 runs in Hall sensor interface mode, every
+ * edge on any of the inputs captures the time since the previous edge into
+ * channel 1 and restarts the counter. The capture interrupt commutates
+ * directly to the step the new Hall state maps to, so the motor gets full
+ * torque from standstill without an open loop spinup. A counter overflow
+ * means the rotor is standing or too slow to be measured.
+ *
+ * The Hall to phase mapping defaults to the HALL MAP_x configuration values
+ * and can be calibrated with @ref comm_process_calibrate(). The calibration
+ * result is reported in the trace.
+ *
+ * Use together with the direct spinup strategy:
+ * @code
+ * make COMMP_STRATEGY=hall CP_SPINUP_STRATEGY=direct
+ * @endcode
+ * The encoder debug pins (DP USE_ENCODER) have to be disabled, the build
+ * stops with an error otherwise. The orange, green and blue LEDs share the
+ * Hall inputs as well: led_init() drives them open drain until
+ * comm_process_init() turns them into floating inputs, LED writes after
+ * that only change the unused output latch.
+ */
+
+#include <stm32/rcc.h>
+#include <stm32/misc.h>
+#include <stm32/tim.h>
+#include <stm32/gpio.h>
+
+#include "types.h"
+#include "config.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+#include "driver/sys_tick.h"
+#include "comm_tim.h"
+#include "comm_process.h"
+#include "control_process.h"
+#include "hall.h"
+#include "foc.h"
+#include "pwm/pwm.h"
+#include "pwm/pwm_steps.h"
+#include "trace.h"
+
+/**
+ * Commutation angle of the calibration field when holding step 0, the
+ * field of step 0 is at 30 degrees in the convention of @ref foc.h.
+ */
+#define COMM_PROCESS_HALL_ANGLE_0 (0x10000 / 12)
+
+volatile bool *comm_process_trigger;
+
+/**
+ * Internal state of the comm process struct.
+ */
+struct comm_process_state {
+	volatile bool trigger;	/**< New Hall edge or capture timer overflow */
+	volatile bool closed_loop; /**< Running in closed loop control flag */
+	struct hall hall;	/**< Hall commutation and speed state */
+};
+
+/**
+ * Hall to phase mapping calibration state.
+ */
+struct comm_process_cal {
+	bool running;		/**< Calibration in progress */
+	int timer;		/**< Soft timer id of the calibration */
+	u16 tick;		/**< Calibration soft timer calls so far */
+	u16 angle;		/**< Commutation angle of the stator field */
+	struct hall_cal cal;	/**< Collected Hall states */
+};
+
+static struct comm_process_state comm_process_state;	/**< Internal state instance */
+static struct comm_process_cal comm_process_cal;	/**< Calibration state instance */
+struct comm_data comm_data;			/**< Public data instance */
+s32 new_cycle_time;				/**< Last Hall capture delta */
+
+/**
+ * Hall to phase mapping from the configuration.
+ */
+static const u8 comm_process_hall_map[HALL_STATES] = {
+	HALL_INVALID,
+	HALL__MAP_1,
+	HALL__MAP_2,
+	HALL__MAP_3,
+	HALL__MAP_4,
+	HALL__MAP_5,
+	HALL__MAP_6,
+	HALL_INVALID
+};
+
+static void comm_process_cal_callback(int id);
+
+/**
+ * Read the Hall sensor inputs.
+ *
+ * @return Hall state, PA6 in bit 0, PA7 in bit 1 and PB0 in bit 2
+ */
+static u8 comm_process_hall_read(void)
+{
+	return (u8)(((GPIO_ReadInputData(GPIOA) >> 6) & 0x03) |
+		    ((GPIO_ReadInputData(GPIOB) & 0x01) << 2));
+}
+
+/**
+ * Commutate to a step of the Hall mapping.
+ *
+ * Normally the step is already preloaded by the previous commutation, only
+ * after a reversal, a missed edge or the start it has to be loaded first.
+ * Schemes with more steps than there are Hall states only get the steps at
+ * the Hall edges applied.
+ *
+ * @param step Hall mapping step or HALL_INVALID
+ */
+static void comm_process_hall_comm(u8 step)
+{
+	u8 index;
+
+	if (step == HALL_INVALID)
+		return;
+
+	index = (u8)((step * pwm_scheme->steps) / HALL_STEPS);
+	if (pwm_step != index)
+		pwm_steps_load(pwm_scheme, index);
+
+	pwm_comm();
+}
+
+/**
+ * Initialize commutation process
+ */
+void comm_process_init(void)
+{
+	NVIC_InitTypeDef nvic;
+	GPIO_InitTypeDef gpio;
+	TIM_TimeBaseInitTypeDef tim_base;
+	TIM_ICInitTypeDef tim_ic;
+
+	comm_process_trigger = &comm_process_state.trigger;
+
+	comm_process_state.trigger = false;
+	comm_process_state.closed_loop = false;
+	comm_process_cal.running = false;
+
+	comm_data.bemf_crossing_detected = false;
+	comm_data.calculated_freq = 0;
+	comm_data.spark_advance = 0;
+	comm_data.in_range_counter = 0;
+
+	/* GPIOA, GPIOB and TIM3 clock enable */
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA |
+			       RCC_APB2Periph_GPIOB, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+
+	/* Hall sensor inputs, the sensors need pull-ups on the board */
+	gpio.GPIO_Pin = GPIO_Pin_6 | GPIO_Pin_7;
+	gpio.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+	gpio.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_Init(GPIOA, &gpio);
+
+	gpio.GPIO_Pin = GPIO_Pin_0;
+	GPIO_Init(GPIOB, &gpio);
+
+	hall_init(&comm_process_state.hall, comm_process_hall_map,
+		  comm_process_hall_read());
+
+	/* Enable the TIM3 gloabal interrupt, same priority as the PWM timer */
+	nvic.NVIC_IRQChannel = TIM3_IRQn;
+	nvic.NVIC_IRQChannelPreemptionPriority = 0;
+	nvic.NVIC_IRQChannelSubPriority = 1;
+	nvic.NVIC_IRQChannelCmd = ENABLE;
+
+	NVIC_Init(&nvic);
+
+	/* TIM3 time base configuration, overflows after 65536 capture ticks */
+	tim_base.TIM_Period = 65535;
+	tim_base.TIM_Prescaler = HALL__TIM_PRESCALER;
+	tim_base.TIM_ClockDivision = 0;
+	tim_base.TIM_CounterMode = TIM_CounterMode_Up;
+	tim_base.TIM_RepetitionCounter = 0;
+
+	TIM_TimeBaseInit(TIM3, &tim_base);
+
+	/* TIM3 Hall sensor interface, XOR of CH1-3 resets and captures */
+	TIM_SelectHallSensor(TIM3, ENABLE);
+	TIM_SelectInputTrigger(TIM3, TIM_TS_TI1F_ED);
+	TIM_SelectSlaveMode(TIM3, TIM_SlaveMode_Reset);
+
+	tim_ic.TIM_Channel = TIM_Channel_1;
+	tim_ic.TIM_ICPolarity = TIM_ICPolarity_Rising;
+	tim_ic.TIM_ICSelection = TIM_ICSelection_TRC;
+	tim_ic.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	tim_ic.TIM_ICFilter = HALL__IC_FILTER;
+
+	TIM_ICInit(TIM3, &tim_ic);
+
+	/* Only counter overflows generate update interrupts, not the resets */
+	TIM_UpdateRequestConfig(TIM3, TIM_UpdateSource_Regular);
+
+	/* TIM3 Capture Compare 1 and Update IT enable */
+	TIM_ITConfig(TIM3, TIM_IT_CC1 | TIM_IT_Update, ENABLE);
+
+	TIM_Cmd(TIM3, ENABLE);
+}
+
+/**
+ * Reset commutation process internal state.
+ */
+void comm_process_reset(void)
+{
+	TIM_ITConfig(TIM3, TIM_IT_CC1 | TIM_IT_Update, DISABLE);
+	hall_reset(&comm_process_state.hall, comm_process_hall_read());
+	TIM_ITConfig(TIM3, TIM_IT_CC1 | TIM_IT_Update, ENABLE);
+}
+
+/**
+ * Commutation process configuration
+ *
+ * The Hall sensors do not depend on the BEMF edge, nothing to configure.
+ *
+ * @param rising Ignored
+ */
+void comm_process_config(bool rising)
+{
+	rising = rising;
+}
+
+/**
+ * Reset and configure commutation process.
+ *
+ * @param rising Ignored
+ */
+void comm_process_config_and_reset(bool rising)
+{
+	comm_process_config(rising);
+	comm_process_reset();
+}
+
+/**
+ * Switch on the closed loop control system
+ *
+ * Commutates to the step of the current Hall state right away.
+ */
+void comm_process_closed_loop_on(void)
+{
+	comm_process_state.closed_loop = true;
+	comm_process_hall_comm(hall_step(&comm_process_state.hall));
+}
+
+/**
+ * Switch off the closed loop control system
+ */
+void comm_process_closed_loop_off(void)
+{
+	comm_process_state.closed_loop = false;
+}
+
+/**
+ * Main periodic body of the commutation process
+ *
+ * Called after every Hall edge and capture timer overflow. Converts the
+ * measured speed into the commutation timer frequency so that the spinning
+ * state is still checked once per step, and reports a valid crossing as
+ * long as the sensors deliver a valid state. A stalled rotor keeps getting
+ * driven, missing or broken sensors make the spinning state give up.
+ */
+void run_comm_process(void)
+{
+	u32 period = hall_period(&comm_process_state.hall);
+	u32 freq = 65535;
+
+	/* Half a step in commutation timer ticks, TIM2 runs at 72MHz / 5 */
+	if (period != 0)
+		freq = (period * (HALL__TIM_PRESCALER + 1)) / (HALL_STEPS * 2 * 5);
+	if (freq > COMM_TIM_FREQ_MAX)
+		freq = COMM_TIM_FREQ_MAX;
+
+	trace_log(trace_ev_comm_freq, (period != 0) ? 1 : 0,
+		  (u16)((freq > 65535) ? 65535 : freq));
+
+	comm_data.calculated_freq = (u16)((freq > 65535) ? 65535 : freq);
+	comm_tim_data.freq = freq;
+	(void)gpc_register_touched(GPROT_COMM_TIM_FREQ_REG_ADDR);
+	comm_tim_update_freq();
+
+	if (comm_process_state.closed_loop) {
+		comm_data.bemf_crossing_detected =
+			(hall_step(&comm_process_state.hall) != HALL_INVALID);
+	}
+}
+
+/**
+ * Do we have enough information for calculating commutation times?
+ *
+ * The Hall state is all the commutation needs, valid from standstill on.
+ */
+bool comm_process_ready(void)
+{
+	return !comm_process_cal.running &&
+		(hall_step(&comm_process_state.hall) != HALL_INVALID);
+}
+
+/**
+ * Start the Hall to phase mapping calibration.
+ *
+ * Only works while the motor is stopped. Aligns the rotor to the field of
+ * step 0, then turns the field slowly one electrical revolution forward and
+ * one backward through the field oriented PWM while recording the Hall
+ * states. The motor has to be free to turn.
+ */
+void comm_process_calibrate(void)
+{
+	if (comm_process_cal.running ||
+	    (control_process_get_state() != cps_idle))
+		return;
+
+	comm_process_cal.timer =
+		sys_tick_timer_register(comm_process_cal_callback,
+					HALL__CAL_TICK);
+	if (comm_process_cal.timer < 0)
+		return;
+
+	comm_process_cal.running = true;
+	comm_process_cal.tick = 0;
+	comm_process_cal.angle = 0;
+	hall_cal_reset(&comm_process_cal.cal);
+
+	pwm_foc_start();
+}
+
+/**
+ * Calibration time reference software timer callback function.
+ *
+ * Samples the Hall state at the current field angle, then moves the field
+ * on. Applies the new mapping and hands the outputs back when done.
+ */
+void comm_process_cal_callback(int id)
+{
+	const u16 sweep = 0x10000 / HALL__CAL_STEP;
+	struct foc_vec v = { HALL__CAL_VOLTAGE, 0 };
+	u16 duty[3];
+	s16 sin;
+	s16 cos;
+	u8 map[HALL_STATES];
+	int i;
+
+	if (comm_process_cal.tick >= HALL__CAL_SETTLE) {
+		hall_cal_sample(&comm_process_cal.cal, comm_process_cal.angle,
+				comm_process_hall_read());
+
+		if (comm_process_cal.tick < HALL__CAL_SETTLE + sweep)
+			comm_process_cal.angle += HALL__CAL_STEP;
+		else
+			comm_process_cal.angle -= HALL__CAL_STEP;
+	}
+
+	if (comm_process_cal.tick >= HALL__CAL_SETTLE + (2 * sweep)) {
+		sys_tick_timer_unregister(id);
+		pwm_foc_stop();
+
+		if (hall_cal_finish(&comm_process_cal.cal, map) == 0) {
+			TIM_ITConfig(TIM3, TIM_IT_CC1 | TIM_IT_Update, DISABLE);
+			hall_init(&comm_process_state.hall, map,
+				  comm_process_hall_read());
+			TIM_ITConfig(TIM3, TIM_IT_CC1 | TIM_IT_Update, ENABLE);
+
+			for (i = 1; i < HALL_STATES - 1; i++)
+				trace_log(trace_ev_hall_cal, (u8)i, map[i]);
+		} else {
+			trace_log(trace_ev_hall_cal, 0, HALL_INVALID);
+		}
+
+		comm_process_cal.running = false;
+		return;
+	}
+
+	comm_process_cal.tick++;
+
+	foc_sin_cos((u16)(COMM_PROCESS_HALL_ANGLE_0 - comm_process_cal.angle),
+		    &sin, &cos);
+	foc_svpwm(foc_inv_park(v, sin, cos), PWM__BASE_CLOCK / PWM__FREQUENCY,
+		  duty);
+	pwm_foc_set(duty);
+}
+
+/**
+ * Timer 3 interrupt handler
+ *
+ * An overflow pending together with a capture happened before the edge,
+ * so it is handled first.
+ */
+void tim3_irq_handler(void)
+{
+	u8 state;
+	u8 step;
+
+	if (TIM_GetITStatus(TIM3, TIM_IT_Update) != RESET) {
+		TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
+
+		hall_timeout(&comm_process_state.hall);
+		comm_process_state.trigger = true;
+	}
+
+	if (TIM_GetITStatus(TIM3, TIM_IT_CC1) != RESET) {
+		TIM_ClearITPendingBit(TIM3, TIM_IT_CC1);
+
+		state = comm_process_hall_read();
+		new_cycle_time = TIM_GetCapture1(TIM3);
+		step = hall_edge(&comm_process_state.hall, state,
+				 (u16)new_cycle_time);
+
+		if (comm_process_state.closed_loop)
+			comm_process_hall_comm(step);
+
+		comm_process_state.trigger = true;
+
+		trace_log(trace_ev_hall, state, step);
+	}
+}
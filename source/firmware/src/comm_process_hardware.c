@@ -37,9 +37,24 @@
 #include "driver/debug_pins.h"
 #include "driver/bemf_hardware_detect.h"
 #include "comm_tim.h"
+#include "comm_map.h"
 #include "comm_process.h"
+#include "filter.h"
+#include "pwm/pwm_steps.h"
 
 #include "sensor_process.h"
+#include "trace.h"
+
+/**
+ * Longest BEMF crossing period the commutation time is calculated from, in
+ * commutation timer ticks, about 18ms.
+ */
+#define COMMP_MAX_PERIOD (4 * 65536)
+
+/**
+ * Commutation time as logged to the 16 bit trace data.
+ */
+#define COMMP_TRACE_FREQ(FREQ) (u16)(((FREQ) > 65535) ? 65535 : (FREQ))
 
 volatile bool *comm_process_trigger;
 
@@ -61,8 +76,8 @@ struct comm_params {
 	s16 spark_advance;	 /**< advance commutation relative to calculated time */
 	u16 direct_cutoff;	 /**< distance from the last calc time that makes the new invalid */
 	u16 direct_cutoff_slope; /**< what is the control slope when outside the direct control window */
-	u16 iir;		 /**< IIR value for the commutation time */
-	u16 hold_off;		 /**< how many bemf samples after a commutation should be dropped */
+	struct filter_iir iir;	 /**< IIR filter of the commutation time */
+	struct filter_ab predict; /**< Alpha beta predictor of the commutation time */
 };
 
 static struct comm_process_state comm_process_state;	/**< Internal state instance */
@@ -84,7 +99,7 @@ void comm_process_init(void)
 		      (u16 *) & (comm_params.spark_advance));
 	gpc_setup_reg(GPROT_COMM_TIM_DIRECT_CUTOFF_REG_ADDR,
 		      &(comm_params.direct_cutoff));
-	gpc_setup_reg(GPROT_COMM_TIM_IIR_POLE_REG_ADDR, &(comm_params.iir));
+	gpc_setup_reg(GPROT_COMM_TIM_IIR_POLE_REG_ADDR, &(comm_params.iir.shift));
 
 	comm_process_trigger = &bemf_hd_data.trigger;
 
@@ -94,13 +109,17 @@ void comm_process_init(void)
 
 	comm_data.bemf_crossing_detected = false;
 	comm_data.calculated_freq = 0;
+	comm_data.spark_advance = 0;
 	comm_data.in_range_counter = 0;
 
 	comm_params.spark_advance = COMMP__SPARK_ADVANCE;
 	comm_params.direct_cutoff = 10000;
 	comm_params.direct_cutoff_slope = 20;
-	comm_params.iir = COMMP__IIR;
-	comm_params.hold_off = 1;
+	filter_iir_init(&comm_params.iir, COMMP__IIR_SHIFT, comm_tim_data.freq);
+	filter_ab_init(&comm_params.predict, COMMP__PREDICT_ALPHA_SHIFT,
+		       COMMP__PREDICT_BETA_SHIFT, comm_tim_data.freq);
+
+	comm_map_init();
 }
 
 /**
@@ -150,34 +169,83 @@ void comm_process_closed_loop_off(void)
 }
 
 /**
- * Main periodic body of the commutation process
+ * Commutation time for a BEMF crossing period.
+ *
+ * Applies the advance of the commutation map and runs the result through
+ * the predictor or the IIR filter. Only called with periods
+ * comm_process_time_valid() accepted, so that a stall or a first capture
+ * does not reach the map and the filter state.
+ *
+ * @param period Time between the last two BEMF crossings
+ * @return New commutation time
  */
-void run_comm_process(void)
+static s32 comm_process_freq(u32 period)
 {
-	u32 big_freq = comm_tim_data.freq;
-	u16 new_freq = (comm_tim_data.curr_time -
-		comm_tim_data.prev_time);
-	u32 big_new_freq = new_freq;
+	s32 big_new_freq = (s32)period;
+	s16 advance;
+	u16 blank;
+
+	/* The constant advance trims the speed dependent one of the map */
+	comm_map_lookup(&comm_map, period, &advance, &blank);
+	advance += comm_params.spark_advance;
+	comm_tim_data.blank = blank;
+
+	big_new_freq += advance;
+	comm_data.spark_advance = advance;
 
-	big_new_freq += comm_params.spark_advance;
+	/* Twelve step schemes commutate twice per BEMF crossing */
+	if (pwm_scheme->steps > 6)
+		big_new_freq /= 4;
+	else
+		big_new_freq /= 2;
+
+	/*
+	 * The spinup and reset code set the commutation time directly, resync
+	 * the filter state to it in that case.
+	 */
+#ifdef COMMP__PREDICT
+	/*
+	 * Extrapolate the trend of the crossing periods so that the estimate
+	 * does not lag behind while accelerating or braking.
+	 */
+	if (filter_ab_output(&comm_params.predict) != (s32)comm_tim_data.freq)
+		filter_ab_set(&comm_params.predict, (s32)comm_tim_data.freq);
 
-#ifdef PWM_SCHEME_12STEP
-	big_new_freq /= 4;
+	big_new_freq = filter_ab_update(&comm_params.predict, big_new_freq);
+	if (big_new_freq < 1)
+		big_new_freq = 1;
 #else
-	big_new_freq /= 2;
+	if (filter_iir_output(&comm_params.iir) != (s32)comm_tim_data.freq)
+		filter_iir_set(&comm_params.iir, (s32)comm_tim_data.freq);
+
+	big_new_freq = filter_iir_update(&comm_params.iir, big_new_freq);
 #endif
 
-	big_freq = big_freq * comm_params.iir;
-	big_new_freq = (big_freq + big_new_freq) / (comm_params.iir + 1);
+	return big_new_freq;
+}
+
+/**
+ * Main periodic body of the commutation process
+ */
+void run_comm_process(void)
+{
+	u32 new_freq = (comm_tim_data.curr_time -
+		comm_tim_data.prev_time);
+	s32 big_new_freq;
 
 	if (comm_process_time_valid()) {
-		comm_tim_data.freq = big_new_freq;
+		big_new_freq = comm_process_freq(new_freq);
+		trace_log(trace_ev_comm_freq, 1, COMMP_TRACE_FREQ(big_new_freq));
+
+		comm_tim_data.freq = (u32)big_new_freq;
 		(void)gpc_register_touched(GPROT_COMM_TIM_FREQ_REG_ADDR);
 
 		comm_tim_update_freq();
 
 		OFF(DP_EXT_SCL);
 	} else {
+		trace_log(trace_ev_comm_freq, 0, COMMP_TRACE_FREQ(new_freq));
+
 		comm_tim_update_freq();
 		OFF(DP_EXT_SCL);
 	}
@@ -191,22 +259,11 @@ void run_comm_process(void)
 
 bool comm_process_time_valid(void) {
 	/*
-	 * check if we are in the range where the comm timer is able
-	 * to operate
-	 */
-	if ((comm_tim_data.update_count > 1) ||
-		((comm_tim_data.update_count == 1) &&
-			(comm_tim_data.curr_time > comm_tim_data.prev_time))) {
-		DEBUG("Not Enough Updates, FAIL\n");
-		return false;
-	}
-
-	/*
-	 * check if we are far away from the edge of the maximal time
-	 * comm timer can work in so that we have enough freedom to operate
+	 * check if the crossing period is in the range the commutation
+	 * time can be calculated from
 	 */
 	if ((comm_tim_data.curr_time -
-			comm_tim_data.prev_time) > (65535- 1000)) {
+			comm_tim_data.prev_time) > COMMP_MAX_PERIOD) {
 		DEBUG("EDGE TIMER FAIL\n");
 		return false;
 	}
@@ -237,3 +294,12 @@ bool comm_process_ready(void)
 
 	return true;
 }
+
+/**
+ * Calibrate the commutation sensors.
+ *
+ * Nothing to calibrate for the BEMF detection.
+ */
+void comm_process_calibrate(void)
+{
+}
@@ -25,6 +25,12 @@
  *
  * This process is being called periodically from the main while loop and
  * generates commutation events.
+ *
+ * The zero crossing time is estimated from a line fitted over the last
+ * phase voltage samples of the commutation step (see bemf_fit.c). A sample
+ * past the zero level the fit does not confirm, like a switching spike, is
+ * no crossing. With too few samples for a fit the two newest samples are
+ * interpolated.
  */
 
 #include "types.h"
@@ -37,6 +43,8 @@
 #include "driver/adc.h"
 #include "comm_tim.h"
 #include "comm_process.h"
+#include "filter.h"
+#include "bemf_fit.h"
 
 #include "sensor_process.h"
 
@@ -50,6 +58,7 @@ struct comm_process_state {
 	s32 pwm_count;		/**< PWM cycle counter in the current commutation */
 	bool closed_loop;	/**< Running in closed loop control flag */
 	u32 prev_phase_voltage;	/**< Previous PWM cycle phase voltage memory */
+	struct bemf_fit fit;	/**< Zero crossing estimator */
 };
 
 /**
@@ -61,8 +70,10 @@ struct comm_params {
 	s16 spark_advance;	 /**< advance commutation relative to calculated time */
 	u16 direct_cutoff;	 /**< distance from the last calc time that makes the new invalid */
 	u16 direct_cutoff_slope; /**< what is the control slope when outside the direct control window */
-	u16 iir;		 /**< IIR value for the commutation time */
+	struct filter_iir iir;	 /**< IIR filter of the commutation time */
 	u16 hold_off;		 /**< how many bemf samples after a commutation should be dropped */
+	u8 fit_samples;		 /**< samples the zero crossing is fitted over */
+	u16 fit_max_residual;	 /**< distance from the fitted line rejecting a sample */
 };
 
 static struct comm_process_state comm_process_state;	/**< Internal state instance */
@@ -84,7 +95,7 @@ void comm_process_init(void)
 	(void)gpc_setup_reg(GPROT_COMM_TIM_DIRECT_CUTOFF_REG_ADDR,
 			    &(comm_params.direct_cutoff));
 	(void)gpc_setup_reg(GPROT_COMM_TIM_IIR_POLE_REG_ADDR,
-			    &(comm_params.iir));
+			    &(comm_params.iir.shift));
 
 	comm_process_state.rising = true;
 	comm_process_state.pwm_count = 0;
@@ -93,13 +104,19 @@ void comm_process_init(void)
 
 	comm_data.bemf_crossing_detected = false;
 	comm_data.calculated_freq = 0;
+	comm_data.spark_advance = 0;
 	comm_data.in_range_counter = 0;
 
 	comm_params.spark_advance = 0;
 	comm_params.direct_cutoff = 10000;
 	comm_params.direct_cutoff_slope = 20;
-	comm_params.iir = 6;
+	filter_iir_init(&comm_params.iir, 3, comm_tim_data.freq);
 	comm_params.hold_off = 1;
+	comm_params.fit_samples = 5;
+	comm_params.fit_max_residual = 200;
+
+	bemf_fit_init(&comm_process_state.fit, comm_params.fit_samples,
+		      comm_params.fit_max_residual);
 }
 
 /**
@@ -108,6 +125,7 @@ void comm_process_init(void)
 void comm_process_reset(void)
 {
 	comm_process_state.pwm_count = 0;
+	bemf_fit_reset(&comm_process_state.fit);
 }
 
 /**
@@ -138,6 +156,7 @@ void comm_process_config_and_reset(bool rising)
 		sensors.phase_voltage = 0;
 	}
 	comm_process_state.pwm_count = 0;
+	bemf_fit_reset(&comm_process_state.fit);
 }
 
 /**
@@ -157,20 +176,55 @@ void comm_process_closed_loop_off(void)
 }
 
 /**
- * Calculate the next commutation time
+ * Interpolate the zero crossing between the two newest samples.
+ *
+ * @return Crossing time, the newest sample time if the samples do not
+ * slope in the expected direction
  */
-static void comm_process_calc_next_comm(void)
+static u32 comm_process_interpolate(void)
 {
-	s32 old_cycle_time = (s32)comm_tim_data.freq;
 	s32 pwm_time = (s32)(comm_tim_data.curr_time - comm_tim_data.prev_time);
 	s32 bemf_rise = (s32)(sensors.phase_voltage -
 			comm_process_state.prev_phase_voltage);
 	s32 zero_value = (s32)(sensors.half_battery_voltage -
 			comm_process_state.prev_phase_voltage);
-	s32 half_cycle_time_adjust = (zero_value * pwm_time) / bemf_rise;
-	u32 half_cycle_time = (u32)((comm_tim_data.prev_time -
-			       comm_tim_data.last_capture_time) +
-				half_cycle_time_adjust);
+	s32 adjust;
+
+	if (comm_process_state.rising ? (bemf_rise <= 0) : (bemf_rise >= 0))
+		return comm_tim_data.curr_time;
+
+	adjust = (zero_value * pwm_time) / bemf_rise;
+	if (adjust < 0)
+		adjust = 0;
+	if (adjust > pwm_time)
+		adjust = pwm_time;
+
+	return comm_tim_data.prev_time + (u32)adjust;
+}
+
+/**
+ * Calculate the next commutation time
+ *
+ * @return false if the samples show no crossing yet
+ */
+static bool comm_process_calc_next_comm(void)
+{
+	s32 old_cycle_time = (s32)comm_tim_data.freq;
+	u32 crossing;
+	u32 half_cycle_time;
+
+	switch (bemf_fit_crossing(&comm_process_state.fit,
+				  comm_process_state.rising, &crossing)) {
+	case bf_crossing:
+		break;
+	case bf_pending:
+		return false;
+	case bf_unknown:
+		crossing = comm_process_interpolate();
+		break;
+	}
+
+	half_cycle_time = crossing - comm_tim_data.last_capture_time;
 	new_cycle_time = (s32)(half_cycle_time * 2);
 
 	if (new_cycle_time > (old_cycle_time + comm_params.direct_cutoff)) {
@@ -187,13 +241,17 @@ static void comm_process_calc_next_comm(void)
 	}
 
 	if (comm_process_state.closed_loop) {
-		new_cycle_time = ((old_cycle_time * comm_params.iir) +
-				  (new_cycle_time +
-				   comm_params.spark_advance)) /
-		    (comm_params.iir + 1);
-		comm_tim_data.freq = (u16)new_cycle_time;
+		if (filter_iir_output(&comm_params.iir) != old_cycle_time)
+			filter_iir_set(&comm_params.iir, old_cycle_time);
+		new_cycle_time = filter_iir_update(&comm_params.iir,
+						   new_cycle_time +
+						   comm_params.spark_advance);
+		comm_tim_data.freq = (u32)new_cycle_time;
+		comm_data.spark_advance = comm_params.spark_advance;
 		comm_tim_update_freq();
 	}
+
+	return true;
 }
 
 /**
@@ -208,6 +266,10 @@ void run_comm_process(void)
 		return;
 	}
 
+	bemf_fit_add(&comm_process_state.fit, comm_tim_data.curr_time,
+		     (s16)((s32)sensors.phase_voltage -
+			   (s32)sensors.half_battery_voltage));
+
 	if ((sensors.phase_voltage > 500) &&
 	    (sensors.phase_voltage < (0xFFF - 500))) {
 		if (comm_process_state.rising) {
@@ -216,8 +278,8 @@ void run_comm_process(void)
 			    && (sensors.phase_voltage >=
 				sensors.half_battery_voltage)
 			    && (!comm_data.bemf_crossing_detected)) {
-				comm_process_calc_next_comm();
-				comm_data.bemf_crossing_detected = true;
+				if (comm_process_calc_next_comm())
+					comm_data.bemf_crossing_detected = true;
 				//ON(LED_ORANGE);
 			} else {
 				//OFF(LED_ORANGE);
@@ -228,8 +290,8 @@ void run_comm_process(void)
 			    && (sensors.phase_voltage <=
 				sensors.half_battery_voltage)
 			    && (!comm_data.bemf_crossing_detected)) {
-				comm_process_calc_next_comm();
-				comm_data.bemf_crossing_detected = true;
+				if (comm_process_calc_next_comm())
+					comm_data.bemf_crossing_detected = true;
 				//ON(LED_ORANGE);
 			} else {
 				//OFF(LED_ORANGE);
@@ -251,3 +313,12 @@ bool comm_process_ready(void)
 {
 	return false;
 }
+
+/**
+ * Calibrate the commutation sensors.
+ *
+ * Nothing to calibrate for the BEMF detection.
+ */
+void comm_process_calibrate(void)
+{
+}
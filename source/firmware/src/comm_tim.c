@@ -26,10 +26,18 @@
  * Implements the timer that is directly triggering the commutation event of
  * the PWM generation subsystem.
  *
+ * TIM2 is a 16 bit timer, its update interrupt counts the wraps and extends
+ * it to a 32 bit time base so that slow spinup steps and short commutation
+ * times are both kept exactly. The compare channel matches once per wrap,
+ * the interrupt handler only commutates once the full 32 bit commutation
+ * time is reached.
+ *
  * @todo The comm timer should use a timer driver and not combine timer
  * peripheral handling code together with the commutation handling part.
  */
 
+#include "config.h"
+
 #include <stm32/rcc.h>
 #include <stm32/misc.h>
 #include <stm32/tim.h>
@@ -46,13 +54,18 @@
 #include "driver/adc.h"
 #include "driver/debug_pins.h"
 #include "pwm/pwm.h"
+#include "trace.h"
+#include "ppm_process.h"
+#include "driver/bemf_hardware_detect.h"
 
 /**
  * Commutation timer internal state
  */
 struct comm_tim_state {
-	volatile u32 update_count;              /**< update count since curr_time, needed for data.update_count calculation */
-	volatile u16 next_prev_time;
+	volatile u16 msb;		/**< Upper half of the time base, TIM2 wraps */
+	volatile u32 next_prev_time;	/**< Timestamp becoming prev_time on the next capture */
+	volatile u32 next_comm;		/**< Time of the next commutation */
+	volatile u32 last_comm;		/**< Time of the last commutation event */
 };
 
 struct comm_tim_data comm_tim_data;		/**< Commutation timer data instance */
@@ -71,8 +84,10 @@ void comm_tim_init(void)
 	TIM_OCInitTypeDef tim_oc;
 
 	comm_tim_data.freq = 65535;
+	comm_tim_data.freq_reg = 65535;
 
-	(void)gpc_setup_reg(GPROT_COMM_TIM_FREQ_REG_ADDR, &(comm_tim_data.freq));
+	(void)gpc_setup_reg(GPROT_COMM_TIM_FREQ_REG_ADDR,
+			    &(comm_tim_data.freq_reg));
 
 	/* TIM2 clock enable */
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
@@ -133,6 +148,57 @@ void comm_tim_reset(void)
 	comm_tim_trigger_comm = false;
 	comm_tim_trigger_comm_once = false;
 	comm_tim_data.freq = 65535;
+	comm_tim_data.freq_reg = 65535;
+	comm_tim_data.blank = 0;
+}
+
+/**
+ * Current time of the 32 bit commutation time base.
+ *
+ * Accounts for a wrap whose update interrupt did not run yet, so it can be
+ * called from any interrupt priority.
+ */
+u32 comm_tim_now(void)
+{
+	u16 msb;
+	u16 lsb;
+	bool wrapped;
+
+	do {
+		msb = comm_tim_state.msb;
+		lsb = TIM_GetCounter(TIM2);
+		wrapped = TIM_GetFlagStatus(TIM2, TIM_FLAG_Update) != RESET;
+	} while (msb != comm_tim_state.msb);
+
+	if (wrapped && (lsb < 0x8000))
+		msb++;
+
+	return ((u32)msb << 16) | lsb;
+}
+
+/**
+ * Set the time of the next commutation.
+ */
+static void comm_tim_schedule(u32 time)
+{
+	comm_tim_state.next_comm = time;
+	TIM_SetCompare1(TIM2, (u16)time);
+}
+
+/**
+ * Set the time of the next commutation, commutate right away if it is
+ * already due.
+ *
+ * Otherwise the compare would only match after the next wrap, as it happens
+ * when the commutation time is calculated from a BEMF edge that had to be
+ * qualified first.
+ */
+static void comm_tim_schedule_due(u32 time)
+{
+	comm_tim_schedule(time);
+
+	if ((s32)(comm_tim_now() - time) >= 0)
+		TIM_GenerateEvent(TIM2, TIM_EventSource_CC1);
 }
 
 /**
@@ -140,12 +206,10 @@ void comm_tim_reset(void)
  */
 void comm_tim_capture_time(void)
 {
-	u16 new_time = TIM_GetCounter(TIM2);
+	u32 new_time = comm_tim_now();
 	comm_tim_data.prev_time = comm_tim_state.next_prev_time;
 	comm_tim_data.curr_time = new_time;
 	comm_tim_state.next_prev_time = new_time;
-	comm_tim_data.update_count = comm_tim_state.update_count;
-	comm_tim_state.update_count = 0;
 }
 
 /**
@@ -154,9 +218,14 @@ void comm_tim_capture_time(void)
  */
 void comm_tim_update_freq(void)
 {
-	TIM_SetCompare1(TIM2,
-			comm_tim_data.last_capture_time + comm_tim_data.freq);
+	if (comm_tim_data.freq > COMM_TIM_FREQ_MAX)
+		comm_tim_data.freq = COMM_TIM_FREQ_MAX;
+
+	comm_tim_data.freq_reg = (comm_tim_data.freq > 65535) ?
+		65535 : (u16)comm_tim_data.freq;
 
+	comm_tim_schedule_due(comm_tim_data.last_capture_time +
+			      comm_tim_data.freq);
 }
 
 /**
@@ -165,9 +234,8 @@ void comm_tim_update_freq(void)
  */
 void comm_tim_update_capture(void)
 {
-	comm_tim_data.last_capture_time = TIM_GetCounter(TIM2);
-	TIM_SetCompare1(TIM2,
-			comm_tim_data.last_capture_time + comm_tim_data.freq);
+	comm_tim_data.last_capture_time = comm_tim_now();
+	comm_tim_schedule(comm_tim_data.last_capture_time + comm_tim_data.freq);
 
 	OFF(DP_EXT_SCL);
 }
@@ -177,7 +245,17 @@ void comm_tim_update_capture(void)
  */
 void comm_tim_update_next_prev(void)
 {
-	comm_tim_state.next_prev_time = TIM_GetCounter(TIM2);
+	comm_tim_update_next_prev_at(comm_tim_now());
+}
+
+/**
+ * Update the next prev time to an earlier time
+ *
+ * @param time Time of the comparator edge
+ */
+void comm_tim_update_next_prev_at(u32 time)
+{
+	comm_tim_state.next_prev_time = time;
 }
 
 /**
@@ -186,17 +264,93 @@ void comm_tim_update_next_prev(void)
  */
 void comm_tim_update_capture_and_time(void)
 {
-	comm_tim_data.last_capture_time = TIM_GetCounter(TIM2);
-	TIM_SetCompare1(TIM2,
-			comm_tim_data.last_capture_time + comm_tim_data.freq);
+	comm_tim_update_capture_and_time_at(comm_tim_now());
+}
+
+/**
+ * Update our last capture time and curr time to an earlier capture
+ *
+ * @param time Time of the capture
+ */
+void comm_tim_update_capture_and_time_at(u32 time)
+{
+	comm_tim_data.last_capture_time = time;
+	comm_tim_schedule_due(comm_tim_data.last_capture_time +
+			      comm_tim_data.freq);
 
 	comm_tim_data.prev_time = comm_tim_state.next_prev_time;
 	comm_tim_data.curr_time = comm_tim_data.last_capture_time;
 	comm_tim_state.next_prev_time = comm_tim_data.last_capture_time;
-	comm_tim_data.update_count = comm_tim_state.update_count;
-	comm_tim_state.update_count = 0;
 }
 
+/**
+ * Rescale the commutation time to a PWM scheme with a different number of
+ * steps per electrical revolution.
+ *
+ * Called from the commutation interrupt that switches the scheme. The
+ * commutation process filters resync to the new time on their next update
+ * as it no longer matches their output.
+ *
+ * @param from Steps per revolution of the old scheme
+ * @param to Steps per revolution of the new scheme
+ */
+void comm_tim_rescale(u8 from, u8 to)
+{
+	comm_tim_data.freq = (comm_tim_data.freq * from) / to;
+	comm_tim_data.freq_reg = (comm_tim_data.freq > 65535) ?
+		65535 : (u16)comm_tim_data.freq;
+
+	/* The commutation that just fired set the next one with the old time */
+	comm_tim_schedule_due(comm_tim_data.last_capture_time +
+			      (comm_tim_data.freq * 2));
+}
+
+/**
+ * Take over a commutation timer frequency written to the governor register.
+ */
+void comm_tim_handle_freq_reg(void)
+{
+	comm_tim_data.freq = comm_tim_data.freq_reg;
+}
+
+/**
+ * Check if a BEMF edge falls into the blanking time after a commutation.
+ *
+ * @param time Time of the BEMF edge
+ * @return true if less than @ref comm_tim_data.blank ticks passed between
+ * the last commutation event and the edge
+ */
+bool comm_tim_blanking(u32 time)
+{
+	return (time - comm_tim_state.last_comm) < comm_tim_data.blank;
+}
+
+#ifdef BEMF_HD__QUALIFY
+/**
+ * Open the BEMF edge window once the blanking time after the last
+ * commutation is over.
+ */
+static void comm_tim_schedule_window(void)
+{
+	u32 open = comm_tim_data.freq >> BEMF_HD__WINDOW_SHIFT;
+
+	if (open < comm_tim_data.blank)
+		open = comm_tim_data.blank;
+	if (open > 0xFFFF)
+		open = 0xFFFF;
+
+	TIM_SetCompare2(TIM2, (u16)(comm_tim_state.last_comm + open));
+	TIM_ClearITPendingBit(TIM2, TIM_IT_CC2);
+	TIM_ITConfig(TIM2, TIM_IT_CC2, ENABLE);
+
+	/* Window start already passed while getting here */
+	if ((comm_tim_now() - comm_tim_state.last_comm) >= open) {
+		TIM_ITConfig(TIM2, TIM_IT_CC2, DISABLE);
+		bemf_hd_window_open();
+	}
+}
+#endif
+
 /**
  * Timer 2 interrupt handler
  */
@@ -204,16 +358,39 @@ void tim2_irq_handler(void)
 {
 	TOGGLE(LED_BLUE);
 
+	/* The compare matches once per wrap, commutate in the right one */
+	if ((TIM_GetITStatus(TIM2, TIM_IT_CC1) != RESET) &&
+	    ((s32)(comm_tim_now() - comm_tim_state.next_comm) < 0))
+		TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
+
+#ifdef BEMF_HD__QUALIFY
+	/*
+	 * An edge still being voted on can be the crossing of the running
+	 * step, wait for the vote instead of commutating without it.
+	 */
+	if ((TIM_GetITStatus(TIM2, TIM_IT_CC1) != RESET) &&
+	    comm_tim_trigger_comm && bemf_hd_voting()) {
+		TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
+		comm_tim_schedule(comm_tim_now() + BEMF_HD_PWM_TICKS);
+	}
+#endif
+
 	if (TIM_GetITStatus(TIM2, TIM_IT_CC1) != RESET) {
 		TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
 
 		/* prepare for next comm */
-		comm_tim_data.last_capture_time = TIM_GetCapture1(TIM2);
+		comm_tim_data.last_capture_time = comm_tim_state.next_comm;
 
 		/* triggering commutation event */
 		if (comm_tim_trigger_comm || comm_tim_trigger_comm_once) {
 			TIM_GenerateEvent(TIM1, TIM_EventSource_COM);
+			comm_tim_state.last_comm = comm_tim_state.next_comm;
 			//TIM_GenerateEvent(TIM1, TIM_EventSource_COM | TIM_EventSource_Update);
+#ifdef BEMF_HD__QUALIFY
+			comm_tim_schedule_window();
+		} else {
+			bemf_hd_window_open();
+#endif
 		}
 
 		/* (re)setting "semaphors" */
@@ -221,20 +398,34 @@ void tim2_irq_handler(void)
 		comm_tim_trigger = true;
 
 		/* Set next comm time */
-		TIM_SetCompare1(TIM2,
-				comm_tim_data.last_capture_time +
-				(comm_tim_data.freq * 2));
-		//TIM_SetCompare1(TIM2,
-		//		comm_tim_data.last_capture_time +
-		//		65535);
+		comm_tim_schedule(comm_tim_data.last_capture_time +
+				  (comm_tim_data.freq * 2));
 
 		TOGGLE(DP_EXT_SCL);
 	}
 
+#ifdef BEMF_HD__QUALIFY
+	if (TIM_GetITStatus(TIM2, TIM_IT_CC2) != RESET) {
+		TIM_ClearITPendingBit(TIM2, TIM_IT_CC2);
+		TIM_ITConfig(TIM2, TIM_IT_CC2, DISABLE);
+		bemf_hd_window_open();
+	}
+#endif
+
 	if (TIM_GetITStatus(TIM2, TIM_IT_Update) != RESET) {
 		TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
 		//DEBUG("UPDATE\n");
 
-		comm_tim_state.update_count++;
+		comm_tim_state.msb++;
+#ifdef PPM__ENABLE
+		ppm_process_check();
+#endif
+	}
+
+#ifdef PPM__ENABLE
+	if (TIM_GetITStatus(TIM2, TIM_IT_CC4) != RESET) {
+		TIM_ClearITPendingBit(TIM2, TIM_IT_CC4);
+		ppm_process_capture();
 	}
+#endif
 }
@@ -19,15 +19,31 @@
 #ifndef __COMM_TIM_H
 #define __COMM_TIM_H
 
+/**
+ * Commutation timer counter clock, TIM2 runs from the 72MHz clock divided
+ * by five [Hz].
+ */
+#define COMM_TIM_CLOCK (72000000 / 5)
+
+/**
+ * Largest commutation timer frequency, a little more than half a second
+ * and within the input range of the IIR filters it runs through.
+ */
+#define COMM_TIM_FREQ_MAX 0x007FFFFF
+
 /**
  * Commutation timer output data
+ *
+ * All times are taken from the 32 bit commutation time base, TIM2 counts
+ * the lower and its update interrupt the upper half.
  */
 struct comm_tim_data {
-	volatile u16 last_capture_time;	/**< Timestamp of the last timer capture */
-	volatile u16 curr_time;		/**< Current commutation timestamp */
-	volatile u16 prev_time;		/**< Previous commutation timestamp */
-	volatile u16 freq;		/**< Current commutation frequency */
-	volatile u32 update_count;      /**< Update count between prev_time and curr_time */
+	volatile u32 last_capture_time;	/**< Timestamp of the last timer capture */
+	volatile u32 curr_time;		/**< Current commutation timestamp */
+	volatile u32 prev_time;		/**< Previous commutation timestamp */
+	volatile u32 freq;		/**< Current commutation frequency */
+	volatile u16 freq_reg;		/**< Governor view of freq, saturated to 16 bit */
+	volatile u16 blank;		/**< Time after a commutation BEMF edges are ignored for */
 };
 
 extern struct comm_tim_data comm_tim_data;
@@ -37,10 +53,16 @@ extern struct comm_tim_data comm_tim_data;
 
 void comm_tim_init(void);
 void comm_tim_reset(void);
+u32 comm_tim_now(void);
 void comm_tim_capture_time(void);
 void comm_tim_update_freq(void);
 void comm_tim_update_next_prev(void);
+void comm_tim_update_next_prev_at(u32 time);
 void comm_tim_update_capture(void);
 void comm_tim_update_capture_and_time(void);
+void comm_tim_update_capture_and_time_at(u32 time);
+void comm_tim_rescale(u8 from, u8 to);
+void comm_tim_handle_freq_reg(void);
+bool comm_tim_blanking(u32 time);
 
 #endif /* __COMM_TIM_H */
@@ -40,7 +40,9 @@
 #include "cp_idle.h"
 #include "cp_aligning.h"
 #include "cp_spinning.h"
+#include "cp_catching.h"
 #include "cp_error.h"
+#include "trace.h"
 
 #include "control_process.h"
 
@@ -84,8 +86,9 @@ static struct cps_event_hook control_process_cb_hook_register[cps_num_states];
  * - cpd_aligning
  * - cps_spinup
  * - cps_spinning
+ * - cps_catching
  *
- * The number of existing process states (currently 5) is stored in
+ * The number of existing process states (currently 6) is stored in
  * cps_num_states.
  *
  * In order to register a callback for a specific process state, use
@@ -127,6 +130,7 @@ void control_process_init(void)
 	cp_spinup_init();
 	cp_aligning_init();
 	cp_spinning_init();
+	cp_catching_init();
 	cp_error_init();
 }
 
@@ -141,6 +145,7 @@ void control_process_reset(void)
 	cp_spinup_reset();
 	cp_aligning_reset();
 	cp_spinning_reset();
+	cp_catching_reset();
 	cp_error_reset();
 
 	control_process.state = cps_idle;
@@ -176,6 +181,14 @@ void control_process_kill(void)
 	control_process.state = cps_idle;
 }
 
+/**
+ * Get the current state of the control process state machine.
+ */
+enum control_process_state control_process_get_state(void)
+{
+	return control_process.state;
+}
+
 /**
  * Main periodic control process body.
  *
@@ -219,6 +232,9 @@ void run_control_process(void)
 	control_process_handle_cb_state(cb_ret);
 
 	if (last_state != control_process.state) {
+		trace_log(trace_ev_cp_state, (u8)control_process.state,
+			  (u16)last_state);
+
 		// Callback changed state of control process, so
 		// if set, we call the last state's state_out_callback ...
 		if (control_process_cb_hook_register[last_state].
@@ -256,6 +272,9 @@ void control_process_handle_cb_state(enum control_process_cb_state cb_ret)
 	// Could also be implemented in error handling strategy:
 	if (cb_ret == cps_cb_exit_control) {
 		// Callback wants process to exit closed loop
+		trace_log(trace_ev_cp_exit, (u8)control_process.state,
+			  (u16)control_process.bemf_lost_crossing_counter);
+		trace_freeze();
 		control_process_kill();
 	} else if (cb_ret == cps_cb_resume_control) {
 		// Callback wants us to enter closed loop
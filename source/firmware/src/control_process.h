@@ -37,6 +37,7 @@ enum control_process_state {
 	cps_aligning,
 	cps_spinup,
 	cps_spinning,
+	cps_catching,
 	cps_num_states,
 };
 
@@ -79,6 +80,7 @@ void control_process_init(void);
 /*@unused@*/ void control_process_reset(void);
 void control_process_ignite(void);
 void control_process_kill(void);
+enum control_process_state control_process_get_state(void);
 void run_control_process(void);
 void control_process_register_cb(enum control_process_state cp_state,
 				 bool * trigger,
@@ -0,0 +1,299 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   cp_catching.c
+ *
+ * @brief  Control process strategy catching a spinning rotor
+ *
+ * Before the regular start the motor is listened to with all outputs off.
+ * A rotor that is still turning, like a windmilling propeller, makes the
+ * BEMF comparators report the zero crossings of all three phases. Every
+ * crossing lies in the middle of one commutation step, the order of the
+ * crossings gives the direction and the time between them the speed.
+ *
+ * Once CP__CATCH_CROSSINGS crossings in a row follow each other in the
+ * driving direction at a steady rate, the commutation timer is set to the
+ * measured speed, the step after the one of the last crossing is preloaded
+ * and the control process goes to closed loop right away, without aligning
+ * and spinning up. The PWM power is taken from the feed forward of the
+ * speed control, so that the drive voltage roughly matches the BEMF and the
+ * takeover neither brakes nor kicks the rotor.
+ *
+ * If CP__CATCH_TIME sys ticks pass without the rotor moving on in the
+ * driving direction, because it stands still, turns backwards or too
+ * slowly for the closed loop, the motor is started through the aligning
+ * and spinup states as before.
+ */
+
+#include "config.h"
+
+#include "cp_catching.h"
+#include "control_process.h"
+
+#include "types.h"
+#include "comm_tim.h"
+#include "pwm/pwm.h"
+#include "pwm/pwm_steps.h"
+#include "comm_process.h"
+#include "speed_ctrl.h"
+#include "driver/sys_tick.h"
+#include "driver/bemf_hardware_detect.h"
+#include "driver/led.h"
+
+/**
+ * Trigger variable of the catching state, set every sys tick.
+ */
+static bool cp_catching_trigger;
+
+/**
+ * Trigger source for catching state.
+ */
+static bool *control_process_catching_trigger = &cp_catching_trigger;
+
+/**
+ * Six step scheme step the floating phase crosses zero in, for each BEMF
+ * crossing source, see the BEMF table in pwm_scheme_6step_pwm_on.c
+ */
+static const s8 cp_catching_steps[] = {
+	-1,	/* bemf_hd_phase_none */
+	5,	/* bemf_hd_phase_u_rising */
+	2,	/* bemf_hd_phase_u_falling */
+	3,	/* bemf_hd_phase_v_rising */
+	0,	/* bemf_hd_phase_v_falling */
+	1,	/* bemf_hd_phase_w_rising */
+	4,	/* bemf_hd_phase_w_falling */
+};
+
+/**
+ * Internal process variables for catching callback.
+ */
+struct catching_process {
+	int timer;		/**< Soft timer id of the trigger */
+	u32 since;		/**< Sys tick time of the entry or the last crossing in driving direction */
+	u32 time;		/**< Time of the last crossing */
+	u32 period;		/**< Time between the last two crossings */
+	s8 step;		/**< Step of the last crossing, -1 if none */
+	u8 count;		/**< Crossings in a row in driving direction */
+};
+static struct catching_process catching_process;
+
+/*============================================================================
+ * Private functions forward declarations
+ *============================================================================*/
+static enum control_process_cb_state
+control_process_catching_cb(struct control_process *cps);
+
+static enum control_process_cb_state
+control_process_catching_state_in_cb(struct control_process *cps);
+
+static enum control_process_cb_state
+control_process_catching_state_out_cb(struct control_process *cps);
+
+static void control_process_catching_timer_callback(int id);
+
+/*============================================================================
+ * Function implementations
+ *============================================================================*/
+
+/**
+ * Initialization of the catching callback process.
+ * Calls cp_catching_reset and registers control_process_catching_cb
+ * as handler for control process state cps_catching.
+ */
+void cp_catching_init(void)
+{
+	cp_catching_reset();
+	control_process_register_cb(cps_catching,
+				    control_process_catching_trigger,
+				    control_process_catching_cb,
+				    control_process_catching_state_in_cb,
+				    control_process_catching_state_out_cb);
+}
+
+/**
+ * Reset function for the catching callback process.
+ * Forgets the crossings seen so far.
+ */
+void cp_catching_reset(void)
+{
+	catching_process.since = sys_tick_get_timer();
+	catching_process.time = comm_tim_data.curr_time;
+	catching_process.period = 0;
+	catching_process.step = -1;
+	catching_process.count = 0;
+}
+
+/**
+ * Check if a crossing continues the sequence of the last ones.
+ *
+ * @param step Step of the crossing
+ * @param period Time since the last crossing
+ * @return true if the crossing is the next one in driving direction and
+ * came at about the rate of the last one
+ */
+static bool cp_catching_follows(s8 step, u32 period)
+{
+	if ((catching_process.step < 0) ||
+	    (step != ((catching_process.step + 1) % 6)))
+		return false;
+
+	if (period > CP__CATCH_MAX_PERIOD)
+		return false;
+
+	/* The first pair sets the rate */
+	if (catching_process.count == 0)
+		return true;
+
+	return ((period * 2) > catching_process.period) &&
+		(period < (catching_process.period * 2));
+}
+
+/**
+ * Take over the spinning rotor at the last crossing.
+ *
+ * Commutates to the next step half a crossing period after the crossing,
+ * less the advance, twelve step schemes commutate twice as often.
+ */
+static void cp_catching_take_over(void)
+{
+	const struct pwm_step_scheme *scheme = pwm_scheme;
+	u32 rpm = speed_ctrl_rpm((60UL * COMM_TIM_CLOCK) /
+				 (6 * SPEED__POLE_PAIRS),
+				 catching_process.period);
+	s32 power = (s32)((SPEED__KFF * rpm) >> SPEED_CTRL_FRAC_BITS);
+	u8 next = (u8)((catching_process.step + 1) % 6);
+	s32 freq;
+
+	if (power < SPEED__MIN_POWER)
+		power = SPEED__MIN_POWER;
+	if (power > SPEED__MAX_POWER)
+		power = SPEED__MAX_POWER;
+	PWM_SET(power);
+
+	/* The comm process already looked up the advance for this period */
+	freq = (((s32)catching_process.period + comm_data.spark_advance) * 3) /
+		scheme->steps;
+	if (freq < 1)
+		freq = 1;
+
+	comm_tim_data.freq = (u32)freq;
+	comm_tim_data.last_capture_time = catching_process.time;
+	comm_tim_update_freq();
+
+	pwm_steps_load(scheme, (u8)((next * scheme->steps) / 6));
+	comm_tim_trigger_comm = true;
+}
+
+/**
+ * Callback function to be hooked as handler for state
+ * cps_catching in control_process.c.
+ *
+ * Follows the BEMF crossings of the unpowered motor and takes over the
+ * rotor once it spins steadily in driving direction. Sets the transition
+ * to control process state cps_aligning if that does not happen in time,
+ * or right away if no soft timer was left to trigger the state.
+ */
+static enum control_process_cb_state
+control_process_catching_cb(struct control_process *cps)
+{
+	u32 time = comm_tim_data.curr_time;
+	u32 period = time - catching_process.time;
+	s8 step;
+
+	if (catching_process.timer < 0) {
+		cps->state = cps_aligning;
+		return cps_cb_continue;
+	}
+
+	if (period == 0) {
+		if (sys_tick_check_timer(catching_process.since,
+					 CP__CATCH_TIME))
+			cps->state = cps_aligning;
+		return cps_cb_continue;
+	}
+
+	step = cp_catching_steps[bemf_hd_data.source];
+
+	if (cp_catching_follows(step, period)) {
+		catching_process.count++;
+		catching_process.since = sys_tick_get_timer();
+	} else {
+		catching_process.count = 0;
+	}
+
+	catching_process.time = time;
+	catching_process.period = period;
+	catching_process.step = step;
+
+	if (catching_process.count < CP__CATCH_CROSSINGS)
+		return cps_cb_continue;
+
+	cp_catching_take_over();
+	cps->state = cps_spinning;
+	return cps_cb_resume_control;
+}
+
+/**
+ * Callback function called before entering control
+ * process state cps_catching.
+ */
+static enum control_process_cb_state
+control_process_catching_state_in_cb(struct control_process *cps)
+{
+	cps = cps;
+
+	pwm_off();
+	cp_catching_reset();
+
+	catching_process.timer =
+	    sys_tick_timer_register(control_process_catching_timer_callback,
+				    0);
+
+	/* Without a timer, run the state once to hand over to aligning */
+	if (catching_process.timer < 0)
+		cp_catching_trigger = true;
+
+	return cps_cb_continue;
+}
+
+/**
+ * Callback function called after leaving control
+ * process state cps_catching, before entering the
+ * next control process state.
+ */
+static enum control_process_cb_state
+control_process_catching_state_out_cb(struct control_process *cps)
+{
+	cps = cps;
+
+	if (catching_process.timer >= 0)
+		sys_tick_timer_unregister(catching_process.timer);
+
+	return cps_cb_continue;
+}
+
+/**
+ * Sys tick soft timer callback function triggering the catching state.
+ */
+static void control_process_catching_timer_callback(int id)
+{
+	id = id;
+
+	cp_catching_trigger = true;
+}
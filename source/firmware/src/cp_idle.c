@@ -26,6 +26,8 @@
  * Default control process implementation for idle state.
  */
 
+#include "config.h"
+
 #include "cp_idle.h"
 #include "control_process.h"
 
@@ -45,7 +47,8 @@ static bool *control_process_idle_trigger = &comm_tim_trigger;
  * cps_idle in control_process.c.
  *
  * Watches control_process.ignite and induces transition
- * to control process state cps_aligning if set.
+ * to control process state cps_catching if set, or to cps_aligning
+ * without CP__CATCH_ENABLE.
  */
 static enum control_process_cb_state
 control_process_idle_cb(struct control_process *cps)
@@ -53,7 +56,11 @@ control_process_idle_cb(struct control_process *cps)
 	if (cps->ignite) {
 		TOGGLE(LED_RED);
 		cps->ignite = false;
+#ifdef CP__CATCH_ENABLE
+		cps->state = cps_catching;
+#else
 		cps->state = cps_aligning;
+#endif
 	}
 	return cps_cb_continue;
 }
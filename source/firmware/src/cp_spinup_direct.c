@@ -0,0 +1,126 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   cp_spinup_direct.c
+ *
+ * @brief  Direct spin up strategy
+ *
+ * Spin up strategy for commutation processes that know the rotor position
+ * at standstill, like the Hall sensor one. Goes to closed loop as soon as
+ * the commutation process is ready instead of running an open loop ramp.
+ * Aligning is not needed either and can be disabled with CP ALIGN_ENABLE.
+ */
+
+#include <string.h>
+
+#include "config.h"
+
+#include "cp_spinup.h"
+#include "control_process.h"
+#include "cp_spinning.h"
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "pwm/pwm.h"
+#include "driver/led.h"
+#include "comm_tim.h"
+
+/**
+ * Trigger source for spinup state.
+ */
+static bool *control_process_spinup_trigger = &comm_tim_trigger;
+
+/**
+ * Internal process variables for spinup callback.
+ */
+struct spinup_process {
+	u32 timeout;  /**< Commutation timer ticks left to get ready */
+};
+static struct spinup_process spinup_process;
+
+static enum control_process_cb_state
+control_process_spinup_cb(struct control_process *cps);
+
+static enum control_process_cb_state
+control_process_spinup_state_in_cb(/*@unused@*/ struct control_process *cps);
+
+/**
+ * Initialization of the spinup callback process.
+ */
+void cp_spinup_init(void)
+{
+	cp_spinup_reset();
+	control_process_register_cb(cps_spinup,
+				    control_process_spinup_trigger,
+				    control_process_spinup_cb,
+				    control_process_spinup_state_in_cb,
+				    NULL);
+}
+
+/**
+ * Reset function for the spinup callback process.
+ */
+void cp_spinup_reset(void)
+{
+	spinup_process.timeout = CP__SD_TIMEOUT;
+	PWM_SET(CP__SST_POWER);
+}
+
+/**
+ * Callback function to be hooked as handler for state
+ * cps_spinup in control_process.c.
+ *
+ * Hands over to the spinning state once the commutation process is ready,
+ * gives up if it does not get ready in time.
+ */
+enum control_process_cb_state
+control_process_spinup_cb(struct control_process *cps)
+{
+	if (cp_spinning_ready()) {
+		cps->state = cps_spinning;
+		return cps_cb_resume_control;
+	}
+
+	if (spinup_process.timeout == 0) {
+		DEBUG("Commutation process never got ready\n");
+		return cps_cb_exit_control;
+	}
+
+	spinup_process.timeout--;
+
+	return cps_cb_continue;
+}
+
+/**
+ * Callback function called before entering control
+ * process state cps_spinup.
+ */
+enum control_process_cb_state
+control_process_spinup_state_in_cb(struct control_process *cps)
+{
+	cps = cps;
+
+	OFF(LED_GREEN);
+	cp_spinup_reset();
+
+	return cps_cb_continue;
+}
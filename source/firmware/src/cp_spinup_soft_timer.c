@@ -39,6 +39,10 @@
 #include "cp_spinning.h"
 
 #include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
 #include "pwm/pwm.h"
 #include "driver/led.h"
 #include "driver/sys_tick.h"
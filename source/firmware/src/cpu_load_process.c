@@ -42,12 +42,7 @@
 #include "gprot.h"
 #include "driver/sys_tick.h"
 #include "driver/led.h"
-
-/**
- * Infinite Impulse Response filter calculation
- */
-#define CLP__IIR(VALUE, NEW_VALUE, IIR) \
-	(((VALUE * IIR) + (NEW_VALUE)) / (IIR + 1))
+#include "filter.h"
 
 /**
  * Internal state of the cpu load process.
@@ -58,6 +53,7 @@ struct cpu_load_process_state {
 	u32 max_cycles;
 	u32 min_cycles;
 	u32 report_counter;
+	struct filter_iir mean_filter;
 };
 
 static struct cpu_load_process_state cpu_load_process_state; /**< Internal state instance */
@@ -87,6 +83,7 @@ void cpu_load_process_reset()
 	cpu_load_process_state.max_cycles = 0;
 	cpu_load_process_state.min_cycles = -1;
 	cpu_load_process_state.report_counter = CLP__REPORT_DIVIDER;
+	filter_iir_init(&cpu_load_process_state.mean_filter, CLP__IIR_SHIFT, 0);
 }
 
 /**
@@ -111,11 +108,13 @@ void cpu_load_process_soft_timer_callback(int id)
 		cpu_load_process_state.min_cycles = cpu_load_process_state.cycles;
 
 	if(cpu_load_process_state.mean_cycles == 0){
+		filter_iir_set(&cpu_load_process_state.mean_filter,
+			cpu_load_process_state.cycles);
 		cpu_load_process_state.mean_cycles = cpu_load_process_state.cycles;
 	} else {
-		cpu_load_process_state.mean_cycles = CLP__IIR(cpu_load_process_state.mean_cycles,
-							cpu_load_process_state.cycles,
-							CLP__IIR_VALUE);
+		cpu_load_process_state.mean_cycles =
+			filter_iir_update(&cpu_load_process_state.mean_filter,
+					cpu_load_process_state.cycles);
 	}
 	cpu_load_process_state.cycles = 0;
 
@@ -0,0 +1,108 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   current_ctrl.c
+ *
+ * @brief  Fixed point PI current controller.
+ *
+ * Hardware independent part of the torque control process (see
+ * torque_process.c).
+ */
+
+#include "types.h"
+
+#include "current_ctrl.h"
+
+static s32 current_ctrl_clamp(s32 val, s32 min, s32 max)
+{
+	if (val > max)
+		return max;
+	if (val < min)
+		return min;
+	return val;
+}
+
+/**
+ * Initialize the current controller.
+ *
+ * @param cc Current controller state
+ * @param kp Proportional gain
+ * @param ki Integral gain
+ * @param limit Current limit
+ * @param slew Largest rise of the current reference per update
+ */
+void current_ctrl_init(struct current_ctrl *cc, s32 kp, s32 ki, s16 limit,
+		       s16 slew)
+{
+	cc->kp = kp;
+	cc->ki = ki;
+	cc->limit = limit;
+	cc->slew = slew;
+
+	current_ctrl_reset(cc, 0, 0);
+}
+
+/**
+ * Preset the controller for a bumpless takeover.
+ *
+ * The current reference slews up from ref and the integrator starts at the
+ * duty in use.
+ *
+ * @param cc Current controller state
+ * @param ref Current reference to start from
+ * @param duty Duty cycle in use [timer counts]
+ */
+void current_ctrl_reset(struct current_ctrl *cc, s16 ref, u16 duty)
+{
+	cc->ref = (s16)current_ctrl_clamp(ref, 0, cc->limit);
+	cc->integral = (s32)duty << CURRENT_CTRL_FRAC_BITS;
+}
+
+/**
+ * Run one current controller step.
+ *
+ * @param cc Current controller state
+ * @param target Current to regulate to, capped at the current limit
+ * @param current Measured current
+ * @param max Largest duty cycle to output [timer counts]
+ * @return New duty cycle [timer counts]
+ */
+u16 current_ctrl_update(struct current_ctrl *cc, s16 target, s16 current,
+			u16 max)
+{
+	s32 top = (s32)max << CURRENT_CTRL_FRAC_BITS;
+	s32 error;
+	s32 out;
+
+	target = (s16)current_ctrl_clamp(target, 0, cc->limit);
+
+	if (target > cc->ref + cc->slew)
+		cc->ref += cc->slew;
+	else
+		cc->ref = target;
+
+	error = current_ctrl_clamp((s32)cc->ref - current, -32768, 32767);
+
+	cc->integral = current_ctrl_clamp(cc->integral + cc->ki * error,
+					  0, top);
+
+	out = current_ctrl_clamp(cc->kp * error + cc->integral, 0, top);
+
+	return (u16)(out >> CURRENT_CTRL_FRAC_BITS);
+}
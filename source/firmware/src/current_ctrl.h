@@ -0,0 +1,57 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURRENT_CTRL_H
+#define __CURRENT_CTRL_H
+
+#include "types.h"
+
+/**
+ * Number of fractional bits of the current controller gains.
+ */
+#define CURRENT_CTRL_FRAC_BITS 12
+
+/**
+ * Fixed point PI current controller.
+ *
+ * Runs once per PWM period on the bus current sampled in the on time and
+ * outputs a duty cycle in timer counts. The current reference follows the
+ * target with a limited slew rate when rising and is cut to the current
+ * limit at once. The integrator is clamped to the output range, so when
+ * the output is capped by the duty commanded from outside, the controller
+ * only takes the duty back once the current reaches the limit.
+ *
+ * All gains have to be below 2^15, currents are ADC counts relative to the
+ * zero current offset.
+ */
+struct current_ctrl {
+	s32 kp;			/**< Proportional gain, duty counts per current count in Q(CURRENT_CTRL_FRAC_BITS) */
+	s32 ki;			/**< Integral gain per PWM period in Q(CURRENT_CTRL_FRAC_BITS) */
+	s16 limit;		/**< Current limit */
+	s16 slew;		/**< Largest rise of the current reference per PWM period */
+	s16 ref;		/**< Current reference */
+	s32 integral;		/**< Integrator with CURRENT_CTRL_FRAC_BITS fractional bits */
+};
+
+void current_ctrl_init(struct current_ctrl *cc, s32 kp, s32 ki, s16 limit,
+		       s16 slew);
+void current_ctrl_reset(struct current_ctrl *cc, s16 ref, u16 duty);
+u16 current_ctrl_update(struct current_ctrl *cc, s16 target, s16 current,
+			u16 max);
+
+#endif /* __CURRENT_CTRL_H */
@@ -0,0 +1,222 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   filter.c
+ *
+ * @brief  Fixed point smoothing filters.
+ *
+ * None of the filters divide per sample. The single pole IIR filter used by
+ * the sensor, cpu load and commutation processes is implemented inline in
+ * @ref filter.h, the biquad and the moving average filters and the alpha
+ * beta tracker are implemented here.
+ */
+
+#include "types.h"
+
+#include "filter.h"
+
+/**
+ * Initialize a biquad filter and reset its state to zero.
+ *
+ * @param f Filter state
+ * @param b0 Feed forward coefficient 0
+ * @param b1 Feed forward coefficient 1
+ * @param b2 Feed forward coefficient 2
+ * @param a1 Feedback coefficient 1
+ * @param a2 Feedback coefficient 2
+ */
+void filter_biquad_init(struct filter_biquad *f, s32 b0, s32 b1, s32 b2,
+			s32 a1, s32 a2)
+{
+	f->b0 = b0;
+	f->b1 = b1;
+	f->b2 = b2;
+	f->a1 = a1;
+	f->a2 = a2;
+
+	filter_biquad_reset(f, 0);
+}
+
+/**
+ * Reset the biquad filter history as if it had settled on value.
+ *
+ * Assumes unity DC gain of the filter.
+ *
+ * @param f Filter state
+ * @param value Settled input and output value
+ */
+void filter_biquad_reset(struct filter_biquad *f, s32 value)
+{
+	f->x1 = value;
+	f->x2 = value;
+	f->y1 = value;
+	f->y2 = value;
+	f->err = 0;
+}
+
+/**
+ * Feed one sample into the biquad filter.
+ *
+ * The fraction dropped when scaling the accumulator back to sample precision
+ * is fed back into the next sample so that the output does not get stuck
+ * above or below the settled value.
+ *
+ * @param f Filter state
+ * @param value New sample
+ * @return New filter output
+ */
+s32 filter_biquad_update(struct filter_biquad *f, s32 value)
+{
+	s64 acc;
+	s32 out;
+
+	acc = (s64)f->b0 * value +
+		(s64)f->b1 * f->x1 +
+		(s64)f->b2 * f->x2 -
+		(s64)f->a1 * f->y1 -
+		(s64)f->a2 * f->y2 +
+		f->err;
+
+	out = (s32)(acc >> FILTER_BIQUAD_FRAC_BITS);
+	f->err = (s32)(acc - ((s64)out << FILTER_BIQUAD_FRAC_BITS));
+
+	f->x2 = f->x1;
+	f->x1 = value;
+	f->y2 = f->y1;
+	f->y1 = out;
+
+	return out;
+}
+
+/**
+ * Initialize a moving average filter with the window filled with value.
+ *
+ * @param f Filter state
+ * @param shift Window size as power of two, clamped to
+ * @ref FILTER_MA_MAX_SHIFT
+ * @param value Initial window content
+ */
+void filter_ma_init(struct filter_ma *f, u16 shift, s32 value)
+{
+	int i;
+
+	if (shift > FILTER_MA_MAX_SHIFT)
+		shift = FILTER_MA_MAX_SHIFT;
+
+	f->shift = shift;
+	f->pos = 0;
+	for (i = 0; i < (1 << shift); i++)
+		f->samples[i] = value;
+	f->sum = value * (1 << shift);
+}
+
+/**
+ * Feed one sample into the moving average filter.
+ *
+ * @param f Filter state
+ * @param value New sample
+ * @return Mean of the last 2^shift samples
+ */
+s32 filter_ma_update(struct filter_ma *f, s32 value)
+{
+	f->sum += value - f->samples[f->pos];
+	f->samples[f->pos] = value;
+	f->pos = (f->pos + 1) & ((1 << f->shift) - 1);
+
+	return f->sum >> f->shift;
+}
+
+/**
+ * Initialize an alpha beta tracker on a constant sequence.
+ *
+ * @param f Tracker state
+ * @param alpha_shift Position gain shift
+ * @param beta_shift Rate gain shift, larger than alpha_shift for a stable
+ * tracker
+ * @param value Initial prediction
+ */
+void filter_ab_init(struct filter_ab *f, u16 alpha_shift, u16 beta_shift,
+		    s32 value)
+{
+	f->alpha_shift = alpha_shift;
+	f->beta_shift = beta_shift;
+
+	filter_ab_set(f, value);
+}
+
+/**
+ * Preset the alpha beta tracker prediction and clear the rate.
+ *
+ * @param f Tracker state
+ * @param value New prediction
+ */
+void filter_ab_set(struct filter_ab *f, s32 value)
+{
+	f->pred = filter_clamp(value, FILTER_AB_MAX_INPUT) *
+		(1 << FILTER_AB_FRAC_BITS);
+	f->rate = 0;
+}
+
+/**
+ * Saturate an alpha beta tracker state value to the scaled input range.
+ */
+static s32 filter_ab_sat(s64 value)
+{
+	const s32 max = FILTER_AB_MAX_INPUT * (1 << FILTER_AB_FRAC_BITS);
+
+	if (value > max)
+		return max;
+	if (value < -max)
+		return -max;
+
+	return (s32)value;
+}
+
+/**
+ * Current alpha beta tracker prediction rounded to sample precision.
+ *
+ * @param f Tracker state
+ */
+s32 filter_ab_output(const struct filter_ab *f)
+{
+	return (f->pred + (1 << (FILTER_AB_FRAC_BITS - 1))) >>
+		FILTER_AB_FRAC_BITS;
+}
+
+/**
+ * Feed one sample into the alpha beta tracker.
+ *
+ * Samples are clamped to @ref FILTER_AB_MAX_INPUT, the state is updated in
+ * 64 bit and saturated so that no input sequence can overflow it.
+ *
+ * @param f Tracker state
+ * @param value New sample
+ * @return Prediction of the next sample rounded to sample precision
+ */
+s32 filter_ab_update(struct filter_ab *f, s32 value)
+{
+	s64 r = ((s64)filter_clamp(value, FILTER_AB_MAX_INPUT) *
+		 (1 << FILTER_AB_FRAC_BITS)) - f->pred;
+
+	f->rate = filter_ab_sat(f->rate + (r >> f->beta_shift));
+	f->pred = filter_ab_sat((s64)f->pred + (r >> f->alpha_shift) +
+				f->rate);
+
+	return filter_ab_output(f);
+}
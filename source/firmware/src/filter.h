@@ -0,0 +1,219 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include "types.h"
+
+/**
+ * Number of fractional bits the single pole IIR filter state carries on top
+ * of the sample precision. Limits the input range to +-2^(31 - FRAC_BITS).
+ */
+#define FILTER_IIR_FRAC_BITS 8
+
+/**
+ * Largest single pole IIR filter input, larger inputs are clamped to it.
+ */
+#define FILTER_IIR_MAX_INPUT ((1 << (31 - FILTER_IIR_FRAC_BITS)) - 1)
+
+/**
+ * Largest usable pole shift of the single pole IIR filter.
+ */
+#define FILTER_IIR_MAX_SHIFT 15
+
+/**
+ * Number of fractional bits of the biquad coefficients.
+ */
+#define FILTER_BIQUAD_FRAC_BITS 14
+
+/**
+ * Largest moving average window as power of two.
+ */
+#define FILTER_MA_MAX_SHIFT 4
+
+/**
+ * Number of fractional bits of the alpha beta tracker state. Limits the
+ * input range to +-2^(30 - FRAC_BITS).
+ */
+#define FILTER_AB_FRAC_BITS 8
+
+/**
+ * Largest alpha beta tracker input, larger inputs are clamped to it and the
+ * state saturates at the same range.
+ */
+#define FILTER_AB_MAX_INPUT ((1 << (30 - FILTER_AB_FRAC_BITS)) - 1)
+
+/**
+ * Single pole IIR low pass filter state.
+ *
+ * y[n] = y[n-1] + (x[n] - y[n-1]) / 2^shift
+ *
+ * This is the same filter as the (y * iir + x) / (iir + 1) form with
+ * iir = 2^shift - 1, without the division and without the truncation of the
+ * state to sample precision.
+ */
+struct filter_iir {
+	s32 acc;		/**< Filter state with FILTER_IIR_FRAC_BITS fractional bits */
+	u16 shift;		/**< Pole shift, alpha = 2^-shift */
+};
+
+/**
+ * Second order IIR filter (direct form I) state.
+ *
+ * Coefficients are in Q(FILTER_BIQUAD_FRAC_BITS), a1 and a2 are given with
+ * the sign they have in the transfer function denominator
+ * 1 + a1 z^-1 + a2 z^-2.
+ */
+struct filter_biquad {
+	s32 b0;			/**< Feed forward coefficient 0 */
+	s32 b1;			/**< Feed forward coefficient 1 */
+	s32 b2;			/**< Feed forward coefficient 2 */
+	s32 a1;			/**< Feedback coefficient 1 */
+	s32 a2;			/**< Feedback coefficient 2 */
+	s32 x1;			/**< Previous input */
+	s32 x2;			/**< Input before the previous input */
+	s32 y1;			/**< Previous output */
+	s32 y2;			/**< Output before the previous output */
+	s32 err;		/**< Quantization error feedback */
+};
+
+/**
+ * Moving average filter over a power of two window.
+ */
+struct filter_ma {
+	s32 samples[1 << FILTER_MA_MAX_SHIFT];	/**< Sample window */
+	s32 sum;				/**< Sum of the window */
+	u16 pos;				/**< Next sample slot */
+	u16 shift;				/**< Window size as power of two */
+};
+
+/**
+ * Alpha beta tracker state.
+ *
+ * Tracks a sample sequence together with its change per sample and predicts
+ * the next sample:
+ *
+ * r = x[n] - p[n]
+ * d[n] = d[n-1] + r / 2^beta_shift
+ * p[n+1] = p[n] + r / 2^alpha_shift + d[n]
+ *
+ * Follows a steady ramp without lag where a low pass filter falls behind.
+ */
+struct filter_ab {
+	s32 pred;		/**< Predicted next sample, FILTER_AB_FRAC_BITS fractional bits */
+	s32 rate;		/**< Change per sample, FILTER_AB_FRAC_BITS fractional bits */
+	u16 alpha_shift;	/**< Position gain shift, alpha = 2^-alpha_shift */
+	u16 beta_shift;		/**< Rate gain shift, beta = 2^-beta_shift */
+};
+
+/**
+ * Clamp a filter input to +-max.
+ *
+ * @param value Filter input
+ * @param max Largest input magnitude
+ */
+static inline s32 filter_clamp(s32 value, s32 max)
+{
+	if (value > max)
+		return max;
+	if (value < -max)
+		return -max;
+
+	return value;
+}
+
+/**
+ * Initialize a single pole IIR filter.
+ *
+ * @param f Filter state
+ * @param shift Pole shift
+ * @param value Initial output value
+ */
+static inline void filter_iir_init(struct filter_iir *f, u16 shift, s32 value)
+{
+	f->shift = shift;
+	f->acc = filter_clamp(value, FILTER_IIR_MAX_INPUT) *
+		(1 << FILTER_IIR_FRAC_BITS);
+}
+
+/**
+ * Preset the single pole IIR filter output.
+ *
+ * @param f Filter state
+ * @param value New output value
+ */
+static inline void filter_iir_set(struct filter_iir *f, s32 value)
+{
+	f->acc = filter_clamp(value, FILTER_IIR_MAX_INPUT) *
+		(1 << FILTER_IIR_FRAC_BITS);
+}
+
+/**
+ * Current single pole IIR filter output rounded to sample precision.
+ *
+ * @param f Filter state
+ */
+static inline s32 filter_iir_output(const struct filter_iir *f)
+{
+	return (f->acc + (1 << (FILTER_IIR_FRAC_BITS - 1))) >>
+		FILTER_IIR_FRAC_BITS;
+}
+
+/**
+ * Feed one sample into the single pole IIR filter.
+ *
+ * One subtraction, two shifts and one addition. Pole shifts above
+ * @ref FILTER_IIR_MAX_SHIFT are clamped as the pole shift is usually exposed
+ * as a governor register. The difference of sample and state can take 33
+ * bits and is taken in 64 bit, the new state lies between the old one and
+ * the sample and always fits.
+ *
+ * @param f Filter state
+ * @param value New sample
+ * @return New filter output rounded to sample precision
+ */
+static inline s32 filter_iir_update(struct filter_iir *f, s32 value)
+{
+	u16 shift = f->shift;
+
+	if (shift > FILTER_IIR_MAX_SHIFT)
+		shift = FILTER_IIR_MAX_SHIFT;
+
+	value = filter_clamp(value, FILTER_IIR_MAX_INPUT);
+	f->acc += (s32)((((s64)value * (1 << FILTER_IIR_FRAC_BITS)) - f->acc) >>
+			shift);
+
+	return filter_iir_output(f);
+}
+
+void filter_biquad_init(struct filter_biquad *f, s32 b0, s32 b1, s32 b2,
+			s32 a1, s32 a2);
+void filter_biquad_reset(struct filter_biquad *f, s32 value);
+s32 filter_biquad_update(struct filter_biquad *f, s32 value);
+
+void filter_ma_init(struct filter_ma *f, u16 shift, s32 value);
+s32 filter_ma_update(struct filter_ma *f, s32 value);
+
+void filter_ab_init(struct filter_ab *f, u16 alpha_shift, u16 beta_shift,
+		    s32 value);
+void filter_ab_set(struct filter_ab *f, s32 value);
+s32 filter_ab_output(const struct filter_ab *f);
+s32 filter_ab_update(struct filter_ab *f, s32 value);
+
+#endif /* __FILTER_H */
@@ -0,0 +1,402 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   foc.c
+ *
+ * @brief  Field oriented current control engine.
+ *
+ * One call of foc_update() per PWM cycle transforms two measured phase
+ * currents into the rotor (d, q) frame, runs one PI controller per axis and
+ * turns the resulting voltage vector into the compare values of the three
+ * TIM1 phase channels using space vector modulation (min/max zero sequence
+ * injection). Everything is 16 bit fixed point with 32 bit intermediates,
+ * the only per cycle loop is the integer square root of the voltage limit,
+ * there are no divisions.
+ */
+
+#include "types.h"
+
+#include "foc.h"
+
+/**
+ * 1/sqrt(3) in Q15
+ */
+#define FOC_INV_SQRT3 18919
+
+/**
+ * sqrt(3)/2 in Q15
+ */
+#define FOC_SQRT3_2 28378
+
+/**
+ * Number of angle bits interpolated between two sine table entries.
+ */
+#define FOC_SIN_INTERP_BITS 6
+
+/**
+ * Quarter wave sine table, sin(i * pi / 512) in Q15.
+ */
+static const s16 foc_sin_table[257] = {
+	    0,   201,   402,   603,   804,  1005,  1206,  1407,
+	 1608,  1809,  2009,  2210,  2410,  2611,  2811,  3012,
+	 3212,  3412,  3612,  3811,  4011,  4210,  4410,  4609,
+	 4808,  5007,  5205,  5404,  5602,  5800,  5998,  6195,
+	 6393,  6590,  6786,  6983,  7179,  7375,  7571,  7767,
+	 7962,  8157,  8351,  8545,  8739,  8933,  9126,  9319,
+	 9512,  9704,  9896, 10087, 10278, 10469, 10659, 10849,
+	11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+	12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+	14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+	15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673,
+	16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+	18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357,
+	19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+	20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+	22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+	23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143,
+	24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+	25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198,
+	26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+	27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+	28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+	28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534,
+	29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+	30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783,
+	30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+	31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+	31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+	32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382,
+	32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+	32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717,
+	32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+	32767
+};
+
+/**
+ * Saturate a 32 bit intermediate to the 16 bit range.
+ */
+static inline s16 foc_sat16(s32 x)
+{
+	if (x > 32767)
+		return 32767;
+	if (x < -32768)
+		return -32768;
+	return (s16)x;
+}
+
+/**
+ * Integer square root.
+ */
+static u16 foc_isqrt(u32 x)
+{
+	u32 res = 0;
+	u32 bit = 1UL << 30;
+
+	while (bit > x)
+		bit >>= 2;
+
+	while (bit != 0) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (u16)res;
+}
+
+/**
+ * Sine of the first quarter wave.
+ *
+ * @param x Angle in the range 0 to FOC_ANGLE_90
+ */
+static s16 foc_sin_quarter(u16 x)
+{
+	u16 idx = x >> FOC_SIN_INTERP_BITS;
+	s32 frac = x & ((1 << FOC_SIN_INTERP_BITS) - 1);
+	s32 s = foc_sin_table[idx];
+
+	if (frac != 0)
+		s += ((foc_sin_table[idx + 1] - s) * frac +
+		      (1 << (FOC_SIN_INTERP_BITS - 1))) >> FOC_SIN_INTERP_BITS;
+
+	return (s16)s;
+}
+
+static s16 foc_sin(u16 angle)
+{
+	u16 x = angle & (FOC_ANGLE_90 - 1);
+
+	switch (angle >> 14) {
+	case 0:
+		return foc_sin_quarter(x);
+	case 1:
+		return foc_sin_quarter(FOC_ANGLE_90 - x);
+	case 2:
+		return -foc_sin_quarter(x);
+	default:
+		return -foc_sin_quarter(FOC_ANGLE_90 - x);
+	}
+}
+
+/**
+ * Initialize the current controller.
+ *
+ * @param foc Controller state
+ * @param kp Proportional gain of both current controllers in
+ * Q(FOC_PI_FRAC_BITS) of volts per current unit, below 2^15
+ * @param ki Integral gain per cycle, same unit and range as kp
+ * @param v_limit Voltage vector magnitude limit, clamped to FOC_V_MAX
+ * @param period PWM period in timer counts, below 2^15
+ */
+void foc_init(struct foc *foc, s32 kp, s32 ki, s16 v_limit, u16 period)
+{
+	foc->pi_d.kp = kp;
+	foc->pi_d.ki = ki;
+	foc->pi_q.kp = kp;
+	foc->pi_q.ki = ki;
+
+	if ((v_limit < 0) || (v_limit > FOC_V_MAX))
+		v_limit = FOC_V_MAX;
+	foc->v_limit = v_limit;
+	foc->period = period;
+
+	foc->i_ref.x = 0;
+	foc->i_ref.y = 0;
+
+	foc_reset(foc);
+}
+
+/**
+ * Reset the controller integrators and center all phases.
+ *
+ * Has to be called before the output stage is handed over to the controller
+ * again after it was driven by something else.
+ *
+ * @param foc Controller state
+ */
+void foc_reset(struct foc *foc)
+{
+	foc->pi_d.integral = 0;
+	foc->pi_q.integral = 0;
+	foc->i.x = 0;
+	foc->i.y = 0;
+	foc->v.x = 0;
+	foc->v.y = 0;
+	foc->duty[0] = foc->period / 2;
+	foc->duty[1] = foc->period / 2;
+	foc->duty[2] = foc->period / 2;
+}
+
+/**
+ * Sine and cosine of an electrical angle in Q15.
+ *
+ * Quarter wave table lookup with linear interpolation, the error stays
+ * within 1.5 LSB.
+ *
+ * @param angle Electrical angle, 2^16 is one revolution
+ * @param sin Sine output
+ * @param cos Cosine output
+ */
+void foc_sin_cos(u16 angle, s16 *sin, s16 *cos)
+{
+	*sin = foc_sin(angle);
+	*cos = foc_sin(angle + FOC_ANGLE_90);
+}
+
+/**
+ * Clarke transform, amplitude invariant.
+ *
+ * The third phase current is implied by the currents summing up to zero.
+ *
+ * @param a Phase A current
+ * @param b Phase B current
+ * @return Current in the stationary (alpha, beta) frame
+ */
+struct foc_vec foc_clarke(s16 a, s16 b)
+{
+	struct foc_vec ab;
+
+	ab.x = a;
+	ab.y = foc_sat16((((s32)a + 2 * (s32)b) * FOC_INV_SQRT3 +
+			  (1 << 14)) >> 15);
+
+	return ab;
+}
+
+/**
+ * Park transform.
+ *
+ * @param ab Vector in the stationary (alpha, beta) frame
+ * @param sin Sine of the rotor angle in Q15
+ * @param cos Cosine of the rotor angle in Q15
+ * @return Vector in the rotor (d, q) frame
+ */
+struct foc_vec foc_park(struct foc_vec ab, s16 sin, s16 cos)
+{
+	struct foc_vec dq;
+
+	dq.x = foc_sat16(((s32)ab.x * cos + (s32)ab.y * sin +
+			  (1 << 14)) >> 15);
+	dq.y = foc_sat16(((s32)ab.y * cos - (s32)ab.x * sin +
+			  (1 << 14)) >> 15);
+
+	return dq;
+}
+
+/**
+ * Inverse Park transform.
+ *
+ * @param dq Vector in the rotor (d, q) frame
+ * @param sin Sine of the rotor angle in Q15
+ * @param cos Cosine of the rotor angle in Q15
+ * @return Vector in the stationary (alpha, beta) frame
+ */
+struct foc_vec foc_inv_park(struct foc_vec dq, s16 sin, s16 cos)
+{
+	struct foc_vec ab;
+
+	ab.x = foc_sat16(((s32)dq.x * cos - (s32)dq.y * sin +
+			  (1 << 14)) >> 15);
+	ab.y = foc_sat16(((s32)dq.x * sin + (s32)dq.y * cos +
+			  (1 << 14)) >> 15);
+
+	return ab;
+}
+
+/**
+ * Run one PI controller step.
+ *
+ * @param pi Controller state
+ * @param error Reference minus measurement, saturated to 16 bit
+ * @param limit Output magnitude limit
+ * @return New controller output
+ */
+s16 foc_pi_update(struct foc_pi *pi, s32 error, s16 limit)
+{
+	s32 max = (s32)limit << FOC_PI_FRAC_BITS;
+	s32 out;
+
+	if (error > 32767)
+		error = 32767;
+	else if (error < -32768)
+		error = -32768;
+
+	pi->integral += pi->ki * error;
+	if (pi->integral > max)
+		pi->integral = max;
+	else if (pi->integral < -max)
+		pi->integral = -max;
+
+	out = pi->kp * error + pi->integral;
+	if (out > max)
+		out = max;
+	else if (out < -max)
+		out = -max;
+
+	return (s16)(out >> FOC_PI_FRAC_BITS);
+}
+
+/**
+ * Space vector modulation.
+ *
+ * Subtracts the mean of the largest and the smallest phase voltage from all
+ * phases, which yields the same switching pattern as the classic sector
+ * based space vector modulation and centers the phases in the PWM period.
+ * Vectors longer than FOC_V_MAX are clipped per phase.
+ *
+ * @param ab Voltage vector in the stationary frame, Q15 of the supply
+ * @param period PWM period in timer counts, below 2^15
+ * @param duty Phase A, B and C compare values output
+ */
+void foc_svpwm(struct foc_vec ab, u16 period, u16 duty[3])
+{
+	s32 beta = ((s32)ab.y * FOC_SQRT3_2) >> 15;
+	s32 half = -(s32)ab.x / 2;
+	s32 v[3];
+	s32 max;
+	s32 min;
+	s32 offset;
+	s32 d;
+	int x;
+
+	v[0] = ab.x;
+	v[1] = half + beta;
+	v[2] = half - beta;
+
+	max = v[0];
+	min = v[0];
+	for (x = 1; x < 3; x++) {
+		if (v[x] > max)
+			max = v[x];
+		if (v[x] < min)
+			min = v[x];
+	}
+	offset = (max + min) / 2;
+
+	for (x = 0; x < 3; x++) {
+		d = (period / 2) + (((v[x] - offset) * period) >> 15);
+		if (d < 0)
+			d = 0;
+		else if (d > period)
+			d = period;
+		duty[x] = (u16)d;
+	}
+}
+
+/**
+ * Run one current control cycle.
+ *
+ * Meant to be called once per PWM period right after the phase currents
+ * were sampled. The new compare values are left in foc->duty.
+ *
+ * The flux current controller gets priority, the torque current controller
+ * is limited to what is left of the voltage circle.
+ *
+ * @param foc Controller state
+ * @param i_a Phase A current
+ * @param i_b Phase B current
+ * @param angle Electrical angle of the rotor flux axis
+ */
+void foc_update(struct foc *foc, s16 i_a, s16 i_b, u16 angle)
+{
+	s16 sin;
+	s16 cos;
+	s32 v_d2;
+	s16 v_q_limit;
+
+	foc_sin_cos(angle, &sin, &cos);
+
+	foc->i = foc_park(foc_clarke(i_a, i_b), sin, cos);
+
+	foc->v.x = foc_pi_update(&foc->pi_d, (s32)foc->i_ref.x - foc->i.x,
+				 foc->v_limit);
+
+	v_d2 = (s32)foc->v.x * foc->v.x;
+	v_q_limit = (s16)foc_isqrt((u32)((s32)foc->v_limit * foc->v_limit -
+					 v_d2));
+
+	foc->v.y = foc_pi_update(&foc->pi_q, (s32)foc->i_ref.y - foc->i.y,
+				 v_q_limit);
+
+	foc_svpwm(foc_inv_park(foc->v, sin, cos), foc->period, foc->duty);
+}
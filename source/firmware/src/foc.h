@@ -0,0 +1,90 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FOC_H
+#define __FOC_H
+
+#include "types.h"
+
+/**
+ * Number of fractional bits of the PI controller gains.
+ */
+#define FOC_PI_FRAC_BITS 12
+
+/**
+ * Largest voltage vector magnitude space vector modulation can produce
+ * without distortion, Vbus / sqrt(3) in Q15 of the supply voltage.
+ */
+#define FOC_V_MAX 18918
+
+/**
+ * Electrical angle of a quarter revolution, the full revolution is 2^16.
+ */
+#define FOC_ANGLE_90 0x4000
+
+/**
+ * Two phase quantity in the stationary (alpha, beta) or the rotating (d, q)
+ * reference frame.
+ */
+struct foc_vec {
+	s16 x;			/**< alpha or d component */
+	s16 y;			/**< beta or q component */
+};
+
+/**
+ * PI controller state.
+ *
+ * The integrator is clamped to the output limit on every step so that it
+ * can not wind up while the output is saturated.
+ */
+struct foc_pi {
+	s32 kp;			/**< Proportional gain in Q(FOC_PI_FRAC_BITS) */
+	s32 ki;			/**< Integral gain per cycle in Q(FOC_PI_FRAC_BITS) */
+	s32 integral;		/**< Integrator with FOC_PI_FRAC_BITS fractional bits */
+};
+
+/**
+ * Field oriented current controller state.
+ *
+ * Currents are in an arbitrary Q15 full scale chosen by the current
+ * measurement, voltages are in Q15 of the supply voltage and the electrical
+ * angle is an unsigned 16 bit fraction of a revolution with zero on the
+ * rotor flux axis.
+ */
+struct foc {
+	struct foc_pi pi_d;	/**< Flux current controller */
+	struct foc_pi pi_q;	/**< Torque current controller */
+	struct foc_vec i_ref;	/**< Current reference (d, q) */
+	struct foc_vec i;	/**< Last measured current (d, q) */
+	struct foc_vec v;	/**< Last voltage command (d, q) */
+	s16 v_limit;		/**< Voltage vector magnitude limit, at most FOC_V_MAX */
+	u16 period;		/**< PWM period in timer counts */
+	u16 duty[3];		/**< Phase A, B and C compare values */
+};
+
+void foc_init(struct foc *foc, s32 kp, s32 ki, s16 v_limit, u16 period);
+void foc_reset(struct foc *foc);
+void foc_sin_cos(u16 angle, s16 *sin, s16 *cos);
+struct foc_vec foc_clarke(s16 a, s16 b);
+struct foc_vec foc_park(struct foc_vec ab, s16 sin, s16 cos);
+struct foc_vec foc_inv_park(struct foc_vec dq, s16 sin, s16 cos);
+s16 foc_pi_update(struct foc_pi *pi, s32 error, s16 limit);
+void foc_svpwm(struct foc_vec ab, u16 period, u16 duty[3]);
+void foc_update(struct foc *foc, s16 i_a, s16 i_b, u16 angle);
+
+#endif /* __FOC_H */
@@ -41,13 +41,17 @@
 #include "gprot.h"
 #include "driver/led.h"
 #include "driver/usart.h"
+#include "driver/can.h"
 #include "pwm/pwm.h"
 #include "comm_tim.h"
+#include "comm_map.h"
 #include "driver/adc.h"
 #include "sensor_process.h"
 #include "comm_process.h"
 #include "control_process.h"
 #include "main.h"
+#include "trace.h"
+#include "ppm_process.h"
 
 /**
  * Commutate once trigger flag
@@ -69,6 +73,10 @@
  * Pull all phases high flag
  */
 #define GPROT_FLAG_ALL_HI (1 << 4)
+/**
+ * Calibrate the commutation sensors flag
+ */
+#define GPROT_FLAG_COMM_CAL (1 << 5)
 
 /**
  * Dummy value...
@@ -124,7 +132,11 @@ void gprot_init()
 void gprot_trigger_output(void *data)
 {
 	data = data;
+#ifdef CAN__GPROT
+	can_enable_send();
+#else
 	usart_enable_send();
+#endif
 }
 
 /**
@@ -140,6 +152,18 @@ void gprot_register_changed(void *data, u8 addr)
 		gprot_update_flags();
 	}else if(addr == GPROT_PWM_VAL_REG_ADDR) {
 		gprot_update_pwm_power();
+	}else if(addr == GPROT_TRACE_CTRL_REG_ADDR) {
+		trace_handle_ctrl();
+	}else if(addr == GPROT_COMM_TIM_FREQ_REG_ADDR) {
+		comm_tim_handle_freq_reg();
+	}else if(addr == GPROT_PWM_SCHEME_REG_ADDR) {
+		pwm_handle_scheme_reg();
+	}else if((addr == GPROT_PPM_IDLE_REG_ADDR) ||
+		 (addr == GPROT_PPM_FULL_REG_ADDR)) {
+		ppm_process_handle_cal_reg();
+	}else if((addr == GPROT_COMM_MAP_INDEX_REG_ADDR) ||
+		 (addr == GPROT_COMM_MAP_VALUE_REG_ADDR)) {
+		comm_map_handle_reg(addr);
 	}
 }
 
@@ -189,6 +213,11 @@ void gprot_update_flags(void)
 		}
 	}
 
+	if (((gprot_flag_reg & GPROT_FLAG_COMM_CAL) != 0) &&
+	    ((gprot_flag_reg_old & GPROT_FLAG_COMM_CAL) == 0)) {
+		comm_process_calibrate();
+	}
+
 	/* add other flags here (up to 16) */
 
 	gprot_flag_reg_old = gprot_flag_reg;
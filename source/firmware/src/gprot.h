@@ -37,6 +37,18 @@
 #define GPROT_ADC_BATTERY_VOLTAGE_REG_ADDR 11
 #define GPROT_ADC_CURRENT_REG_ADDR 12
 #define GPROT_ADC_TEMPERATURE_REG_ADDR 13
+#define GPROT_TRACE_CTRL_REG_ADDR 14
+#define GPROT_TRACE_STATUS_REG_ADDR 15
+#define GPROT_PWM_SCHEME_REG_ADDR 16
+#define GPROT_SPEED_SETPOINT_REG_ADDR 17
+#define GPROT_SPEED_RPM_REG_ADDR 18
+#define GPROT_TORQUE_SETPOINT_REG_ADDR 19
+#define GPROT_PPM_WIDTH_REG_ADDR 20
+#define GPROT_PPM_IDLE_REG_ADDR 21
+#define GPROT_PPM_FULL_REG_ADDR 22
+#define GPROT_PPM_ERRORS_REG_ADDR 23
+#define GPROT_COMM_MAP_INDEX_REG_ADDR 24
+#define GPROT_COMM_MAP_VALUE_REG_ADDR 25
 /** @} */
 
 void gprot_init();
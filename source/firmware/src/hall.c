@@ -0,0 +1,271 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   hall.c
+ *
+ * @brief  Hall sensor commutation and speed measurement.
+ *
+ * Hardware independent part of the Hall sensor commutation process (see
+ * comm_process_hall.c). Every Hall edge is looked up in an eight entry
+ * table giving the commutation step to drive in the new state, the capture
+ * delta between the edges gives the speed.
+ *
+ * The table is built by the calibration from the angles the Hall states are
+ * seen at while the stator field is turned slowly, so the sensor wiring
+ * order and placement do not matter. Angles are commutation angles here,
+ * zero at the field of step 0 and increasing by @ref HALL_STEP_ANGLE per
+ * step in the direction the commutation sequence turns the motor.
+ */
+
+#include "types.h"
+
+#include "hall.h"
+
+/**
+ * Lead of the driven field over the middle of a Hall state, 90 degrees.
+ */
+#define HALL_LEAD 0x4000
+
+static void hall_window_clear(struct hall *hall)
+{
+	hall->count = 0;
+	hall->pos = 0;
+	hall->sum = 0;
+}
+
+/**
+ * Initialize the Hall sensor state.
+ *
+ * @param hall Hall sensor state
+ * @param map Commutation step of each Hall state, HALL_INVALID for
+ * 000, 111 and states that should stop the commutation
+ * @param state Current Hall state
+ */
+void hall_init(struct hall *hall, const u8 map[HALL_STATES], u8 state)
+{
+	int i;
+
+	for (i = 0; i < HALL_STATES; i++)
+		hall->map[i] = map[i];
+
+	hall_reset(hall, state);
+}
+
+/**
+ * Reset the speed measurement and resync to a Hall state.
+ *
+ * @param hall Hall sensor state
+ * @param state Current Hall state
+ */
+void hall_reset(struct hall *hall, u8 state)
+{
+	hall->state = state & (HALL_STATES - 1);
+	hall->step = hall->map[hall->state];
+	hall->synced = false;
+	hall_window_clear(hall);
+}
+
+/**
+ * Handle a Hall edge.
+ *
+ * Only capture deltas between two edges in commutation order go into the
+ * speed measurement, an invalid state, a reversal or a skipped state
+ * restart it.
+ *
+ * @param hall Hall sensor state
+ * @param state New Hall state
+ * @param delta Capture timer ticks since the previous edge
+ * @return Commutation step to drive or HALL_INVALID
+ */
+u8 hall_edge(struct hall *hall, u8 state, u16 delta)
+{
+	u8 step = hall->map[state & (HALL_STATES - 1)];
+	u8 next = hall->step + 1;
+
+	if (next >= HALL_STEPS)
+		next = 0;
+
+	if ((step != HALL_INVALID) && hall->synced && (step == next)) {
+		if (hall->count == HALL_STEPS)
+			hall->sum -= hall->delta[hall->pos];
+		else
+			hall->count++;
+
+		hall->delta[hall->pos] = delta;
+		hall->sum += delta;
+
+		hall->pos++;
+		if (hall->pos >= HALL_STEPS)
+			hall->pos = 0;
+	} else {
+		hall_window_clear(hall);
+	}
+
+	hall->synced = (step != HALL_INVALID);
+	hall->state = state & (HALL_STATES - 1);
+	hall->step = step;
+
+	return step;
+}
+
+/**
+ * Handle a capture timer overflow, the rotor is too slow to be measured.
+ *
+ * @param hall Hall sensor state
+ */
+void hall_timeout(struct hall *hall)
+{
+	hall->synced = false;
+	hall_window_clear(hall);
+}
+
+/**
+ * Duration of one electrical revolution.
+ *
+ * Extrapolated from the capture deltas available until a full revolution
+ * has been measured.
+ *
+ * @param hall Hall sensor state
+ * @return Capture timer ticks per electrical revolution, 0 if unknown
+ */
+u32 hall_period(const struct hall *hall)
+{
+	if (hall->count == HALL_STEPS)
+		return hall->sum;
+
+	if (hall->count == 0)
+		return 0;
+
+	return (hall->sum * HALL_STEPS) / hall->count;
+}
+
+/**
+ * Start a new Hall to phase mapping calibration.
+ *
+ * @param cal Calibration state
+ */
+void hall_cal_reset(struct hall_cal *cal)
+{
+	int i;
+
+	for (i = 0; i < HALL_STATES; i++) {
+		cal->first[i] = 0;
+		cal->sum[i] = 0;
+		cal->count[i] = 0;
+	}
+}
+
+/**
+ * Record the Hall state seen at a commutation angle.
+ *
+ * The field should be turned in small steps, once forward and once
+ * backward, so that the rotor lagging behind the field cancels out.
+ *
+ * @param cal Calibration state
+ * @param angle Commutation angle of the stator field
+ * @param state Hall state
+ */
+void hall_cal_sample(struct hall_cal *cal, u16 angle, u8 state)
+{
+	state &= HALL_STATES - 1;
+
+	if (cal->count[state] == 0xFFFF)
+		return;
+
+	if (cal->count[state] == 0)
+		cal->first[state] = angle;
+
+	cal->sum[state] += (s16)(u16)(angle - cal->first[state]);
+	cal->count[state]++;
+}
+
+/**
+ * Build the Hall to phase mapping from the calibration samples.
+ *
+ * Every state is mapped to the step whose field is closest to 90 degrees
+ * ahead of the middle of the state. The states are snapped to the steps
+ * together by their mean distance from the step grid, so that with the
+ * sensors half a step off two states can not round to the same step. The
+ * calibration fails if the states 000 or 111 were seen, a state is missing
+ * or two states still end up on the same step, in that case map is left
+ * untouched.
+ *
+ * @param cal Calibration state
+ * @param map Commutation step of each Hall state output
+ * @return 0 on success, 1 if the sensors are not usable
+ */
+int hall_cal_finish(const struct hall_cal *cal, u8 map[HALL_STATES])
+{
+	u16 target[HALL_STATES];
+	u8 new_map[HALL_STATES];
+	u8 used = 0;
+	s32 offset = 0;
+	s32 ref = 0;
+	s32 d;
+	u8 step;
+	int i;
+
+	if ((cal->count[0] != 0) || (cal->count[HALL_STATES - 1] != 0))
+		return 1;
+
+	for (i = 1; i < HALL_STATES - 1; i++) {
+		if (cal->count[i] == 0)
+			return 1;
+
+		target[i] = (u16)(cal->first[i] + (cal->sum[i] / cal->count[i]) +
+				  HALL_LEAD);
+
+		/* Distance from the step grid, wrapped around the first one */
+		d = target[i] % HALL_STEP_ANGLE;
+		if (i == 1)
+			ref = d;
+		d -= ref;
+		if (d >= HALL_STEP_ANGLE / 2)
+			d -= HALL_STEP_ANGLE;
+		else if (d < -(HALL_STEP_ANGLE / 2))
+			d += HALL_STEP_ANGLE;
+		offset += d;
+	}
+	offset = ref + (offset / HALL_STEPS);
+	if (offset >= HALL_STEP_ANGLE / 2)
+		offset -= HALL_STEP_ANGLE;
+	else if (offset < -(HALL_STEP_ANGLE / 2))
+		offset += HALL_STEP_ANGLE;
+
+	new_map[0] = HALL_INVALID;
+	new_map[HALL_STATES - 1] = HALL_INVALID;
+
+	for (i = 1; i < HALL_STATES - 1; i++) {
+		step = (u8)((u16)(target[i] - offset + (HALL_STEP_ANGLE / 2)) /
+			    HALL_STEP_ANGLE);
+		if (step >= HALL_STEPS)
+			step = 0;
+
+		if ((used & (1 << step)) != 0)
+			return 1;
+		used |= 1 << step;
+
+		new_map[i] = step;
+	}
+
+	for (i = 0; i < HALL_STATES; i++)
+		map[i] = new_map[i];
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HALL_H
+#define __HALL_H
+
+#include "types.h"
+
+/**
+ * Number of Hall sensor input combinations, three inputs.
+ */
+#define HALL_STATES 8
+
+/**
+ * Number of valid Hall states and commutation steps per electrical
+ * revolution.
+ */
+#define HALL_STEPS 6
+
+/**
+ * Step of the Hall states 000 and 111 and of states not calibrated.
+ */
+#define HALL_INVALID 0xFF
+
+/**
+ * Electrical angle of one commutation step, the full revolution is 2^16.
+ */
+#define HALL_STEP_ANGLE (0x10000 / HALL_STEPS)
+
+/**
+ * Hall sensor commutation state.
+ *
+ * The capture deltas of the last full electrical revolution are summed up,
+ * that way the misplacement of the individual sensors cancels out of the
+ * speed measurement.
+ */
+struct hall {
+	u8 map[HALL_STATES];	/**< Commutation step of each Hall state */
+	u8 state;		/**< Last Hall state */
+	u8 step;		/**< Commutation step of the last Hall state */
+	bool synced;		/**< Capture timer ran uninterrupted since the last edge */
+	u8 count;		/**< Number of valid capture deltas in the window */
+	u8 pos;			/**< Next capture delta slot */
+	u16 delta[HALL_STEPS];	/**< Capture deltas of the last revolution */
+	u32 sum;		/**< Sum of the capture deltas in the window */
+};
+
+/**
+ * Hall to phase mapping calibration state.
+ *
+ * Collects the mean commutation angle every Hall state is seen at while the
+ * stator field is turned slowly through a full revolution.
+ */
+struct hall_cal {
+	u16 first[HALL_STATES];	/**< Angle a state was seen at first */
+	s32 sum[HALL_STATES];	/**< Sum of the angles relative to first */
+	u16 count[HALL_STATES];	/**< Number of samples of a state */
+};
+
+void hall_init(struct hall *hall, const u8 map[HALL_STATES], u8 state);
+void hall_reset(struct hall *hall, u8 state);
+u8 hall_edge(struct hall *hall, u8 state, u16 delta);
+void hall_timeout(struct hall *hall);
+u32 hall_period(const struct hall *hall);
+void hall_cal_reset(struct hall_cal *cal);
+void hall_cal_sample(struct hall_cal *cal, u16 angle, u8 state);
+int hall_cal_finish(const struct hall_cal *cal, u8 map[HALL_STATES]);
+
+/**
+ * Commutation step of the last Hall state.
+ *
+ * @param hall Hall sensor state
+ * @return Step index or HALL_INVALID
+ */
+static inline u8 hall_step(const struct hall *hall)
+{
+	return hall->step;
+}
+
+#endif /* __HALL_H */
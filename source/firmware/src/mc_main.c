@@ -39,6 +39,8 @@
 #include "driver/led.h"
 #include "gprot.h"
 #include "driver/usart.h"
+#include "driver/can.h"
+#include "driver/i2c.h"
 #include "driver/adc.h"
 #include "driver/sys_tick.h"
 #include "driver/bemf_hardware_detect.h"
@@ -49,6 +51,10 @@
 #include "comm_process.h"
 #include "sensor_process.h"
 #include "control_process.h"
+#include "speed_process.h"
+#include "torque_process.h"
+#include "ppm_process.h"
+#include "trace.h"
 
 /**
  * Running in demo mode flag
@@ -85,7 +91,15 @@ int main(void)
 	led_init();
 	debug_pins_init();
 	gprot_init();
+	trace_init();
+#ifdef CAN__GPROT
+	can_init();
+#else
 	usart_init();
+#endif
+#ifdef I2C__ENABLE
+	i2c_init();
+#endif
 	sys_tick_init();
 	cpu_load_process_init();
 	comm_process_init();
@@ -94,6 +108,9 @@ int main(void)
 	pwm_init();
 	comm_tim_init();
 	control_process_init();
+	speed_process_init();
+	torque_process_init();
+	ppm_process_init();
 	bemf_hd_init();
 
 	demo_counter = 500;
@@ -114,18 +131,43 @@ int main(void)
 		{
 			flag++;
 		}
+#ifdef CAN__GPROT
+		if (can_rx_trigger) {
+			can_rx_trigger = false;
+			can_process_rx();
+		}
+#else
+		if (usart_rx_trigger) {
+			usart_rx_trigger = false;
+			usart_process_rx();
+		}
+#endif
+
+#ifdef I2C__ENABLE
+		if (i2c_rx_trigger) {
+			i2c_rx_trigger = false;
+			i2c_process_rx();
+		}
+#endif
+
 		if (*comm_process_trigger) {
 			*comm_process_trigger = false;
 			run_comm_process();
 		}
 
 		run_control_process();
+
+#ifdef PPM__ENABLE
+		run_ppm_process();
+#endif
 		
 		if (*sensor_process_trigger) {
 			*sensor_process_trigger = false;
 			run_sensor_process();
 		}
 
+		run_trace_process();
+
 		//TOGGLE(LED_BLUE);
 
 		if (demo) {
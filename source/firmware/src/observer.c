@@ -0,0 +1,189 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   observer.c
+ *
+ * @brief  Sensorless rotor angle and speed observer.
+ *
+ * Estimates the rotor flux vector from the stator voltage equation
+ * psi = integral(v - R * i) - L * i, with the nonlinear magnitude
+ * correction of Ortega et al. pulling the estimate back onto the circle of
+ * the known rotor flux linkage so that the open integration can not drift.
+ * A type 2 phase locked loop tracks the angle of the flux vector, giving
+ * the electrical angle and speed without an arctangent.
+ *
+ * All coefficients are precomputed by observer_init() so that one update is
+ * a handful of 32x32 bit multiplies with 64 bit results, one sine/cosine
+ * table lookup and no divisions.
+ *
+ * Resistance errors shift the estimate by roughly the resistive voltage
+ * error over the BEMF, so the angle is only usable above a minimum speed.
+ * Below that it has to come from the alignment or the block commutation.
+ */
+
+#include "types.h"
+
+#include "foc.h"
+#include "observer.h"
+
+/**
+ * Largest flux integrator magnitude, 8 times the rotor flux linkage.
+ */
+#define OBSERVER_FLUX_MAX (8 << OBSERVER_FLUX_BITS)
+
+/**
+ * 2 pi in 1/1000
+ */
+#define OBSERVER_2PI_MILLI 6283
+
+static s32 observer_k(u64 k)
+{
+	return (k > 0x7FFFFFFF) ? 0x7FFFFFFF : (s32)k;
+}
+
+static s32 observer_clamp(s32 x)
+{
+	if (x > OBSERVER_FLUX_MAX)
+		return OBSERVER_FLUX_MAX;
+	if (x < -OBSERVER_FLUX_MAX)
+		return -OBSERVER_FLUX_MAX;
+	return x;
+}
+
+/**
+ * Initialize the observer.
+ *
+ * The PLL is critically damped with its natural frequency at the given
+ * bandwidth. Should the motor parameters be so far off the unit ranges that
+ * a coefficient does not fit into 31 bits it saturates.
+ *
+ * @param obs Observer state
+ * @param p Motor and observer parameters
+ */
+void observer_init(struct observer *obs, const struct observer_params *p)
+{
+	const u32 shift = OBSERVER_FLUX_BITS + OBSERVER_K_BITS - 15;
+	u64 flux = (p->flux != 0) ? p->flux : 1;
+	u64 bwp = (u64)p->pll_bw * p->period / 1000;
+	u64 ki;
+
+	obs->k_v = observer_k(((u64)p->v_fs * p->period << shift) /
+			      (flux * 1000));
+	obs->k_r = observer_k((((u64)p->r * p->i_fs / 1000) * p->period /
+			       1000 << shift) / (flux * 1000));
+	obs->k_l = observer_k(((u64)p->l * p->i_fs << shift) / (flux * 1000));
+	obs->gain = observer_k(((u64)p->gain * p->period << OBSERVER_K_BITS) /
+			       1000000000);
+
+	obs->pll_kp = observer_k(((2 * (u64)p->pll_bw * p->period) <<
+				  OBSERVER_FLUX_BITS) / 1000000000);
+	ki = bwp * bwp * OBSERVER_2PI_MILLI / 1000;
+	ki = (((ki << 12) / 1000000) << (OBSERVER_FLUX_BITS - 12)) / 1000000;
+	obs->pll_ki = observer_k(ki);
+
+	observer_reset(obs, 0);
+}
+
+/**
+ * Reset the observer to a rotor at standstill.
+ *
+ * @param obs Observer state
+ * @param angle Electrical angle of the rotor flux axis if known, for
+ * example after aligning the rotor, 0 otherwise
+ */
+void observer_reset(struct observer *obs, u16 angle)
+{
+	s16 sin;
+	s16 cos;
+
+	foc_sin_cos(angle, &sin, &cos);
+
+	obs->x[0] = (s32)cos << (OBSERVER_FLUX_BITS - 15);
+	obs->x[1] = (s32)sin << (OBSERVER_FLUX_BITS - 15);
+	obs->flux[0] = obs->x[0];
+	obs->flux[1] = obs->x[1];
+	obs->i.x = 0;
+	obs->i.y = 0;
+	obs->angle = (u32)angle << 16;
+	obs->pll_speed = 0;
+	obs->speed = 0;
+}
+
+/**
+ * Feed one voltage and current sample into the observer.
+ *
+ * Has to be called once every observer_params.period.
+ *
+ * @param obs Observer state
+ * @param v Mean stator voltage (alpha, beta) since the last update in
+ * Q15 of observer_params.v_fs
+ * @param i Stator current (alpha, beta) in Q15 of observer_params.i_fs
+ */
+void observer_update(struct observer *obs, struct foc_vec v,
+		     struct foc_vec i)
+{
+	const s32 round = 1 << (OBSERVER_K_BITS - 1);
+	s32 eta[2];
+	s64 mag2;
+	s64 mag_err;
+	s32 err;
+	s16 sin;
+	s16 cos;
+
+	/* Open integration of the BEMF, trapezoidal resistive drop */
+	obs->x[0] += (s32)(((s64)v.x * obs->k_v -
+			    (((s64)((s32)i.x + obs->i.x) * obs->k_r) >> 1) +
+			    round) >> OBSERVER_K_BITS);
+	obs->x[1] += (s32)(((s64)v.y * obs->k_v -
+			    (((s64)((s32)i.y + obs->i.y) * obs->k_r) >> 1) +
+			    round) >> OBSERVER_K_BITS);
+	obs->i = i;
+
+	eta[0] = obs->x[0] - (s32)(((s64)i.x * obs->k_l + round) >>
+				   OBSERVER_K_BITS);
+	eta[1] = obs->x[1] - (s32)(((s64)i.y * obs->k_l + round) >>
+				   OBSERVER_K_BITS);
+
+	/* Pull the rotor flux estimate towards the flux linkage circle */
+	mag2 = (s64)eta[0] * eta[0] + (s64)eta[1] * eta[1];
+	mag_err = (((s64)1 << (2 * OBSERVER_FLUX_BITS)) - mag2) >>
+		OBSERVER_FLUX_BITS;
+	if (mag_err < -OBSERVER_FLUX_MAX)
+		mag_err = -OBSERVER_FLUX_MAX;
+	obs->x[0] = observer_clamp(obs->x[0] +
+				   (s32)((((eta[0] * mag_err) >>
+					   OBSERVER_FLUX_BITS) * obs->gain) >>
+					 OBSERVER_K_BITS));
+	obs->x[1] = observer_clamp(obs->x[1] +
+				   (s32)((((eta[1] * mag_err) >>
+					   OBSERVER_FLUX_BITS) * obs->gain) >>
+					 OBSERVER_K_BITS));
+	obs->flux[0] = eta[0];
+	obs->flux[1] = eta[1];
+
+	/* Track the flux vector angle, predicted from the last speed */
+	obs->angle += (u32)obs->pll_speed;
+	foc_sin_cos((u16)(obs->angle >> 16), &sin, &cos);
+	err = (s32)(((s64)eta[1] * cos - (s64)eta[0] * sin) >> 15);
+
+	obs->pll_speed += (s32)(((s64)err * obs->pll_ki) >> OBSERVER_K_BITS);
+	err = (s32)(((s64)err * obs->pll_kp) >> OBSERVER_K_BITS);
+	obs->angle += (u32)err;
+	obs->speed = obs->pll_speed + err;
+}
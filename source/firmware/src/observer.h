@@ -0,0 +1,90 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OBSERVER_H
+#define __OBSERVER_H
+
+#include "types.h"
+
+#include "foc.h"
+
+/**
+ * Number of fractional bits of the flux estimate, 1.0 is the rotor flux
+ * linkage.
+ */
+#define OBSERVER_FLUX_BITS 24
+
+/**
+ * Number of fractional bits of the precomputed observer coefficients.
+ */
+#define OBSERVER_K_BITS 16
+
+/**
+ * Motor and observer parameters in integer SI based units.
+ */
+struct observer_params {
+	u32 r;			/**< Phase resistance [uOhm] */
+	u32 l;			/**< Phase inductance [nH] */
+	u32 flux;		/**< Rotor flux linkage, peak phase BEMF per electrical rad/s [nWb] */
+	u32 v_fs;		/**< Voltage of the Q15 full scale [mV] */
+	u32 i_fs;		/**< Current of the Q15 full scale [mA] */
+	u32 period;		/**< Time between two updates [ns] */
+	u32 gain;		/**< Flux magnitude correction gain [1/s] */
+	u32 pll_bw;		/**< Angle tracking loop bandwidth [Hz] */
+};
+
+/**
+ * Sensorless rotor angle observer state.
+ *
+ * The flux vector is in Q(OBSERVER_FLUX_BITS) of the rotor flux linkage,
+ * the angle is a 32 bit fraction of an electrical revolution in the
+ * convention of @ref foc.h, zero on the rotor flux axis.
+ */
+struct observer {
+	s32 k_v;		/**< Flux change per voltage unit and update */
+	s32 k_r;		/**< Flux change per current unit and update due to R */
+	s32 k_l;		/**< Flux per current unit due to L */
+	s32 gain;		/**< Flux magnitude correction per update */
+	s32 pll_kp;		/**< Angle tracking loop proportional gain */
+	s32 pll_ki;		/**< Angle tracking loop integral gain */
+	s32 x[2];		/**< Stator flux integral (alpha, beta) */
+	struct foc_vec i;	/**< Previous current (alpha, beta) */
+	s32 flux[2];		/**< Rotor flux estimate (alpha, beta) */
+	s32 pll_speed;		/**< Angle tracking loop integrator */
+	u32 angle;		/**< Electrical angle estimate */
+	s32 speed;		/**< Electrical angle change in the last update */
+};
+
+void observer_init(struct observer *obs, const struct observer_params *p);
+void observer_reset(struct observer *obs, u16 angle);
+void observer_update(struct observer *obs, struct foc_vec v,
+		     struct foc_vec i);
+
+/**
+ * Estimated electrical angle of the rotor flux axis, ready to be passed to
+ * foc_update().
+ *
+ * @param obs Observer state
+ * @return Electrical angle, 2^16 is one revolution
+ */
+static inline u16 observer_angle(const struct observer *obs)
+{
+	return (u16)(obs->angle >> 16);
+}
+
+#endif /* __OBSERVER_H */
@@ -0,0 +1,194 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   ppm.c
+ *
+ * @brief  RC pulse decoder and throttle curve.
+ *
+ * Hardware independent part of the RC pulse throttle input (see
+ * ppm_process.c). Every captured pulse is checked for its width and for the
+ * time since the previous pulse, pulses failing either check are counted
+ * and dropped while the last valid throttle is held. The output is only
+ * armed after a number of consecutive frames at idle throttle, so that a
+ * transmitter left at some throttle position does not start the motor, and
+ * falls back to zero throttle when no valid frame arrives within the
+ * timeout.
+ *
+ * The throttle curve maps the pulse width between the calibrated idle and
+ * full throttle widths linearly in between PPM_CURVE_POINTS evenly spaced
+ * points.
+ */
+
+#include "types.h"
+
+#include "ppm.h"
+
+/**
+ * Number of fractional bits of the throttle curve interpolation.
+ */
+#define PPM_CURVE_FRAC_BITS 12
+
+/**
+ * Initialize the RC pulse decoder, starts disarmed.
+ *
+ * @param ppm Decoder state
+ * @param config Decoder configuration, has to stay valid
+ */
+void ppm_init(struct ppm *ppm, const struct ppm_config *config)
+{
+	ppm->config = config;
+	ppm->last_pulse = 0;
+	ppm->last_frame = 0;
+	ppm->synced = false;
+	ppm->armed = false;
+	ppm->idle_frames = 0;
+	ppm->width = 0;
+	ppm->power = 0;
+	ppm->errors = 0;
+	ppm->failsafes = 0;
+}
+
+static void ppm_reject(struct ppm *ppm)
+{
+	ppm->errors++;
+	ppm->idle_frames = 0;
+}
+
+/**
+ * Decode one captured pulse.
+ *
+ * The first pulse after start or a signal loss only serves as reference
+ * for the frame period check of the next one.
+ *
+ * @param ppm Decoder state
+ * @param width Pulse width [capture ticks]
+ * @param time Time of the pulse
+ * @param glitch More than one edge seen since the last pulse
+ * @return true if the pulse is a valid frame and power holds a new value
+ */
+bool ppm_pulse(struct ppm *ppm, u16 width, u32 time, bool glitch)
+{
+	const struct ppm_config *config = ppm->config;
+	u32 period = time - ppm->last_pulse;
+	s16 power;
+
+	if (glitch || (width < config->width_min) ||
+	    (width > config->width_max)) {
+		ppm_reject(ppm);
+		return false;
+	}
+
+	/* Keep the reference so the next regular frame passes again */
+	if (ppm->synced && (period < config->period_min)) {
+		ppm_reject(ppm);
+		return false;
+	}
+
+	ppm->last_pulse = time;
+
+	if (!ppm->synced) {
+		ppm->synced = true;
+		return false;
+	}
+
+	if (period > config->period_max) {
+		ppm_reject(ppm);
+		return false;
+	}
+
+	ppm->last_frame = time;
+	ppm->width = width;
+	power = ppm_curve(config, width);
+
+	if (!ppm->armed) {
+		if (width > ((u32)config->idle + config->deadband)) {
+			ppm->idle_frames = 0;
+			return false;
+		}
+
+		if (ppm->idle_frames < config->arm_frames)
+			ppm->idle_frames++;
+		if (ppm->idle_frames < config->arm_frames)
+			return false;
+
+		ppm->armed = true;
+	}
+
+	ppm->power = power;
+
+	return true;
+}
+
+/**
+ * Check for loss of the RC signal.
+ *
+ * Disarms the decoder and sets zero throttle when no valid frame arrived
+ * within the timeout.
+ *
+ * @param ppm Decoder state
+ * @param now Current time
+ * @return true if the signal just got lost
+ */
+bool ppm_check(struct ppm *ppm, u32 now)
+{
+	if (!ppm->armed || ((now - ppm->last_frame) <= ppm->config->timeout))
+		return false;
+
+	ppm->armed = false;
+	ppm->synced = false;
+	ppm->idle_frames = 0;
+	ppm->power = 0;
+	ppm->failsafes++;
+
+	return true;
+}
+
+/**
+ * Map a pulse width through the throttle curve.
+ *
+ * @param config Decoder configuration holding calibration and curve
+ * @param width Pulse width [capture ticks]
+ * @return Throttle power in the units of PWM_SET()
+ */
+s16 ppm_curve(const struct ppm_config *config, u16 width)
+{
+	u32 start = (u32)config->idle + config->deadband;
+	u32 span;
+	u32 pos;
+	u32 seg;
+	s32 frac;
+	s32 a;
+	s32 b;
+
+	if (width <= start)
+		return config->curve[0];
+	if ((width >= config->full) || (config->full <= start))
+		return config->curve[PPM_CURVE_POINTS - 1];
+
+	span = config->full - start;
+	pos = (((width - start) * (PPM_CURVE_POINTS - 1)) <<
+	       PPM_CURVE_FRAC_BITS) / span;
+	seg = pos >> PPM_CURVE_FRAC_BITS;
+	frac = (s32)(pos & ((1 << PPM_CURVE_FRAC_BITS) - 1));
+
+	a = config->curve[seg];
+	b = config->curve[seg + 1];
+
+	return (s16)(a + (((b - a) * frac) / (1 << PPM_CURVE_FRAC_BITS)));
+}
@@ -0,0 +1,69 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PPM_H
+#define __PPM_H
+
+#include "types.h"
+
+/**
+ * Number of points of the throttle curve.
+ */
+#define PPM_CURVE_POINTS 5
+
+/**
+ * RC pulse decoder configuration.
+ *
+ * Pulse widths are given in capture timer ticks, frame periods and the
+ * timeout in ticks of the time base passed to ppm_pulse() and ppm_check().
+ */
+struct ppm_config {
+	u16 width_min;			/**< Shortest valid pulse */
+	u16 width_max;			/**< Longest valid pulse */
+	u16 idle;			/**< Calibrated pulse width of zero throttle */
+	u16 full;			/**< Calibrated pulse width of full throttle */
+	u16 deadband;			/**< Width above idle still read as zero throttle */
+	u32 period_min;			/**< Shortest valid frame period */
+	u32 period_max;			/**< Longest valid frame period */
+	u32 timeout;			/**< Time without a valid frame until failsafe */
+	u8 arm_frames;			/**< Consecutive idle frames needed to arm */
+	s16 curve[PPM_CURVE_POINTS];	/**< Power at evenly spaced throttle positions */
+};
+
+/**
+ * RC pulse decoder state.
+ */
+struct ppm {
+	const struct ppm_config *config;	/**< Configuration in use */
+	u32 last_pulse;		/**< Time of the last pulse with a valid width */
+	u32 last_frame;		/**< Time of the last valid frame */
+	bool synced;		/**< last_pulse is a valid period reference */
+	bool armed;		/**< Throttle output enabled */
+	u8 idle_frames;		/**< Consecutive idle frames while disarmed */
+	u16 width;		/**< Width of the last valid frame */
+	s16 power;		/**< Throttle output in the units of PWM_SET() */
+	u16 errors;		/**< Rejected frames */
+	u16 failsafes;		/**< Signal losses */
+};
+
+void ppm_init(struct ppm *ppm, const struct ppm_config *config);
+bool ppm_pulse(struct ppm *ppm, u16 width, u32 time, bool glitch);
+bool ppm_check(struct ppm *ppm, u32 now);
+s16 ppm_curve(const struct ppm_config *config, u16 width);
+
+#endif /* __PPM_H */
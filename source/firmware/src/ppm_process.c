@@ -0,0 +1,228 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   ppm_process.c
+ *
+ * @brief  RC pulse throttle input process.
+ *
+ * Measures the RC servo pulse on PA2 with the commutation timer TIM2: input
+ * capture channel 3 latches the rising edge directly from TI3, channel 4 the
+ * falling edge indirectly from TI3, so no second pin is needed. The capture
+ * channel 4 interrupt hands the pulse to the decoder (see ppm.c), more
+ * edges than one pulse between two interrupts show up as overcapture or as
+ * missing rising edge capture and reject the pulse.
+ *
+ * While the control process is spinning the decoded throttle is set with
+ * PWM_SET() right from the capture interrupt and written to the compare
+ * registers through pwm_limit(), so it takes effect in the next PWM period
+ * without waiting for the next commutation. The TIM2 update interrupt,
+ * every 4.55ms, checks for signal loss and drops the throttle to zero.
+ *
+ * Starting and stopping the motor is left to the main loop: it ignites the
+ * control process when the armed throttle leaves idle and kills it at idle
+ * throttle or after a signal loss.
+ *
+ * The idle and full throttle pulse widths can be calibrated through
+ * governor registers in microseconds.
+ */
+
+#include "config.h"
+
+#include <stm32/rcc.h>
+#include <stm32/gpio.h>
+#include <stm32/tim.h>
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+#include "driver/sys_tick.h"
+#include "pwm/pwm.h"
+#include "comm_tim.h"
+#include "control_process.h"
+#include "torque_process.h"
+#include "ppm.h"
+
+#include "ppm_process.h"
+
+/**
+ * Convert microseconds to capture timer ticks.
+ */
+#define PPM_PROCESS_TICKS(US) (((u32)(US) * (COMM_TIM_CLOCK / 100000)) / 10)
+
+/**
+ * Convert capture timer ticks to microseconds.
+ */
+#define PPM_PROCESS_US(TICKS) (((u32)(TICKS) * 10) / (COMM_TIM_CLOCK / 100000))
+
+/**
+ * Internal state of the RC pulse throttle input process.
+ */
+struct ppm_process_state {
+	struct ppm_config config;	/**< Decoder configuration */
+	struct ppm ppm;			/**< Decoder state */
+	u16 width;			/**< Last valid pulse width register [us] */
+	u16 idle;			/**< Idle throttle calibration register [us] */
+	u16 full;			/**< Full throttle calibration register [us] */
+	bool running;			/**< Motor started by the throttle */
+};
+
+static struct ppm_process_state ppm_process_state; /**< Internal state instance */
+
+/**
+ * Initialize the RC pulse throttle input process.
+ */
+void ppm_process_init(void)
+{
+	struct ppm_config *config = &ppm_process_state.config;
+#ifdef PPM__ENABLE
+	GPIO_InitTypeDef gpio;
+	TIM_ICInitTypeDef tim_ic;
+#endif
+
+	(void)gpc_setup_reg(GPROT_PPM_WIDTH_REG_ADDR,
+			    &ppm_process_state.width);
+	(void)gpc_setup_reg(GPROT_PPM_IDLE_REG_ADDR, &ppm_process_state.idle);
+	(void)gpc_setup_reg(GPROT_PPM_FULL_REG_ADDR, &ppm_process_state.full);
+	(void)gpc_setup_reg(GPROT_PPM_ERRORS_REG_ADDR,
+			    &ppm_process_state.ppm.errors);
+
+	config->width_min = PPM_PROCESS_TICKS(PPM__WIDTH_MIN);
+	config->width_max = PPM_PROCESS_TICKS(PPM__WIDTH_MAX);
+	config->deadband = PPM_PROCESS_TICKS(PPM__DEADBAND);
+	config->period_min = PPM__PERIOD_MIN;
+	config->period_max = PPM__PERIOD_MAX;
+	config->timeout = PPM__TIMEOUT;
+	config->arm_frames = PPM__ARM_FRAMES;
+	config->curve[0] = PPM__CURVE_0;
+	config->curve[1] = PPM__CURVE_1;
+	config->curve[2] = PPM__CURVE_2;
+	config->curve[3] = PPM__CURVE_3;
+	config->curve[4] = PPM__CURVE_4;
+
+	ppm_process_state.width = 0;
+	ppm_process_state.idle = PPM__IDLE;
+	ppm_process_state.full = PPM__FULL;
+	ppm_process_state.running = false;
+	ppm_process_handle_cal_reg();
+
+	ppm_init(&ppm_process_state.ppm, config);
+
+#ifdef PPM__ENABLE
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+
+	/* TIM2_CH3 input */
+	gpio.GPIO_Pin = GPIO_Pin_2;
+	gpio.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+	gpio.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_Init(GPIOA, &gpio);
+
+	/* Time base and clock are set up by comm_tim_init() */
+	tim_ic.TIM_Channel = TIM_Channel_3;
+	tim_ic.TIM_ICPolarity = TIM_ICPolarity_Rising;
+	tim_ic.TIM_ICSelection = TIM_ICSelection_DirectTI;
+	tim_ic.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	tim_ic.TIM_ICFilter = PPM__IC_FILTER;
+	TIM_ICInit(TIM2, &tim_ic);
+
+	tim_ic.TIM_Channel = TIM_Channel_4;
+	tim_ic.TIM_ICPolarity = TIM_ICPolarity_Falling;
+	tim_ic.TIM_ICSelection = TIM_ICSelection_IndirectTI;
+	TIM_ICInit(TIM2, &tim_ic);
+
+	TIM_ITConfig(TIM2, TIM_IT_CC4, ENABLE);
+#endif
+}
+
+/**
+ * Take over the idle and full throttle calibration registers.
+ *
+ * Called when the governor changed one of them.
+ */
+void ppm_process_handle_cal_reg(void)
+{
+	struct ppm_config *config = &ppm_process_state.config;
+
+	config->idle = PPM_PROCESS_TICKS(ppm_process_state.idle);
+	config->full = PPM_PROCESS_TICKS(ppm_process_state.full);
+}
+
+/**
+ * Pulse captured, called from the TIM2 capture channel 4 interrupt.
+ */
+void ppm_process_capture(void)
+{
+	struct ppm *ppm = &ppm_process_state.ppm;
+	bool glitch = (TIM_GetFlagStatus(TIM2, TIM_FLAG_CC3) == RESET) ||
+		(TIM_GetFlagStatus(TIM2, TIM_FLAG_CC3OF) != RESET) ||
+		(TIM_GetFlagStatus(TIM2, TIM_FLAG_CC4OF) != RESET);
+	u16 rise = TIM_GetCapture3(TIM2);
+	u16 width = TIM_GetCapture4(TIM2) - rise;
+
+	TIM_ClearFlag(TIM2, TIM_FLAG_CC3 | TIM_FLAG_CC3OF | TIM_FLAG_CC4OF);
+
+	if (!ppm_pulse(ppm, width, sys_tick_get_timer(), glitch))
+		return;
+
+	ppm_process_state.width = (u16)PPM_PROCESS_US(ppm->width);
+
+	if ((control_process_get_state() != cps_spinning) ||
+	    torque_process_active())
+		return;
+
+	PWM_SET(ppm->power);
+	/* Apply in the running PWM period */
+	pwm_limit((u16)pwm_duty_max);
+}
+
+/**
+ * Signal loss check, called from the TIM2 update interrupt.
+ */
+void ppm_process_check(void)
+{
+	if (!ppm_check(&ppm_process_state.ppm, sys_tick_get_timer()))
+		return;
+
+	if (control_process_get_state() == cps_spinning) {
+		PWM_SET(0);
+		pwm_limit((u16)pwm_duty_max);
+	}
+}
+
+/**
+ * Start and stop the motor following the throttle, called from the main
+ * loop.
+ */
+void run_ppm_process(void)
+{
+	const struct ppm *ppm = &ppm_process_state.ppm;
+	bool run = ppm->armed &&
+		(ppm->width > ((u32)ppm->config->idle + ppm->config->deadband));
+
+	if (run == ppm_process_state.running)
+		return;
+
+	ppm_process_state.running = run;
+	if (run)
+		control_process_ignite();
+	else
+		control_process_kill();
+}
@@ -41,10 +41,13 @@
 #include "gprot.h"
 #include "pwm_schemes.h"
 #include "pwm_utils.h"
+#include "pwm_steps.h"
 
 #include "pwm/pwm.h"
 
 #include "driver/led.h"
+#include "driver/bemf_hardware_detect.h"
+#include "trace.h"
 
 //#define PWM__VALUE 700
 //#define PWM__OFFSET 250
@@ -61,8 +64,46 @@
 volatile enum pwm_mode pwm_mode = PWM__MODE;
 /** Current PWM duty cycle */
 volatile uint32_t pwm_val = PWM__VALUE;
+/** Duty cycle cap set by the current limit, see pwm_limit() */
+volatile uint32_t pwm_duty_max = PWM__BASE_CLOCK / PWM__FREQUENCY;
+/** Phases with all outputs off in the step in effect, bit 0 is phase A */
+volatile u8 pwm_floating;
 /** Current PWM offset for ADC triggering */
 static volatile uint16_t pwm_offset = PWM__OFFSET;
+/** PWM scheme governor register */
+static u16 pwm_scheme_reg;
+/** Per PWM period handler of the scheme in effect, NULL if none */
+static void (*volatile pwm_update)(void);
+
+/**
+ * PWM scheme dispatch table, indexed by enum pwm_scheme_id.
+ */
+const struct pwm_step_scheme *const pwm_schemes[pwm_scheme_id_num] = {
+	&pwm_scheme_6step_pwm_on,
+	&pwm_scheme_6step_on_pwm,
+	&pwm_scheme_6step_h_pwm_l_on,
+	&pwm_scheme_6step_h_on_l_pwm,
+	&pwm_scheme_12step_pwm_on_pwm,
+	&pwm_scheme_sine
+};
+
+/**
+ * Complementary PWM on all phases, the output stage configuration of the
+ * field oriented control.
+ */
+static const struct pwm_step pwm_step_foc[1] = {
+	PWM_STEP(cpwm, cpwm, cpwm)
+};
+
+/**
+ * Single step scheme keeping the output stage in complementary PWM, it is
+ * not selectable through the governor.
+ */
+static const struct pwm_step_scheme pwm_scheme_foc = {
+	pwm_step_foc, pwm_step_foc, 1, NULL, NULL
+};
+
+static u16 pwm_scheme_active_id(void);
 
 /**
  * Initialize the three phase (6outputs) PWM peripheral and internal state.
@@ -76,6 +117,14 @@ void pwm_init(void)
 	TIM_BDTRInitTypeDef tim_bdtr;
 
 	(void)gpc_setup_reg(GPROT_PWM_OFFSET_REG_ADDR, &pwm_offset);
+	(void)gpc_setup_reg(GPROT_PWM_SCHEME_REG_ADDR, &pwm_scheme_reg);
+
+	pwm_scheme = &PWM__SCHEME;
+	pwm_scheme_next = NULL;
+	pwm_scheme_reg = pwm_scheme_active_id();
+	pwm_update = NULL;
+
+	pwm_scheme_sine_init();
 
 	/* Enable clock for TIM1 subsystem */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1 |
@@ -89,6 +138,13 @@ void pwm_init(void)
 	nvic.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&nvic);
 
+	/* Enable TIM1 interrupt */
+	nvic.NVIC_IRQChannel = TIM1_UP_IRQn;
+	nvic.NVIC_IRQChannelPreemptionPriority = 0;
+	nvic.NVIC_IRQChannelSubPriority = 1;
+	nvic.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvic);
+
 	/* Enable TIM1 interrupt */
 	nvic.NVIC_IRQChannel = TIM1_CC_IRQn;
 	nvic.NVIC_IRQChannelPreemptionPriority = 0;
@@ -154,6 +210,9 @@ void pwm_init(void)
 
 	TIM_CCPreloadControl(TIM1, ENABLE);
 
+	/* Capture the static register bits for the commutation step tables */
+	pwm_steps_init();
+
 	/* Enable COM and CC interrupt */
 	TIM_ITConfig(TIM1, TIM_IT_COM, ENABLE);
 	//TIM_ITConfig(TIM1, TIM_IT_COM | TIM_IT_CC4, ENABLE);
@@ -176,6 +235,135 @@ void pwm_comm(void)
 	TIM_GenerateEvent(TIM1, TIM_EventSource_COM);
 }
 
+/**
+ * Number of the active PWM scheme in the dispatch table.
+ */
+u16 pwm_scheme_active_id(void)
+{
+	u16 id;
+
+	for (id = 0; id < (u16)pwm_scheme_id_num; id++) {
+		if (pwm_schemes[id] == pwm_scheme)
+			break;
+	}
+
+	return id;
+}
+
+/**
+ * Select the PWM scheme used from the next commutation on.
+ *
+ * The switch itself happens in the commutation interrupt so that a
+ * commutation step is never built from two different schemes.
+ *
+ * @param id PWM scheme number, see enum pwm_scheme_id
+ * @return 0 on success, 1 if the scheme number is invalid
+ */
+int pwm_scheme_select(u16 id)
+{
+	if (id >= (u16)pwm_scheme_id_num)
+		return 1;
+
+	pwm_scheme_reg = id;
+
+	/* Applied by pwm_foc_stop() */
+	if (pwm_scheme == &pwm_scheme_foc)
+		return 0;
+
+	pwm_scheme_next = (pwm_schemes[id] != pwm_scheme) ? pwm_schemes[id] :
+		NULL;
+
+	return 0;
+}
+
+/**
+ * Handle a write to the PWM scheme governor register.
+ *
+ * Invalid scheme numbers are rejected by reporting the active scheme back.
+ */
+void pwm_handle_scheme_reg(void)
+{
+	if (pwm_scheme_select(pwm_scheme_reg) != 0) {
+		pwm_scheme_reg = pwm_scheme_active_id();
+		(void)gpc_register_touched(GPROT_PWM_SCHEME_REG_ADDR);
+	}
+}
+
+/**
+ * Hand the output stage over to the field oriented control.
+ *
+ * Switches all phases to complementary PWM with the compare values in the
+ * middle of the period. The compare values are then updated every PWM
+ * period with pwm_foc_set().
+ */
+void pwm_foc_start(void)
+{
+	pwm_mode = PWM_DRIVE;
+	pwm_val = (PWM__BASE_CLOCK / PWM__FREQUENCY) / 2;
+
+	pwm_scheme_next = NULL;
+	pwm_scheme = &pwm_scheme_foc;
+	pwm_step = 0;
+
+	TIM1->CCER = pwm_step_base.ccer | pwm_step_foc[0].ccer;
+	TIM1->CCMR1 = pwm_step_base.ccmr1 | pwm_step_foc[0].ccmr1;
+	TIM1->CCMR2 = pwm_step_base.ccmr2 | pwm_step_foc[0].ccmr2;
+	pwm_comm();
+}
+
+/**
+ * Take the output stage back from the field oriented control.
+ *
+ * Switches off all outputs and goes back to the PWM scheme selected in the
+ * governor register.
+ */
+void pwm_foc_stop(void)
+{
+	pwm_scheme = pwm_schemes[pwm_scheme_reg];
+	pwm_step = 0;
+
+	pwm_off();
+}
+
+/**
+ * Set the phase compare values, they take effect with the next update event.
+ *
+ * @param duty Phase A, B and C compare values
+ */
+void pwm_foc_set(const u16 duty[3])
+{
+	TIM_SetCompare1(TIM1, duty[0]);
+	TIM_SetCompare2(TIM1, duty[1]);
+	TIM_SetCompare3(TIM1, duty[2]);
+}
+
+/**
+ * Cap the duty cycle of the block commutation schemes.
+ *
+ * The cap takes effect with the next PWM period instead of waiting for the
+ * next commutation, that way a current limit can react within one period.
+ * Schemes with their own compare value handling pick it up through
+ * pwm_duty().
+ *
+ * @param duty Maximum compare value, the PWM period to release the cap
+ */
+void pwm_limit(u16 duty)
+{
+	const struct pwm_step_scheme *scheme = pwm_scheme;
+	uint32_t val;
+
+	pwm_duty_max = duty;
+
+	if ((scheme->comm != NULL) || (scheme->update != NULL) ||
+	    (scheme == &pwm_scheme_foc))
+		return;
+
+	val = pwm_duty();
+	TIM_SetCompare1(TIM1, val);
+	TIM_SetCompare2(TIM1, val);
+	TIM_SetCompare3(TIM1, val);
+}
+
 /**
  * Switch off all outputs
  */
@@ -205,31 +393,79 @@ void pwm_all_hi(void)
 
 /**
  * PWM timer commutation event interrupt handler
+ *
+ * The step that just took effect was preloaded by pwm_scheme, its handlers
+ * are run before the next step gets preloaded, possibly from a newly
+ * selected scheme.
  */
 void tim1_trg_com_irq_handler(void)
 {
+	const struct pwm_step_scheme *scheme = pwm_scheme;
+
 	TIM_ClearITPendingBit(TIM1, TIM_IT_COM);
 
 	//ON(LED_BLUE);
 
-	TIM_SetCompare1(TIM1, pwm_val);
-	TIM_SetCompare2(TIM1, pwm_val);
-	TIM_SetCompare3(TIM1, pwm_val);
+	if (scheme->comm != NULL) {
+		scheme->comm();
+	} else {
+		TIM_SetCompare1(TIM1, pwm_duty());
+		TIM_SetCompare2(TIM1, pwm_duty());
+		TIM_SetCompare3(TIM1, pwm_duty());
+	}
 	TIM_SetCompare4(TIM1, pwm_offset);
 
-	PWM__SCHEME();
+	/* The preload still holds the step that just took effect */
+	pwm_floating = pwm_steps_floating(TIM1->CCER);
+
+	if (scheme->update != pwm_update) {
+		pwm_update = scheme->update;
+		TIM_ITConfig(TIM1, TIM_IT_Update,
+			     (pwm_update != NULL) ? ENABLE : DISABLE);
+	}
+
+	pwm_steps_comm();
+
+	trace_log(trace_ev_comm, (u8)pwm_mode, pwm_val);
 	//OFF(LED_BLUE);
 }
 
+/**
+ * PWM timer update event interrupt handler
+ *
+ * Only enabled while a scheme modulating the phases within a step is in
+ * effect.
+ */
+void tim1_up_irq_handler(void)
+{
+	void (*update)(void) = pwm_update;
+
+	TIM_ClearITPendingBit(TIM1, TIM_IT_Update);
+
+	if (update != NULL)
+		update();
+}
+
 /**
  * PWM timer capture compare event interrupt handler
  */
 void tim1_cc_irq_handler(void)
 {
+#ifdef BEMF_HD__QUALIFY
+	/* End of the on time, only enabled while a BEMF edge is voted on */
+	if (TIM_GetITStatus(TIM1, TIM_IT_CC1) != RESET) {
+		TIM_ClearITPendingBit(TIM1, TIM_IT_CC1);
+		bemf_hd_sample(true);
+	}
+#endif
+
 	if (TIM_GetITStatus(TIM1, TIM_IT_CC4) != RESET) {
 		TIM_ClearITPendingBit(TIM1, TIM_IT_CC4);
 
 		/* Toggling ORANGE LED ca. 22us after pwm duty cycle start of PWM1 */
 		//if(pwm_trig_led) TOGGLE(LED_ORANGE);
+#ifdef BEMF_HD__QUALIFY
+		bemf_hd_sample(false);
+#endif
 	}
 }
@@ -19,14 +19,19 @@
 #ifndef __PWM_H
 #define __PWM_H
 
+#include "trace.h"
+
 #define PWM_SET(VAL)							\
-	if(VAL >= 0) {							\
-		pwm_mode = PWM_DRIVE;					\
-		pwm_val = (((PWM__BASE_CLOCK / PWM__FREQUENCY) * VAL) / PWM__MAX_POWER); \
-	} else {							\
-		pwm_mode = PWM_BRAKE;					\
-		pwm_val = (((PWM__BASE_CLOCK / PWM__FREQUENCY) * -VAL) / PWM__MAX_POWER); \
-	}
+	do {								\
+		if ((VAL) >= 0) {					\
+			pwm_mode = PWM_DRIVE;				\
+			pwm_val = (((PWM__BASE_CLOCK / PWM__FREQUENCY) * (VAL)) / PWM__MAX_POWER); \
+		} else {						\
+			pwm_mode = PWM_BRAKE;				\
+			pwm_val = (((PWM__BASE_CLOCK / PWM__FREQUENCY) * -(VAL)) / PWM__MAX_POWER); \
+		}							\
+		trace_log(trace_ev_pwm, (u8)pwm_mode, (u16)pwm_val);	\
+	} while (0)
 
 enum pwm_mode {
 	PWM_DRIVE,
@@ -35,11 +40,29 @@ enum pwm_mode {
 
 extern volatile enum pwm_mode pwm_mode;
 extern volatile uint32_t pwm_val;
+extern volatile uint32_t pwm_duty_max;
+extern volatile u8 pwm_floating;
 
 void pwm_init(void);
 void pwm_off(void);
 void pwm_all_lo(void);
 void pwm_all_hi(void);
 void pwm_comm(void);
+int pwm_scheme_select(u16 id);
+void pwm_handle_scheme_reg(void);
+void pwm_foc_start(void);
+void pwm_foc_stop(void);
+void pwm_foc_set(const u16 duty[3]);
+void pwm_limit(u16 duty);
+
+/**
+ * Duty cycle in effect, pwm_val capped by the current limit.
+ *
+ * @return Compare value of the PWM phases
+ */
+static inline uint32_t pwm_duty(void)
+{
+	return (pwm_val < pwm_duty_max) ? pwm_val : pwm_duty_max;
+}
 
 #endif /* __PWM_H */
@@ -56,104 +56,37 @@
  * @endverbatim
  */
 
-#include <stm32/tim.h>
+#include "types.h"
 
-#include "pwm.h"
-#include "pwm_utils.h"
+#include "pwm_steps.h"
 
 #include "pwm_scheme_12step_pwm_on_pwm.h"
 
 /**
- * PWM scheme configuration function
+ * Steps, the scheme drives when braking too
  */
-void pwm_scheme_12step_pwm_on_pwm(void)
-{
-	static int pwm_phase = 1;
+static const struct pwm_step pwm_scheme_12step_pwm_on_pwm_drive[] = {
+	PWM_STEP(hpwm, off, low),	/* step 1 */
+	PWM_STEP(high, off, lpwm),	/* step 2 */
+	PWM_STEP(high, lpwm, off),	/* step 3 */
+	PWM_STEP(hpwm, low, off),	/* step 4 */
+	PWM_STEP(off, low, hpwm),	/* step 5 */
+	PWM_STEP(off, lpwm, high),	/* step 6 */
+	PWM_STEP(lpwm, off, high),	/* step 7 */
+	PWM_STEP(low, off, hpwm),	/* step 8 */
+	PWM_STEP(low, hpwm, off),	/* step 9 */
+	PWM_STEP(lpwm, high, off),	/* step 10 */
+	PWM_STEP(off, high, lpwm),	/* step 11 */
+	PWM_STEP(off, hpwm, low),	/* step 12 */
+};
 
-	switch (pwm_phase) {
-	case 1:		// 000
-
-		/* Configure step 2 */
-		pwm_set_a_high_b_off__c_lpwm();
-
-		pwm_phase++;
-		break;
-	case 2:		// 030
-
-		/* Configure step 3 */
-		pwm_set_a_high_b_lpwm_c_off();
-
-		pwm_phase++;
-		break;
-	case 3:		// 060
-
-		/* Configure step 4 */
-		pwm_set_a_hpwm_b_low__c_off();
-
-		pwm_phase++;
-		break;
-	case 4:		// 090
-
-		/* Configure step 5 */
-		pwm_set_a_off__b_low__c_hpwm();
-
-		pwm_phase++;
-		break;
-	case 5:		// 120
-
-		/* Configure step 6 */
-		pwm_set_a_off__b_lpwm_c_high();
-
-		pwm_phase++;
-		break;
-	case 6:		// 150
-
-		/* Configure step 7 */
-		pwm_set_a_lpwm_b_off__c_high();
-
-		pwm_phase++;
-		break;
-	case 7:		// 180
-
-		/* Configure step 8 */
-		pwm_set_a_low__b_off__c_hpwm();
-
-		pwm_phase++;
-		break;
-	case 8:		// 210
-
-		/* Configure step 9 */
-		pwm_set_a_low__b_hpwm_c_off();
-
-		pwm_phase++;
-		break;
-	case 9:		// 240
-
-		/* Configure step 10 */
-		pwm_set_a_lpwm_b_high_c_off();
-
-		pwm_phase++;
-		break;
-	case 10:		// 270
-
-		/* Configure step 11 */
-		pwm_set_a_off__b_high_c_lpwm();
-
-		pwm_phase++;
-		break;
-	case 11:		// 300
-
-		/* Configure step 12 */
-		pwm_set_a_off__b_hpwm_c_low();
-
-		pwm_phase++;
-		break;
-	case 12:		// 330
-
-		/* Configure step 1 */
-		pwm_set_a_hpwm_b_off__c_low();
-
-		pwm_phase = 1;
-		break;
-	}
-}
+/**
+ * PWM scheme description
+ */
+const struct pwm_step_scheme pwm_scheme_12step_pwm_on_pwm = {
+	pwm_scheme_12step_pwm_on_pwm_drive,
+	pwm_scheme_12step_pwm_on_pwm_drive,
+	12,
+	NULL,
+	NULL
+};
@@ -19,6 +19,8 @@
 #ifndef __PWM_SCHEME_12STEP_PWM_ON_PWM
 #define __PWM_SCHEME_12STEP_PWM_ON_PWM
 
-void pwm_scheme_12step_pwm_on_pwm(void);
+#include "pwm/pwm_steps.h"
+
+extern const struct pwm_step_scheme pwm_scheme_12step_pwm_on_pwm;
 
 #endif /* __PWM_SCHEME_12STEP_PWM_ON_PWM */
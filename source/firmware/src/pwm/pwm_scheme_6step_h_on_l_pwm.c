@@ -50,61 +50,31 @@
  * @endverbatim
  */
 
-#include <stm32/tim.h>
+#include "types.h"
 
-#include "pwm_utils.h"
+#include "pwm_steps.h"
 
 #include "pwm_scheme_6step_h_on_l_pwm.h"
 
 /**
- * PWM scheme configuration function
+ * Steps, the scheme drives when braking too
  */
-void pwm_scheme_6step_h_on_l_pwm(void)
-{
-	static int pwm_phase = 1;
+static const struct pwm_step pwm_scheme_6step_h_on_l_pwm_drive[] = {
+	PWM_STEP(high, off, lpwm),	/* step 1 */
+	PWM_STEP(high, lpwm, off),	/* step 2 */
+	PWM_STEP(off, lpwm, high),	/* step 3 */
+	PWM_STEP(lpwm, off, high),	/* step 4 */
+	PWM_STEP(lpwm, high, off),	/* step 5 */
+	PWM_STEP(off, high, lpwm),	/* step 6 */
+};
 
-	switch (pwm_phase) {
-	case 1:		// 000
-
-		/* Configure step 2 */
-		pwm_set_a_high_b_lpwm_c_off();
-
-		pwm_phase++;
-		break;
-	case 2:		// 060
-
-		/* Configure step 3 */
-		pwm_set_a_off__b_lpwm_c_high();
-
-		pwm_phase++;
-		break;
-	case 3:		// 120
-
-		/* Configure step 4 */
-		pwm_set_a_lpwm_b_off__c_high();
-
-		pwm_phase++;
-		break;
-	case 4:		// 180
-
-		/* Configure step 5 */
-		pwm_set_a_lpwm_b_high_c_off();
-
-		pwm_phase++;
-		break;
-	case 5:		// 220
-
-		/* Configure step 6 */
-		pwm_set_a_off__b_high_c_lpwm();
-
-		pwm_phase++;
-		break;
-	case 6:		// 280
-
-		/* Configure step 1 */
-		pwm_set_a_high_b_off__c_lpwm();
-
-		pwm_phase = 1;
-		break;
-	}
-}
+/**
+ * PWM scheme description
+ */
+const struct pwm_step_scheme pwm_scheme_6step_h_on_l_pwm = {
+	pwm_scheme_6step_h_on_l_pwm_drive,
+	pwm_scheme_6step_h_on_l_pwm_drive,
+	6,
+	NULL,
+	NULL
+};
@@ -19,6 +19,8 @@
 #ifndef __PWM_SCHEME_6STEP_H_ON_L_PWM
 #define __PWM_SCHEME_6STEP_H_ON_L_PWM
 
-void pwm_scheme_6step_h_on_l_pwm(void);
+#include "pwm/pwm_steps.h"
+
+extern const struct pwm_step_scheme pwm_scheme_6step_h_on_l_pwm;
 
 #endif /* __PWM_SCHEME_6STEP_H_ON_L_PWM */
@@ -101,109 +101,43 @@
  * @endverbatim
  */
 
-#include <stm32/tim.h>
+#include "types.h"
 
-#include "pwm_utils.h"
-#include "pwm/pwm.h"
+#include "pwm_steps.h"
 
 #include "pwm_scheme_6step_pwm_on.h"
 
 /**
- * PWM scheme configuration function
+ * Steps when driving
  */
-void pwm_scheme_6step_pwm_on(void)
-{
-	static int pwm_phase = 1;
+static const struct pwm_step pwm_scheme_6step_pwm_on_drive[] = {
+	PWM_STEP(hpwm, off, low),	/* step 1 */
+	PWM_STEP(high, lpwm, off),	/* step 2 */
+	PWM_STEP(off, low, hpwm),	/* step 3 */
+	PWM_STEP(lpwm, off, high),	/* step 4 */
+	PWM_STEP(low, hpwm, off),	/* step 5 */
+	PWM_STEP(off, high, lpwm),	/* step 6 */
+};
 
-	if (pwm_mode == PWM_DRIVE) {
-		switch (pwm_phase) {
-		case 1:		// 000
-
-			/* Configure step 2 */
-			pwm_set_a_high_b_lpwm_c_off();
-
-			pwm_phase++;
-			break;
-		case 2:		// 060
-
-			/* Configure step 3 */
-			pwm_set_a_off__b_low__c_hpwm();
-
-			pwm_phase++;
-			break;
-		case 3:		// 120
-
-			/* Configure step 4 */
-			pwm_set_a_lpwm_b_off__c_high();
-
-			pwm_phase++;
-			break;
-		case 4:		// 180
-
-			/* Configure step 5 */
-			pwm_set_a_low__b_hpwm_c_off();
-
-			pwm_phase++;
-			break;
-		case 5:		// 220
-
-			/* Configure step 6 */
-			pwm_set_a_off__b_high_c_lpwm();
-
-			pwm_phase++;
-			break;
-		case 6:		// 280
-
-			/* Configure step 1 */
-			pwm_set_a_hpwm_b_off__c_low();
-
-			pwm_phase = 1;
-			break;
-		}
-	} else { /* pwm_mode == PWM_BRAKE */
-		switch (pwm_phase) {
-		case 1:		// 000
-
-			/* Configure step 2 */
-			pwm_set_a_off__b_hpwm_c_off();
-
-			pwm_phase++;
-			break;
-		case 2:		// 060
-
-			/* Configure step 3 */
-			pwm_set_a_off__b_off__c_lpwm();
-
-			pwm_phase++;
-			break;
-		case 3:		// 120
-
-			/* Configure step 4 */
-			pwm_set_a_hpwm_b_off__c_off();
-
-			pwm_phase++;
-			break;
-		case 4:		// 180
-
-			/* Configure step 5 */
-			pwm_set_a_off__b_lpwm_c_off();
-
-			pwm_phase++;
-			break;
-		case 5:		// 220
-
-			/* Configure step 6 */
-			pwm_set_a_off__b_off__c_hpwm();
-
-			pwm_phase++;
-			break;
-		case 6:		// 280
-
-			/* Configure step 1 */
-			pwm_set_a_lpwm_b_off__c_off();
+/**
+ * Steps when braking
+ */
+static const struct pwm_step pwm_scheme_6step_pwm_on_brake[] = {
+	PWM_STEP(lpwm, off, off),	/* step 1 */
+	PWM_STEP(off, hpwm, off),	/* step 2 */
+	PWM_STEP(off, off, lpwm),	/* step 3 */
+	PWM_STEP(hpwm, off, off),	/* step 4 */
+	PWM_STEP(off, lpwm, off),	/* step 5 */
+	PWM_STEP(off, off, hpwm),	/* step 6 */
+};
 
-			pwm_phase = 1;
-			break;
-		}
-	}
-}
+/**
+ * PWM scheme description
+ */
+const struct pwm_step_scheme pwm_scheme_6step_pwm_on = {
+	pwm_scheme_6step_pwm_on_drive,
+	pwm_scheme_6step_pwm_on_brake,
+	6,
+	NULL,
+	NULL
+};
@@ -19,6 +19,8 @@
 #ifndef __PWM_SCHEME_6STEP_PWM_ON
 #define __PWM_SCHEME_6STEP_PWM_ON
 
-void pwm_scheme_6step_pwm_on(void);
+#include "pwm/pwm_steps.h"
+
+extern const struct pwm_step_scheme pwm_scheme_6step_pwm_on;
 
 #endif /* __PWM_SCHEME_6STEP_PWM_ON */
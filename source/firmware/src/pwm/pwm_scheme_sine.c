@@ -0,0 +1,251 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   pwm_scheme_sine.c
+ *
+ * @brief  Implementation of the sinusoidal PWM scheme.
+ *
+ * All three phases are switched complementary and their compare values
+ * follow a sine, or a sine with injected third harmonic, over the
+ * electrical revolution. The six steps of the scheme only mark the
+ * commutation events, each one resynchronizes the electrical angle to the
+ * start of the 60 sector the 6 step block schemes apply in the same step:
+ * @verbatim
+ *  | 1| 2| 3| 4| 5| 6|
+ * -+--+--+--+--+--+--+
+ *  |  |  |  |  |  |  '-  30
+ *  |  |  |  |  |  '---- 330
+ *  |  |  |  |  '------- 270
+ *  |  |  |  '---------- 210
+ *  |  |  '------------- 150
+ *  |  '----------------  90
+ *  '-------------------  30
+ * A: sin(angle)
+ * B: sin(angle + 120)
+ * C: sin(angle - 120)
+ * @endverbatim
+ *
+ * Between two commutations the angle advances every PWM period by the
+ * amount the commutation timer period @ref comm_tim_data.freq predicts and
+ * stops at the end of the step if the next commutation is late. The
+ * division for that is done once per commutation, the PWM update interrupt
+ * only does a table lookup and a multiply per phase.
+ *
+ * The quarter wave table is built at startup from the PWM__SINE_*
+ * definitions in the configuration. The compare values swing by
+ * +/- pwm_duty() / 2 around the middle of the PWM period at full table
+ * amplitude. When braking the same modulation is used, the complementary
+ * switching regenerates as soon as the amplitude drops below the BEMF.
+ *
+ * With all phases driven there is no floating phase left for the BEMF
+ * comparators, they follow the applied voltages instead. The commutation
+ * timing therefore keeps the speed it had when the scheme was selected.
+ */
+
+#include "config.h"
+
+#include <stm32/tim.h>
+
+#include "types.h"
+
+#include "foc.h"
+#include "comm_tim.h"
+
+#include "pwm_steps.h"
+#include "pwm/pwm.h"
+
+#include "pwm_scheme_sine.h"
+
+/**
+ * Number of quarter wave table entries.
+ */
+#define PWM_SINE_TABLE_SIZE (1 << PWM__SINE_TABLE_BITS)
+
+/**
+ * Number of angle bits below the table index.
+ */
+#define PWM_SINE_INDEX_SHIFT (14 - PWM__SINE_TABLE_BITS)
+
+/**
+ * 2/sqrt(3) in Q15, scales the third harmonic injected sine to unity peak.
+ */
+#define PWM_SINE_THIRD_HARMONIC_GAIN 37837
+
+/**
+ * Electrical angle of one step, with 8 fractional bits.
+ */
+#define PWM_SINE_STEP_ANGLE ((1UL << 24) / 6)
+
+/**
+ * PWM period in TIM1 counts.
+ */
+#define PWM_SINE_PERIOD ((PWM__BASE_CLOCK / PWM__FREQUENCY) + 1)
+
+/**
+ * TIM1 counts per commutation timer tick, see comm_tim_init().
+ */
+#define PWM_SINE_COMM_TIM_PRESCALER 5
+
+/**
+ * Angle increment per PWM period times the commutation timer period, a
+ * step lasts two commutation timer periods.
+ */
+#define PWM_SINE_INC ((PWM_SINE_STEP_ANGLE * PWM_SINE_PERIOD) / \
+		      (2 * PWM_SINE_COMM_TIM_PRESCALER))
+
+/**
+ * One third of the electrical revolution.
+ */
+#define PWM_SINE_ANGLE_120 21845
+
+#ifndef PWM__SINE_TABLE_BITS
+#error "PWM__SINE_TABLE_BITS is not configured"
+#endif
+
+#if (PWM__SINE_TABLE_BITS < 2) || (PWM__SINE_TABLE_BITS > 12)
+#error "PWM__SINE_TABLE_BITS has to be in the range 2 to 12"
+#endif
+
+/**
+ * Sine scheme internal state
+ */
+struct pwm_scheme_sine_state {
+	u16 base;		/**< Electrical angle at the start of the step */
+	u32 progress;		/**< Angle advance within the step, 8 fractional bits */
+	u32 inc;		/**< Angle advance per PWM period, 8 fractional bits */
+};
+
+static void pwm_scheme_sine_comm(void);
+static void pwm_scheme_sine_update(void);
+
+/**
+ * Quarter wave table, scaled by PWM__SINE_AMPLITUDE
+ */
+static s16 pwm_scheme_sine_table[PWM_SINE_TABLE_SIZE + 1];
+
+static struct pwm_scheme_sine_state pwm_scheme_sine_state;
+
+/**
+ * Steps, all phases complementary PWM
+ */
+static const struct pwm_step pwm_scheme_sine_steps[] = {
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 1 */
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 2 */
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 3 */
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 4 */
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 5 */
+	PWM_STEP(cpwm, cpwm, cpwm),	/* step 6 */
+};
+
+const struct pwm_step_scheme pwm_scheme_sine = {
+	pwm_scheme_sine_steps,
+	pwm_scheme_sine_steps,
+	6,
+	pwm_scheme_sine_comm,
+	pwm_scheme_sine_update
+};
+
+/**
+ * Build the quarter wave table.
+ */
+void pwm_scheme_sine_init(void)
+{
+	s16 s;
+	s16 c;
+	s32 v;
+	int i;
+
+	for (i = 0; i <= PWM_SINE_TABLE_SIZE; i++) {
+		u16 angle = (u16)(i << PWM_SINE_INDEX_SHIFT);
+
+		foc_sin_cos(angle, &s, &c);
+		v = s;
+#ifdef PWM__SINE_THIRD_HARMONIC
+		foc_sin_cos((u16)(3 * angle), &s, &c);
+		v = ((v + s / 6) * PWM_SINE_THIRD_HARMONIC_GAIN) >> 15;
+#endif
+		pwm_scheme_sine_table[i] = (s16)((v * PWM__SINE_AMPLITUDE) >> 15);
+	}
+
+	pwm_scheme_sine_state.base = 0;
+	pwm_scheme_sine_state.progress = 0;
+	pwm_scheme_sine_state.inc = 0;
+}
+
+/**
+ * Modulation waveform value.
+ *
+ * @param angle Electrical angle, 2^16 is one revolution
+ * @return Waveform value in Q15 scaled by PWM__SINE_AMPLITUDE
+ */
+s16 pwm_scheme_sine_lookup(u16 angle)
+{
+	u16 x = (angle >> PWM_SINE_INDEX_SHIFT) & (PWM_SINE_TABLE_SIZE - 1);
+
+	switch (angle >> 14) {
+	case 0:
+		return pwm_scheme_sine_table[x];
+	case 1:
+		return pwm_scheme_sine_table[PWM_SINE_TABLE_SIZE - x];
+	case 2:
+		return -pwm_scheme_sine_table[x];
+	default:
+		return -pwm_scheme_sine_table[PWM_SINE_TABLE_SIZE - x];
+	}
+}
+
+/**
+ * Resynchronize the electrical angle to the step taking effect.
+ */
+static void pwm_scheme_sine_comm(void)
+{
+	u32 freq = comm_tim_data.freq;
+
+	pwm_scheme_sine_state.base = (u16)(((2 * pwm_step + 1) << 16) / 12);
+	pwm_scheme_sine_state.progress = 0;
+	pwm_scheme_sine_state.inc = PWM_SINE_INC / ((freq != 0) ? freq : 1);
+}
+
+/**
+ * Advance the electrical angle and preload the compare values for the next
+ * PWM period.
+ */
+static void pwm_scheme_sine_update(void)
+{
+	u32 progress = pwm_scheme_sine_state.progress +
+		pwm_scheme_sine_state.inc;
+	s32 amplitude = (s32)pwm_duty();
+	u16 half = (PWM__BASE_CLOCK / PWM__FREQUENCY) / 2;
+	u16 angle;
+
+	if (progress > PWM_SINE_STEP_ANGLE)
+		progress = PWM_SINE_STEP_ANGLE;
+	pwm_scheme_sine_state.progress = progress;
+
+	angle = pwm_scheme_sine_state.base + (u16)(progress >> 8);
+
+	TIM_SetCompare1(TIM1, half + (u16)((pwm_scheme_sine_lookup(angle) *
+					    amplitude) >> 16));
+	TIM_SetCompare2(TIM1, half + (u16)((pwm_scheme_sine_lookup(angle +
+					     PWM_SINE_ANGLE_120) *
+					    amplitude) >> 16));
+	TIM_SetCompare3(TIM1, half + (u16)((pwm_scheme_sine_lookup(angle -
+					     PWM_SINE_ANGLE_120) *
+					    amplitude) >> 16));
+}
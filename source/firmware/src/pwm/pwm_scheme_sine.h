@@ -0,0 +1,29 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PWM_SCHEME_SINE
+#define __PWM_SCHEME_SINE
+
+#include "pwm/pwm_steps.h"
+
+extern const struct pwm_step_scheme pwm_scheme_sine;
+
+void pwm_scheme_sine_init(void);
+s16 pwm_scheme_sine_lookup(u16 angle);
+
+#endif /* __PWM_SCHEME_SINE */
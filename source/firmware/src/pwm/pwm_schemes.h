@@ -24,5 +24,21 @@
 #include "pwm_scheme_6step_on_pwm.h"
 #include "pwm_scheme_6step_pwm_on.h"
 #include "pwm_scheme_12step_pwm_on_pwm.h"
+#include "pwm_scheme_sine.h"
+
+/**
+ * PWM scheme numbers as used in the governor PWM scheme register.
+ */
+enum pwm_scheme_id {
+	pwm_scheme_id_6step_pwm_on = 0,
+	pwm_scheme_id_6step_on_pwm,
+	pwm_scheme_id_6step_h_pwm_l_on,
+	pwm_scheme_id_6step_h_on_l_pwm,
+	pwm_scheme_id_12step_pwm_on_pwm,
+	pwm_scheme_id_sine,
+	pwm_scheme_id_num
+};
+
+extern const struct pwm_step_scheme *const pwm_schemes[pwm_scheme_id_num];
 
 #endif /* __PWM_SCHEMES_H */
@@ -0,0 +1,75 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   pwm_steps.c
+ *
+ * @brief  Table driven commutation step engine.
+ *
+ * The PWM schemes are described as const tables of the channel 1-3 bits of
+ * the TIM1 CCER, CCMR1 and CCMR2 registers for every step (see
+ * @ref pwm_steps.h). The remaining bits of these registers do not change
+ * after the timer is initialized, they are captured once so that the
+ * commutation interrupt only has to store three precomputed values instead
+ * of doing read-modify-write cycles on the timer registers.
+ */
+
+#include <stm32/tim.h>
+
+#include "types.h"
+
+#include "comm_tim.h"
+#include "pwm_steps.h"
+
+struct pwm_step_base pwm_step_base;	/**< Static TIM1 register bits */
+u8 pwm_step;				/**< Index of the currently preloaded step */
+const struct pwm_step_scheme *pwm_scheme; /**< Active PWM scheme */
+/** PWM scheme to switch to at the next commutation, NULL if none */
+const struct pwm_step_scheme *volatile pwm_scheme_next;
+
+/**
+ * Capture the TIM1 register bits not owned by the commutation steps.
+ *
+ * Has to be called after the TIM1 output compare channels are configured.
+ */
+void pwm_steps_init(void)
+{
+	pwm_step_base.ccer = TIM1->CCER & ~PWM_STEP_CCER_MASK;
+	pwm_step_base.ccmr1 = TIM1->CCMR1 & ~PWM_STEP_CCMR1_MASK;
+	pwm_step_base.ccmr2 = TIM1->CCMR2 & ~PWM_STEP_CCMR2_MASK;
+	pwm_step = 0;
+}
+
+/**
+ * Map the current step index from one scheme onto another one.
+ *
+ * Keeps the electrical angle when switching between schemes with a
+ * different number of steps per revolution, the commutation time is
+ * rescaled to the new step length.
+ *
+ * @param from Scheme the current step index belongs to
+ * @param to Scheme that is going to be used from now on
+ */
+void pwm_steps_switch(const struct pwm_step_scheme *from,
+		      const struct pwm_step_scheme *to)
+{
+	if (from->steps != to->steps) {
+		pwm_step = (u8)((pwm_step * to->steps) / from->steps);
+		comm_tim_rescale(from->steps, to->steps);
+	}
+}
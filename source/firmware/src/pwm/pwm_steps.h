@@ -0,0 +1,206 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PWM_STEPS_H
+#define __PWM_STEPS_H
+
+#include <stm32/tim.h>
+
+#include "types.h"
+
+#include "pwm_utils.h"
+#include "pwm/pwm.h"
+
+/**
+ * CCER bits owned by the commutation steps (CC1-3 E and NE).
+ */
+#define PWM_STEP_CCER_MASK 0x0555
+
+/**
+ * CCMR1 bits owned by the commutation steps (OC1M and OC2M).
+ */
+#define PWM_STEP_CCMR1_MASK 0x7070
+
+/**
+ * CCMR2 bits owned by the commutation steps (OC3M).
+ */
+#define PWM_STEP_CCMR2_MASK 0x0070
+
+/* Output enable bits of one phase in a given state */
+#define PWM_STEP_CCER_off (PWM_HI_OFF | PWM_LO_OFF)
+#define PWM_STEP_CCER_hpwm (PWM_HI_ON | PWM_LO_OFF)
+#define PWM_STEP_CCER_lpwm (PWM_HI_OFF | PWM_LO_ON)
+#define PWM_STEP_CCER_high (PWM_HI_ON | PWM_LO_ON)
+#define PWM_STEP_CCER_low (PWM_HI_ON | PWM_LO_ON)
+#define PWM_STEP_CCER_cpwm (PWM_HI_ON | PWM_LO_ON)
+
+/* Output compare mode of one phase in a given state */
+#define PWM_STEP_MODE_off pwm_conf_mode_off
+#define PWM_STEP_MODE_hpwm pwm_conf_mode_pwm
+#define PWM_STEP_MODE_lpwm pwm_conf_mode_pwm
+#define PWM_STEP_MODE_high pwm_conf_mode_high
+#define PWM_STEP_MODE_low pwm_conf_mode_low
+#define PWM_STEP_MODE_cpwm pwm_conf_mode_pwm
+
+/**
+ * Commutation step table entry initializer.
+ *
+ * Each phase is one of off, hpwm, lpwm, high or low, the same states the
+ * pwm_set_a_*_b_*_c_* manipulators in @ref pwm_utils.h are named after, or
+ * cpwm for complementary PWM on both switches as used by the field oriented
+ * control.
+ *
+ * @code
+ * PWM_STEP(hpwm, off, low)
+ * @endcode
+ */
+#define PWM_STEP(A, B, C)						\
+	{								\
+		(PWM_STEP_CCER_##A << 0) |				\
+		(PWM_STEP_CCER_##B << 4) |				\
+		(PWM_STEP_CCER_##C << 8),				\
+		PWM_STEP_MODE_##A | (PWM_STEP_MODE_##B << 8),		\
+		PWM_STEP_MODE_##C					\
+	}
+
+/**
+ * Channel 1-3 part of the TIM1 register images of one commutation step.
+ */
+struct pwm_step {
+	u16 ccer;		/**< CCER output enable bits */
+	u16 ccmr1;		/**< CCMR1 output compare modes of phase A and B */
+	u16 ccmr2;		/**< CCMR2 output compare mode of phase C */
+};
+
+/**
+ * PWM scheme description.
+ *
+ * A scheme is a list of steps per electrical revolution for driving and
+ * braking. Both tables have to have the same length, schemes without a
+ * separate braking sequence use the driving table for both.
+ *
+ * Block commutation schemes use the same compare value on all phases and
+ * have no handlers. Schemes that modulate the phases within a step set the
+ * compare values themselves from the handlers instead.
+ */
+struct pwm_step_scheme {
+	const struct pwm_step *drive;	/**< Steps when driving */
+	const struct pwm_step *brake;	/**< Steps when braking */
+	u8 steps;			/**< Number of steps per electrical revolution */
+	void (*comm)(void);		/**< Called when a step of the scheme takes effect */
+	void (*update)(void);		/**< Called every PWM period during a step of the scheme */
+};
+
+/**
+ * TIM1 register bits not owned by the commutation steps, captured by
+ * pwm_steps_init().
+ */
+struct pwm_step_base {
+	u16 ccer;		/**< CCER channel 4 and polarity bits */
+	u16 ccmr1;		/**< CCMR1 preload and selection bits */
+	u16 ccmr2;		/**< CCMR2 channel 4, preload and selection bits */
+};
+
+extern struct pwm_step_base pwm_step_base;
+extern u8 pwm_step;
+extern const struct pwm_step_scheme *pwm_scheme;
+extern const struct pwm_step_scheme *volatile pwm_scheme_next;
+
+void pwm_steps_init(void);
+void pwm_steps_switch(const struct pwm_step_scheme *from,
+		      const struct pwm_step_scheme *to);
+
+/**
+ * Phases a CCER image leaves floating.
+ *
+ * @param ccer TIM1 CCER value
+ * @return Phases with both outputs disabled, bit 0 is phase A
+ */
+static inline u8 pwm_steps_floating(u16 ccer)
+{
+	u8 floating = 0;
+	int phase;
+
+	for (phase = 0; phase < 3; phase++)
+		if (((ccer >> (4 * phase)) & (PWM_HI_ON | PWM_LO_ON)) == 0)
+			floating |= (u8)(1 << phase);
+
+	return floating;
+}
+
+/**
+ * Preload a given commutation step of a scheme.
+ *
+ * The new configuration takes effect with the next COM event.
+ *
+ * @param scheme PWM scheme
+ * @param index Step index, below the number of steps of the scheme
+ */
+static inline void pwm_steps_load(const struct pwm_step_scheme *scheme,
+				  u8 index)
+{
+	const struct pwm_step *step;
+
+	pwm_step = index;
+
+	step = ((pwm_mode == PWM_DRIVE) ? scheme->drive : scheme->brake) + index;
+
+	TIM1->CCER = pwm_step_base.ccer | step->ccer;
+	TIM1->CCMR1 = pwm_step_base.ccmr1 | step->ccmr1;
+	TIM1->CCMR2 = pwm_step_base.ccmr2 | step->ccmr2;
+}
+
+/**
+ * Preload the next commutation step of a scheme.
+ *
+ * Three register stores and an index increment, the new configuration takes
+ * effect with the next COM event.
+ *
+ * @param scheme Active PWM scheme
+ */
+static inline void pwm_steps_next(const struct pwm_step_scheme *scheme)
+{
+	u8 next = pwm_step + 1;
+
+	if (next >= scheme->steps)
+		next = 0;
+
+	pwm_steps_load(scheme, next);
+}
+
+/**
+ * Preload the next commutation step of the active scheme.
+ *
+ * Switches to a newly selected scheme first, so a scheme change always
+ * takes effect at a commutation boundary. Costs one load and compare on top
+ * of @ref pwm_steps_next when no switch is pending.
+ */
+static inline void pwm_steps_comm(void)
+{
+	const struct pwm_step_scheme *next = pwm_scheme_next;
+
+	if (next != NULL) {
+		pwm_steps_switch(pwm_scheme, next);
+		pwm_scheme = next;
+		pwm_scheme_next = NULL;
+	}
+
+	pwm_steps_next(pwm_scheme);
+}
+
+#endif /* __PWM_STEPS_H */
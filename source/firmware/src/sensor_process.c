@@ -36,6 +36,7 @@
 #include "driver/led.h"
 #include "driver/adc.h"
 #include "gprot.h"
+#include "filter.h"
 
 #include "sensor_process.h"
 
@@ -48,28 +49,28 @@ struct sensor_params {
 	 */
 	struct pv {
 		s32 offset; /**< how much to offset the value */
-		u32 iir;    /**< IIR filter value */
+		struct filter_iir iir; /**< IIR filter */
 	} pv;
 	/**
 	 * Supply rail voltage post processing parameters
 	 */
 	struct bv {
 		s32 offset; /**< how much to offset the value */
-		u32 iir;    /**< IIR filter value */
+		struct filter_iir iir; /**< IIR filter */
 	} bv;
 	/**
 	 * Global controller current
 	 */
 	struct c {
 		s32 offset;	 /**< The value of zero */
-		u32 iir;	 /**< IIR filter value */
+		struct filter_iir iir; /**< IIR filter */
 	} c;
 	/**
 	 * Powerstage temperature
 	 */
 	struct t {
 		s32 offset; /**< Zero temperature offset value */
-		u32 iir;	 /**< IIR filter value */
+		struct filter_iir iir; /**< IIR filter */
 	} t;
 };
 
@@ -94,10 +95,9 @@ volatile bool *sensor_process_trigger;
 static int sensor_trigger_debug_output;
 
 /**
- * Infinite Impulse Response filter calculation
+ * Default IIR filter pole shift of the sensor values
  */
-#define SENSOR_OFFSET_IIR(VALUE, NEW_VALUE, OFFSET, IIR) \
-	(((VALUE * IIR) + (NEW_VALUE + OFFSET)) / (IIR + 1))
+#define SENSOR_IIR_SHIFT 4
 
 /**
  * Sensor process initializer.
@@ -121,11 +121,11 @@ void sensor_process_init(void)
 	sensors.temp = 0;
 
 	sensor_params.bv.offset = 0;
-	sensor_params.bv.iir = 20;
+	filter_iir_init(&sensor_params.bv.iir, SENSOR_IIR_SHIFT, 0);
 	sensor_params.c.offset = 0;
-	sensor_params.c.iir = 20;
+	filter_iir_init(&sensor_params.c.iir, SENSOR_IIR_SHIFT, 0);
 	sensor_params.t.offset = 0;
-	sensor_params.t.iir = 20;
+	filter_iir_init(&sensor_params.t.iir, SENSOR_IIR_SHIFT, 0);
 
 	sensor_trigger_debug_output = 0;
 }
@@ -138,38 +138,40 @@ void sensor_process_reset(void)
 	sensors.battery_voltage = 0;
 	sensors.current = 0;
 	sensors.temp = 0;
+
+	filter_iir_set(&sensor_params.bv.iir, 0);
+	filter_iir_set(&sensor_params.c.iir, 0);
+	filter_iir_set(&sensor_params.t.iir, 0);
 }
 
 /**
  * The main periodic process implementation.
  *
  * This function is being called every time new sensor data arrives through the
- * interrupt system.
+ * interrupt system. The ADC driver hands in the averages of all samples
+ * taken since the previous call.
  */
 void run_sensor_process(void)
 {
-	u16 battery_voltage = adc_data.battery_voltage;
-	u16 current = adc_data.current;
-	u16 temp = adc_data.temp;
+	u16 battery_voltage = adc_data.battery_voltage_avg;
+	u16 current = adc_data.current_avg;
+	u16 temp = adc_data.temp_avg;
 
 	//TOGGLE(LED_RED);
 	/* Calculate battery voltage */
-	sensors.battery_voltage =
-		SENSOR_OFFSET_IIR(sensors.battery_voltage, battery_voltage,
-				sensor_params.bv.offset,
-				sensor_params.bv.iir);
+	sensors.battery_voltage = (s16)
+		filter_iir_update(&sensor_params.bv.iir,
+				battery_voltage + sensor_params.bv.offset);
 
 	/* Calculate global current */
-	sensors.current =
-		SENSOR_OFFSET_IIR(sensors.current, current,
-				sensor_params.c.offset,
-				sensor_params.c.iir);
+	sensors.current = (s16)
+		filter_iir_update(&sensor_params.c.iir,
+				current + sensor_params.c.offset);
 
 	/* Calculate power stage temperature */
-	sensors.temp =
-		SENSOR_OFFSET_IIR(sensors.temp, temp,
-				sensor_params.t.offset,
-				sensor_params.t.iir);
+	sensors.temp = (s16)
+		filter_iir_update(&sensor_params.t.iir,
+				temp + sensor_params.t.offset);
 
 	if (sensor_trigger_debug_output == 10) {
 		sensor_trigger_debug_output = 0;
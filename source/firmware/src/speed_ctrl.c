@@ -0,0 +1,126 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   speed_ctrl.c
+ *
+ * @brief  Fixed point PI speed controller.
+ *
+ * Hardware independent part of the speed control process (see
+ * speed_process.c).
+ */
+
+#include "types.h"
+
+#include "speed_ctrl.h"
+
+static s32 speed_ctrl_clamp(s32 val, s32 min, s32 max)
+{
+	if (val > max)
+		return max;
+	if (val < min)
+		return min;
+	return val;
+}
+
+/**
+ * Initialize the speed controller.
+ *
+ * @param sc Speed controller state
+ * @param kp Proportional gain
+ * @param ki Integral gain
+ * @param kff Feed forward gain
+ * @param min Lower output limit
+ * @param max Upper output limit
+ */
+void speed_ctrl_init(struct speed_ctrl *sc, s32 kp, s32 ki, s32 kff,
+		     s16 min, s16 max)
+{
+	sc->kp = kp;
+	sc->ki = ki;
+	sc->kff = kff;
+	sc->min = min;
+	sc->max = max;
+
+	speed_ctrl_reset(sc, 0, min);
+}
+
+/**
+ * Preset the integrator for a bumpless takeover.
+ *
+ * The next update at the setpoint without speed error outputs out.
+ *
+ * @param sc Speed controller state
+ * @param setpoint Speed setpoint [rpm]
+ * @param out Output currently applied
+ */
+void speed_ctrl_reset(struct speed_ctrl *sc, u16 setpoint, s16 out)
+{
+	s32 min = (s32)sc->min << SPEED_CTRL_FRAC_BITS;
+	s32 max = (s32)sc->max << SPEED_CTRL_FRAC_BITS;
+	s32 ff = speed_ctrl_clamp(sc->kff * setpoint, min, max);
+
+	sc->integral = speed_ctrl_clamp(((s32)out << SPEED_CTRL_FRAC_BITS) - ff,
+					min - ff, max - ff);
+}
+
+/**
+ * Run one speed controller step.
+ *
+ * @param sc Speed controller state
+ * @param setpoint Speed setpoint [rpm]
+ * @param rpm Measured speed [rpm]
+ * @return New output
+ */
+s16 speed_ctrl_update(struct speed_ctrl *sc, u16 setpoint, u16 rpm)
+{
+	s32 min = (s32)sc->min << SPEED_CTRL_FRAC_BITS;
+	s32 max = (s32)sc->max << SPEED_CTRL_FRAC_BITS;
+	s32 error = speed_ctrl_clamp((s32)setpoint - rpm, -32768, 32767);
+	s32 ff = speed_ctrl_clamp(sc->kff * setpoint, min, max);
+	s32 p = speed_ctrl_clamp(sc->kp * error, min - max, max - min);
+	s32 out;
+
+	sc->integral = speed_ctrl_clamp(sc->integral + sc->ki * error,
+					min - ff, max - ff);
+
+	out = speed_ctrl_clamp(ff + p + sc->integral, min, max);
+
+	return (s16)(out >> SPEED_CTRL_FRAC_BITS);
+}
+
+/**
+ * Convert a commutation period to a speed.
+ *
+ * @param k Speed in rpm times period in timer ticks
+ * @param period Measured period [timer ticks]
+ * @return Mechanical speed [rpm], saturated to 16 bit
+ */
+u16 speed_ctrl_rpm(u32 k, u32 period)
+{
+	u32 rpm;
+
+	if (period == 0)
+		return 0xFFFF;
+
+	rpm = k / period;
+	if (rpm > 0xFFFF)
+		return 0xFFFF;
+
+	return (u16)rpm;
+}
@@ -0,0 +1,55 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SPEED_CTRL_H
+#define __SPEED_CTRL_H
+
+#include "types.h"
+
+/**
+ * Number of fractional bits of the speed controller gains.
+ */
+#define SPEED_CTRL_FRAC_BITS 12
+
+/**
+ * Fixed point PI speed controller with feed forward.
+ *
+ * The output is the PWM power in the units of PWM_SET(). The feed forward
+ * term gives the power needed to run at the setpoint without load, the PI
+ * part only has to make up for the load. The integrator is clamped so that
+ * feed forward and integrator together stay within the output limits, that
+ * way it can not wind up while the output is saturated.
+ *
+ * All gains have to be below 2^15.
+ */
+struct speed_ctrl {
+	s32 kp;			/**< Proportional gain, power per rpm in Q(SPEED_CTRL_FRAC_BITS) */
+	s32 ki;			/**< Integral gain per update in Q(SPEED_CTRL_FRAC_BITS) */
+	s32 kff;		/**< Feed forward gain, power per rpm in Q(SPEED_CTRL_FRAC_BITS) */
+	s16 min;		/**< Lower output limit */
+	s16 max;		/**< Upper output limit */
+	s32 integral;		/**< Integrator with SPEED_CTRL_FRAC_BITS fractional bits */
+};
+
+void speed_ctrl_init(struct speed_ctrl *sc, s32 kp, s32 ki, s32 kff,
+		     s16 min, s16 max);
+void speed_ctrl_reset(struct speed_ctrl *sc, u16 setpoint, s16 out);
+s16 speed_ctrl_update(struct speed_ctrl *sc, u16 setpoint, u16 rpm);
+u16 speed_ctrl_rpm(u32 k, u32 period);
+
+#endif /* __SPEED_CTRL_H */
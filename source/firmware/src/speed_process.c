@@ -0,0 +1,173 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   speed_process.c
+ *
+ * @brief  Closed loop speed control process.
+ *
+ * Regulates the PWM power while the control process is spinning so that
+ * the motor holds the speed setpoint register. The speed is measured from
+ * the commutation timer period. The process runs from a soft timer at a
+ * fixed rate, independent of the motor speed, so the controller gains do
+ * not change with it.
+ *
+ * The controller follows the setpoint through a ramp starting at the speed
+ * the motor has when the control takes over, so that the step from the
+ * spinup speed and setpoint changes do not overshoot.
+ *
+ * A setpoint of zero disables the speed control, the power is then set
+ * through the PWM power register as before. While the speed control is
+ * active it overrides the PWM power register. The torque control takes
+ * precedence, while it regulates the current the speed control is idle.
+ */
+
+#include "config.h"
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+#include "driver/sys_tick.h"
+#include "pwm/pwm.h"
+#include "pwm/pwm_steps.h"
+#include "comm_tim.h"
+#include "comm_process.h"
+#include "control_process.h"
+#include "speed_ctrl.h"
+#include "torque_process.h"
+
+#include "speed_process.h"
+
+/**
+ * Internal state of the speed control process.
+ */
+struct speed_process_state {
+	u16 setpoint;		/**< Speed setpoint register [rpm], 0 disables */
+	u16 rpm;		/**< Measured speed register [rpm] */
+	u16 target;		/**< Ramped setpoint the controller follows [rpm] */
+	bool active;		/**< Speed control is driving the PWM power */
+	struct speed_ctrl ctrl;	/**< Speed controller */
+};
+
+static struct speed_process_state speed_process_state; /**< Internal state instance */
+
+static void speed_process_soft_timer_callback(int id);
+
+/**
+ * Initialize the speed control process.
+ */
+void speed_process_init(void)
+{
+	(void)gpc_setup_reg(GPROT_SPEED_SETPOINT_REG_ADDR,
+			    &speed_process_state.setpoint);
+	(void)gpc_setup_reg(GPROT_SPEED_RPM_REG_ADDR,
+			    &speed_process_state.rpm);
+
+	speed_process_state.setpoint = SPEED__SETPOINT;
+	speed_process_reset();
+
+	(void)sys_tick_timer_register(speed_process_soft_timer_callback,
+				      SPEED__TIME_BASE);
+}
+
+/**
+ * Reset the speed control process, keeps the setpoint.
+ */
+void speed_process_reset(void)
+{
+	speed_process_state.rpm = 0;
+	speed_process_state.target = 0;
+	speed_process_state.active = false;
+	speed_ctrl_init(&speed_process_state.ctrl, SPEED__KP, SPEED__KI,
+			SPEED__KFF, SPEED__MIN_POWER, SPEED__MAX_POWER);
+}
+
+/**
+ * PWM power currently applied, inverse of PWM_SET().
+ */
+static s16 speed_process_power(void)
+{
+	s32 power = ((s32)pwm_val * PWM__MAX_POWER) /
+		(PWM__BASE_CLOCK / PWM__FREQUENCY);
+
+	if (pwm_mode == PWM_BRAKE)
+		power = -power;
+
+	return (s16)power;
+}
+
+/**
+ * Speed control soft timer callback function.
+ */
+void speed_process_soft_timer_callback(int id)
+{
+	s32 period;
+	s16 power;
+
+	id = id;
+
+	if (control_process_get_state() != cps_spinning) {
+		speed_process_state.rpm = 0;
+		speed_process_state.active = false;
+		return;
+	}
+
+	/*
+	 * comm_tim_data.freq is half of a commutation step, shortened by the
+	 * spark advance, get the BEMF crossing period of 60 electrical degrees
+	 * back from it.
+	 */
+	period = (((s32)comm_tim_data.freq * 2 * pwm_scheme->steps) / 6) -
+		comm_data.spark_advance;
+	if (period < 1)
+		period = 1;
+
+	speed_process_state.rpm =
+		speed_ctrl_rpm((60UL * COMM_TIM_CLOCK) / (6 * SPEED__POLE_PAIRS),
+			       (u32)period);
+
+	if ((speed_process_state.setpoint == 0) || torque_process_active()) {
+		speed_process_state.active = false;
+		return;
+	}
+
+	if (!speed_process_state.active) {
+		speed_process_state.target = speed_process_state.rpm;
+		speed_ctrl_reset(&speed_process_state.ctrl,
+				 speed_process_state.target,
+				 speed_process_power());
+		speed_process_state.active = true;
+	}
+
+	if (speed_process_state.setpoint >
+	    (speed_process_state.target + SPEED__RAMP))
+		speed_process_state.target += SPEED__RAMP;
+	else if ((speed_process_state.setpoint + SPEED__RAMP) <
+		 speed_process_state.target)
+		speed_process_state.target -= SPEED__RAMP;
+	else
+		speed_process_state.target = speed_process_state.setpoint;
+
+	power = speed_ctrl_update(&speed_process_state.ctrl,
+				  speed_process_state.target,
+				  speed_process_state.rpm);
+	PWM_SET(power);
+}
@@ -0,0 +1,166 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   torque_process.c
+ *
+ * @brief  Current limit and torque control process.
+ *
+ * Runs the current controller (see current_ctrl.c) once every PWM period on
+ * the bus current the ADC samples at a fixed point of every PWM period,
+ * directly from the sample block complete interrupt.
+ *
+ * While the motor is driven the process always acts as a current limit: the
+ * controller output caps the duty cycle commanded through the PWM power
+ * register or the speed control, the cap is applied in the running PWM
+ * period through pwm_limit(). That way an overload is cut back in the next
+ * period instead of at the next commutation.
+ *
+ * With a non zero torque setpoint register the process takes over the PWM
+ * power while spinning and regulates the current to the setpoint, rising
+ * with TORQUE__SLEW counts per period. Setpoint and limit are ADC counts
+ * above TORQUE__CURRENT_OFFSET.
+ */
+
+#include "config.h"
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+#include "driver/adc.h"
+#include "pwm/pwm.h"
+#include "control_process.h"
+#include "current_ctrl.h"
+
+#include "torque_process.h"
+
+/**
+ * PWM period in timer counts.
+ */
+#define TORQUE_PWM_PERIOD (PWM__BASE_CLOCK / PWM__FREQUENCY)
+
+/**
+ * Operating mode of the torque control process.
+ */
+enum torque_process_mode {
+	tpm_off,		/**< Motor not driven, duty cap released */
+	tpm_limit,		/**< Capping the commanded duty at the current limit */
+	tpm_torque,		/**< Regulating the current to the setpoint */
+};
+
+/**
+ * Internal state of the torque control process.
+ */
+struct torque_process_state {
+	u16 setpoint;			/**< Torque setpoint register, 0 only limits */
+	enum torque_process_mode mode;	/**< Current operating mode */
+	struct current_ctrl ctrl;	/**< Current controller */
+};
+
+static struct torque_process_state torque_process_state; /**< Internal state instance */
+
+static void torque_process_adc_callback(void);
+
+/**
+ * Initialize the torque control process.
+ */
+void torque_process_init(void)
+{
+	(void)gpc_setup_reg(GPROT_TORQUE_SETPOINT_REG_ADDR,
+			    &torque_process_state.setpoint);
+
+	torque_process_state.setpoint = TORQUE__SETPOINT;
+	torque_process_reset();
+
+#ifdef TORQUE__ENABLE
+	adc_set_callback(torque_process_adc_callback);
+#endif
+}
+
+/**
+ * Reset the torque control process, keeps the setpoint.
+ */
+void torque_process_reset(void)
+{
+	torque_process_state.mode = tpm_off;
+	current_ctrl_init(&torque_process_state.ctrl, TORQUE__KP, TORQUE__KI,
+			  TORQUE__LIMIT, TORQUE__SLEW);
+	pwm_limit(TORQUE_PWM_PERIOD);
+}
+
+/**
+ * Check if the torque control overrides the PWM power.
+ *
+ * @return true while regulating the current to the setpoint
+ */
+bool torque_process_active(void)
+{
+	return torque_process_state.mode == tpm_torque;
+}
+
+/**
+ * ADC sample block complete callback function.
+ */
+void torque_process_adc_callback(void)
+{
+	enum control_process_state state = control_process_get_state();
+	s16 current = (s16)adc_data.current - TORQUE__CURRENT_OFFSET;
+	s16 setpoint = (s16)torque_process_state.setpoint;
+	u16 duty;
+	s16 power;
+
+	if ((state != cps_aligning) && (state != cps_spinup) &&
+	    (state != cps_spinning)) {
+		if (torque_process_state.mode != tpm_off) {
+			torque_process_state.mode = tpm_off;
+			pwm_limit(TORQUE_PWM_PERIOD);
+		}
+		return;
+	}
+
+	if ((state == cps_spinning) && (setpoint != 0)) {
+		if (torque_process_state.mode != tpm_torque) {
+			current_ctrl_reset(&torque_process_state.ctrl, current,
+					   (u16)pwm_duty());
+			torque_process_state.mode = tpm_torque;
+		}
+
+		duty = current_ctrl_update(&torque_process_state.ctrl, setpoint,
+					   current, TORQUE_PWM_PERIOD);
+
+		/* Round up so that PWM_SET() gives back at least duty */
+		power = (s16)((((u32)duty * PWM__MAX_POWER) +
+			       TORQUE_PWM_PERIOD - 1) / TORQUE_PWM_PERIOD);
+		PWM_SET(power);
+		pwm_limit(TORQUE_PWM_PERIOD);
+		return;
+	}
+
+	if (torque_process_state.mode != tpm_limit) {
+		current_ctrl_reset(&torque_process_state.ctrl, TORQUE__LIMIT,
+				   (u16)pwm_val);
+		torque_process_state.mode = tpm_limit;
+	}
+
+	duty = current_ctrl_update(&torque_process_state.ctrl, TORQUE__LIMIT,
+				   current, (u16)pwm_val);
+	pwm_limit(duty);
+}
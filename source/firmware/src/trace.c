@@ -0,0 +1,251 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   trace.c
+ *
+ * @brief  Timestamped binary event trace.
+ *
+ * The control and commutation code records state transitions, BEMF
+ * crossings, commutations and PWM changes into a small ring buffer. The
+ * buffer is frozen when the control process gives up closed loop control so
+ * that the events leading to a desync can be read out afterwards through the
+ * governor protocol (see @ref trace_def.h for the dump format).
+ */
+
+#include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "gprot.h"
+
+#include "trace.h"
+
+/**
+ * Trace buffer instance
+ */
+struct trace_buffer trace_buffer;
+
+/**
+ * Trace control register, see TRACE_CMD_*
+ */
+static u16 trace_ctrl;
+
+/**
+ * Trace status register, see TRACE_STATUS_FROZEN
+ */
+static u16 trace_status;
+
+/**
+ * Internal state of the trace dump process.
+ */
+struct trace_dump_state {
+	bool running;	/**< Dump in progress flag */
+	u32 next;	/**< Next event to be sent */
+	u32 end;	/**< One after the last event to be sent */
+};
+
+static struct trace_dump_state trace_dump_state; /**< Dump state instance */
+
+/**
+ * Hex digit lookup table
+ */
+static const char trace_hex[] = "0123456789ABCDEF";
+
+/**
+ * Write a value as fixed width hex number.
+ *
+ * @param buf Output buffer
+ * @param value Value to convert
+ * @param digits Amount of hex digits to write
+ *
+ * @return Pointer after the last written character
+ */
+static char *trace_put_hex(char *buf, u32 value, int digits)
+{
+	int i;
+
+	for (i = digits - 1; i >= 0; i--) {
+		buf[i] = trace_hex[value & 0xF];
+		value >>= 4;
+	}
+
+	return buf + digits;
+}
+
+/**
+ * Write an unsigned decimal number.
+ *
+ * @param buf Output buffer
+ * @param value Value to convert
+ *
+ * @return Pointer after the last written character
+ */
+static char *trace_put_dec(char *buf, u32 value)
+{
+	char tmp[10];
+	int len = 0;
+
+	do {
+		tmp[len++] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+
+	while (len > 0)
+		*buf++ = tmp[--len];
+
+	return buf;
+}
+
+/**
+ * Update the trace status register.
+ */
+static void trace_update_status(void)
+{
+	u32 count = trace_buffer.head;
+
+	if (count > TRACE__SIZE)
+		count = TRACE__SIZE;
+
+	trace_status = (u16)count;
+	if (trace_buffer.frozen)
+		trace_status |= TRACE_STATUS_FROZEN;
+}
+
+/**
+ * Initialize the trace buffer and the governor registers.
+ */
+void trace_init(void)
+{
+	(void)gpc_setup_reg(GPROT_TRACE_CTRL_REG_ADDR, &trace_ctrl);
+	(void)gpc_setup_reg(GPROT_TRACE_STATUS_REG_ADDR, &trace_status);
+
+	trace_ctrl = TRACE_CMD_ARM;
+	trace_dump_state.running = false;
+
+	trace_arm();
+}
+
+/**
+ * Clear the trace buffer and start recording.
+ */
+void trace_arm(void)
+{
+	trace_buffer.frozen = true;
+	trace_buffer.head = 0;
+	trace_dump_state.running = false;
+	trace_buffer.frozen = false;
+
+	trace_update_status();
+}
+
+/**
+ * Stop recording, keeping the buffer contents.
+ */
+void trace_freeze(void)
+{
+	trace_buffer.frozen = true;
+
+	trace_update_status();
+}
+
+/**
+ * Freeze the trace and start sending the buffer contents.
+ */
+void trace_dump(void)
+{
+	char buf[24];
+	char *p = buf;
+	u32 head;
+
+	trace_freeze();
+
+	head = trace_buffer.head;
+
+	trace_dump_state.end = head;
+	if (head > TRACE__SIZE)
+		trace_dump_state.next = head - TRACE__SIZE;
+	else
+		trace_dump_state.next = 0;
+
+	*p++ = 'T';
+	*p++ = 'B';
+	*p++ = ' ';
+	p = trace_put_dec(p, trace_dump_state.end - trace_dump_state.next);
+	*p++ = ' ';
+	p = trace_put_dec(p, TRACE_TIME_BASE);
+	*p++ = '\n';
+
+	(void)gpc_send_string(buf, p - buf);
+
+	trace_dump_state.running = true;
+}
+
+/**
+ * Handle a write to the trace control register.
+ */
+void trace_handle_ctrl(void)
+{
+	switch (trace_ctrl) {
+	case TRACE_CMD_ARM:
+		trace_arm();
+		break;
+	case TRACE_CMD_FREEZE:
+		trace_freeze();
+		break;
+	case TRACE_CMD_DUMP:
+		trace_dump();
+		break;
+	}
+}
+
+/**
+ * Main periodic body of the trace process.
+ *
+ * Sends one event of a running dump each time the governor output buffer
+ * ran empty, so a dump never competes for buffer space with other output.
+ */
+void run_trace_process(void)
+{
+	struct trace_event *ev;
+	char buf[20];
+	char *p = buf;
+
+	if (!trace_dump_state.running || gpc_not_empty())
+		return;
+
+	if (trace_dump_state.next == trace_dump_state.end) {
+		trace_dump_state.running = false;
+		(void)gpc_send_string("TX\n", 3);
+		return;
+	}
+
+	ev = &trace_buffer.events[trace_dump_state.next & (TRACE__SIZE - 1)];
+	trace_dump_state.next++;
+
+	*p++ = 'T';
+	*p++ = 'E';
+	p = trace_put_hex(p, ev->time, 8);
+	p = trace_put_hex(p, ev->type, 2);
+	p = trace_put_hex(p, ev->arg, 2);
+	p = trace_put_hex(p, ev->data, 4);
+	*p++ = '\n';
+
+	(void)gpc_send_string(buf, p - buf);
+}
@@ -0,0 +1,103 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "config.h"
+#include "types.h"
+
+#include "comm_tim.h"
+#include "trace_def.h"
+
+#ifndef TRACE__SIZE
+/**
+ * Default amount of trace slots, has to be a power of two.
+ */
+#define TRACE__SIZE 256
+#endif
+
+/**
+ * Time base of the trace timestamps, the 32 bit commutation time base.
+ */
+#define TRACE_TIME_BASE COMM_TIM_CLOCK
+
+/**
+ * One recorded trace event.
+ */
+struct trace_event {
+	u32 time;		/**< Commutation time base timestamp, see comm_tim_now() */
+	u8 type;		/**< Event type, see enum trace_event_type */
+	u8 arg;			/**< Event argument */
+	u16 data;		/**< Event data */
+};
+
+/**
+ * Trace ring buffer.
+ */
+struct trace_buffer {
+	struct trace_event events[TRACE__SIZE]; /**< Event slots */
+	volatile u32 head;			/**< Total number of recorded events */
+	volatile bool frozen;			/**< Recording stopped flag */
+};
+
+extern struct trace_buffer trace_buffer;
+
+/**
+ * Record one event into the trace buffer.
+ *
+ * Safe to be called from interrupt handlers and the main loop. Costs one
+ * interrupt lock around the slot reservation and four stores.
+ *
+ * @param type Event type
+ * @param arg Event argument
+ * @param data Event data
+ */
+static inline void trace_log(enum trace_event_type type, u8 arg, u16 data)
+{
+#ifdef TRACE__ENABLE
+	struct trace_event *ev;
+	u32 primask;
+
+	if (trace_buffer.frozen)
+		return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	ev = &trace_buffer.events[trace_buffer.head++ & (TRACE__SIZE - 1)];
+	__set_PRIMASK(primask);
+
+	ev->time = comm_tim_now();
+	ev->type = (u8)type;
+	ev->arg = arg;
+	ev->data = data;
+#else
+	type = type;
+	arg = arg;
+	data = data;
+#endif
+}
+
+void trace_init(void);
+void trace_arm(void);
+void trace_freeze(void);
+void trace_dump(void);
+void trace_handle_ctrl(void);
+void run_trace_process(void);
+
+#endif /* __TRACE_H */
@@ -0,0 +1,76 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event trace definitions shared between the firmware and the PC tools.
+ *
+ * A trace dump is transferred as governor protocol strings:
+ *
+ * "TB <count> <time base in Hz>\n"     dump header
+ * "TE<tttttttt><yy><aa><dddd>\n"       one event, hex encoded
+ * "TX\n"                               dump end
+ *
+ * t: 32bit timestamp in commutation timer ticks
+ * y: event type (enum trace_event_type)
+ * a: 8bit event argument
+ * d: 16bit event data
+ */
+
+#ifndef __TRACE_DEF_H
+#define __TRACE_DEF_H
+
+/** @{ */
+/**
+ * Trace dump string packet prefixes.
+ */
+#define TRACE_DUMP_BEGIN "TB"
+#define TRACE_DUMP_EVENT "TE"
+#define TRACE_DUMP_END "TX"
+/** @} */
+
+/** @{ */
+/**
+ * Commands written to the trace control register.
+ */
+#define TRACE_CMD_ARM 0
+#define TRACE_CMD_FREEZE 1
+#define TRACE_CMD_DUMP 2
+/** @} */
+
+/**
+ * Trace status register frozen flag, the lower bits hold the event count.
+ */
+#define TRACE_STATUS_FROZEN (1 << 15)
+
+/**
+ * Trace event types.
+ */
+enum trace_event_type {
+	trace_ev_none = 0,
+	trace_ev_cp_state,	/**< arg: new control process state, data: old state */
+	trace_ev_cp_exit,	/**< arg: state, data: lost BEMF crossing counter */
+	trace_ev_bemf,		/**< arg: enum bemf_hd_source */
+	trace_ev_comm,		/**< arg: pwm mode, data: pwm duty cycle */
+	trace_ev_comm_freq,	/**< arg: time valid flag, data: commutation time */
+	trace_ev_pwm,		/**< arg: pwm mode, data: pwm duty cycle */
+	trace_ev_hall,		/**< arg: Hall state, data: commutation step */
+	trace_ev_hall_cal,	/**< arg: Hall state, data: calibrated step, 0xFF on failure */
+	trace_ev_num_types
+};
+
+#endif /* __TRACE_DEF_H */
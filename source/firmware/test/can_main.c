@@ -17,12 +17,15 @@
  */
 
 /**
- * @file   blink_main.c
+ * @file   can_main.c
  * @author Piotr Esden-Tempski <piotr@esden.net>
  * @date   Tue Aug 17 01:47:20 2010
  *
- * @brief  Blink test implementation
+ * @brief  CAN governor transport test implementation
  *
+ * Serves the governor protocol over CAN as node CAN__DEFAULT_ADDR, or
+ * CAN_ADDR given on the make command line. Register 5 counts up every
+ * 100ms.
  */
 
 #include "config.h"
@@ -34,6 +37,10 @@
 #include <stm32/tim.h>
 
 #include "types.h"
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
 #include "driver/led.h"
 #include "driver/can.h"
 #include "driver/sys_tick.h"
@@ -48,35 +55,62 @@ static void system_init(void)
 }
 
 /**
- * Blink test main function
+ * Callback from the libgovernor enabling transmission.
+ *
+ * @param data Callback passed through data. Ignored here.
+ */
+static void can_test_trigger_output(void *data)
+{
+	data = data;
+	can_enable_send();
+}
+
+/**
+ * Callback from libgovernor indicating that a register content has changed.
+ *
+ * @param data Callback passed through data. Ignored here.
+ * @param addr Address of the changed register. Ignored here.
+ */
+static void can_test_register_changed(void *data, u8 addr)
+{
+	data = data;
+	addr = addr;
+	TOGGLE(LED_RED);
+}
+
+/**
+ * CAN governor transport test main function
  *
  * @return Nothing really...
  */
 int main(void)
 {
 	int timer;
-	uint8_t data[1];
+	u16 test_counter;
 
 	system_init();
 	led_init();
 	sys_tick_init();
+	(void)gpc_init(can_test_trigger_output, NULL,
+		       can_test_register_changed, NULL);
 	can_init();
 
-	timer = sys_tick_get_timer();
+	test_counter = 0;
+	(void)gpc_setup_reg(5, &test_counter);
 
-	data[0] = 10;
+	timer = sys_tick_get_timer();
 
 	while (true) {
+		if (can_rx_trigger) {
+			can_rx_trigger = false;
+			can_process_rx();
+		}
+
 		if (sys_tick_check_timer(timer, 10000)) {
-			data[0]++;
 			timer = sys_tick_get_timer();
-#ifdef CAN__SEND
-#ifdef CAN_ADDR
-			can_transmit(CAN_ADDR, data, 1);
-#else
-			can_transmit(CAN__DEFAULT_ADDR, data, 1);
-#endif
-#endif
+			test_counter++;
+			(void)gpc_register_touched(5);
+			TOGGLE(LED_BLUE);
 		}
 	}
 }
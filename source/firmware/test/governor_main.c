@@ -50,7 +50,7 @@ static void system_init(void)
 /**
  * Crude delay implementation.
  *
- * Burn some MCU cycles.
+ * Burn some MCU cycles, handling governor input meanwhile.
  *
  * @param delay "time" delay
  */
@@ -58,6 +58,10 @@ static void my_delay(unsigned long delay)
 {
 
 	while (delay != 0) {
+		if (usart_rx_trigger) {
+			usart_rx_trigger = false;
+			usart_process_rx();
+		}
 		delay--;
 	}
 }
@@ -36,4 +36,22 @@ typedef void (*gp_with_string_hook_t) (void *data, char *string, int size);
 #define GP_MODE_MASK 0xE0
 #define GP_ADDR_MASK 0x1F
 
+/*
+ * Governor protocol over CAN
+ *
+ * Every node on the bus has a node id, requests from the master to a node
+ * and the answers of the node use one standard identifier each. Requests to
+ * GP_CAN_NODE_BROADCAST are handled by all nodes. The payload of a frame is
+ * a piece of the governor byte stream of up to GP_CAN_PAYLOAD bytes, the
+ * master only puts complete packets into a request frame.
+ */
+#define GP_CAN_PAYLOAD 8
+#define GP_CAN_NODE_MASK 0x3F
+#define GP_CAN_NODE_BROADCAST 0
+#define GP_CAN_ID_REQUEST 0x200
+#define GP_CAN_ID_ANSWER 0x240
+#define GP_CAN_ID_TYPE_MASK 0x7C0
+#define GP_CAN_REQUEST_ID(NODE) (GP_CAN_ID_REQUEST | ((NODE) & GP_CAN_NODE_MASK))
+#define GP_CAN_ANSWER_ID(NODE) (GP_CAN_ID_ANSWER | ((NODE) & GP_CAN_NODE_MASK))
+
 #endif /* GPDEF_H */
@@ -24,8 +24,13 @@ int gpc_init(gp_simple_hook_t trigger_output, void *trigger_output_data,
 int gpc_set_get_version_callback(gp_simple_hook_t get_version, void *get_version_data);
 int gpc_setup_reg(u8 addr, volatile u16 * reg);
 s32 gpc_pickup_byte(void);
+s32 gpc_pickup_block(u8 **data);
+s32 gpc_pickup_done(s32 size);
 int gpc_send_reg(u8 addr);
+int gpc_get_reg(u8 addr, u16 *val);
+int gpc_set_reg(u8 addr, u16 val);
 int gpc_handle_byte(u8 ch);
+void gpc_resync(void);
 int gpc_register_touched(u8 addr);
 int gpc_send_string(char *string, int len);
 int gpc_not_empty(void);
@@ -38,6 +38,8 @@ s32 ring_safe_write_ch(struct ring *ring, u8 ch);
 s32 ring_safe_write(struct ring *ring, u8 * data, ring_size_t size);
 s32 ring_read_ch(struct ring *ring, u8 * ch);
 s32 ring_read(struct ring *ring, u8 * data, ring_size_t size);
+s32 ring_peek_block(struct ring *ring, u8 **data);
+s32 ring_drop(struct ring *ring, ring_size_t size);
 s32 ring_empty(struct ring * ring);
 
 #endif /* RING_H */
@@ -116,6 +116,16 @@ s32 gpc_pickup_byte(void)
 	return ring_read_ch(&gpc_output_ring, 0);
 }
 
+s32 gpc_pickup_block(u8 **data)
+{
+	return ring_peek_block(&gpc_output_ring, data);
+}
+
+s32 gpc_pickup_done(s32 size)
+{
+	return ring_drop(&gpc_output_ring, size);
+}
+
 int gpc_not_empty()
 {
 	if(ring_empty(&gpc_output_ring) > 0)
@@ -150,6 +160,31 @@ int gpc_send_reg(u8 addr)
 	return 1;
 }
 
+int gpc_get_reg(u8 addr, u16 *val)
+{
+	if ((addr > 31) || !gpc_register_map[addr])
+		return 1;
+
+	*val = *gpc_register_map[addr];
+
+	return 0;
+}
+
+int gpc_set_reg(u8 addr, u16 val)
+{
+	if ((addr > 31) || !gpc_register_map[addr]) {
+		DEBUG("addr %02X not set up\n", addr);
+		return 1;
+	}
+
+	*gpc_register_map[addr] = val;
+	if (gpc_hooks.register_changed)
+		gpc_hooks.register_changed(gpc_hooks.register_changed_data,
+					   addr);
+
+	return 0;
+}
+
 int gpc_send_string(char *string, int len)
 {
 	int i;
@@ -227,17 +262,8 @@ int gpc_handle_byte(u8 byte)
 		gpc_data |= byte << 8;
 		gpc_state = GPCS_IDLE;
 
-		if (!gpc_register_map[gpc_addr]) {
-			DEBUG("addr %02X with pointer %p not set up\n",
-			      gpc_addr, gpc_register_map[gpc_addr]);
+		if (gpc_set_reg(gpc_addr, gpc_data))
 			return 1;
-		}
-
-		*gpc_register_map[gpc_addr] = gpc_data;
-		if (gpc_hooks.register_changed)
-			gpc_hooks.register_changed(gpc_hooks.
-						   register_changed_data,
-						   gpc_addr);
 
 		break;
 	default:
@@ -248,6 +274,11 @@ int gpc_handle_byte(u8 byte)
 	return 0;
 }
 
+void gpc_resync(void)
+{
+	gpc_state = GPCS_IDLE;
+}
+
 int gpc_register_touched(u8 addr)
 {
 	if (addr > 31)
@@ -91,6 +91,31 @@ s32 ring_read_ch(struct ring * ring, u8 * ch)
 	return ret;
 }
 
+s32 ring_peek_block(struct ring *ring, u8 **data)
+{
+	u32 end = ring->end;
+
+	*data = ring->data + ring->begin;
+
+	if (end >= ring->begin)
+		return end - ring->begin;
+
+	return ring->size - ring->begin;
+}
+
+s32 ring_drop(struct ring *ring, ring_size_t size)
+{
+	u32 end = ring->end;
+	s32 used = (end + ring->size - ring->begin) % ring->size;
+
+	if (size > used)
+		size = used;
+
+	ring->begin = (ring->begin + size) % ring->size;
+
+	return size;
+}
+
 s32 ring_empty(struct ring * ring)
 {
 	return ring->end - ring->begin;
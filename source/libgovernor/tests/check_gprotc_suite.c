@@ -184,6 +184,62 @@ START_TEST(test_gprotc_handle_byte_write)
 }
 END_TEST
 
+START_TEST(test_gprotc_resync)
+{
+	u16 data = 0xDADE;
+
+	fail_unless(0 == gpc_setup_reg(1, &gpc_dummy_register_map[1]));
+	fail_unless(0 == gpc_setup_reg(2, &gpc_dummy_register_map[2]));
+
+	/* write cut off after the address byte */
+	fail_unless(0 == gpc_handle_byte(1 | GP_MODE_WRITE));
+	gpc_resync();
+
+	fail_unless(0 == gpc_handle_byte(2 | GP_MODE_WRITE));
+	fail_unless(0 == gpc_handle_byte(data & 0xFF));
+	fail_unless(0 == gpc_handle_byte(data >> 8));
+	fail_unless(1 == gpc_dummy_register_changed);
+	fail_unless(2 == gpc_dummy_register_changed_addr);
+	fail_unless(data == gpc_dummy_register_map[2]);
+	fail_unless(0xAA55+1 == gpc_dummy_register_map[1]);
+}
+END_TEST
+
+START_TEST(test_gprotc_get_set_reg)
+{
+	u16 addr;
+	u16 data;
+
+	for(addr=0; addr<256; addr++){
+		fail_unless(1 == gpc_get_reg(addr, &data));
+		fail_unless(1 == gpc_set_reg(addr, 0xDADE));
+		fail_unless(0 == gpc_dummy_register_changed);
+	}
+
+	for(addr=0; addr<32; addr++){
+		fail_unless(0 == gpc_setup_reg(addr, &gpc_dummy_register_map[addr]));
+	}
+
+	for(addr=0; addr<32; addr++){
+		fail_unless(0 == gpc_get_reg(addr, &data));
+		fail_unless(0xAA55+addr == data);
+
+		fail_unless(0 == gpc_set_reg(addr, 0xDADE - addr));
+		fail_unless(1 == gpc_dummy_register_changed);
+		fail_unless(addr == gpc_dummy_register_changed_addr);
+		fail_unless((void *)1 == gpc_dummy_register_changed_data);
+		fail_unless(0xDADE - addr == gpc_dummy_register_map[addr]);
+		fail_unless(0 == gpc_get_reg(addr, &data));
+		fail_unless(0xDADE - addr == data);
+		fail_unless(-1 == gpc_pickup_byte());
+
+		gpc_dummy_register_changed = 0;
+		gpc_dummy_register_changed_addr = 0;
+		gpc_dummy_register_changed_data = 0;
+	}
+}
+END_TEST
+
 START_TEST(test_gprotc_read_cont)
 {
 	u16 addr = 0;
@@ -325,6 +381,8 @@ Suite *make_lg_gprotc_suite(void)
 	tcase_add_test(tc, test_gprotc_send_reg);
 	tcase_add_test(tc, test_gprotc_handle_byte_read);
 	tcase_add_test(tc, test_gprotc_handle_byte_write);
+	tcase_add_test(tc, test_gprotc_resync);
+	tcase_add_test(tc, test_gprotc_get_set_reg);
 	tcase_add_test(tc, test_gprotc_read_cont);
 	tcase_add_test(tc, test_gprotc_send_short_string);
 	tcase_add_test(tc, test_gprotc_send_long_string);
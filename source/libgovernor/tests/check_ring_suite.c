@@ -113,6 +113,36 @@ START_TEST(test_ring_write_read_array)
 }
 END_TEST
 
+START_TEST(test_ring_peek_drop)
+{
+	u8 *block;
+
+	fail_unless(0 == ring_peek_block(&test_ring, &block));
+	fail_unless(data == block);
+
+	fail_unless(6 == ring_write(&test_ring, (u8 *)"ABCDEF", 6));
+	fail_unless(6 == ring_peek_block(&test_ring, &block));
+	fail_unless(0 == memcmp(block, "ABCDEF", 6));
+
+	fail_unless(4 == ring_drop(&test_ring, 4));
+	fail_unless(2 == ring_peek_block(&test_ring, &block));
+	fail_unless(0 == memcmp(block, "EF", 2));
+
+	/* Wrapped data comes in two blocks */
+	fail_unless(6 == ring_write(&test_ring, (u8 *)"GHIJKL", 6));
+	fail_unless(6 == ring_peek_block(&test_ring, &block));
+	fail_unless(0 == memcmp(block, "EFGHIJ", 6));
+	fail_unless(6 == ring_drop(&test_ring, 6));
+	fail_unless(2 == ring_peek_block(&test_ring, &block));
+	fail_unless(0 == memcmp(block, "KL", 2));
+
+	/* Never drops more than there is */
+	fail_unless(2 == ring_drop(&test_ring, 5));
+	fail_unless(0 == ring_peek_block(&test_ring, &block));
+	fail_unless(-1 == ring_read_ch(&test_ring, NULL));
+}
+END_TEST
+
 Suite *make_lg_ring_suite()
 {
 	Suite *s;
@@ -127,6 +157,7 @@ Suite *make_lg_ring_suite()
 	tcase_add_test(tc_ring_read_write, test_ring_write_read_one);
 	tcase_add_test(tc_ring_read_write, test_ring_write_read_max);
 	tcase_add_test(tc_ring_read_write, test_ring_write_read_array);
+	tcase_add_test(tc_ring_read_write, test_ring_peek_drop);
 
 	return s;
 }
@@ -29,7 +29,10 @@ ConnectDialog::ConnectDialog(QWidget *parent) :
 
     ui->interfaceComboBox->addItem("Simulator");
     ui->interfaceComboBox->addItem("FTDI");
+    ui->interfaceComboBox->addItem("SocketCAN");
     ui->interfaceComboBox->addItem("Add Interface...");
+
+    on_interfaceComboBox_currentIndexChanged(ui->interfaceComboBox->currentIndex());
 }
 
 ConnectDialog::~ConnectDialog()
@@ -53,3 +56,19 @@ int ConnectDialog::getInterfaceId()
 {
     return ui->interfaceComboBox->currentIndex();
 }
+
+QString ConnectDialog::getCanInterface()
+{
+    return ui->canInterfaceLineEdit->text();
+}
+
+int ConnectDialog::getCanNode()
+{
+    return ui->canNodeSpinBox->value();
+}
+
+void ConnectDialog::on_interfaceComboBox_currentIndexChanged(int index)
+{
+    ui->canInterfaceLineEdit->setEnabled(index == 2);
+    ui->canNodeSpinBox->setEnabled(index == 2);
+}
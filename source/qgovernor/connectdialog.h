@@ -31,6 +31,8 @@ public:
     ConnectDialog(QWidget *parent = 0);
     ~ConnectDialog();
     int getInterfaceId();
+    QString getCanInterface();
+    int getCanNode();
 
 protected:
     void changeEvent(QEvent *e);
@@ -39,6 +41,7 @@ private:
     Ui::connectDialog *ui;
 
 private slots:
+    void on_interfaceComboBox_currentIndexChanged(int index);
 };
 
 #endif // CONNECTDIALOG_H
@@ -0,0 +1,199 @@
+/*
+ * qgovernor - QT based Open-BLDC PC interface tool
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <QSocketNotifier>
+
+extern "C" {
+#include <lg/types.h>
+#include <lg/gpdef.h>
+}
+
+#include "governorsocketcan.h"
+
+GovernorSocketCan::GovernorSocketCan(QObject *parent, const QString &canInterface, int node)
+    : QIODevice(parent), canInterface(canInterface), node(node), fd(-1), notifier(NULL)
+{
+}
+
+GovernorSocketCan::~GovernorSocketCan()
+{
+    if(fd >= 0)
+        ::close(fd);
+}
+
+bool GovernorSocketCan::open(OpenMode mode)
+{
+    struct ifreq ifr;
+    struct sockaddr_can addr;
+    struct can_filter filter;
+
+    fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if(fd < 0){
+        qDebug("Error: unable to open CAN socket: %s", strerror(errno));
+        return false;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, canInterface.toLocal8Bit().constData(), IFNAMSIZ - 1);
+    if(ioctl(fd, SIOCGIFINDEX, &ifr) < 0){
+        qDebug("Error: unknown CAN interface %s: %s", ifr.ifr_name, strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    /* Only the answers of our node */
+    filter.can_id = GP_CAN_ANSWER_ID(node);
+    filter.can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        qDebug("Error: unable to bind to CAN interface %s: %s", ifr.ifr_name, strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(on_notifier_activated(int)));
+
+    input.clear();
+    packet.clear();
+    frame.clear();
+
+    return QIODevice::open(mode);
+}
+
+void GovernorSocketCan::close()
+{
+    if(fd < 0)
+        return;
+
+    QIODevice::close();
+
+    delete notifier;
+    notifier = NULL;
+    ::close(fd);
+    fd = -1;
+}
+
+bool GovernorSocketCan::isSequential() const
+{
+    return true;
+}
+
+qint64 GovernorSocketCan::bytesAvailable() const
+{
+    return input.size() + QIODevice::bytesAvailable();
+}
+
+bool GovernorSocketCan::sendFrame()
+{
+    struct can_frame can_frame;
+    int retry = 100;
+
+    if(frame.isEmpty())
+        return true;
+
+    memset(&can_frame, 0, sizeof(can_frame));
+    can_frame.can_id = GP_CAN_REQUEST_ID(node);
+    can_frame.can_dlc = frame.size();
+    memcpy(can_frame.data, frame.constData(), frame.size());
+    frame.clear();
+
+    /* Wait for room in the interface transmit queue */
+    while(::write(fd, &can_frame, sizeof(can_frame)) != sizeof(can_frame)){
+        if((errno != ENOBUFS && errno != EAGAIN) || (retry-- == 0)){
+            qDebug("Error: unable to send CAN frame: %s", strerror(errno));
+            return false;
+        }
+        usleep(200);
+    }
+
+    return true;
+}
+
+qint64 GovernorSocketCan::writeData(const char *data, qint64 len)
+{
+    unsigned char mode;
+    int size;
+    qint64 i;
+
+    for(i=0; i<len; i++){
+        packet.append(data[i]);
+
+        /* Requests are single bytes except for writes */
+        mode = packet.at(0);
+        size = (mode & (GP_MODE_READ | GP_MODE_STRING)) ? 1 : 3;
+        if(packet.size() < size)
+            continue;
+
+        if(frame.size() + packet.size() > GP_CAN_PAYLOAD){
+            if(!sendFrame())
+                return -1;
+        }
+        frame.append(packet);
+        packet.clear();
+    }
+
+    if(!sendFrame())
+        return -1;
+
+    return len;
+}
+
+qint64 GovernorSocketCan::readData(char *data, qint64 maxlen)
+{
+    qint64 count = qMin(maxlen, (qint64)input.size());
+
+    memcpy(data, input.constData(), count);
+    input.remove(0, count);
+
+    return count;
+}
+
+void GovernorSocketCan::on_notifier_activated(int socket)
+{
+    struct can_frame can_frame;
+    bool received = false;
+
+    while(::read(socket, &can_frame, sizeof(can_frame)) == sizeof(can_frame)){
+        if(can_frame.can_id != (canid_t)GP_CAN_ANSWER_ID(node))
+            continue;
+        input.append((const char *)can_frame.data, can_frame.can_dlc);
+        received = true;
+    }
+
+    if(received)
+        emit readyRead();
+}
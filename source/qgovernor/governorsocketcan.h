@@ -0,0 +1,70 @@
+/*
+ * qgovernor - QT based Open-BLDC PC interface tool
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GOVERNORSOCKETCAN_H
+#define GOVERNORSOCKETCAN_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+class QSocketNotifier;
+
+/*
+ * Governor protocol transport over a SocketCAN interface.
+ *
+ * Talks to one node on the bus, see GP_CAN_REQUEST_ID() and
+ * GP_CAN_ANSWER_ID() in lg/gpdef.h. The kernel filter of the socket only
+ * passes the answers of that node, so any number of instances, in one or
+ * in several processes, can share a bus and each control and monitor its
+ * own controller. Requests are packed into frames as whole packets.
+ *
+ * For testing without hardware a virtual CAN interface does the job:
+ *   ip link add dev vcan0 type vcan && ip link set up vcan0
+ */
+class GovernorSocketCan : public QIODevice
+{
+    Q_OBJECT
+public:
+    GovernorSocketCan(QObject *parent, const QString &canInterface, int node);
+    ~GovernorSocketCan();
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+private:
+    QString canInterface;
+    int node;
+    int fd;
+    QSocketNotifier *notifier;
+    QByteArray input;
+    QByteArray packet;
+    QByteArray frame;
+
+    bool sendFrame();
+
+protected:
+    virtual qint64 writeData(const char *data, qint64 len);
+    virtual qint64 readData(char *data, qint64 maxlen);
+
+private slots:
+    void on_notifier_activated(int socket);
+};
+
+#endif // GOVERNORSOCKETCAN_H
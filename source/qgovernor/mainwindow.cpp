@@ -20,6 +20,7 @@ extern "C" {
 #include <lg/types.h>
 #include <lg/gpdef.h>
 #include "../firmware/src/gprot.h"
+#include "../firmware/src/trace_def.h"
 }
 
 #include "mainwindow.h"
@@ -44,6 +45,7 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(governorMaster, SIGNAL(outputTriggered()), this, SLOT(on_outputTriggered()));
     connect(governorMaster, SIGNAL(registerChanged(unsigned char)), this, SLOT(on_registerChanged(unsigned char)));
     connect(governorMaster, SIGNAL(stringReceived(QString)), this, SLOT(on_stringReceived(QString)));
+    connect(&traceDecoder, SIGNAL(traceDecoded(QString)), this, SLOT(on_traceDecoded(QString)));
 
     /* register display table */
     unsigned short value;
@@ -302,6 +304,9 @@ void MainWindow::on_actionConnect_triggered(bool checked)
             case 1:
                 governorInterface = new GovernorFtdi(this);
                 break;
+            case 2:
+                governorInterface = new GovernorSocketCan(this, connectDialog->getCanInterface(), connectDialog->getCanNode());
+                break;
             }
 
             if(governorInterface->open(QIODevice::ReadWrite)){
@@ -334,7 +339,8 @@ void MainWindow::on_actionConnect_triggered(bool checked)
     }else{
         ui->statusBar->showMessage(tr("Connection closed."), 5000);
         if(connectDialog->getInterfaceId() == 0 ||
-           connectDialog->getInterfaceId() == 1)
+           connectDialog->getInterfaceId() == 1 ||
+           connectDialog->getInterfaceId() == 2)
             delete governorInterface;
         ui->registerTableView->setDisabled(true);
         ui->commGroupBox->setDisabled(true);
@@ -442,9 +448,30 @@ void MainWindow::on_PWMDutyCycleHorizontalSlider_valueChanged(int value)
 
 void MainWindow::on_stringReceived(QString string)
 {
+    if (traceDecoder.decode(string))
+        return;
+
     ui->consolePlainTextEdit->insertPlainText(string);
 }
 
+void MainWindow::on_actionDumpTrace_triggered()
+{
+    governorMaster->sendSet(GPROT_TRACE_CTRL_REG_ADDR, TRACE_CMD_DUMP);
+}
+
+void MainWindow::on_traceDecoded(const QString &timeline)
+{
+    QPlainTextEdit *page = new QPlainTextEdit(this);
+
+    page->setReadOnly(true);
+    page->setLineWrapMode(QPlainTextEdit::NoWrap);
+    page->setFont(QFont("Courier"));
+    page->setPlainText(timeline);
+
+    ui->OpenBLDCTabWidget->addTab(page, tr("Trace"));
+    ui->OpenBLDCTabWidget->setCurrentWidget(page);
+}
+
 
 void MainWindow::on_consoleClearPushButton_pressed()
 {
@@ -31,8 +31,10 @@
 #include "connectdialog.h"
 #include "governorsimulator.h"
 #include "governorftdi.h"
+#include "governorsocketcan.h"
 
 #include "govconfig.h"
+#include "tracedecoder.h"
 
 
 
@@ -60,6 +62,7 @@ private:
     QTcpSocket *tcpSocket;
 
     GovernorMaster *governorMaster;
+    TraceDecoder traceDecoder;
     bool connected;
 
     QAction *updateRegister;
@@ -93,6 +96,8 @@ private slots:
     void on_guiRegisterChanged(QStandardItem *item);
     void on_governorInterface_readyRead();
     void on_stringReceived(QString string);
+    void on_actionDumpTrace_triggered();
+    void on_traceDecoded(const QString &timeline);
 
     void addTargetTab(GovConfig const & config);
 };
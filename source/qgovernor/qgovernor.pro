@@ -28,9 +28,11 @@ SOURCES += main.cpp \
     protocolmodel.cpp \
     governorsimulator.cpp \
     governorftdi.cpp \
+    governorsocketcan.cpp \
     govconfig.cpp \
     targetwidgetfactory.cpp \
-    log.cpp
+    log.cpp \
+    tracedecoder.cpp
 HEADERS += mainwindow.h \
     connectdialog.h \
     governormaster.h \
@@ -40,13 +42,15 @@ HEADERS += mainwindow.h \
     protocolmodel.h \
     governorsimulator.h \
     governorftdi.h \
+    governorsocketcan.h \
     govconfig.h \
     targetwidgetfactory.h \
     govconfigwidget.h \
     govconfigspinbox.h \
     govconfigslider.h \
     govconfigcheckbox.h \
-    log.h
+    log.h \
+    tracedecoder.h
 FORMS += mainwindow.ui \
     connectdialog.ui \
     simulator.ui
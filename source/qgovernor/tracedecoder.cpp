@@ -0,0 +1,198 @@
+/*
+ * qgovernor - QT based Open-BLDC PC interface tool
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+extern "C" {
+#include "../firmware/src/trace_def.h"
+}
+
+#include "tracedecoder.h"
+
+#include <QStringList>
+#include <QTextStream>
+
+/**
+ * Names of the control process states, in order of the firmware
+ * enum control_process_state.
+ */
+static const char *cpStateNames[] = {
+    "error", "idle", "aligning", "spinup", "spinning"
+};
+
+/**
+ * Names of the BEMF detection sources, in order of the firmware
+ * enum bemf_hd_source.
+ */
+static const char *bemfSourceNames[] = {
+    "none", "U rising", "U falling", "V rising", "V falling",
+    "W rising", "W falling"
+};
+
+static QString lookupName(const char **names, unsigned int count, unsigned int index)
+{
+    if (index < count)
+        return QString(names[index]);
+
+    return QString("#%1").arg(index);
+}
+
+TraceDecoder::TraceDecoder(QObject *parent) :
+    QObject(parent),
+    active(false),
+    expectedCount(0),
+    timeBase(1)
+{
+}
+
+/**
+ * Feed a string received from the governor client.
+ *
+ * @return true if the string was part of a trace dump and should not be
+ * shown on the console.
+ */
+bool TraceDecoder::decode(const QString &string)
+{
+    if (!active && !string.startsWith(TRACE_DUMP_BEGIN))
+        return false;
+
+    lineBuffer.append(string);
+
+    int end;
+    while ((end = lineBuffer.indexOf('\n')) >= 0) {
+        QString line = lineBuffer.left(end);
+        lineBuffer.remove(0, end + 1);
+        decodeLine(line);
+    }
+
+    return true;
+}
+
+bool TraceDecoder::isActive() const
+{
+    return active;
+}
+
+void TraceDecoder::decodeLine(const QString &line)
+{
+    if (line.startsWith(TRACE_DUMP_BEGIN)) {
+        QStringList fields = line.split(' ', QString::SkipEmptyParts);
+
+        active = true;
+        events.clear();
+        expectedCount = (fields.size() > 1) ? fields.at(1).toUInt() : 0;
+        timeBase = (fields.size() > 2) ? fields.at(2).toUInt() : 0;
+        if (timeBase == 0)
+            timeBase = 1;
+    } else if (line.startsWith(TRACE_DUMP_EVENT) && line.size() >= 18) {
+        Event event;
+        bool ok = true;
+
+        event.time = line.mid(2, 8).toUInt(&ok, 16);
+        if (ok)
+            event.type = line.mid(10, 2).toUShort(&ok, 16);
+        if (ok)
+            event.arg = line.mid(12, 2).toUShort(&ok, 16);
+        if (ok)
+            event.data = line.mid(14, 4).toUShort(&ok, 16);
+        if (ok)
+            events.append(event);
+    } else if (line.startsWith(TRACE_DUMP_END)) {
+        active = false;
+        lineBuffer.clear();
+        emit traceDecoded(timeline());
+    }
+}
+
+/**
+ * Build the timeline text from the collected events.
+ *
+ * The timer wrap counter is incremented in a lower priority interrupt than
+ * some of the events are recorded in, so a timestamp may be missing one
+ * wrap. This is detected as a large step back in time and corrected.
+ */
+QString TraceDecoder::timeline() const
+{
+    QString result;
+    QTextStream out(&result);
+    quint64 first = 0;
+    quint64 last = 0;
+
+    out << "Trace: " << events.size() << " of " << expectedCount
+        << " events, time base " << timeBase << " Hz\n";
+    out << "      time [us]   delta [us]  event\n";
+
+    for (int i = 0; i < events.size(); i++) {
+        const Event &event = events.at(i);
+        quint64 time = event.time;
+
+        if ((i != 0) && (time < last) && ((last - time) > 0x8000))
+            time += 0x10000;
+        if (i == 0)
+            first = time;
+
+        double absUs = (double)(time - first) * 1000000.0 / timeBase;
+        double deltaUs = (double)(time - ((i == 0) ? time : last)) *
+            1000000.0 / timeBase;
+
+        out << QString("%1 %2  ").arg(absUs, 14, 'f', 1).arg(deltaUs, 12, 'f', 1)
+            << describe(event) << "\n";
+
+        last = time;
+    }
+
+    return result;
+}
+
+QString TraceDecoder::describe(const Event &event)
+{
+    unsigned int cpStates = sizeof(cpStateNames) / sizeof(cpStateNames[0]);
+    unsigned int bemfSources = sizeof(bemfSourceNames) / sizeof(bemfSourceNames[0]);
+
+    switch (event.type) {
+    case trace_ev_cp_state:
+        return QString("control state %1 -> %2")
+            .arg(lookupName(cpStateNames, cpStates, event.data))
+            .arg(lookupName(cpStateNames, cpStates, event.arg));
+    case trace_ev_cp_exit:
+        return QString("control exit in %1, lost crossings %2")
+            .arg(lookupName(cpStateNames, cpStates, event.arg))
+            .arg(event.data);
+    case trace_ev_bemf:
+        return QString("bemf crossing %1")
+            .arg(lookupName(bemfSourceNames, bemfSources, event.arg));
+    case trace_ev_comm:
+        return QString("commutation mode %1 pwm %2")
+            .arg(event.arg).arg(event.data);
+    case trace_ev_comm_freq:
+        return QString("comm time %1 %2")
+            .arg(event.data).arg(event.arg ? "valid" : "invalid");
+    case trace_ev_hall:
+        return QString("hall state %1 step %2")
+            .arg(event.arg).arg(event.data);
+    case trace_ev_hall_cal:
+        if (event.data == 0xFF)
+            return QString("hall calibration failed");
+        return QString("hall calibration state %1 -> step %2")
+            .arg(event.arg).arg(event.data);
+    case trace_ev_pwm:
+        return QString("pwm set mode %1 value %2")
+            .arg(event.arg).arg(event.data);
+    default:
+        return QString("unknown event %1 arg %2 data %3")
+            .arg(event.type).arg(event.arg).arg(event.data);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * qgovernor - QT based Open-BLDC PC interface tool
+ * Copyright (C) 2010 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACEDECODER_H
+#define TRACEDECODER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+
+/**
+ * Decoder for the firmware event trace dump.
+ *
+ * Collects the trace dump strings sent by the firmware (see
+ * firmware/src/trace_def.h) and turns them into a human readable timeline
+ * once the dump end marker has been received.
+ */
+class TraceDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    TraceDecoder(QObject *parent = 0);
+    bool decode(const QString &string);
+    bool isActive() const;
+
+  signals:
+    void traceDecoded(const QString &timeline);
+
+private:
+    struct Event {
+        quint32 time;
+        quint8 type;
+        quint8 arg;
+        quint16 data;
+    };
+
+    bool active;
+    QString lineBuffer;
+    QList<Event> events;
+    unsigned int expectedCount;
+    unsigned int timeBase;
+
+    void decodeLine(const QString &line);
+    QString timeline() const;
+    static QString describe(const Event &event);
+};
+
+#endif // TRACEDECODER_H